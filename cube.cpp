@@ -3,6 +3,8 @@
 
 #include "cube.h"
 #include "vectXf.h"
+#include "profiler.h"
+#include "render_queue.h"
 
 #include <GL/gl.h>
 #include <GL/glut.h>
@@ -93,6 +95,39 @@ void cube::draw(const vect3f* const pointer_pos) const {
   _set_solid(restore_solid);
 }
 
+void cube::draw_outline() const {
+  glColor3f(_color.x, _color.y, _color.z);
+  _front.draw(false);
+  _right.draw(false);
+  _back.draw(false);
+  _left.draw(false);
+  _top.draw(false);
+  _bottom.draw(false);
+}
+
+void cube::submit(render_queue& queue, const render_state& state, const vect3f* const pointer_pos) const {
+  float modelview[16];
+  render_queue::current_modelview(modelview);
+
+  if (!_solid && (pointer_pos == 0 || !contains_point(*pointer_pos))) {
+    render_state outline(state);
+    outline.draw_mode = GL_LINE_LOOP;
+    outline.translucent = false;
+    queue.submit(outline, modelview, [this]() { draw_outline(); });
+    return;
+  }
+
+  render_state solid(state);
+  solid.draw_mode = GL_QUADS;
+  solid.translucent = (_translucency < 1.0f);
+  bool material = (solid.lighting && !solid.shaded);
+  const side* sides[6] = { &_front, &_right, &_back, &_left, &_top, &_bottom };
+  for (int i=0;i<6;i++) {
+    const side* s = sides[i];
+    queue.submit(solid, modelview, [s, material]() { s->draw(true, material); }, view_depth(modelview, s->center()));
+  }
+}
+
 
 
 
@@ -143,17 +178,26 @@ bool cube::side::contains_point(const vect3f& point) const {
   }
 }
 
-void cube::side::draw() const {
-  if (solid) {
+vect3f cube::side::center() const { return (bottom_left+top_right)/2.0f; }
+
+void cube::side::draw() const { draw(solid); }
+
+void cube::side::draw(bool as_solid, bool material) const {
+  if (as_solid) {
     glBegin(GL_QUADS);
     glColor4f(highlight_color.x, highlight_color.y, highlight_color.z, translucency);
 
     #ifndef USE_GL_COLOR_MATERIAL
-      glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, vect4f(highlight_color.x, highlight_color.y, highlight_color.z, translucency));
+      if (material) {
+        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, vect4f(highlight_color.x, highlight_color.y, highlight_color.z, translucency));
+        PROFILE_COUNT(COUNTER_MATERIAL_CHANGES, 1);
+      }
     #endif
 
   }
   else glBegin(GL_LINE_LOOP);
+  PROFILE_COUNT(COUNTER_DRAW_CALLS, 1);
+  PROFILE_COUNT(COUNTER_VERTICES, 4);
 
   // specifiy correct normal:
   switch(face) {
@@ -6,6 +6,9 @@
 
 #include "vectXf.h"
 
+class render_queue;
+struct render_state;
+
 class cube {
   private:
     vect3f _bottom_left;
@@ -30,7 +33,9 @@ class cube {
 
         void initialize(const vect3f& b_left, float width, FACE s);
         bool contains_point(const vect3f& point) const;
+        vect3f center() const;
         void draw() const;
+        void draw(bool as_solid, bool material=true) const; // material: set the solid's material (fixed function lighting)
     } _front, _right, _back, _left, _top, _bottom;
 
     void _set_solid(bool t=true) const;
@@ -45,6 +50,10 @@ class cube {
     bool contains_point(const vect3f& point) const;
 
     void draw(const vect3f* const pointer_pos=0) const;
+    void draw_outline() const; // the edges in the cube's color (GL_LINE_LOOP per side; what submit() queues for an outline)
+    // queues draw() (see render_queue.h) with state's lighting and line width: an outline is one item; a solid (or highlighted)
+    //   cube is an item per side, translucent ones ordered by depth
+    void submit(render_queue& queue, const render_state& state, const vect3f* const pointer_pos=0) const;
 };
 
 #endif
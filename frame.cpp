@@ -0,0 +1,186 @@
+// File: frame.cpp
+// Written by Joshua Green
+
+#include "frame.h"
+
+#include <GL/gl.h>
+#include <GL/glu.h>
+
+#include <mutex>
+#include <chrono>
+#include <functional>
+using namespace std;
+
+// *** BEGIN FRAME_SCHEDULER DEFINITIONS ***
+frame_scheduler::frame_scheduler(double interval_ms) : _changed(0), _requested(false), _interval_ms(interval_ms),
+  _last_frame(chrono::steady_clock::now()) { }
+
+bool frame_scheduler::invalidate(unsigned int changed) {
+  if (changed == 0) return false;
+  lock_guard<mutex> lock(_lock);
+  _changed |= changed;
+  _stats.requests++;
+  if (_requested) {
+    _stats.coalesced++;
+    return false;
+  }
+  _requested = true;
+  return true;
+}
+
+bool frame_scheduler::requested() const {
+  lock_guard<mutex> lock(_lock);
+  return _requested;
+}
+
+int frame_scheduler::delay_ms() const {
+  lock_guard<mutex> lock(_lock);
+  double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - _last_frame).count();
+  return (elapsed >= _interval_ms ? 0 : (int)(_interval_ms - elapsed + 0.5));
+}
+
+unsigned int frame_scheduler::begin_frame() {
+  lock_guard<mutex> lock(_lock);
+  unsigned int changed = (_requested ? _changed : (unsigned int)FRAME_ALL);
+  _changed = 0;
+  _requested = false;
+  _last_frame = chrono::steady_clock::now();
+  return changed;
+}
+
+void frame_scheduler::end_frame(bool scene_drawn) {
+  lock_guard<mutex> lock(_lock);
+  _stats.frames++;
+  if (scene_drawn) _stats.scene_frames++;
+  else _stats.composited_frames++;
+}
+
+frame_stats frame_scheduler::stats() const {
+  lock_guard<mutex> lock(_lock);
+  return _stats;
+}
+// *** END FRAME_SCHEDULER DEFINITIONS ***
+
+// *** BEGIN LAYER_CACHE DEFINITIONS ***
+layer_cache::layer_cache() : _texture(0), _width(0), _height(0), _texture_width(0), _texture_height(0) { }
+
+// the texture is a power of two large enough for the window (gl 1.1), grown (never shrunk) as the window is; a window larger than
+//   the renderer's textures can be (GL_MAX_TEXTURE_SIZE is 1024 on some gl 1.1 renderers) isn't captured
+bool layer_cache::capture(int width, int height) {
+  if (_texture == 0) glGenTextures(1, &_texture);
+  if (_texture == 0) { // (no gl context: draw() draws nothing either way)
+    _width = width;
+    _height = height;
+    return true;
+  }
+  for (int i=0;i<16 && glGetError() != GL_NO_ERROR;i++); // (errors left by the scene aren't the capture's)
+
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  bool captured = true;
+  if (width > _texture_width || height > _texture_height) {
+    int texture_width = 1, texture_height = 1;
+    while (texture_width < width) texture_width *= 2;
+    while (texture_height < height) texture_height *= 2;
+
+    GLint max_size = 0, proxy_width = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (texture_width <= max_size && texture_height <= max_size) {
+      glTexImage2D(GL_PROXY_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+      glGetTexLevelParameteriv(GL_PROXY_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &proxy_width);
+    }
+    _texture_width = 0; // (until the texture is allocated at the new size)
+    _texture_height = 0;
+    if (proxy_width == 0) captured = false;
+    else {
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, texture_width, texture_height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+      captured = (glGetError() == GL_NO_ERROR);
+      if (captured) {
+        _texture_width = texture_width;
+        _texture_height = texture_height;
+      }
+    }
+  }
+  if (captured) {
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+    captured = (glGetError() == GL_NO_ERROR);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (!captured) {
+    invalidate(); // (so the next frame draws the scene rather than compositing a texture that doesn't hold it)
+    return false;
+  }
+  _width = width;
+  _height = height;
+  return true;
+}
+
+bool layer_cache::valid(int width, int height) const { return (_width > 0 && _width == width && _height == height); }
+
+void layer_cache::draw() const {
+  if (_texture == 0 || _width == 0) return;
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0, _width, 0, _height);
+
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_TEXTURE_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, _texture);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+  float s = (float)_width/_texture_width, t = (float)_height/_texture_height;
+  glColor3f(1.0f, 1.0f, 1.0f);
+  glBegin(GL_QUADS);
+  glTexCoord2f(0.0f, 0.0f); glVertex2i(0, 0);
+  glTexCoord2f(s, 0.0f);    glVertex2i(_width, 0);
+  glTexCoord2f(s, t);       glVertex2i(_width, _height);
+  glTexCoord2f(0.0f, t);    glVertex2i(0, _height);
+  glEnd();
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glPopAttrib();
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+void layer_cache::invalidate() {
+  _width = 0;
+  _height = 0;
+}
+// *** END LAYER_CACHE DEFINITIONS ***
+
+// *** BEGIN DISPLAY_LIST DEFINITIONS ***
+display_list::display_list() : _list(0), _compiled(false) { }
+
+void display_list::draw(const function<void ()>& build) {
+  if (_compiled) {
+    glCallList(_list);
+    return;
+  }
+  if (_list == 0) _list = glGenLists(1);
+  if (_list == 0) { // (no gl context)
+    build();
+    return;
+  }
+  glNewList(_list, GL_COMPILE_AND_EXECUTE);
+  build();
+  glEndList();
+  _compiled = true;
+}
+
+void display_list::invalidate() { _compiled = false; }
+// *** END DISPLAY_LIST DEFINITIONS ***
@@ -0,0 +1,98 @@
+// File: frame.h
+// Written by Joshua Green
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <GL/gl.h>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+// ------------------------------------------------------------ FRAME SCHEDULING ------------------------------------------------------------ //
+//   + frame_scheduler                                                                                                                        //
+//       - invalidate(changed) marks what an event changed (FRAME_ flags); it returns true if a frame should be requested for it, false if    //
+//         nothing changed or a frame is already requested (the changes are drawn by that one: a burst of events is one frame)                //
+//       - delay_ms() is how long the requested frame should wait so frames are at least interval_ms apart (one per refresh)                  //
+//       - begin_frame() takes the changes made since the last frame; a frame nobody requested (the window was exposed) is FRAME_ALL          //
+//       - invalidate() may be called from any thread                                                                                         //
+//   + layer_cache                                                                                                                            //
+//       - capture(width, height) copies the color buffer drawn so far into a texture, which draw() puts back as a full window quad; so a     //
+//         frame where only the palette or overlays changed recomposites the scene rather than drawing it again                               //
+//       - valid(width, height) is false until a capture of that size (a resize needs a new one); a capture fails (returning false) if the    //
+//         window is larger than the renderer's textures can be (GL_MAX_TEXTURE_SIZE, then a GL_PROXY_TEXTURE_2D check) or gl reports an      //
+//         error, and the cache is left invalid, so every frame draws the scene                                                               //
+//   + display_list                                                                                                                           //
+//       - draw(build) calls the list, compiling it from build() (while drawing it) the first time or after invalidate()                      //
+//   + NOTES:                                                                                                                                 //
+//       - with no gl context (headless), layer_cache and display_list draw nothing; display_list calls build() every time                    //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+enum FRAME_CHANGE {
+  FRAME_MODELS  = 0x01, // a model was edited, loaded, swapped, shown or hidden (or drawn differently)
+  FRAME_CAMERA  = 0x02,
+  FRAME_CURSOR  = 0x04, // the cursor or the light moved
+  FRAME_GRID    = 0x08, // the grid or axis was redefined or toggled
+  FRAME_PALETTE = 0x10,
+  FRAME_OVERLAY = 0x20, // the prompt, its operations or the profiler overlay
+
+  FRAME_SCENE = FRAME_MODELS | FRAME_CAMERA | FRAME_CURSOR | FRAME_GRID,
+  FRAME_ALL = FRAME_SCENE | FRAME_PALETTE | FRAME_OVERLAY
+};
+
+struct frame_stats {
+  int requests;  // invalidate() calls that changed something
+  int coalesced; // of those, the ones drawn by a frame already requested
+  int frames, scene_frames, composited_frames; // frames drawn; the ones drawing the scene or recompositing it
+
+  frame_stats() : requests(0), coalesced(0), frames(0), scene_frames(0), composited_frames(0) { }
+};
+
+class frame_scheduler {
+  private:
+    mutable std::mutex _lock;
+    unsigned int _changed;
+    bool _requested;
+    double _interval_ms;
+    std::chrono::steady_clock::time_point _last_frame;
+    frame_stats _stats;
+
+  public:
+    frame_scheduler(double interval_ms);
+
+    bool invalidate(unsigned int changed);
+    bool requested() const;
+    int delay_ms() const;
+    unsigned int begin_frame();
+    void end_frame(bool scene_drawn);
+    frame_stats stats() const;
+};
+
+class layer_cache {
+  private:
+    GLuint _texture;
+    int _width, _height;                 // captured
+    int _texture_width, _texture_height; // (powers of two)
+
+  public:
+    layer_cache();
+
+    bool capture(int width, int height); // false (leaving the cache invalid) if the texture couldn't be allocated or copied into
+    bool valid(int width, int height) const;
+    void draw() const;
+    void invalidate();
+};
+
+class display_list {
+  private:
+    GLuint _list;
+    bool _compiled;
+
+  public:
+    display_list();
+
+    void draw(const std::function<void ()>& build);
+    void invalidate();
+};
+
+#endif
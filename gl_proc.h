@@ -0,0 +1,20 @@
+// File: gl_proc.h
+// Written by Joshua Green
+
+#ifndef GL_PROC_H
+#define GL_PROC_H
+
+// GL_PROC_ADDRESS(name) fetches a gl entry point the 1.1 headers don't declare (timer queries, glsl) from the platform's gl rather
+//   than from glut, so any glut will do (the glut32 the modeler ships with has no glutGetProcAddress()); include this ahead of gl.h,
+//   as windows.h has to come first there. The entry point may be null: check it (and the gl version) before calling it.
+#ifdef _WIN32
+  #include <windows.h>
+  #include <GL/gl.h>
+  #define GL_PROC_ADDRESS(name) wglGetProcAddress(name)
+#else
+  #include <GL/gl.h>
+  #include <GL/glx.h>
+  #define GL_PROC_ADDRESS(name) glXGetProcAddress((const GLubyte*)name)
+#endif
+
+#endif
@@ -0,0 +1,381 @@
+// File: half_edge.cpp
+// Written by Joshua Green
+
+#include "half_edge.h"
+#include "model3d.h"
+#include "parallel.h"
+#include "trace.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+using namespace std;
+
+// *** BEGIN HALF_EDGE_MESH DEFINITIONS ***
+half_edge_mesh::half_edge_mesh() : _built(false) { }
+
+unsigned long long half_edge_mesh::_key(int a, int b) {
+  if (a > b) swap(a, b);
+  return ((unsigned long long)(unsigned int)a << 32) | (unsigned int)b;
+}
+
+size_t half_edge_mesh::_partition(unsigned long long key, size_t partitions) {
+  unsigned long long h = key*0x9E3779B97F4A7C15ull;
+  return (size_t)((h ^ (h >> 29)) % partitions);
+}
+
+bool half_edge_mesh::_linked(int face) const { return (_faces[face].size() >= 3); }
+
+void half_edge_mesh::_reserve_vertex(int id) {
+  if (id < _vertex_edges.size()) return;
+  _vertex_edges.resize(id+1);
+  _vertex_uses.resize(id+1, 0);
+}
+
+half_edge half_edge_mesh::_other_edge(int id, int face) const {
+  // the faces sharing the edges on either side of id's corner usually have one
+  int size = _faces[face].size();
+  for (int j=0;j<size;j++) {
+    if (_faces[face][j] != id) continue;
+    half_edge sides[2] = { half_edge(face, j), prev(half_edge(face, j)) };
+    for (int k=0;k<2;k++) {
+      for (half_edge g=_links[face][sides[k].corner]; g != sides[k]; g=_links[g.face][g.corner]) {
+        if (g.face == face) continue;
+        if (from(g) == id) return g;
+        if (to(g) == id) return next(g);
+      }
+    }
+  }
+
+  // otherwise id is where separate fans meet (or nothing else uses it)
+  if (id >= _vertex_uses.size() || _vertex_uses[id] == 0) return half_edge();
+  for (int i=0;i<_faces.size();i++) {
+    if (i == face || !_linked(i)) continue;
+    for (int j=0;j<_faces[i].size();j++) if (_faces[i][j] == id) return half_edge(i, j);
+  }
+  return half_edge();
+}
+
+void half_edge_mesh::_link_face(int face) {
+  if (!_linked(face)) return;
+  const vector<int>& ids = _faces[face];
+  int size = ids.size();
+  for (int j=0;j<size;j++) {
+    _reserve_vertex(ids[j]);
+    _vertex_uses[ids[j]]++;
+    if (!_vertex_edges[ids[j]].valid()) _vertex_edges[ids[j]] = half_edge(face, j);
+
+    _links[face][j] = half_edge(face, j);
+    int a = ids[j], b = ids[(j+1)%size];
+    if (a == b) continue; // (a repeated point has no edge)
+    unsigned long long key = _key(a, b);
+    edge_map& edges = _edges[_partition(key, _edges.size())];
+    pair<edge_map::iterator, bool> found = edges.insert(make_pair(key, half_edge(face, j)));
+    if (!found.second) { // joins the ring after the half edge the hash holds
+      half_edge& first = _links[found.first->second.face][found.first->second.corner];
+      _links[face][j] = first;
+      first = half_edge(face, j);
+    }
+  }
+}
+
+void half_edge_mesh::_unlink_face(int face) {
+  if (!_linked(face)) return;
+  const vector<int>& ids = _faces[face];
+  int size = ids.size();
+  for (int j=0;j<size;j++) _vertex_uses[ids[j]]--;
+  for (int j=0;j<size;j++) {
+    if (_vertex_edges[ids[j]].face == face) _vertex_edges[ids[j]] = _other_edge(ids[j], face);
+  }
+
+  for (int j=0;j<size;j++) {
+    half_edge h(face, j);
+    half_edge link = _links[face][j];
+    int a = ids[j], b = ids[(j+1)%size];
+    if (a == b) continue;
+    unsigned long long key = _key(a, b);
+    edge_map& edges = _edges[_partition(key, _edges.size())];
+    if (link == h) edges.erase(key);
+    else {
+      half_edge before = link;
+      while (_links[before.face][before.corner] != h) before = _links[before.face][before.corner];
+      _links[before.face][before.corner] = link;
+      edge_map::iterator entry = edges.find(key);
+      if (entry != edges.end() && entry->second == h) entry->second = link;
+    }
+    _links[face][j] = h;
+  }
+}
+
+void half_edge_mesh::build(const vector<vector<facet>>& faces, int coordinate_count, int thread_count) {
+  TRACE_SPAN(build_span, "half_edge_mesh::build");
+  clear();
+  if (thread_count <= 0) thread_count = hardware_threads();
+
+  int face_total = faces.size();
+  _faces.resize(face_total);
+  _links.resize(face_total);
+  parallel_for(0, face_total, 4096, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      int size = faces[i].size();
+      _faces[i].resize(size);
+      _links[i].resize(size);
+      for (int j=0;j<size;j++) {
+        _faces[i][j] = faces[i][j].id;
+        _links[i][j] = half_edge(i, j);
+      }
+    }
+  }, thread_count);
+
+  _vertex_edges.assign(coordinate_count, half_edge());
+  _vertex_uses.assign(coordinate_count, 0);
+  size_t half_edges = 0;
+  for (int i=0;i<face_total;i++) {
+    if (!_linked(i)) continue;
+    for (int j=0;j<_faces[i].size();j++) {
+      int id = _faces[i][j];
+      _reserve_vertex(id);
+      _vertex_uses[id]++;
+      if (!_vertex_edges[id].valid()) _vertex_edges[id] = half_edge(i, j);
+    }
+    half_edges += _faces[i].size();
+  }
+
+  // the half edges are bucketed by partition (a counting sort on it), so each partition's edges are hashed by one thread alone:
+  //   a ring only ever holds half edges of the same partition
+  _edges.resize(thread_count);
+  vector<size_t> starts(thread_count+1, 0);
+  vector<unsigned long long> keys(half_edges);
+  vector<int> partitions(half_edges);
+  size_t k = 0;
+  for (int i=0;i<face_total;i++) {
+    if (!_linked(i)) continue;
+    int size = _faces[i].size();
+    for (int j=0;j<size;j++,k++) {
+      keys[k] = _key(_faces[i][j], _faces[i][(j+1)%size]);
+      partitions[k] = _partition(keys[k], thread_count);
+      starts[partitions[k]+1]++;
+    }
+  }
+  for (int p=0;p<thread_count;p++) starts[p+1] += starts[p];
+  vector<size_t> next_slot(starts.begin(), starts.end()-1);
+  vector<half_edge> bucketed(half_edges);
+  vector<unsigned long long> bucketed_keys(half_edges);
+  k = 0;
+  for (int i=0;i<face_total;i++) {
+    if (!_linked(i)) continue;
+    for (int j=0;j<_faces[i].size();j++,k++) {
+      size_t slot = next_slot[partitions[k]]++;
+      bucketed[slot] = half_edge(i, j);
+      bucketed_keys[slot] = keys[k];
+    }
+  }
+
+  parallel_for(0, thread_count, 1, [&](long long int begin, long long int end) {
+    for (long long int p=begin;p<end;p++) {
+      edge_map& edges = _edges[p];
+      edges.reserve((starts[p+1]-starts[p])/2 + 1);
+      for (size_t s=starts[p];s<starts[p+1];s++) {
+        const half_edge& h = bucketed[s];
+        if (from(h) == to(h)) continue;
+        pair<edge_map::iterator, bool> found = edges.insert(make_pair(bucketed_keys[s], h));
+        if (!found.second) {
+          half_edge& first = _links[found.first->second.face][found.first->second.corner];
+          _links[h.face][h.corner] = first;
+          first = h;
+        }
+      }
+    }
+  }, thread_count);
+
+  _built = true;
+  TRACE_ARG(build_span, "half_edges", half_edges);
+}
+
+void half_edge_mesh::clear() {
+  _built = false;
+  vector<vector<int>>().swap(_faces);
+  vector<vector<half_edge>>().swap(_links);
+  vector<half_edge>().swap(_vertex_edges);
+  vector<int>().swap(_vertex_uses);
+  vector<edge_map>().swap(_edges);
+}
+
+bool half_edge_mesh::built() const { return _built; }
+
+void half_edge_mesh::insert(int face, int corner, int id) {
+  if (!_built || face < 0 || face >= _faces.size() || corner < 0 || corner > _faces[face].size()) return;
+  _unlink_face(face);
+  _faces[face].insert(_faces[face].begin()+corner, id);
+  _links[face].insert(_links[face].begin()+corner, half_edge(face, corner));
+  _link_face(face);
+}
+
+void half_edge_mesh::set_corner(int face, int corner, int id) {
+  if (!_built || face < 0 || face >= _faces.size() || corner < 0 || corner >= _faces[face].size()) return;
+  _unlink_face(face);
+  _faces[face][corner] = id;
+  _link_face(face);
+}
+
+void half_edge_mesh::remove(int face, int corner) {
+  if (!_built || face < 0 || face >= _faces.size() || corner < 0 || corner >= _faces[face].size()) return;
+  _unlink_face(face);
+  _faces[face].erase(_faces[face].begin()+corner);
+  _links[face].erase(_links[face].begin()+corner);
+  _link_face(face);
+}
+
+void half_edge_mesh::push_face() {
+  if (!_built) return;
+  _faces.push_back(vector<int>());
+  _links.push_back(vector<half_edge>());
+}
+
+void half_edge_mesh::set_face(int face, const vector<int>& ids) {
+  if (!_built || face < 0 || face >= _faces.size()) return;
+  _unlink_face(face);
+  _faces[face] = ids;
+  _links[face].resize(ids.size());
+  _link_face(face);
+}
+
+void half_edge_mesh::resize(int count) {
+  if (!_built || count < 0) return;
+  for (int i=(int)_faces.size()-1;i>=count;i--) _unlink_face(i);
+  _faces.resize(count);
+  _links.resize(count);
+}
+
+int half_edge_mesh::face_count() const { return _faces.size(); }
+
+int half_edge_mesh::face_size(int face) const { return _faces[face].size(); }
+
+half_edge half_edge_mesh::next(const half_edge& h) const { return half_edge(h.face, (h.corner+1)%_faces[h.face].size()); }
+
+half_edge half_edge_mesh::prev(const half_edge& h) const {
+  int size = _faces[h.face].size();
+  return half_edge(h.face, (h.corner+size-1)%size);
+}
+
+int half_edge_mesh::from(const half_edge& h) const { return _faces[h.face][h.corner]; }
+
+int half_edge_mesh::to(const half_edge& h) const { return _faces[h.face][(h.corner+1)%_faces[h.face].size()]; }
+
+half_edge half_edge_mesh::twin(const half_edge& h) const {
+  if (!h.valid() || !_linked(h.face)) return half_edge();
+  half_edge link = _links[h.face][h.corner];
+  if (link == h || _links[link.face][link.corner] != h) return half_edge(); // alone, or one of three or more
+  return link;
+}
+
+bool half_edge_mesh::is_boundary(const half_edge& h) const {
+  return (h.valid() && _linked(h.face) && from(h) != to(h) && _links[h.face][h.corner] == h);
+}
+
+void half_edge_mesh::edge_faces(const half_edge& h, vector<int>& faces) const {
+  if (!h.valid() || !_linked(h.face)) return;
+  half_edge g = h;
+  do {
+    faces.push_back(g.face);
+    g = _links[g.face][g.corner];
+  } while (g != h);
+}
+
+half_edge half_edge_mesh::vertex_edge(int id) const {
+  if (id < 0 || id >= _vertex_edges.size()) return half_edge();
+  return _vertex_edges[id];
+}
+
+void half_edge_mesh::one_ring(int id, vector<int>& neighbors) const {
+  half_edge start = vertex_edge(id);
+  if (!start.valid()) return;
+  int first = neighbors.size();
+  int limit = _vertex_uses[id] + 1; // (faces that disagree on winding can't send the walk around forever)
+
+  // around from start (across the edge before each corner) until the fan closes or an open edge is reached
+  half_edge h = start;
+  bool closed = false;
+  for (int steps=0;steps<limit;steps++) {
+    neighbors.push_back(to(h));
+    half_edge before = prev(h);
+    half_edge t = twin(before);
+    if (!t.valid() || from(t) != id) {
+      neighbors.push_back(from(before));
+      break;
+    }
+    h = t;
+    if (h == start) {
+      closed = true;
+      break;
+    }
+  }
+  if (closed) return;
+
+  // then the other way from start, ahead of it
+  vector<int> ahead;
+  h = start;
+  for (int steps=0;steps<limit;steps++) {
+    half_edge t = twin(h);
+    if (!t.valid() || to(t) != id) break;
+    h = next(t);
+    ahead.push_back(to(h));
+  }
+  neighbors.insert(neighbors.begin()+first, ahead.rbegin(), ahead.rend());
+}
+
+bool half_edge_mesh::boundary_loop(const half_edge& h, vector<half_edge>& loop) const {
+  if (!is_boundary(h)) return false;
+  half_edge g = h;
+  for (int steps=0;steps<=_vertex_uses.size();steps++) {
+    loop.push_back(g);
+    // around to() until the next open edge leaving it
+    half_edge out = next(g);
+    int limit = _vertex_uses[from(out)] + 1;
+    for (int k=0;!is_boundary(out);k++) {
+      half_edge t = twin(out);
+      if (k == limit || !t.valid() || to(t) != from(out)) return false; // a non manifold (or inconsistently wound) point
+      out = next(t);
+    }
+    g = out;
+    if (g == h) return true;
+  }
+  return false;
+}
+
+bool half_edge_mesh::orient(int seed_face, vector<int>& faces) const {
+  if (seed_face < 0 || seed_face >= _faces.size()) return true;
+
+  // breadth first across twins: a twin running the same way as its half edge belongs to a face wound the other way
+  vector<signed char> flip(_faces.size(), -1);
+  vector<int> queue(1, seed_face);
+  flip[seed_face] = 0;
+  bool agree = true;
+  for (int q=0;q<queue.size();q++) {
+    int face = queue[q];
+    if (!_linked(face)) continue;
+    for (int j=0;j<_faces[face].size();j++) {
+      half_edge h(face, j);
+      half_edge t = twin(h);
+      if (!t.valid()) continue;
+      signed char wanted = flip[face] ^ (from(t) == from(h) ? 1 : 0);
+      if (flip[t.face] < 0) {
+        flip[t.face] = wanted;
+        queue.push_back(t.face);
+        if (wanted) faces.push_back(t.face);
+      }
+      else if (flip[t.face] != wanted) agree = false;
+    }
+  }
+  return agree;
+}
+
+size_t half_edge_mesh::memory_usage() const {
+  size_t bytes = _faces.capacity()*sizeof(vector<int>) + _links.capacity()*sizeof(vector<half_edge>);
+  for (int i=0;i<_faces.size();i++) bytes += _faces[i].capacity()*sizeof(int) + _links[i].capacity()*sizeof(half_edge);
+  bytes += _vertex_edges.capacity()*sizeof(half_edge) + _vertex_uses.capacity()*sizeof(int);
+  for (int i=0;i<_edges.size();i++) {
+    bytes += _edges[i].bucket_count()*sizeof(void*) + _edges[i].size()*(sizeof(unsigned long long)+sizeof(half_edge)+2*sizeof(void*));
+  }
+  return bytes;
+}
+// *** END HALF_EDGE_MESH DEFINITIONS ***
@@ -0,0 +1,107 @@
+// File: half_edge.h
+// Written by Joshua Green
+
+#ifndef HALF_EDGE_H
+#define HALF_EDGE_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+
+struct facet;
+
+// a face's edge from one of its facets to the next: (face, corner) runs from facet [face][corner] to facet [face][corner+1]
+//   (wrapping to the first), so it's indexed as a vertex_id is
+struct half_edge {
+  int face, corner;
+
+  half_edge() : face(-1), corner(-1) { }
+  half_edge(int _face, int _corner) : face(_face), corner(_corner) { }
+
+  bool valid() const { return (face >= 0); }
+  bool operator==(const half_edge& other) const { return (face == other.face && corner == other.corner); }
+  bool operator!=(const half_edge& other) const { return !(*this == other); }
+};
+
+// ------------------------------------------------------------- HALF EDGE MESH ------------------------------------------------------------- //
+//   + build(faces, coordinate_count, thread_count=0)                                                                                         //
+//       - links every face's half edges to the half edges of the other faces along the same edge, in linear time: the half edges             //
+//         are split by a hash of their edge into a partition per thread, and each partition is hashed on its own thread                      //
+//       - faces of fewer than three facets (the face still being added to) have no half edges until they grow to three                       //
+//   + insert(face, corner, id) / set_corner(face, corner, id) / remove(face, corner)                                                         //
+//     push_face() / set_face(face, ids) / resize(face_count)                                                                                 //
+//       - mirror the same edit to the faces built from, relinking only the faces edited (nothing is done until build())                      //
+//   + next(h) / prev(h) / from(h) / to(h)                                                                                                    //
+//       - the half edges around h's face and the coordinates h runs between                                                                  //
+//   + twin(h)                                                                                                                                //
+//       - the other face's half edge along h's edge; invalid if h is on the boundary or the edge is shared by three or more faces            //
+//   + edge_faces(h, faces)                                                                                                                   //
+//       - every face using h's edge, h's own first (non manifold edges included)                                                             //
+//   + vertex_edge(id) / one_ring(id, neighbors)                                                                                              //
+//       - a half edge leaving coordinate id, and the coordinates joined to id by an edge, in order around it                                 //
+//   + boundary_loop(h, loop)                                                                                                                 //
+//       - the boundary half edges (from h, which must be one) around the hole or open edge h borders, in order                               //
+//   + orient(seed_face, faces)                                                                                                               //
+//       - the faces whose windings must be reversed to agree with seed_face's, across everything connected to it by shared edges;            //
+//         returns false if they can't all agree (a mobius strip: the faces are listed as the search first reached them)                      //
+//       - only twins are crossed, so faces joined by an edge shared by three or more faces are oriented separately                           //
+//   + NOTES:                                                                                                                                 //
+//       - each half edge keeps the next half edge along the same (undirected) edge, so the faces sharing an edge form a ring; an edge        //
+//         used by exactly two faces makes them twins; the hash holds one half edge of each ring                                              //
+//       - walking a ring, a one-ring or a boundary costs O(1) per step; edits cost O(size of the face) (plus the rings it's on)              //
+//       - one_ring() walks the fan of faces around vertex_edge(id), crossing only twins that run opposite to each other, so                  //
+//         coordinates where separate fans meet (or whose faces disagree on winding) only report one fan                                      //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+class half_edge_mesh {
+  private:
+    typedef std::unordered_map<unsigned long long, half_edge> edge_map; // edge key -> a half edge on it
+
+    bool _built;
+    std::vector<std::vector<int>> _faces;           // each face's coordinate ids (a copy of the facets' ids)
+    std::vector<std::vector<half_edge>> _links;     // per half edge, the next one along the same edge (itself if it's alone)
+    std::vector<half_edge> _vertex_edges;           // per coordinate, a half edge leaving it
+    std::vector<int> _vertex_uses;                  // per coordinate, the corners of linked faces at it
+    std::vector<edge_map> _edges;                   // partitioned by a hash of the key
+
+    static unsigned long long _key(int a, int b); // the same for a->b and b->a
+    static size_t _partition(unsigned long long key, size_t partitions);
+    bool _linked(int face) const; // faces of fewer than three facets aren't
+    void _reserve_vertex(int id);
+    half_edge _other_edge(int id, int face) const; // a half edge leaving id that isn't in face (invalid if there's none)
+    void _link_face(int face);
+    void _unlink_face(int face);
+
+  public:
+    half_edge_mesh();
+
+    void build(const std::vector<std::vector<facet>>& faces, int coordinate_count, int thread_count=0);
+    void clear();
+    bool built() const;
+
+    void insert(int face, int corner, int id);
+    void set_corner(int face, int corner, int id);
+    void remove(int face, int corner);
+    void push_face();
+    void set_face(int face, const std::vector<int>& ids);
+    void resize(int face_count);
+
+    int face_count() const;
+    int face_size(int face) const;
+    half_edge next(const half_edge& h) const;
+    half_edge prev(const half_edge& h) const;
+    int from(const half_edge& h) const;
+    int to(const half_edge& h) const;
+    half_edge twin(const half_edge& h) const;
+    bool is_boundary(const half_edge& h) const;
+    void edge_faces(const half_edge& h, std::vector<int>& faces) const;
+
+    half_edge vertex_edge(int id) const;
+    void one_ring(int id, std::vector<int>& neighbors) const;
+    bool boundary_loop(const half_edge& h, std::vector<half_edge>& loop) const;
+    bool orient(int seed_face, std::vector<int>& faces) const;
+
+    size_t memory_usage() const; // approximate bytes held
+};
+
+#endif
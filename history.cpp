@@ -0,0 +1,267 @@
+// File: history.cpp
+// Written by Joshua Green
+
+#include "history.h"
+#include "model3d.h"
+#include "selection.h"
+#include "trace.h"
+
+#include <vector>
+#include <string>
+#include <utility>
+#include <chrono>
+using namespace std;
+
+size_t edit_history::step::memory_usage() const {
+  size_t bytes = sizeof(step) + label.capacity() + faces.capacity()*sizeof(face_record) + facets.capacity()*sizeof(index2d) +
+                 points.capacity()*sizeof(vect3f);
+  for (int i=0;i<faces.size();i++) {
+    bytes += (faces[i].points.capacity() + faces[i].colors.capacity() + faces[i].normals.capacity())*sizeof(vect3f);
+    bytes += faces[i].ids.capacity()*sizeof(int);
+  }
+  if (model) bytes += sizeof(model3d) + model->memory_usage();
+  return bytes;
+}
+
+edit_history::edit_history(size_t max_steps, size_t max_bytes) : _max_steps(max_steps), _max_bytes(max_bytes), _bytes(0), _changes(0) { }
+
+// the coordinates by value, indexed on the first point whose id no longer holds it (a face restored after its coordinates were
+//   dropped and renumbered by a defragment), so that restoring a large step costs a pass over the coordinates rather than the
+//   search per point set_face() would make; rebuilt if the model is defragmented while it's in use
+struct edit_history::coordinate_index {
+  attribute_table points; // (exact, by bit pattern)
+  vector<int> ids;        // the coordinate at each of points (-1 for none)
+  int indexed;            // coordinates entered into points
+
+  coordinate_index() : indexed(0) { }
+
+  int find(const model3d& model, const vect3f& point, int id) {
+    const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+    if (id >= 0 && id < coordinates.size() && coordinates[id] == point) return id;
+    if (indexed > coordinates.size()) { // (defragmented: renumbered)
+      points.clear();
+      ids.clear();
+      indexed = 0;
+    }
+    for (;indexed<coordinates.size();indexed++) { // (set_face() appends the coordinates it's told are missing)
+      int entry = points.insert(coordinates[indexed]);
+      if (entry == ids.size()) ids.push_back(indexed);
+      else if (ids[entry] < 0) ids[entry] = indexed;
+    }
+    int entry = points.insert(point);
+    if (entry == ids.size()) ids.push_back(-1);
+    return ids[entry];
+  }
+};
+
+void edit_history::_capture(const model3d& model, int face, face_record& record) {
+  record.face = face;
+  record.points.clear();
+  record.colors.clear();
+  record.normals.clear();
+  record.ids.clear();
+  model.get_face(face, record.points, record.colors, record.normals); // a face past the end is captured as empty
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr(); // (empty while compact or paged)
+  if (face >= 0 && face < faces.size()) for (int i=0;i<faces[face].size();i++) record.ids.push_back(faces[face][i].id);
+}
+
+void edit_history::_restore(model3d& model, const face_record& record, coordinate_index& index) {
+  vector<int> ids(record.points.size());
+  for (int i=0;i<ids.size();i++) ids[i] = index.find(model, record.points[i], (i < record.ids.size() ? record.ids[i] : -1));
+  model.set_face(record.face, record.points, record.colors, record.normals, &ids);
+}
+
+void edit_history::_push(step&& s) {
+  _redo.clear(); // a new edit branches away from anything undone
+  _changes++;
+  s.time = clock::now();
+  _bytes += s.memory_usage();
+  _undo.push_back(move(s));
+
+  // always keeps the newest step, however large
+  while (_undo.size() > 1 && (_undo.size() > _max_steps || _bytes > _max_bytes)) {
+    _bytes -= _undo.front().memory_usage();
+    _undo.pop_front();
+  }
+}
+
+void edit_history::record_faces(const model3d& model, const vector<int>& faces, const string& label, bool coalesce) {
+  if (coalesce && _redo.empty() && !_undo.empty()) {
+    step& last = _undo.back();
+    bool same = (last.type == STEP_FACES && last.coalesce && last.label == label && last.face_count == model.face_count() &&
+                 last.faces.size() == faces.size());
+    for (int i=0;same && i<faces.size();i++) same = (last.faces[i].face == faces[i]);
+    if (same && chrono::duration_cast<chrono::milliseconds>(clock::now() - last.time).count() < COALESCE_MS) {
+      last.time = clock::now(); // the step already holds the faces as they were before the first of these edits
+      _changes++;
+      return;
+    }
+  }
+
+  step s;
+  s.type = STEP_FACES;
+  s.label = label;
+  s.coalesce = coalesce;
+  s.face_count = model.face_count();
+  s.faces.resize(faces.size());
+  for (int i=0;i<faces.size();i++) _capture(model, faces[i], s.faces[i]);
+  _push(move(s));
+}
+
+void edit_history::record_translate(const vect3f& offset) {
+  step s;
+  s.type = STEP_TRANSLATE;
+  s.label = "translate";
+  s.offset = offset;
+  _push(move(s));
+}
+
+void edit_history::record_mirror(int axis) {
+  step s;
+  s.type = STEP_MIRROR;
+  s.label = "mirror";
+  s.axis = axis;
+  _push(move(s));
+}
+
+void edit_history::record_move(const model3d& model, const selection_set& selection) {
+  if (!selection.fits(model)) return; // (translate() won't move anything)
+  step s;
+  s.type = STEP_MOVE;
+  s.label = "move selection";
+  selection.facets(s.facets);
+
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+  vector<char> moved(coordinates.size(), 0);
+  s.points.resize(s.facets.size());
+  for (int i=0;i<s.facets.size();i++) {
+    int id = faces[s.facets[i][0]][s.facets[i][1]].id;
+    moved[id] = 1;
+    s.points[i] = coordinates[id];
+  }
+
+  // the faces straddling the selection's edge get new normals; a face moved whole keeps its own
+  for (int i=0;i<faces.size();i++) {
+    int corners = 0;
+    for (int j=0;j<faces[i].size();j++) corners += moved[faces[i][j].id];
+    if (corners == 0 || corners == faces[i].size()) continue;
+    s.faces.push_back(face_record());
+    _capture(model, i, s.faces.back());
+  }
+  _push(move(s));
+}
+
+void edit_history::record_model(const model3d& model, const string& label) {
+  step s;
+  s.type = STEP_MODEL;
+  s.label = label;
+  s.model.reset(new model3d(model));
+  _push(move(s));
+}
+
+void edit_history::record_replace(model3d& model, const string& label) {
+  step s;
+  s.type = STEP_MODEL;
+  s.label = label;
+  s.model.reset(new model3d(std::move(model)));
+  model.clear(); // the moved from model is emptied back to a usable (lattice mode preserving) state
+  _push(move(s));
+}
+
+void edit_history::_apply(step& s, model3d& model) {
+  TRACE_SPAN(apply_span, "edit_history::apply");
+  TRACE_ARG(apply_span, "step", s.label);
+  switch(s.type) {
+    case STEP_FACES: {
+      // keep what the faces hold now (including any faces about to be truncated, such as those appended by the edit),
+      //   then put back what they held when the step was recorded
+      int current_count = model.face_count();
+      vector<face_record> current(s.faces.size());
+      for (int i=0;i<s.faces.size();i++) _capture(model, s.faces[i].face, current[i]);
+      for (int face=s.face_count;face<current_count;face++) {
+        bool recorded = false;
+        for (int i=0;!recorded && i<s.faces.size();i++) recorded = (s.faces[i].face == face);
+        if (recorded) continue;
+        current.push_back(face_record());
+        _capture(model, face, current.back());
+      }
+
+      model.resize_faces(s.face_count);
+      coordinate_index index;
+      for (int i=0;i<s.faces.size();i++) _restore(model, s.faces[i], index);
+
+      s.faces.swap(current);
+      s.face_count = current_count;
+    } break;
+    case STEP_TRANSLATE: {
+      model.translate(vect3f(0.0f, 0.0f, 0.0f) - s.offset);
+      s.offset = vect3f(0.0f, 0.0f, 0.0f) - s.offset;
+    } break;
+    case STEP_MIRROR: { model.mirror(s.axis); } break;
+    case STEP_MOVE: {
+      // the facets' coordinates are found through their faces and corners (the ids may have been renumbered since), all of them
+      //   read before any is put back, as facets share coordinates; the stretched faces then find their points in place
+      const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+      const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+      vector<vect3f> current(s.facets.size());
+      for (int i=0;i<s.facets.size();i++) current[i] = coordinates[faces[s.facets[i][0]][s.facets[i][1]].id];
+      vector<face_record> current_faces(s.faces.size());
+      for (int i=0;i<s.faces.size();i++) _capture(model, s.faces[i].face, current_faces[i]);
+
+      for (int i=0;i<s.facets.size();i++) model.edit_coord(faces[s.facets[i][0]][s.facets[i][1]].id, s.points[i]);
+      coordinate_index index;
+      for (int i=0;i<s.faces.size();i++) _restore(model, s.faces[i], index);
+
+      s.points.swap(current);
+      s.faces.swap(current_faces);
+    } break;
+    case STEP_MODEL: { swap(model, *s.model); } break;
+  }
+}
+
+bool edit_history::undo(model3d& model) {
+  if (_undo.empty()) return false;
+  step s(move(_undo.back()));
+  _undo.pop_back();
+  _bytes -= s.memory_usage();
+  _apply(s, model);
+  _changes++;
+  s.coalesce = false; // a redone step is never extended
+  _redo.push_back(move(s));
+  return true;
+}
+
+bool edit_history::redo(model3d& model) {
+  if (_redo.empty()) return false;
+  step s(move(_redo.back()));
+  _redo.pop_back();
+  _apply(s, model);
+  _changes++;
+  _bytes += s.memory_usage();
+  _undo.push_back(move(s));
+  return true;
+}
+
+void edit_history::clear() {
+  _undo.clear();
+  _redo.clear();
+  _bytes = 0;
+  _changes++;
+}
+
+int edit_history::undo_count() const { return _undo.size(); }
+
+int edit_history::redo_count() const { return _redo.size(); }
+
+string edit_history::undo_label() const { return (_undo.empty() ? string() : _undo.back().label); }
+
+string edit_history::redo_label() const { return (_redo.empty() ? string() : _redo.back().label); }
+
+size_t edit_history::memory_usage() const {
+  size_t bytes = _bytes;
+  for (int i=0;i<_redo.size();i++) bytes += _redo[i].memory_usage();
+  return bytes;
+}
+
+unsigned long long edit_history::changes() const { return _changes; }
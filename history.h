@@ -0,0 +1,106 @@
+// File: history.h
+// Written by Joshua Green
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "model3d.h"
+#include "vectXf.h"
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <chrono>
+
+class selection_set;
+
+// ----------------------------------------------------------- CLASS EDIT_HISTORY ----------------------------------------------------------- //
+//   + record_faces(model, faces, label, coalesce=false)                                                                                      //
+//       - call before an edit that changes only the listed faces (and/or the face count): the faces' current values are kept                //
+//       - with coalesce, an edit with the same label and faces as the previous one (within COALESCE_MS of it) joins that step                //
+//   + record_translate(offset) / record_mirror(axis)                                                                                         //
+//       - call after translating or mirroring the whole model: only the transform is kept                                                    //
+//   + record_move(model, selection)                                                                                                          //
+//       - call before translating a selection (model3d::translate()): each selected facet's face, corner and point are kept, along with      //
+//         the faces the move stretches (whose normals it recalculates); undoing puts the facets' coordinates back, then those faces          //
+//   + record_model(model) / record_replace(model)                                                                                            //
+//       - for edits that change everything: record_model() keeps a copy, record_replace() moves the model into the history and              //
+//         leaves it cleared (for 'C' and loading, where the old model would be thrown away)                                                  //
+//   + undo(model) / redo(model)                                                                                                              //
+//       - swaps the model's state with the step's, so a step undone is the same step redone; return false if there's nothing to do         //
+//   + clear()                                                                                                                                //
+//       - forgets every step (the model was replaced outside of the history, or its faces were renumbered)                                   //
+//   + changes()                                                                                                                              //
+//       - counts the steps recorded (coalesced edits included), undone and redone, and the clears: an edit made through the history         //
+//         changes it, so work done on a copy of the model can tell whether the model was edited meanwhile                                    //
+//   + NOTES:                                                                                                                                 //
+//       - steps hold values (and faces and corners) rather than coordinate ids, so they survive model3d's automatic defragmentation          //
+//       - the oldest steps are dropped beyond max_steps or max_bytes                                                                         //
+//       - float translations are undone by translating back, which may round (lattice models are exact)                                      //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+class edit_history {
+  public:
+    static const int COALESCE_MS = 750;
+
+  private:
+    typedef std::chrono::steady_clock clock;
+    enum STEP_TYPE { STEP_FACES, STEP_TRANSLATE, STEP_MIRROR, STEP_MOVE, STEP_MODEL };
+
+    struct face_record {
+      int face;
+      std::vector<vect3f> points, colors, normals;
+      std::vector<int> ids; // the coordinates the points were at (tried first when they're put back)
+    };
+    struct coordinate_index; // finds the coordinates points are at once their ids no longer hold them (see history.cpp)
+
+    struct step {
+      STEP_TYPE type;
+      std::string label;
+      bool coalesce;
+      clock::time_point time;
+
+      int face_count;                   // STEP_FACES
+      std::vector<face_record> faces;   // STEP_FACES, STEP_MOVE (the faces stretched)
+      vect3f offset;                    // STEP_TRANSLATE
+      std::vector<index2d> facets;      // STEP_MOVE
+      std::vector<vect3f> points;       // STEP_MOVE (one per facet)
+      int axis;                         // STEP_MIRROR
+      std::unique_ptr<model3d> model;   // STEP_MODEL
+
+      step() : type(STEP_FACES), coalesce(false), face_count(0), axis(0) { }
+      size_t memory_usage() const;
+    };
+
+    std::deque<step> _undo;
+    std::vector<step> _redo;
+    size_t _max_steps, _max_bytes, _bytes;
+    unsigned long long _changes;
+
+    void _push(step&& s);
+    void _apply(step& s, model3d& model); // swaps the model's state with s's
+    static void _capture(const model3d& model, int face, face_record& record);
+    static void _restore(model3d& model, const face_record& record, coordinate_index& index);
+
+  public:
+    edit_history(size_t max_steps=512, size_t max_bytes=64*1024*1024);
+
+    void record_faces(const model3d& model, const std::vector<int>& faces, const std::string& label, bool coalesce=false);
+    void record_translate(const vect3f& offset);
+    void record_mirror(int axis);
+    void record_move(const model3d& model, const selection_set& selection);
+    void record_model(const model3d& model, const std::string& label);
+    void record_replace(model3d& model, const std::string& label);
+
+    bool undo(model3d& model);
+    bool redo(model3d& model);
+    void clear();
+
+    int undo_count() const;
+    int redo_count() const;
+    std::string undo_label() const; // the label of the step undo() would reverse ("" if none)
+    std::string redo_label() const;
+    size_t memory_usage() const;    // approximate bytes held by every step
+    unsigned long long changes() const;
+};
+
+#endif
@@ -0,0 +1,164 @@
+// File: input_trace.cpp
+// Written by Joshua Green
+
+#include "input_trace.h"
+#include "fileio/fileio.h"
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cctype>
+using namespace std;
+
+namespace {
+  string format_ms(double ms) {
+    char buffer[32];
+    sprintf(buffer, "%.3f", ms);
+    return string(buffer);
+  }
+
+  double percentile(const vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    int i = (int)(p*(sorted.size()-1) + 0.5);
+    return sorted[min(max(i, 0), (int)sorted.size()-1)];
+  }
+}
+
+// *** BEGIN INPUT_EVENT DEFINITIONS ***
+input_event::input_event() : ms(0.0), type(INPUT_KEY) {
+  for (int i=0;i<5;i++) values[i] = 0;
+}
+
+string input_event::label() const {
+  switch (type) {
+    case INPUT_KEY: {
+      if (isgraph(values[0])) return string("key '") + (char)values[0] + "'";
+      return "key " + to_string(values[0]);
+    }
+    case INPUT_SPECIAL: return "special " + to_string(values[0]);
+    case INPUT_MOUSE: return "mouse";
+    case INPUT_RESIZE: return "resize";
+    default: return "line";
+  }
+}
+// *** END INPUT_EVENT DEFINITIONS ***
+
+// *** BEGIN INPUT_RECORDER DEFINITIONS ***
+input_recorder::input_recorder() : _file(0) { }
+
+input_recorder::~input_recorder() { close(); }
+
+bool input_recorder::open(const string& filename) {
+  lock_guard<mutex> lock(_lock);
+  if (_file) delete _file;
+  _file = new fileio();
+  _file->open(filename, "w");
+  if (!_file->is_open()) {
+    delete _file;
+    _file = 0;
+    return false;
+  }
+  _file->write(INPUT_TRACE_HEADER() + "\n");
+  _file->flush();
+  _start = chrono::steady_clock::now();
+  return true;
+}
+
+void input_recorder::close() {
+  lock_guard<mutex> lock(_lock);
+  if (!_file) return;
+  _file->close();
+  delete _file;
+  _file = 0;
+}
+
+bool input_recorder::is_open() {
+  lock_guard<mutex> lock(_lock);
+  return (_file != 0);
+}
+
+void input_recorder::_write(const string& event) {
+  lock_guard<mutex> lock(_lock);
+  if (!_file) return;
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - _start).count();
+  _file->write(format_ms(ms) + " " + event + "\n");
+  _file->flush();
+}
+
+void input_recorder::key(unsigned char key, int x, int y, int modifiers) {
+  _write("key " + to_string((int)key) + " " + to_string(x) + " " + to_string(y) + " " + to_string(modifiers));
+}
+
+void input_recorder::special(int key, int x, int y, int modifiers) {
+  _write("special " + to_string(key) + " " + to_string(x) + " " + to_string(y) + " " + to_string(modifiers));
+}
+
+void input_recorder::mouse(int button, int state, int x, int y, int modifiers) {
+  _write("mouse " + to_string(button) + " " + to_string(state) + " " + to_string(x) + " " + to_string(y) + " " + to_string(modifiers));
+}
+
+void input_recorder::resize(int width, int height) { _write("resize " + to_string(width) + " " + to_string(height)); }
+
+void input_recorder::line(const string& text) {
+  string single(text);
+  replace(single.begin(), single.end(), '\n', ' ');
+  replace(single.begin(), single.end(), '\r', ' ');
+  _write("line " + single);
+}
+// *** END INPUT_RECORDER DEFINITIONS ***
+
+bool read_input_trace(const string& filename, vector<input_event>& events) {
+  fileio file;
+  file.open(filename, "r");
+  if (!file.is_open()) return false;
+  string data = file.read(file.size());
+  file.close();
+
+  istringstream lines(data);
+  string line;
+  if (!getline(lines, line)) return false;
+  if (line.length() > 0 && line[line.length()-1] == '\r') line.erase(line.length()-1);
+  if (line != INPUT_TRACE_HEADER()) return false;
+
+  while (getline(lines, line)) {
+    if (line.length() > 0 && line[line.length()-1] == '\r') line.erase(line.length()-1);
+    if (line.empty()) continue;
+
+    istringstream fields(line);
+    input_event event;
+    string type;
+    fields >> event.ms >> type;
+    int count = 0;
+    if (type == "key") { event.type = INPUT_KEY; count = 4; }
+    else if (type == "special") { event.type = INPUT_SPECIAL; count = 4; }
+    else if (type == "mouse") { event.type = INPUT_MOUSE; count = 5; }
+    else if (type == "resize") { event.type = INPUT_RESIZE; count = 2; }
+    else if (type == "line") {
+      event.type = INPUT_LINE;
+      size_t start = line.find(" line");
+      event.text = (start == string::npos || start+6 > line.length() ? string() : line.substr(start+6));
+    }
+    else return false;
+
+    for (int i=0;i<count;i++) fields >> event.values[i];
+    if (fields.fail()) return false;
+    events.push_back(event);
+  }
+  return true;
+}
+
+latency_summary summarize_latencies(vector<double> samples) {
+  latency_summary summary;
+  if (samples.empty()) return summary;
+  sort(samples.begin(), samples.end());
+  summary.count = samples.size();
+  for (int i=0;i<samples.size();i++) summary.mean += samples[i];
+  summary.mean /= samples.size();
+  summary.p50 = percentile(samples, 0.50);
+  summary.p95 = percentile(samples, 0.95);
+  summary.p99 = percentile(samples, 0.99);
+  summary.max = samples.back();
+  return summary;
+}
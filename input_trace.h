@@ -0,0 +1,78 @@
+// File: input_trace.h
+// Written by Joshua Green
+
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+
+class fileio;
+
+// -------------------------------------------------------------- INPUT TRACES -------------------------------------------------------------- //
+//   + input_recorder                                                                                                                         //
+//       - open(filename) starts a trace (its clock starts at zero); key(), special(), mouse(), resize() and line() append an event           //
+//       - each event is written (and flushed) as it's recorded, so a trace survives the modeler crashing                                     //
+//       - line() is an answer entered into one of the modeler's prompts (the keys typing it aren't recorded); every call is locked           //
+//   + read_input_trace(filename, events)                                                                                                     //
+//       - returns false if filename isn't a trace (events are appended in the order recorded)                                                //
+//   + summarize_latencies(samples)                                                                                                           //
+//       - count, mean and percentiles of a list of milliseconds                                                                              //
+//   + NOTES:                                                                                                                                 //
+//       - a trace is text: INPUT_TRACE_HEADER() on the first line, then an event per line as "<ms> <type> <values>":                         //
+//           key <key> <x> <y> <modifiers> | special <key> <x> <y> <modifiers> | mouse <button> <state> <x> <y> <modifiers> |                 //
+//           resize <width> <height> | line <the text entered, to the end of the line>                                                        //
+//       - modifiers are glutGetModifiers() at the time of the event (replayed through the modeler's key_modifiers())                         //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+inline std::string INPUT_TRACE_HEADER() { return std::string("input_trace=1"); }
+
+enum INPUT_EVENT_TYPE { INPUT_KEY, INPUT_SPECIAL, INPUT_MOUSE, INPUT_RESIZE, INPUT_LINE };
+
+struct input_event {
+  double ms; // since the trace was opened
+  INPUT_EVENT_TYPE type;
+  int values[5]; // key, x, y, modifiers | button, state, x, y, modifiers | width, height
+  std::string text; // INPUT_LINE
+
+  input_event();
+  std::string label() const; // groups events for reports: "key 'w'", "special 9", "mouse", "resize" or "line"
+};
+
+class input_recorder {
+  private:
+    std::mutex _lock;
+    fileio* _file;
+    std::chrono::steady_clock::time_point _start;
+
+    void _write(const std::string& event);
+
+  public:
+    input_recorder();
+    ~input_recorder();
+
+    bool open(const std::string& filename);
+    void close();
+    bool is_open();
+
+    void key(unsigned char key, int x, int y, int modifiers);
+    void special(int key, int x, int y, int modifiers);
+    void mouse(int button, int state, int x, int y, int modifiers);
+    void resize(int width, int height);
+    void line(const std::string& text);
+};
+
+bool read_input_trace(const std::string& filename, std::vector<input_event>& events);
+
+struct latency_summary {
+  int count;
+  double mean, p50, p95, p99, max;
+
+  latency_summary() : count(0), mean(0.0), p50(0.0), p95(0.0), p99(0.0), max(0.0) { }
+};
+
+latency_summary summarize_latencies(std::vector<double> samples);
+
+#endif
@@ -0,0 +1,361 @@
+// File: journal.cpp
+// Written by Joshua Green
+
+#include "journal.h"
+#include "model3d.h"
+#include "validate.h"
+#include "trace.h"
+#include "fileio/fileio.h"
+
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <sys/types.h>
+#include <sys/stat.h>
+using namespace std;
+
+const char* const model_journal::JOURNAL_SUFFIX = ".journal";
+
+// record encoding (values are stored in the machine's native (little endian) byte order, as in the binary model format)
+namespace {
+  enum JOURNAL_RECORD {
+    RECORD_ADD_VERTEX = 1,    // f32 point[3], f32 color[3]
+    RECORD_EDIT_COORD,        // i32 coordinate id, f32 point[3]
+    RECORD_SET_COLOR,         // i32 face, i32 facet, f32 color[3]
+    RECORD_REMOVE_VERTEX,     // i32 face, i32 facet
+    RECORD_PUSH_FACE,
+    RECORD_POP_FACE,
+    RECORD_TRANSLATE,         // f32 offset[3]
+    RECORD_MIRROR,            // u8 axis
+    RECORD_CLEAR,
+    RECORD_CHECKPOINT         // u32 length, binary format model
+  };
+
+  template <typename T> void put(string& data, T value) { data.append((const char*)&value, sizeof(T)); }
+
+  void put_vect3f(string& data, const vect3f& v) {
+    put<float>(data, v.x);
+    put<float>(data, v.y);
+    put<float>(data, v.z);
+  }
+
+  class record_reader {
+    private:
+      const string& _data;
+      size_t _pos;
+      bool _ok;
+    public:
+      record_reader(const string& data, size_t pos) : _data(data), _pos(pos), _ok(true) { }
+      bool ok() const { return _ok; }
+      bool done() const { return _pos >= _data.length(); }
+      size_t pos() const { return _pos; }
+      template <typename T> T get() {
+        T value = T();
+        if (_pos+sizeof(T) > _data.length()) _ok = false;
+        else {
+          memcpy(&value, _data.data()+_pos, sizeof(T));
+          _pos += sizeof(T);
+        }
+        return value;
+      }
+      vect3f get_vect3f() {
+        float x = get<float>(), y = get<float>(), z = get<float>();
+        return vect3f(x, y, z);
+      }
+      string get_bytes(size_t length) {
+        if (_pos+length > _data.length()) {
+          _ok = false;
+          return string();
+        }
+        _pos += length;
+        return _data.substr(_pos-length, length);
+      }
+  };
+
+  string read_file(const string& filename, bool& found) {
+    fileio file;
+    file.open(filename, "r");
+    found = file.is_open();
+    if (!found) return string();
+    return file.read(file.size());
+  }
+
+  bool file_exists(const string& filename) {
+    fileio file;
+    file.open(filename, "r");
+    return file.is_open();
+  }
+
+  // the file's size and modification time (-1 if it doesn't exist): identifies the model file a journal's records were made against
+  void file_stamp(const string& filename, long long int& size, long long int& modified) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) {
+      size = -1;
+      modified = -1;
+      return;
+    }
+    size = (long long int)info.st_size;
+    modified = (long long int)info.st_mtime;
+  }
+}
+
+model_journal::model_journal() : _bytes(0), _need_checkpoint(false), _stale(false) { attach("untitled"); }
+
+void model_journal::attach(const string& model_filename) {
+  _filename = model_filename + JOURNAL_SUFFIX;
+  _model_filename = model_filename;
+  file_stamp(_model_filename, _base_size, _base_modified);
+  _pending.clear();
+  _need_checkpoint = false;
+  _stale = false;
+
+  fileio file;
+  file.open(_filename, "r");
+  _bytes = (file.is_open() ? file.size() : 0);
+}
+
+string model_journal::filename() const { return _filename; }
+
+bool model_journal::exists() const { return (file_exists(_filename) || file_exists(_filename + ".tmp")); }
+
+string model_journal::_header() const {
+  string header(JOURNAL_HEADER());
+  put<unsigned int>(header, JOURNAL_VERSION);
+  put<long long int>(header, _base_size);
+  put<long long int>(header, _base_modified);
+  return header;
+}
+
+bool model_journal::_read_header(const string& data, size_t& records, long long int& base_size, long long int& base_modified) {
+  if (data.compare(0, JOURNAL_HEADER().length(), JOURNAL_HEADER()) != 0) return false;
+  record_reader reader(data, JOURNAL_HEADER().length());
+  if (reader.get<unsigned int>() != JOURNAL_VERSION || !reader.ok()) return false;
+  base_size = reader.get<long long int>();
+  base_modified = reader.get<long long int>();
+  records = reader.pos();
+  return reader.ok();
+}
+
+void model_journal::_begin_record(unsigned char type) { put<unsigned char>(_pending, type); }
+
+void model_journal::add_vertex(const vect3f& point, const vect3f& color) {
+  _begin_record(RECORD_ADD_VERTEX);
+  put_vect3f(_pending, point);
+  put_vect3f(_pending, color);
+}
+
+void model_journal::edit_coord(int coord_id, const vect3f& point) {
+  _begin_record(RECORD_EDIT_COORD);
+  put<int>(_pending, coord_id);
+  put_vect3f(_pending, point);
+}
+
+void model_journal::set_vertex_color(const int* const vertex_id, const vect3f& color) {
+  _begin_record(RECORD_SET_COLOR);
+  put<int>(_pending, vertex_id[0]);
+  put<int>(_pending, vertex_id[1]);
+  put_vect3f(_pending, color);
+}
+
+void model_journal::remove_vertex(const int* const vertex_id) {
+  _begin_record(RECORD_REMOVE_VERTEX);
+  put<int>(_pending, vertex_id[0]);
+  put<int>(_pending, vertex_id[1]);
+}
+
+void model_journal::push_face() { _begin_record(RECORD_PUSH_FACE); }
+
+void model_journal::pop_face() { _begin_record(RECORD_POP_FACE); }
+
+void model_journal::translate(const vect3f& offset) {
+  _begin_record(RECORD_TRANSLATE);
+  put_vect3f(_pending, offset);
+}
+
+void model_journal::mirror(int axis) {
+  _begin_record(RECORD_MIRROR);
+  put<unsigned char>(_pending, axis);
+}
+
+void model_journal::clear() { _begin_record(RECORD_CLEAR); }
+
+void model_journal::invalidate() {
+  _pending.clear(); // the checkpoint supersedes them
+  _need_checkpoint = true;
+}
+
+bool model_journal::flush(const model3d& model) {
+  // compacts once the journal is larger than the model it would be replaced by (so the checkpoint's cost is spread over
+  //   at least as many bytes of edits)
+  long long int model_bytes = (long long int)model.coordinate_count()*12 + (long long int)model.vertex_count()*12;
+  long long int journal_bytes = _bytes + _pending.length();
+  if (_need_checkpoint || (journal_bytes > CHECKPOINT_MIN_BYTES && journal_bytes > model_bytes)) return _write_checkpoint(model);
+  if (_pending.empty()) return true;
+
+  TRACE_SPAN(flush_span, "model_journal::flush");
+  TRACE_ARG(flush_span, "bytes", (long long int)_pending.length());
+
+  fileio file;
+  file.open(_filename); // (created if it doesn't exist)
+  if (!file.is_open()) return false;
+  if (file.size() == 0) {
+    string header = _header();
+    file.write(header);
+    _bytes = header.length();
+  }
+  file.seek("END");
+  file.write(_pending);
+  file.flush();
+  file.close();
+
+  _bytes += _pending.length();
+  _pending.clear();
+  return true;
+}
+
+bool model_journal::_write_checkpoint(const model3d& model) {
+  TRACE_SPAN(checkpoint_span, "model_journal::checkpoint");
+
+  string data = _header();
+  put<unsigned char>(data, RECORD_CHECKPOINT);
+  size_t length_pos = data.length();
+  put<unsigned int>(data, 0);
+  model.to_binary(data);
+  unsigned int length = data.length() - length_pos - sizeof(unsigned int);
+  memcpy(&data[length_pos], &length, sizeof(unsigned int));
+  TRACE_ARG(checkpoint_span, "bytes", (long long int)data.length());
+
+  string temp_filename = _filename + ".tmp";
+  {
+    fileio file;
+    file.open(temp_filename, "w");
+    if (!file.is_open()) return false;
+    file.write(data);
+    file.flush();
+    file.close();
+  }
+  if (rename(temp_filename.c_str(), _filename.c_str()) != 0) { // (windows won't rename over an existing file)
+    remove(_filename.c_str());
+    if (rename(temp_filename.c_str(), _filename.c_str()) != 0) return false;
+  }
+
+  _bytes = data.length();
+  _pending.clear();
+  _need_checkpoint = false;
+  return true;
+}
+
+bool model_journal::recover(model3d& model, mesh_report* report, bool base_loaded) {
+  string temp_filename = _filename + ".tmp";
+  if (!file_exists(_filename)) {
+    // a compaction was interrupted after the old journal was removed: the new one is complete
+    if (!file_exists(temp_filename) || rename(temp_filename.c_str(), _filename.c_str()) != 0) return false;
+  }
+  else remove(temp_filename.c_str()); // a compaction that didn't finish writing; the journal is still whole
+
+  TRACE_SPAN(recover_span, "model_journal::recover");
+  bool found;
+  string data = read_file(_filename, found);
+
+  // records refer to the file's faces by index, so they're only replayed onto the file they were written against (a journal
+  //   starting with a checkpoint replaces the model); any other journal is kept for the user, out of the way of new edits
+  size_t first = 0;
+  long long int base_size = 0, base_modified = 0, size, modified;
+  file_stamp(_model_filename, size, modified);
+  bool readable = _read_header(data, first, base_size, base_modified);
+  bool checkpointed = (readable && first < data.length() && (unsigned char)data[first] == RECORD_CHECKPOINT);
+  if (!readable || (!checkpointed && (!base_loaded || base_size != size || base_modified != modified))) {
+    string stale_filename = _filename + ".stale";
+    remove(stale_filename.c_str());
+    if (rename(_filename.c_str(), stale_filename.c_str()) != 0) remove(_filename.c_str());
+    _bytes = 0;
+    _pending.clear();
+    _need_checkpoint = true;
+    _stale = true;
+    return false;
+  }
+
+  int records = replay(data, model);
+  TRACE_ARG(recover_span, "records", records);
+  if (records < 0) return false;
+
+  // (validated once the records are replayed: they refer to the faces as they were written; a repair renumbers them, so
+  //   the next flush() rewrites the journal as a checkpoint of the repaired model)
+  mesh_report validated = model.validate(true);
+  if (report) *report = validated;
+
+  _bytes = data.length();
+  _pending.clear();
+  _need_checkpoint = !validated.clean();
+  return (records > 0);
+}
+
+void model_journal::discard() {
+  remove(_filename.c_str());
+  remove((_filename + ".tmp").c_str());
+  _pending.clear();
+  _bytes = 0;
+  _need_checkpoint = false;
+}
+
+bool model_journal::stale() const { return _stale; }
+
+long long int model_journal::pending_bytes() const { return _pending.length(); }
+
+long long int model_journal::journal_bytes() const { return _bytes; }
+
+int model_journal::replay(const string& data, model3d& model) {
+  size_t first;
+  long long int base_size, base_modified;
+  if (!_read_header(data, first, base_size, base_modified)) return -1;
+  record_reader reader(data, first);
+
+  int records = 0;
+  while (!reader.done()) {
+    unsigned char type = reader.get<unsigned char>();
+    int vertex_id[2];
+    switch(type) {
+      case RECORD_ADD_VERTEX: {
+        vect3f point = reader.get_vect3f();
+        vect3f color = reader.get_vect3f();
+        if (reader.ok()) model.add_vertex(point, color);
+      } break;
+      case RECORD_EDIT_COORD: {
+        int coord_id = reader.get<int>();
+        vect3f point = reader.get_vect3f();
+        if (reader.ok()) model.edit_coord(coord_id, point);
+      } break;
+      case RECORD_SET_COLOR: {
+        vertex_id[0] = reader.get<int>();
+        vertex_id[1] = reader.get<int>();
+        vect3f color = reader.get_vect3f();
+        if (reader.ok()) model.set_vertex_color(vertex_id, color);
+      } break;
+      case RECORD_REMOVE_VERTEX: {
+        vertex_id[0] = reader.get<int>();
+        vertex_id[1] = reader.get<int>();
+        if (reader.ok()) model.remove_vertex(vertex_id);
+      } break;
+      case RECORD_PUSH_FACE: { model.push_face(); } break;
+      case RECORD_POP_FACE: { model.pop_face(); } break;
+      case RECORD_TRANSLATE: {
+        vect3f offset = reader.get_vect3f();
+        if (reader.ok()) model.translate(offset);
+      } break;
+      case RECORD_MIRROR: {
+        int axis = reader.get<unsigned char>();
+        if (reader.ok()) model.mirror(axis);
+      } break;
+      case RECORD_CLEAR: { model.clear(); } break;
+      case RECORD_CHECKPOINT: {
+        unsigned int length = reader.get<unsigned int>();
+        string image = reader.get_bytes(length);
+        if (reader.ok() && !model.from_binary(image)) return records; // a damaged checkpoint ends the usable journal
+      } break;
+      default: return records; // not a record: the rest of the file is unusable
+    }
+    if (!reader.ok()) break; // cut short
+    records++;
+  }
+  return records;
+}
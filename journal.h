@@ -0,0 +1,91 @@
+// File: journal.h
+// Written by Joshua Green
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "model3d.h"
+#include "vectXf.h"
+#include <string>
+
+// ---------------------------------------------------------- CLASS MODEL_JOURNAL ----------------------------------------------------------- //
+//   + attach(string model_filename)                                                                                                          //
+//       - journals edits to the model saved as model_filename into model_filename + JOURNAL_SUFFIX (pending records are dropped)             //
+//   + add_vertex(point, color) / edit_coord(id, point) / set_vertex_color(vertex, color) / remove_vertex(vertex)                             //
+//     push_face() / pop_face() / translate(offset) / mirror(axis) / clear()                                                                  //
+//       - call after making the same edit to the model: queues a small binary record of it                                                   //
+//   + invalidate()                                                                                                                           //
+//       - call after any other edit (undo, merge, face_resolution, ...): the next flush() writes a checkpoint                                //
+//   + flush(model)                                                                                                                           //
+//       - appends the queued records to the journal (call on a timer); the cost depends on the edits made, not the model's size              //
+//       - once the journal outgrows the model (or after invalidate()) it's compacted: rewritten as a checkpoint of the whole model           //
+//   + exists()                                                                                                                               //
+//       - true if the attached file has a journal (recover() would apply it to the model as loaded from that file)                           //
+//   + recover(model, report=0, base_loaded=true)                                                                                             //
+//       - if a journal exists for the attached file, applies it to model (which should hold the file as it was loaded) and returns true      //
+//       - base_loaded: whether model holds the file (false if it couldn't be loaded); a journal that doesn't start with a checkpoint is      //
+//         only applied to the file it was written against (the same size and modification time), as it was loaded                            //
+//       - a journal that doesn't apply is kept, moved to filename() + ".stale", and stale() returns true                                     //
+//       - the recovered model is validated and repaired (filling report; see validate.h); a repair makes the next flush() a checkpoint       //
+//   + discard()                                                                                                                              //
+//       - removes the journal; call once the model has been saved (or its changes abandoned)                                                 //
+//   + replay(data, model)                                                                                                                    //
+//       - applies a journal image to model, returning the number of records applied (-1 if data isn't a journal)                             //
+//       - a record cut short (by a crash while it was written) ends the replay                                                               //
+//   + NOTES:                                                                                                                                 //
+//       - a journal is JOURNAL_HEADER() | u32 version | i64 size | i64 modification time (of the model file when attached, -1 if it          //
+//         didn't exist), followed by records: u8 type and the record's fields; records refer to the file's faces by index                    //
+//       - a checkpoint record (u32 length and a binary format model) replaces the model; compaction writes a journal holding only one,       //
+//         to a temporary file that is then moved over the journal, so a crash leaves either the old or the new journal                       //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+class model_journal {
+  private:
+    static const unsigned int JOURNAL_VERSION = 2;
+    static const long long int CHECKPOINT_MIN_BYTES = 64*1024; // journals smaller than this are never compacted
+
+    std::string _filename;      // the journal's file name
+    std::string _model_filename;
+    long long int _base_size, _base_modified; // the model file as it was attached (the records edit it)
+    bool _stale;                // the last recover() moved the journal aside
+    std::string _pending;       // records queued since the last flush()
+    long long int _bytes;       // size of the journal file
+    bool _need_checkpoint;
+
+    std::string _header() const;
+    void _begin_record(unsigned char type);
+    static bool _read_header(const std::string& data, size_t& records, long long int& base_size, long long int& base_modified);
+    bool _write_checkpoint(const model3d& model);
+
+  public:
+    static const char* const JOURNAL_SUFFIX;
+    static std::string JOURNAL_HEADER() { return "journal="; }
+
+    model_journal();
+
+    void attach(const std::string& model_filename);
+    std::string filename() const;
+    bool exists() const; // true if there's a journal (or an interrupted compaction of one) to recover
+
+    void add_vertex(const vect3f& point, const vect3f& color);
+    void edit_coord(int coord_id, const vect3f& point);
+    void set_vertex_color(const int* const vertex_id, const vect3f& color);
+    void remove_vertex(const int* const vertex_id);
+    void push_face();
+    void pop_face();
+    void translate(const vect3f& offset);
+    void mirror(int axis);
+    void clear();
+    void invalidate();
+
+    bool flush(const model3d& model);
+    bool recover(model3d& model, mesh_report* report=0, bool base_loaded=true);
+    bool stale() const;
+    void discard();
+
+    long long int pending_bytes() const;
+    long long int journal_bytes() const;
+
+    static int replay(const std::string& data, model3d& model);
+};
+
+#endif
@@ -0,0 +1,459 @@
+// File: lod.cpp
+// Written by Joshua Green
+
+#include "lod.h"
+#include "model3d.h"
+#include "vectXf.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+namespace {
+  const double BOUNDARY_WEIGHT = 100.0; // how strongly boundary points are held to the boundary (against the faces' planes)
+  const double FLIP_COSINE = 0.2;       // a collapse may turn a face by no more than acos(FLIP_COSINE)
+
+  double dot(const vect3f& a, const vect3f& b) { return (double)a.x*b.x + (double)a.y*b.y + (double)a.z*b.z; }
+
+  vect3f lerp(const vect3f& a, const vect3f& b, float t) { return a + (b-a)*t; }
+
+  // the summed squared distance to a set of planes, as a symmetric 4x4 matrix (its upper triangle)
+  struct quadric {
+    double m[10]; // xx xy xz xd yy yz yd zz zd dd
+
+    quadric() { for (int i=0;i<10;i++) m[i] = 0.0; }
+    quadric(double a, double b, double c, double d, double weight) { // the plane a*x + b*y + c*z + d = 0 (a unit normal)
+      m[0] = a*a*weight; m[1] = a*b*weight; m[2] = a*c*weight; m[3] = a*d*weight;
+      m[4] = b*b*weight; m[5] = b*c*weight; m[6] = b*d*weight;
+      m[7] = c*c*weight; m[8] = c*d*weight;
+      m[9] = d*d*weight;
+    }
+
+    void operator+=(const quadric& q) { for (int i=0;i<10;i++) m[i] += q.m[i]; }
+    quadric operator+(const quadric& q) const {
+      quadric sum(*this);
+      sum += q;
+      return sum;
+    }
+
+    double error(const vect3f& p) const {
+      double x = p.x, y = p.y, z = p.z;
+      double e = m[0]*x*x + 2*m[1]*x*y + 2*m[2]*x*z + 2*m[3]*x + m[4]*y*y + 2*m[5]*y*z + 2*m[6]*y + m[7]*z*z + 2*m[8]*z + m[9];
+      return max(e, 0.0);
+    }
+
+    // the point of least error, if the planes pin one down (false for flat or straight neighborhoods)
+    bool optimum(vect3f& p) const {
+      double det = m[0]*(m[4]*m[7] - m[5]*m[5]) - m[1]*(m[1]*m[7] - m[5]*m[2]) + m[2]*(m[1]*m[5] - m[4]*m[2]);
+      double scale = m[0]*m[4]*m[7];
+      if (fabs(det) <= 1e-10*max(fabs(scale), 1e-30) || fabs(det) < 1e-30) return false;
+      double bx = -m[3], by = -m[6], bz = -m[8];
+      // cramer's rule
+      double x = (bx*(m[4]*m[7] - m[5]*m[5]) - m[1]*(by*m[7] - m[5]*bz) + m[2]*(by*m[5] - m[4]*bz))/det;
+      double y = (m[0]*(by*m[7] - bz*m[5]) - bx*(m[1]*m[7] - m[5]*m[2]) + m[2]*(m[1]*bz - by*m[2]))/det;
+      double z = (m[0]*(m[4]*bz - m[5]*by) - m[1]*(m[1]*bz - by*m[2]) + bx*(m[1]*m[5] - m[4]*m[2]))/det;
+      p = vect3f(x, y, z);
+      return true;
+    }
+  };
+
+  // an indexed triangle mesh: one color and normal per point
+  struct lod_mesh {
+    vector<vect3f> points, colors, normals;
+    vector<int> triangles;        // 3 points per triangle
+    vector<unsigned char> locked; // points that mustn't move (shared with another cluster)
+    vector<int> origin;           // a cluster's points' indices in the mesh it was cut from (empty otherwise)
+
+    long long int triangle_count() const { return triangles.size()/3; }
+  };
+
+  unsigned long long int edge_key(int a, int b) {
+    if (a > b) swap(a, b);
+    return ((unsigned long long int)(unsigned int)a << 32) | (unsigned int)b;
+  }
+
+  class qem_simplifier {
+    private:
+      struct candidate {
+        double cost;
+        int keep, remove;       // remove collapses into keep, which moves to position
+        int keep_version, remove_version;
+        vect3f position;
+        float t;                // position's place along the edge (0 at keep, 1 at remove), for the attributes
+
+        bool operator<(const candidate& other) const { return cost > other.cost; } // (priority_queue is a max heap)
+      };
+
+      lod_mesh& _mesh;
+      vector<quadric> _quadrics;
+      vector<vector<int>> _point_triangles; // triangles around each point (removed ones are skipped, then pruned)
+      vector<unsigned char> _removed;       // per triangle
+      vector<int> _versions;                // per point, bumped as it changes (a queued edge is stale once either end has changed)
+      priority_queue<candidate> _queue;
+      long long int _live;
+
+      vect3f _normal(int triangle, int moved=-1, const vect3f& position=vect3f()) const {
+        const int* const t = &_mesh.triangles[triangle*3];
+        vect3f p[3];
+        for (int i=0;i<3;i++) p[i] = (t[i] == moved ? position : _mesh.points[t[i]]);
+        return (p[1]-p[0]).cross(p[2]-p[0]);
+      }
+
+      bool _queue_edge(int a, int b) {
+        if (a == b || (_mesh.locked[a] && _mesh.locked[b])) return false;
+        if (_mesh.locked[b]) swap(a, b);
+
+        candidate c;
+        c.keep = a;
+        c.remove = b;
+        c.keep_version = _versions[a];
+        c.remove_version = _versions[b];
+        const vect3f& pa = _mesh.points[a];
+        const vect3f& pb = _mesh.points[b];
+        quadric q = _quadrics[a] + _quadrics[b];
+
+        if (_mesh.locked[a]) c.position = pa;
+        else {
+          // the optimum, unless it's well off the edge (a nearly singular neighborhood); otherwise the best of the ends and middle
+          vect3f edge = pb-pa, optimum;
+          double length = dot(edge, edge);
+          bool found = q.optimum(optimum);
+          if (found) {
+            vect3f offset = optimum - (pa+pb)*0.5f;
+            found = (dot(offset, offset) <= 4.0*length);
+          }
+          if (found) c.position = optimum;
+          else {
+            vect3f choices[3] = { pa, pb, (pa+pb)*0.5f };
+            c.position = pa;
+            for (int i=1;i<3;i++) if (q.error(choices[i]) < q.error(c.position)) c.position = choices[i];
+          }
+        }
+        c.cost = q.error(c.position);
+
+        vect3f edge = pb-pa;
+        double length = dot(edge, edge);
+        c.t = (length > 0.0 ? (float)min(1.0, max(0.0, dot(c.position-pa, edge)/length)) : 0.0f);
+        _queue.push(c);
+        return true;
+      }
+
+      // false if moving keep and remove to position would turn one of the faces around them over (or flatten it)
+      bool _valid(const candidate& c) const {
+        for (int k=0;k<2;k++) {
+          int point = (k == 0 ? c.keep : c.remove);
+          const vector<int>& around = _point_triangles[point];
+          for (int i=0;i<around.size();i++) {
+            int triangle = around[i];
+            if (_removed[triangle]) continue;
+            const int* const t = &_mesh.triangles[triangle*3];
+            bool shared = (t[0] == c.keep || t[1] == c.keep || t[2] == c.keep) && (t[0] == c.remove || t[1] == c.remove || t[2] == c.remove);
+            if (shared) continue; // collapses away
+            vect3f before = _normal(triangle), after = _normal(triangle, point, c.position);
+            double before_length = sqrt(dot(before, before)), after_length = sqrt(dot(after, after));
+            if (after_length <= 0.0) return false;
+            if (before_length > 0.0 && dot(before, after) < FLIP_COSINE*before_length*after_length) return false;
+          }
+        }
+        return true;
+      }
+
+      void _collapse(const candidate& c) {
+        int keep = c.keep, remove = c.remove;
+        _mesh.points[keep] = c.position;
+        _mesh.colors[keep] = lerp(_mesh.colors[keep], _mesh.colors[remove], c.t);
+        vect3f normal = lerp(_mesh.normals[keep], _mesh.normals[remove], c.t);
+        if (dot(normal, normal) > 0.0) {
+          normal.normalize();
+          _mesh.normals[keep] = normal;
+        }
+        _quadrics[keep] += _quadrics[remove];
+
+        vector<int>& around = _point_triangles[remove];
+        for (int i=0;i<around.size();i++) {
+          int triangle = around[i];
+          if (_removed[triangle]) continue;
+          int* const t = &_mesh.triangles[triangle*3];
+          if (t[0] == keep || t[1] == keep || t[2] == keep) {
+            _removed[triangle] = 1;
+            _live--;
+            continue;
+          }
+          for (int j=0;j<3;j++) if (t[j] == remove) t[j] = keep;
+          _point_triangles[keep].push_back(triangle);
+        }
+        vector<int>().swap(around);
+        _versions[remove] = -1;
+        _versions[keep]++;
+
+        // prune keep's list, and requeue its edges against its new quadric
+        vector<int>& kept = _point_triangles[keep];
+        int live = 0;
+        for (int i=0;i<kept.size();i++) if (!_removed[kept[i]]) kept[live++] = kept[i];
+        kept.resize(live);
+        vector<int> neighbors;
+        for (int i=0;i<kept.size();i++) {
+          const int* const t = &_mesh.triangles[kept[i]*3];
+          for (int j=0;j<3;j++) if (t[j] != keep) neighbors.push_back(t[j]);
+        }
+        sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        for (int i=0;i<neighbors.size();i++) _queue_edge(keep, neighbors[i]);
+      }
+
+    public:
+      explicit qem_simplifier(lod_mesh& mesh) : _mesh(mesh), _live(mesh.triangle_count()) {
+        int point_count = _mesh.points.size();
+        _quadrics.assign(point_count, quadric());
+        _point_triangles.assign(point_count, vector<int>());
+        _removed.assign(_live, 0);
+        _versions.assign(point_count, 0);
+        if (_mesh.locked.size() != point_count) _mesh.locked.assign(point_count, 0);
+
+        // each face's plane, weighted by its area; each edge's uses (an edge used once is on the boundary)
+        unordered_map<unsigned long long int, pair<int, int>> edges; // key -> (uses, a triangle using it)
+        edges.reserve(_live*2);
+        for (int i=0;i<_live;i++) {
+          const int* const t = &_mesh.triangles[i*3];
+          vect3f normal = _normal(i);
+          double length = sqrt(dot(normal, normal));
+          if (length > 0.0) {
+            vect3f unit = normal/length;
+            quadric plane(unit.x, unit.y, unit.z, -dot(unit, _mesh.points[t[0]]), length*0.5);
+            for (int j=0;j<3;j++) _quadrics[t[j]] += plane;
+          }
+          for (int j=0;j<3;j++) {
+            _point_triangles[t[j]].push_back(i);
+            pair<int, int>& edge = edges[edge_key(t[j], t[(j+1)%3])];
+            if (edge.first++ == 0) edge.second = i;
+          }
+        }
+
+        for (unordered_map<unsigned long long int, pair<int, int>>::const_iterator i=edges.begin();i!=edges.end();i++) {
+          int a = (int)(i->first >> 32), b = (int)(i->first & 0xffffffffu);
+          if (i->second.first == 1) { // a plane through the boundary edge, perpendicular to its face
+            vect3f edge = _mesh.points[b] - _mesh.points[a];
+            vect3f normal = edge.cross(_normal(i->second.second));
+            double length = sqrt(dot(normal, normal));
+            if (length > 0.0) {
+              vect3f unit = normal/length;
+              quadric plane(unit.x, unit.y, unit.z, -dot(unit, _mesh.points[a]), BOUNDARY_WEIGHT*dot(edge, edge));
+              _quadrics[a] += plane;
+              _quadrics[b] += plane;
+            }
+          }
+          _queue_edge(a, b);
+        }
+      }
+
+      void run(long long int target) {
+        while (_live > target && !_queue.empty()) {
+          candidate c = _queue.top();
+          _queue.pop();
+          if (_versions[c.keep] != c.keep_version || _versions[c.remove] != c.remove_version) continue; // stale
+          if (!_valid(c)) continue;
+          _collapse(c);
+        }
+
+        // drop the removed triangles and any point they leave unused
+        vector<int> remap(_mesh.points.size(), -1);
+        lod_mesh result;
+        for (int i=0;i<_removed.size();i++) {
+          if (_removed[i]) continue;
+          for (int j=0;j<3;j++) {
+            int point = _mesh.triangles[i*3+j];
+            if (remap[point] < 0) {
+              remap[point] = result.points.size();
+              result.points.push_back(_mesh.points[point]);
+              result.colors.push_back(_mesh.colors[point]);
+              result.normals.push_back(_mesh.normals[point]);
+              result.locked.push_back(_mesh.locked[point]);
+              if (!_mesh.origin.empty()) result.origin.push_back(_mesh.origin[point]);
+            }
+            result.triangles.push_back(remap[point]);
+          }
+        }
+        _mesh = result;
+      }
+  };
+
+  lod_mesh triangulate(const model3d& model) {
+    lod_mesh mesh;
+    if (model.is_compact() || model.is_paged()) {
+      model3d expanded(model);
+      expanded.expand();
+      return triangulate(expanded);
+    }
+    const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+    const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+    const attribute_table& colors = *model.get_colors_ptr();
+    const attribute_table& normals = *model.get_normals_ptr();
+
+    mesh.points = coordinates;
+    mesh.colors.assign(coordinates.size(), DEFAULT_COLOR);
+    mesh.normals.assign(coordinates.size(), vect3f(0.0f, 0.0f, 1.0f));
+    mesh.locked.assign(coordinates.size(), 0);
+    vector<unsigned char> seen(coordinates.size(), 0);
+    for (int i=0;i<faces.size();i++) {
+      for (int j=0;j<faces[i].size();j++) {
+        const facet& f = faces[i][j];
+        if (seen[f.id]) continue;
+        seen[f.id] = 1;
+        if (f.color < colors.size()) mesh.colors[f.id] = colors[f.color];
+        if (f.normal < normals.size()) mesh.normals[f.id] = normals[f.normal];
+      }
+      for (int j=2;j<faces[i].size();j++) {
+        int a = faces[i][0].id, b = faces[i][j-1].id, c = faces[i][j].id;
+        if (a == b || b == c || a == c) continue;
+        mesh.triangles.push_back(faces[i][0].id);
+        mesh.triangles.push_back(faces[i][j-1].id);
+        mesh.triangles.push_back(faces[i][j].id);
+      }
+    }
+    return mesh;
+  }
+
+  model3d to_model(const lod_mesh& mesh) {
+    vector<vector<facet>> faces(mesh.triangle_count(), vector<facet>(3));
+    for (long long int i=0;i<faces.size();i++) {
+      for (int j=0;j<3;j++) {
+        int point = mesh.triangles[i*3+j];
+        faces[i][j] = facet(point, point, point);
+      }
+    }
+    vector<vect3f> points(mesh.points), colors(mesh.colors), normals(mesh.normals);
+    return model3d(std::move(points), std::move(colors), std::move(normals), std::move(faces));
+  }
+
+  // splits mesh into a grid of clusters (by triangle centroid), simplifies them concurrently with their shared points locked,
+  //   and stitches the results back into mesh
+  void simplify_clusters(lod_mesh& mesh, long long int target, const lod_params& params) {
+    long long int triangles = mesh.triangle_count();
+    int per_axis = max(1, (int)ceil(cbrt((double)triangles/params.cluster_faces)));
+    int cluster_count = per_axis*per_axis*per_axis;
+    TRACE_SPAN(cluster_span, "simplify clusters");
+    TRACE_ARG(cluster_span, "clusters", cluster_count);
+
+    vect3f low = mesh.points[0], high = mesh.points[0];
+    for (int i=1;i<mesh.points.size();i++) {
+      const vect3f& p = mesh.points[i];
+      low = vect3f(min(low.x, p.x), min(low.y, p.y), min(low.z, p.z));
+      high = vect3f(max(high.x, p.x), max(high.y, p.y), max(high.z, p.z));
+    }
+    vect3f extent = high-low;
+
+    vector<int> cluster_of(triangles);
+    vector<vector<int>> members(cluster_count);
+    for (long long int i=0;i<triangles;i++) {
+      vect3f centroid = (mesh.points[mesh.triangles[i*3]] + mesh.points[mesh.triangles[i*3+1]] + mesh.points[mesh.triangles[i*3+2]])/3.0f;
+      int cell[3];
+      float position[3] = { centroid.x-low.x, centroid.y-low.y, centroid.z-low.z }, size[3] = { extent.x, extent.y, extent.z };
+      for (int k=0;k<3;k++) cell[k] = (size[k] > 0.0f ? min(per_axis-1, max(0, (int)(position[k]/size[k]*per_axis))) : 0);
+      cluster_of[i] = (cell[0]*per_axis + cell[1])*per_axis + cell[2];
+      members[cluster_of[i]].push_back(i);
+    }
+
+    // a point used by two clusters is locked in both
+    vector<int> owner(mesh.points.size(), -1);
+    vector<unsigned char> shared(mesh.points.size(), 0);
+    for (long long int i=0;i<triangles;i++) {
+      for (int j=0;j<3;j++) {
+        int point = mesh.triangles[i*3+j];
+        if (owner[point] < 0) owner[point] = cluster_of[i];
+        else if (owner[point] != cluster_of[i]) shared[point] = 1;
+      }
+    }
+
+    vector<lod_mesh> results(cluster_count);
+    double keep = (double)target/triangles;
+    parallel_for(0, cluster_count, 1, [&](long long int begin, long long int end) {
+      for (long long int c=begin;c<end;c++) {
+        if (members[c].empty()) continue;
+        lod_mesh& local = results[c];
+        unordered_map<int, int> remap;
+        for (int i=0;i<members[c].size();i++) {
+          for (int j=0;j<3;j++) {
+            int point = mesh.triangles[members[c][i]*3+j];
+            unordered_map<int, int>::iterator found = remap.find(point);
+            if (found == remap.end()) {
+              found = remap.insert(make_pair(point, (int)local.points.size())).first;
+              local.points.push_back(mesh.points[point]);
+              local.colors.push_back(mesh.colors[point]);
+              local.normals.push_back(mesh.normals[point]);
+              local.locked.push_back(shared[point] || mesh.locked[point]);
+              local.origin.push_back(point);
+            }
+            local.triangles.push_back(found->second);
+          }
+        }
+        qem_simplifier simplifier(local);
+        simplifier.run((long long int)(members[c].size()*keep));
+      }
+    }, params.threads);
+
+    // stitch: locked points go back to their own index (each is shared, and unmoved, between clusters); the points each cluster
+    //   kept of its own are appended
+    lod_mesh stitched;
+    stitched.points = mesh.points;
+    stitched.colors = mesh.colors;
+    stitched.normals = mesh.normals;
+    for (int c=0;c<cluster_count;c++) {
+      const lod_mesh& local = results[c];
+      vector<int> index(local.points.size());
+      for (int i=0;i<local.points.size();i++) {
+        if (local.locked[i]) index[i] = local.origin[i];
+        else {
+          index[i] = stitched.points.size();
+          stitched.points.push_back(local.points[i]);
+          stitched.colors.push_back(local.colors[i]);
+          stitched.normals.push_back(local.normals[i]);
+        }
+      }
+      for (int i=0;i<local.triangles.size();i++) stitched.triangles.push_back(index[local.triangles[i]]);
+    }
+    stitched.locked.assign(stitched.points.size(), 0);
+    for (int i=0;i<mesh.points.size();i++) stitched.locked[i] = mesh.locked[i];
+    mesh = stitched;
+  }
+
+  void simplify_mesh(lod_mesh& mesh, long long int target, const lod_params& params) {
+    if (mesh.triangle_count() > params.cluster_faces && params.cluster_faces > 0 && (params.threads != 1)) {
+      simplify_clusters(mesh, target, params);
+    }
+    qem_simplifier simplifier(mesh); // (after clustering, finishes off the seams; run() also drops unused points)
+    simplifier.run(target);
+  }
+}
+
+model3d simplify(const model3d& model, long long int target_faces, const lod_params& params) {
+  TRACE_SPAN(simplify_span, "simplify");
+  lod_mesh mesh = triangulate(model);
+  TRACE_ARG(simplify_span, "triangles", mesh.triangle_count());
+  if (mesh.triangle_count() > target_faces) simplify_mesh(mesh, max(target_faces, 1LL), params);
+  TRACE_ARG(simplify_span, "result", mesh.triangle_count());
+  return to_model(mesh);
+}
+
+vector<model3d> build_lods(const model3d& model, const lod_params& params) {
+  TRACE_SPAN(lod_span, "build_lods");
+  vector<model3d> levels;
+  lod_mesh mesh = triangulate(model);
+  long long int faces = mesh.triangle_count();
+  TRACE_ARG(lod_span, "triangles", faces);
+
+  for (int i=0;i<params.levels;i++) {
+    long long int target = (long long int)(faces*params.ratio);
+    if (target < params.min_faces) break;
+    simplify_mesh(mesh, target, params);
+    if (mesh.triangle_count() >= faces) break; // nothing more would collapse
+    faces = mesh.triangle_count();
+    levels.push_back(to_model(mesh));
+  }
+  TRACE_ARG(lod_span, "levels", (long long int)levels.size());
+  return levels;
+}
@@ -0,0 +1,42 @@
+// File: lod.h
+// Written by Joshua Green
+
+#ifndef LOD_H
+#define LOD_H
+
+#include "model3d.h"
+#include <vector>
+
+// ------------------------------------------------------------ LEVELS OF DETAIL ------------------------------------------------------------ //
+//   + simplify(model, target_faces, params)                                                                                                  //
+//       - returns model reduced to about target_faces triangles by quadric error edge collapses (garland & heckbert)                         //
+//       - each collapse moves the kept point to where the summed squared distance to the planes of the faces around both points is least;    //
+//         colors and normals are interpolated along the collapsed edge, so the model's coloring and shading carry over                       //
+//       - points on the mesh's open boundary are held to it by planes perpendicular to the boundary, and a collapse that would turn a        //
+//         face over is refused                                                                                                               //
+//   + build_lods(model, params)                                                                                                              //
+//       - the chain of levels for model3d::set_lods(): each level is simplified from the one before it, to params.ratio of its faces,        //
+//         until params.levels are built or a level would have fewer than params.min_faces faces                                              //
+//       - a slow call: the modeler runs it on a background thread against a copy of the model                                                //
+//   + NOTES:                                                                                                                                 //
+//       - faces are triangulated (as fans) first, so the levels are triangles; a point takes the color and normal of the first facet         //
+//         using it (color seams between faces sharing a point aren't kept)                                                                   //
+//       - meshes of more than params.cluster_faces triangles are split into a grid of spatial clusters that are simplified concurrently      //
+//         (with the points shared between clusters locked in place); a serial pass over the stitched mesh then finishes the job,             //
+//         collapsing the seams the clusters had to leave                                                                                     //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+struct lod_params {
+  float ratio;                 // faces kept per level
+  int levels;                  // at most
+  long long int min_faces;     // the coarsest level allowed
+  long long int cluster_faces; // meshes larger than this are simplified in parallel clusters of about this many triangles
+  int threads;                 // zero uses every hardware thread
+
+  lod_params() : ratio(0.25f), levels(4), min_faces(64), cluster_faces(65536), threads(0) { }
+};
+
+model3d simplify(const model3d& model, long long int target_faces, const lod_params& params=lod_params());
+std::vector<model3d> build_lods(const model3d& model, const lod_params& params=lod_params());
+
+#endif
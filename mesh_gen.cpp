@@ -0,0 +1,244 @@
+// File: mesh_gen.cpp
+// Written by Joshua Green
+
+#include "mesh_gen.h"
+#include "model3d.h"
+#include "vectXf.h"
+#include "parallel.h"
+#include "trace.h"
+#include <vector>
+#include <string>
+#include <cmath>
+using namespace std;
+
+namespace {
+  const float PI = 3.14159265f;
+  const long long int CHUNK_SIZE = 16384; // elements per parallel work item
+
+  // stateless hash so any element can be generated independently of the others (splitmix64 finalizer)
+  unsigned long long int hash64(unsigned long long int a, unsigned long long int b) {
+    unsigned long long int z = a*0x9E3779B97F4A7C15ull + b + 0x632BE59BD9B4E019ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  // uniform float in [0, 1)
+  float hash_float(unsigned long long int a, unsigned long long int b) { return (hash64(a, b) >> 40)/16777216.0f; }
+
+  long long int at_least(long long int value, long long int minimum) { return (value < minimum ? minimum : value); }
+
+  // smoothly interpolated lattice noise
+  float value_noise(unsigned int seed, float x, float z) {
+    int xi = (int)floor(x), zi = (int)floor(z);
+    float xf = x-xi, zf = z-zi;
+    xf = xf*xf*(3.0f-2.0f*xf);
+    zf = zf*zf*(3.0f-2.0f*zf);
+
+    float c[4];
+    for (int i=0;i<4;i++) {
+      unsigned long long int lattice = ((unsigned long long int)(unsigned int)(xi+(i&1)) << 32) | (unsigned int)(zi+(i>>1));
+      c[i] = hash_float(seed, lattice);
+    }
+    float bottom = c[0] + (c[1]-c[0])*xf;
+    float top = c[2] + (c[3]-c[2])*xf;
+    return bottom + (top-bottom)*zf;
+  }
+
+  float terrain_height(unsigned int seed, float x, float z) {
+    float height = 0.0f, amplitude = 0.25f, frequency = 2.0f;
+    for (int octave=0;octave<5;octave++) {
+      height += (value_noise(seed+octave, x*frequency, z*frequency)-0.5f)*amplitude;
+      amplitude *= 0.5f;
+      frequency *= 2.0f;
+    }
+    return height;
+  }
+
+  // water, grass, dirt, snow
+  const vect3f TERRAIN_COLORS[4] = { vect3f(0.1f, 0.3f, 0.7f), vect3f(0.2f, 0.6f, 0.2f), vect3f(0.5f, 0.4f, 0.25f), vect3f(0.95f, 0.95f, 0.95f) };
+
+  // index into TERRAIN_COLORS
+  int terrain_color(float height) {
+    if (height < -0.05f) return 0;
+    if (height < 0.08f) return 1;
+    if (height < 0.18f) return 2;
+    return 3;
+  }
+
+  // smooth shading: the normals are per coordinate, so each corner's normal index is its coordinate id
+  void fill_face(vector<facet>& face, const int* ids, int count, int color) {
+    face.resize(count);
+    for (int i=0;i<count;i++) face[i] = facet(ids[i], color, ids[i]);
+  }
+
+  // finishes the model the way add_vertex()/push_face() would leave it (an empty current face at the end)
+  model3d build(vector<vect3f>& coordinates, vector<vect3f>& colors, vector<vect3f>& normals, vector<vector<facet>>& faces) {
+    faces.push_back(vector<facet>());
+    return model3d(std::move(coordinates), std::move(colors), std::move(normals), std::move(faces));
+  }
+}
+
+model3d generate_sphere(const mesh_params& params) {
+  TRACE_SPAN(span, "generate_sphere");
+
+  // rings*segments faces with segments = 2*rings
+  long long int rings = at_least((long long int)(sqrt(params.faces/2.0)+0.5), 2);
+  long long int segments = rings*2;
+  long long int coordinate_count = 2 + (rings-1)*segments;
+  long long int north = 0, south = coordinate_count-1;
+
+  vector<vect3f> coordinates(coordinate_count), normals(coordinate_count);
+  parallel_for(0, coordinate_count, CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      if (i == north) coordinates[i] = vect3f(0.0f, 1.0f, 0.0f);
+      else if (i == south) coordinates[i] = vect3f(0.0f, -1.0f, 0.0f);
+      else {
+        long long int ring = (i-1)/segments + 1, segment = (i-1)%segments;
+        float theta = PI*ring/rings, phi = 2.0f*PI*segment/segments;
+        coordinates[i] = vect3f(sin(theta)*cos(phi), cos(theta), sin(theta)*sin(phi));
+      }
+      normals[i] = coordinates[i];
+    }
+  }, params.threads);
+
+  vector<vector<facet>> faces(rings*segments);
+  vector<vect3f> colors(faces.size()); // one per face
+  parallel_for(0, faces.size(), CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int f=begin;f<end;f++) {
+      long long int band = f/segments, segment = f%segments, next = (segment+1)%segments;
+      // ring vertex id; ring 0 is the north pole and ring 'rings' is the south pole
+      auto id = [&](long long int ring, long long int s) -> int {
+        if (ring == 0) return north;
+        if (ring == rings) return south;
+        return 1 + (ring-1)*segments + s;
+      };
+
+      int ids[4] = { id(band, segment), id(band, next), id(band+1, next), id(band+1, segment) };
+      colors[f] = vect3f(0.5f+0.5f*normals[ids[2]].x, 0.5f+0.5f*normals[ids[2]].y, 0.5f+0.5f*normals[ids[2]].z);
+      if (band == 0) fill_face(faces[f], ids+1, 3, f);
+      else if (band == rings-1) fill_face(faces[f], ids, 3, f);
+      else fill_face(faces[f], ids, 4, f);
+    }
+  }, params.threads);
+
+  TRACE_ARG(span, "faces", faces.size());
+  return build(coordinates, colors, normals, faces);
+}
+
+model3d generate_torus(const mesh_params& params) {
+  TRACE_SPAN(span, "generate_torus");
+
+  const float major = 1.0f, minor = 0.35f;
+  long long int tube = at_least((long long int)(sqrt(params.faces/2.0)+0.5), 3); // segments around the tube
+  long long int around = tube*2;                                                // segments around the ring
+
+  vector<vect3f> coordinates(around*tube), normals(around*tube);
+  parallel_for(0, coordinates.size(), CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      float u = 2.0f*PI*(i/tube)/around, v = 2.0f*PI*(i%tube)/tube;
+      coordinates[i] = vect3f((major+minor*cos(v))*cos(u), minor*sin(v), (major+minor*cos(v))*sin(u));
+      normals[i] = vect3f(cos(v)*cos(u), sin(v), cos(v)*sin(u));
+    }
+  }, params.threads);
+
+  vector<vector<facet>> faces(around*tube);
+  vector<vect3f> colors(faces.size()); // one per face
+  parallel_for(0, faces.size(), CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int f=begin;f<end;f++) {
+      long long int u = f/tube, v = f%tube;
+      long long int u_next = (u+1)%around, v_next = (v+1)%tube;
+      int ids[4] = { (int)(u*tube+v), (int)(u*tube+v_next), (int)(u_next*tube+v_next), (int)(u_next*tube+v) };
+      colors[f] = vect3f(0.3f+0.4f*(float)u/around, 0.3f, 0.7f-0.4f*(float)v/tube);
+      fill_face(faces[f], ids, 4, f);
+    }
+  }, params.threads);
+
+  TRACE_ARG(span, "faces", faces.size());
+  return build(coordinates, colors, normals, faces);
+}
+
+model3d generate_terrain(const mesh_params& params) {
+  TRACE_SPAN(span, "generate_terrain");
+
+  long long int n = at_least((long long int)(sqrt((double)params.faces)+0.5), 1);
+  long long int row = n+1;
+  float step = 2.0f/n;
+
+  vector<vect3f> coordinates(row*row), normals(row*row);
+  parallel_for(0, coordinates.size(), CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      float x = -1.0f + step*(i/row), z = -1.0f + step*(i%row);
+      coordinates[i] = vect3f(x, terrain_height(params.seed, x, z), z);
+
+      // central difference normal
+      float dx = terrain_height(params.seed, x+step, z) - terrain_height(params.seed, x-step, z);
+      float dz = terrain_height(params.seed, x, z+step) - terrain_height(params.seed, x, z-step);
+      normals[i] = vect3f(-dx, 2.0f*step, -dz);
+      normals[i].normalize();
+    }
+  }, params.threads);
+
+  vector<vector<facet>> faces(n*n);
+  parallel_for(0, faces.size(), CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int f=begin;f<end;f++) {
+      long long int i = f/n, j = f%n;
+      int ids[4] = { (int)(i*row+j), (int)(i*row+j+1), (int)((i+1)*row+j+1), (int)((i+1)*row+j) };
+      fill_face(faces[f], ids, 4, terrain_color(coordinates[ids[0]].y));
+    }
+  }, params.threads);
+  vector<vect3f> colors(TERRAIN_COLORS, TERRAIN_COLORS+4);
+
+  TRACE_ARG(span, "faces", faces.size());
+  return build(coordinates, colors, normals, faces);
+}
+
+model3d generate_soup(const mesh_params& params) {
+  TRACE_SPAN(span, "generate_soup");
+
+  long long int face_count = at_least(params.faces, 1);
+  int valence = (params.valence < 3 ? 3 : params.valence);
+  float sharing = params.sharing;
+  if (sharing < 0.0f) sharing = 0.0f;
+  if (sharing > 0.999f) sharing = 0.999f;
+
+  long long int corner_count = face_count*valence;
+  long long int coordinate_count = at_least((long long int)(corner_count*(1.0f-sharing)+0.5f), valence);
+
+  vector<vect3f> coordinates(coordinate_count);
+  parallel_for(0, coordinate_count, CHUNK_SIZE, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      coordinates[i] = vect3f(hash_float(params.seed, 3*i), hash_float(params.seed, 3*i+1), hash_float(params.seed, 3*i+2));
+    }
+  }, params.threads);
+
+  vector<vector<facet>> faces(face_count);
+  vector<vect3f> colors(face_count), normals(face_count); // flat shaded: one color and one normal per face
+  parallel_for(0, face_count, CHUNK_SIZE, [&](long long int begin, long long int end) {
+    vector<int> ids(valence);
+    for (long long int f=begin;f<end;f++) {
+      // corner c of face f maps to slot c*face_count+f, spread evenly over the coordinates; the per-face rotation
+      // keeps the pattern irregular while leaving the corners of a face distinct
+      long long int rotation = hash64(params.seed^0x5A5A5A5Au, f) % coordinate_count;
+      for (int c=0;c<valence;c++) ids[c] = (int)(((c*face_count+f)*coordinate_count/corner_count + rotation) % coordinate_count);
+
+      normals[f] = (coordinates[ids[1]]-coordinates[ids[0]]).cross(coordinates[ids[2]]-coordinates[ids[1]]);
+      normals[f].normalize();
+      colors[f] = vect3f(hash_float(params.seed+1, f), hash_float(params.seed+2, f), hash_float(params.seed+3, f));
+
+      faces[f].resize(valence);
+      for (int c=0;c<valence;c++) faces[f][c] = facet(ids[c], f, f);
+    }
+  }, params.threads);
+
+  TRACE_ARG(span, "faces", faces.size());
+  return build(coordinates, colors, normals, faces);
+}
+
+model3d generate_mesh(const string& shape, const mesh_params& params) {
+  if (shape == "sphere") return generate_sphere(params);
+  if (shape == "torus") return generate_torus(params);
+  if (shape == "terrain") return generate_terrain(params);
+  if (shape == "soup") return generate_soup(params);
+  return model3d();
+}
@@ -0,0 +1,44 @@
+// File: mesh_gen.h
+// Written by Joshua Green
+
+#ifndef MESH_GEN_H
+#define MESH_GEN_H
+
+#include "model3d.h"
+#include <string>
+
+// ------------------------------------------------------------ MESH GENERATION ------------------------------------------------------------ //
+//   + generate_sphere(params)                                                                                                                //
+//       - latitude/longitude subdivided unit sphere (triangle caps, quad bands), smooth normals                                              //
+//   + generate_torus(params)                                                                                                                 //
+//       - quad torus (major radius 1.0, minor radius 0.35), smooth normals                                                                   //
+//   + generate_terrain(params)                                                                                                               //
+//       - square quad grid over [-1, 1] displaced by seeded value noise, colored by height                                                   //
+//   + generate_soup(params)                                                                                                                  //
+//       - random polygons of params.valence corners within the unit cube                                                                     //
+//       - each coordinate is shared by 1/(1-params.sharing) facets on average                                                                //
+//   + generate_mesh(shape, params)                                                                                                           //
+//       - calls the generator named shape ("sphere", "torus", "terrain" or "soup"); returns an empty model for an unknown shape              //
+//   + NOTES:                                                                                                                                 //
+//       - params.faces is a target; the parametric shapes round it to their nearest grid                                                     //
+//       - output depends only on the params (not on params.threads), so a (shape, faces, seed) triple always produces the same model        //
+//       - the models are built directly into coordinate/color/normal/facet arrays in parallel, bypassing add_vertex()'s searches         //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+struct mesh_params {
+  long long int faces;
+  unsigned int seed;
+  float sharing; // soup only: 0.0 (no shared coordinates) to just under 1.0
+  int valence;   // soup only: corners per face (at least 3)
+  int threads;   // zero uses every hardware thread
+
+  mesh_params() : faces(1000), seed(1), sharing(0.5f), valence(3), threads(0) { }
+};
+
+model3d generate_sphere(const mesh_params& params);
+model3d generate_torus(const mesh_params& params);
+model3d generate_terrain(const mesh_params& params);
+model3d generate_soup(const mesh_params& params);
+model3d generate_mesh(const std::string& shape, const mesh_params& params);
+
+#endif
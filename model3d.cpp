@@ -3,23 +3,177 @@
 
 #include "model3d.h"
 #include "vectXf.h"
+#include "paged.h"
+#include "vertex_cache.h"
+#include "selection.h"
+#include "validate.h"
+#include "trace.h"
 #include "fileio/fileio.h"
 #include "str/str.h"
 #include <vector>
 #include <string>
+#include <memory>
+#include <functional>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 
 #include <GL/gl.h>
-#include <GL/glut.h>
-#include <GL/glu.h>
 
 #include <iostream>
 using namespace std;
 
+// binary format helpers (values are stored in the machine's native (little endian) byte order)
+namespace {
+  template <typename T> void put(string& data, T value) { data.append((const char*)&value, sizeof(T)); }
+
+  class binary_reader {
+    private:
+      const string& _data;
+      size_t _pos;
+      bool _ok;
+    public:
+      binary_reader(const string& data, size_t pos) : _data(data), _pos(pos), _ok(true) { }
+      bool ok() const { return _ok; }
+      size_t remaining() const { return _data.length() - _pos; }
+      string get_bytes(size_t length) {
+        if (length > remaining()) {
+          _ok = false;
+          return string();
+        }
+        _pos += length;
+        return _data.substr(_pos-length, length);
+      }
+      template <typename T> T get() {
+        T value = T();
+        if (_pos+sizeof(T) > _data.length()) _ok = false;
+        else {
+          memcpy(&value, _data.data()+_pos, sizeof(T));
+          _pos += sizeof(T);
+        }
+        return value;
+      }
+      vect3f get_vect3f() {
+        float x = get<float>(), y = get<float>(), z = get<float>();
+        return vect3f(x, y, z);
+      }
+  };
+}
+
+// text format helpers
+namespace {
+  const vect3f DEFAULT_NORMAL(0.0f, 0.0f, 1.0f);
+
+  // "(x, y, z)(x, y, z)..." as written by vect3f::to_string()
+  void parse_points(const string& data, vector<vect3f>& points) {
+    vector<string> point_strings(explode(data, ")", -1));
+    points.reserve(points.size() + point_strings.size());
+    for (int i=0;i<point_strings.size();i++) {
+      point_strings[i].erase(point_strings[i].begin()); // remove the '('
+      vector<string> coordinate_strings(explode(point_strings[i], ",", -1));
+      points.push_back(vect3f(atof(coordinate_strings[0].c_str()), atof(coordinate_strings[1].c_str()), atof(coordinate_strings[2].c_str()))); // create and insert point
+    }
+  }
+}
+
+// compact storage codecs
+namespace {
+  const float QUANTIZE_MAX = 65535.0f;
+
+  unsigned short quantize(float value, float origin, float step) {
+    if (!(step > 0.0f)) return 0;
+    float q = (value-origin)/step + 0.5f;
+    if (!(q > 0.0f)) return 0;
+    if (q >= QUANTIZE_MAX) return 65535;
+    return (unsigned short)q;
+  }
+
+  // [-1, 1] <-> [0, 65535]
+  unsigned short quantize_snorm(float value) {
+    if (value < -1.0f) value = -1.0f;
+    if (value > 1.0f) value = 1.0f;
+    return (unsigned short)((value*0.5f + 0.5f)*QUANTIZE_MAX + 0.5f);
+  }
+  float dequantize_snorm(unsigned short value) { return value/QUANTIZE_MAX*2.0f - 1.0f; }
+
+  float sign_not_zero(float value) { return (value < 0.0f ? -1.0f : 1.0f); }
+
+  // projects the unit normal onto an octahedron and unfolds the octahedron's lower half over the corners of the upper half
+  void encode_normal(const vect3f& normal, unsigned short* encoded) {
+    float length = fabs(normal.x) + fabs(normal.y) + fabs(normal.z);
+    float x = 0.0f, y = 0.0f; // zero (or undefined) normals are stored as (0, 0, 1)
+    if (length > 0.0f) {
+      x = normal.x/length;
+      y = normal.y/length;
+      if (normal.z < 0.0f) {
+        float folded_x = (1.0f-fabs(y))*sign_not_zero(x);
+        y = (1.0f-fabs(x))*sign_not_zero(y);
+        x = folded_x;
+      }
+    }
+    encoded[0] = quantize_snorm(x);
+    encoded[1] = quantize_snorm(y);
+  }
+
+  vect3f decode_normal(const unsigned short* encoded) {
+    float x = dequantize_snorm(encoded[0]), y = dequantize_snorm(encoded[1]);
+    float z = 1.0f - fabs(x) - fabs(y);
+    if (z < 0.0f) {
+      float unfolded_x = (1.0f-fabs(y))*sign_not_zero(x);
+      y = (1.0f-fabs(x))*sign_not_zero(y);
+      x = unfolded_x;
+    }
+    vect3f normal(x, y, z);
+    normal.normalize();
+    return normal;
+  }
+
+  unsigned int pack_channel(float value) {
+    if (!(value > 0.0f)) return 0;
+    if (value >= 1.0f) return 255;
+    return (unsigned int)(value*255.0f + 0.5f);
+  }
+
+  unsigned int pack_color(const vect3f& color) {
+    return pack_channel(color.x) | (pack_channel(color.y)<<8) | (pack_channel(color.z)<<16) | 0xff000000u;
+  }
+
+  vect3f unpack_color(unsigned int color) {
+    return vect3f((color&0xff)/255.0f, ((color>>8)&0xff)/255.0f, ((color>>16)&0xff)/255.0f);
+  }
+
+  // facet k's value within one of a page_chunk's lists
+  vect3f chunk_value(const vector<float>& values, size_t k) { return vect3f(values[k*3+0], values[k*3+1], values[k*3+2]); }
+
+  void append_value(vector<float>& values, const vect3f& value) {
+    values.push_back(value.x);
+    values.push_back(value.y);
+    values.push_back(value.z);
+  }
+
+  // model3d::_calculate_normals() over one face of a page_chunk (starting at facet offset)
+  void chunk_face_normals(page_chunk& chunk, size_t offset, int size) {
+    if (size < 3) return;
+    for (int i=0;i<size;i++) {
+      vect3f a = chunk_value(chunk.points, offset+(i+0)%size);
+      vect3f b = chunk_value(chunk.points, offset+(i+1)%size);
+      vect3f c = chunk_value(chunk.points, offset+(i+2)%size);
+      vect3f normal = (b-a).cross(c-b);
+      normal.normalize();
+      chunk.normals[(offset+i)*3+0] = normal.x;
+      chunk.normals[(offset+i)*3+1] = normal.y;
+      chunk.normals[(offset+i)*3+2] = normal.z;
+    }
+  }
+}
+
 void model3d::_initialize() {
   _facet_data.push_back(vector<facet>());
 
   _vertex_count = 0;
   _need_normals = false;
+  _released = 0;
 
   _draw_mode = GL_POLYGON;
   _pos = vect3f(0.0f, 0.0f, 0.0f);
@@ -36,11 +190,36 @@ void model3d::_initialize() {
   _use_draw_funcs = false;
   _pre_draw = 0;
   _post_draw = 0;
+
+  _colors.clear();
+  _normals.clear();
+
+  _compact = false;
+  vector<unsigned short>().swap(_compact_coordinates);
+  vector<unsigned int>().swap(_compact_face_sizes);
+  vector<compact_facet>().swap(_compact_facets);
+
+  _paged.reset();
+
+  use_lods = true;
+  vector<model3d>().swap(_lods);
+  _lod_radius = 0.0f;
+
+  _lattice = false;
+  _lattice_scale = 0.0f;
+  vector<lattice_point>().swap(_lattice_coordinates);
+  _lattice_index.clear();
+
+  _adjacency.clear();
 }
 
 // returns the index of the specified point if it exists within _coordinates.
 // if it does not exist, -1 is returned.
 int model3d::_get_facet_id(const vect3f& point) const {
+  if (_lattice) {
+    unordered_map<lattice_point, int, lattice_point_hash>::const_iterator found = _lattice_index.find(_snap(point));
+    return (found == _lattice_index.end() ? -1 : found->second);
+  }
   for (int i=0;i<_coordinates.size();i++) if (_coordinates[i] == point) return i;
   return -1;
 }
@@ -51,26 +230,54 @@ template <typename T> bool model3d::_in_bounds(const int* const indices, const v
   return (indices[0] < vect.size() && indices[1] < vect[indices[0]].size());
 }
 
-void model3d::_calculate_normals() const {
-  if (_facet_data.back().size() < 3) return; // need a plane to calculate normals
+void model3d::_calculate_normals(int face) const {
+  if (face < 0) face = _facet_data.size()-1;
+  const vector<facet>& face_data = _facet_data[face];
+  if (face_data.size() < 3) return; // need a plane to calculate normals
 
-  int size = _facet_data.back().size();
+  int size = face_data.size();
   for (int i=0;i<size;i++) {
-    const vect3f* const a = &(_coordinates[(((_facet_data.back())[mod(i+0, size)]).id)]);
-    const vect3f* const b = &(_coordinates[(((_facet_data.back())[mod(i+1, size)]).id)]);
-    const vect3f* const c = &(_coordinates[(((_facet_data.back())[mod(i+2, size)]).id)]);
-    ((_facet_data.back())[i]).normal = ((*b)-(*a)).cross((*c)-(*b));
-    ((_facet_data.back())[i]).normal.normalize();
+    const vect3f* const a = &(_coordinates[((face_data[mod(i+0, size)]).id)]);
+    const vect3f* const b = &(_coordinates[((face_data[mod(i+1, size)]).id)]);
+    const vect3f* const c = &(_coordinates[((face_data[mod(i+2, size)]).id)]);
+    vect3f normal = ((*b)-(*a)).cross((*c)-(*b));
+    normal.normalize();
+    (face_data[i]).normal = _normals.insert(normal);
   }
 }
 
+void model3d::_relink_face(int face) {
+  if (!_adjacency.built()) return;
+  vector<int> ids(_facet_data[face].size());
+  for (int i=0;i<ids.size();i++) ids[i] = _facet_data[face][i].id;
+  _adjacency.set_face(face, ids);
+}
+
 model3d::model3d() { _initialize(); }
 
-model3d::model3d(const vector<vect3f>& coordinates, const vector<vector<facet>>& facets) {
+model3d::model3d(const vector<vect3f>& coordinates, const vector<vect3f>& colors, const vector<vect3f>& normals,
+                 const vector<vector<facet>>& facets) {
   _initialize();
 
   _coordinates = coordinates;
+  _colors.assign(vector<vect3f>(colors));
+  _normals.assign(vector<vect3f>(normals));
   _facet_data = facets;
+  if (_facet_data.empty()) _facet_data.push_back(vector<facet>());
+
+  for (int i=0;i<_facet_data.size();i++) {
+    _vertex_count += _facet_data[i].size();
+  }
+}
+
+model3d::model3d(vector<vect3f>&& coordinates, vector<vect3f>&& colors, vector<vect3f>&& normals, vector<vector<facet>>&& facets) {
+  _initialize();
+
+  _coordinates.swap(coordinates);
+  _colors.assign(std::move(colors));
+  _normals.assign(std::move(normals));
+  _facet_data.swap(facets);
+  if (_facet_data.empty()) _facet_data.push_back(vector<facet>());
 
   for (int i=0;i<_facet_data.size();i++) {
     _vertex_count += _facet_data[i].size();
@@ -78,12 +285,16 @@ model3d::model3d(const vector<vect3f>& coordinates, const vector<vector<facet>>&
 }
 
 void model3d::clear() { 
+  bool lattice = _lattice;
+  float scale = _lattice_scale;
+
   _coordinates.clear();
   _facet_data.clear();
 
   _sub_models.clear();
 
   _initialize();
+  if (lattice) set_lattice(scale);
 }
 
 void model3d::enable_draw_funcs(void (*pre)(const model3d&), void (*post)(const model3d&)) {
@@ -97,42 +308,86 @@ void model3d::disable_draw_funcs() {
   _use_draw_funcs = false;
 }
 
-vector<vect3f> model3d::get_coordinates() const { return _coordinates; }
+vector<vect3f> model3d::get_coordinates() const {
+  if (_compact || _paged) {
+    model3d expanded(*this);
+    expanded.expand();
+    return expanded._coordinates;
+  }
+  return _coordinates;
+}
 
 const vector<vect3f>* const model3d::get_coordinates_ptr() const { return &_coordinates; }
 
-vector<vector<facet>> model3d::get_facet_data() const { return _facet_data; }
+vector<vector<facet>> model3d::get_facet_data() const {
+  if (_compact || _paged) {
+    model3d expanded(*this);
+    expanded.expand();
+    return expanded._facet_data;
+  }
+  return _facet_data;
+}
 
 const vector<vector<facet>>* const model3d::get_facet_data_ptr() const { return &_facet_data; }
 
+const attribute_table* const model3d::get_colors_ptr() const { return &_colors; }
+
+const attribute_table* const model3d::get_normals_ptr() const { return &_normals; }
+
 GLenum model3d::get_draw_mode() const { return _draw_mode; }
 
 void model3d::set_draw_mode(GLenum draw_mode) { _draw_mode = draw_mode; }
 
 // sets a specific facet color (facet referenced by two dimensional indices)
 void model3d::set_vertex_color(const int* const vertex_id, const vect3f& color) {
-  if (_in_bounds(vertex_id, _facet_data)) _facet_data[vertex_id[0]][vertex_id[1]].color = color;
+  _begin_edit();
+  // the facet is pointed at the (possibly new) table entry; other facets sharing the old color keep it
+  if (_in_bounds(vertex_id, _facet_data)) _facet_data[vertex_id[0]][vertex_id[1]].color = _colors.insert(color);
 }
 
 vect3f model3d::get_vertex_color(const int* const vertex_id) const {
-  if (_in_bounds(vertex_id, _facet_data)) return _facet_data[vertex_id[0]][vertex_id[1]].color;
+  if (_paged) {
+    vector<vect3f> points, colors, normals;
+    get_face(vertex_id[0], points, colors, normals);
+    return (vertex_id[1] >= 0 && vertex_id[1] < colors.size() ? colors[vertex_id[1]] : DEFAULT_COLOR);
+  }
+  if (_compact) {
+    if (vertex_id[0] < 0 || vertex_id[1] < 0 || vertex_id[0] >= _compact_face_sizes.size() || vertex_id[1] >= _compact_face_sizes[vertex_id[0]]) return DEFAULT_COLOR;
+    size_t offset = 0;
+    for (int i=0;i<vertex_id[0];i++) offset += _compact_face_sizes[i];
+    return unpack_color(_compact_facets[offset+vertex_id[1]].color);
+  }
+  if (_in_bounds(vertex_id, _facet_data)) return _colors[_facet_data[vertex_id[0]][vertex_id[1]].color];
   return DEFAULT_COLOR;
 }
 
-// appends a vertex to the object's current face vector
-index2d model3d::add_vertex(const vect3f& point, const vect3f& color, const vect3f* const normal) {
+int model3d::_add_coordinate(const vect3f& point) {
   int facet_id = _get_facet_id(point);
   if (facet_id < 0) { // vertex doesn't exist yet
     facet_id = _coordinates.size();
-    _coordinates.push_back(point);
+    if (_lattice) {
+      lattice_point snapped = _snap(point);
+      _lattice_coordinates.push_back(snapped);
+      _lattice_index[snapped] = facet_id;
+      _coordinates.push_back(_lattice_position(snapped));
+    }
+    else _coordinates.push_back(point);
   }
+  return facet_id;
+}
+
+// appends a vertex to the object's current face vector
+index2d model3d::add_vertex(const vect3f& point, const vect3f& color, const vect3f* const normal) {
+  _begin_edit();
+  int facet_id = _add_coordinate(point);
 
   // set flag to calculate normals on face push or save:
   if (normal == 0) {
     _need_normals = true;
-    _facet_data.back().push_back(facet(facet_id, color));
+    _facet_data.back().push_back(facet(facet_id, _colors.insert(color), _normals.insert(DEFAULT_NORMAL)));
   }
-  else _facet_data.back().push_back(facet(facet_id, color, *normal));
+  else _facet_data.back().push_back(facet(facet_id, _colors.insert(color), _normals.insert(*normal)));
+  _adjacency.insert(_facet_data.size()-1, _facet_data.back().size()-1, facet_id);
 
   _vertex_count++;
 
@@ -140,42 +395,764 @@ index2d model3d::add_vertex(const vect3f& point, const vect3f& color, const vect
 }
 
 void model3d::edit_coord(int coord_id, const vect3f& point) {
+  _begin_edit();
   if (coord_id < _coordinates.size()) {
-    _coordinates[coord_id] = point;
+    if (_lattice) {
+      lattice_point snapped = _snap(point);
+      unordered_map<lattice_point, int, lattice_point_hash>::iterator old = _lattice_index.find(_lattice_coordinates[coord_id]);
+      if (old != _lattice_index.end() && old->second == coord_id) _lattice_index.erase(old);
+      _lattice_index.insert(make_pair(snapped, coord_id)); // keeps an existing coordinate at the new position as the one found
+      _lattice_coordinates[coord_id] = snapped;
+      _coordinates[coord_id] = _lattice_position(snapped);
+    }
+    else _coordinates[coord_id] = point;
   }
 }
 
 void model3d::edit_vertex(const int* const vertex_id, const facet& vertex) {
+  _begin_edit();
   if (_in_bounds(vertex_id, _facet_data)) {
     _facet_data[vertex_id[0]][vertex_id[1]] = vertex;
+    _adjacency.set_corner(vertex_id[0], vertex_id[1], vertex.id);
+    _release(1); // the facet's old coordinate may no longer be referenced
   }
 }
 
 void model3d::remove_vertex(const int* const vertex_id) {
+  _begin_edit();
   if (_in_bounds(vertex_id, _facet_data)) {
     _facet_data[vertex_id[0]].erase(_facet_data[vertex_id[0]].begin()+vertex_id[1]);
+    _adjacency.remove(vertex_id[0], vertex_id[1]);
+    _vertex_count--;
+    _release(1);
   }
 }
 
 void model3d::push_face() {
+  _begin_edit();
   if (_facet_data.back().size() > 0) {
     if (_need_normals) _calculate_normals(); // calculate normals if they're undefined
     _facet_data.push_back(vector<facet>()); // only add a face if the current face has a facet
+    _adjacency.push_face();
   }
   _need_normals = false;
 }
 
 void model3d::pop_face() {
-  if (_facet_data.size() > 1) _facet_data.pop_back();
-  else if (_facet_data.size() == 1) _facet_data.back().clear();
+  _begin_edit();
+  int removed = (_facet_data.empty() ? 0 : _facet_data.back().size());
+  if (_facet_data.size() > 1) {
+    _facet_data.pop_back();
+    _adjacency.resize(_facet_data.size());
+  }
+  else if (_facet_data.size() == 1) {
+    _facet_data.back().clear();
+    _relink_face(0);
+  }
   _need_normals = false;
+  _vertex_count -= removed;
+  _release(removed);
 }
 
-void model3d::recalculate_normals() const { _calculate_normals(); }
+void model3d::recalculate_normals() const {
+  if (_compact || _paged) return; // normals were brought up to date by compact() or page_out()
+  for (int i=0;i<_facet_data.size();i++) _calculate_normals(i);
+}
 
 int model3d::vertex_count() const { return _vertex_count; }
 
-void model3d::save(string& filename) const {
+int model3d::face_count() const {
+  if (_paged) return _paged->face_count();
+  return (_compact ? _compact_face_sizes.size() : _facet_data.size());
+}
+
+void model3d::get_face(int face, vector<vect3f>& points, vector<vect3f>& colors, vector<vect3f>& normals) const {
+  if (_paged) { // only the chunk holding the face is read
+    int chunk = _paged->find_face(face);
+    shared_ptr<const page_chunk> data = (chunk < 0 ? shared_ptr<const page_chunk>() : _paged->chunk(chunk));
+    if (!data) return;
+    size_t offset = 0;
+    int index = face - _paged->info(chunk).first_face;
+    for (int i=0;i<index;i++) offset += data->face_sizes[i];
+    for (int i=0;i<data->face_sizes[index];i++) {
+      points.push_back(chunk_value(data->points, offset+i));
+      colors.push_back(chunk_value(data->colors, offset+i));
+      normals.push_back(chunk_value(data->normals, offset+i));
+    }
+    return;
+  }
+  if (_compact) {
+    if (face < 0 || face >= _compact_face_sizes.size()) return;
+    size_t offset = 0;
+    for (int i=0;i<face;i++) offset += _compact_face_sizes[i];
+    vect3f color, normal;
+    for (int i=0;i<_compact_face_sizes[face];i++) {
+      const compact_facet& f = _compact_facets[offset+i];
+      _decode_facet(f, color, normal);
+      points.push_back(_decode_coordinate(f.id));
+      colors.push_back(color);
+      normals.push_back(normal);
+    }
+    return;
+  }
+  if (face < 0 || face >= _facet_data.size()) return;
+  for (int i=0;i<_facet_data[face].size();i++) {
+    const facet& f = _facet_data[face][i];
+    points.push_back(_coordinates[f.id]);
+    colors.push_back(_colors[f.color]);
+    normals.push_back(_normals[f.normal]);
+  }
+}
+
+void model3d::set_face(int face, const vector<vect3f>& points, const vector<vect3f>& colors, const vector<vect3f>& normals,
+                       const vector<int>* const ids) {
+  _begin_edit();
+  if (face < 0 || face >= _facet_data.size()) return;
+
+  // points still at the coordinate the face held at that position keep it, saving a search for the (common) unmoved point
+  vector<facet> old;
+  old.swap(_facet_data[face]);
+  int removed = old.size();
+  for (int i=0;i<points.size();i++) {
+    int id = -1;
+    if (ids && (*ids)[i] >= 0 && (*ids)[i] < _coordinates.size() && _coordinates[(*ids)[i]] == points[i]) id = (*ids)[i];
+    else if (ids && (*ids)[i] < 0 && !_lattice) { // (known to be missing)
+      id = _coordinates.size();
+      _coordinates.push_back(points[i]);
+    }
+    else id = (i < old.size() && _coordinates[old[i].id] == points[i] ? old[i].id : _add_coordinate(points[i]));
+    _facet_data[face].push_back(facet(id, _colors.insert(colors[i]), _normals.insert(normals[i])));
+  }
+  _vertex_count += _facet_data[face].size() - removed;
+  _relink_face(face);
+  if (face+1 == _facet_data.size()) _need_normals = true; // as after add_vertex(): the current face's normals are calculated once it's pushed
+  _release(removed);
+}
+
+void model3d::resize_faces(int count) {
+  _begin_edit();
+  if (count < 1) count = 1; // there is always a current face
+  int removed = 0;
+  for (int i=count;i<_facet_data.size();i++) removed += _facet_data[i].size();
+  if (count < _facet_data.size()) _need_normals = false;
+  _facet_data.resize(count);
+  _adjacency.resize(count);
+  _vertex_count -= removed;
+  _release(removed);
+}
+
+void model3d::_begin_edit() {
+  if (_compact || _paged) expand();
+  if (!_lods.empty()) vector<model3d>().swap(_lods);
+}
+
+void model3d::_release(int facets) {
+  _released += facets;
+  if (_released >= DEFRAGMENT_THRESHOLD && _released >= _vertex_count/4) defragment(false);
+}
+
+int model3d::defragment(bool drop_empty_faces) {
+  if (_paged) return 0; // a page file holds no garbage: it's written de-indexed
+  bool was_compact = _compact;
+  if (was_compact) expand();
+  TRACE_SPAN(defragment_span, "model3d::defragment");
+  _adjacency.clear(); // (the coordinates and faces are renumbered)
+  if (_need_normals) _calculate_normals(); // the current face's normals refer to the table being compacted
+
+  // mark what the facets refer to
+  vector<int> coordinate_map(_coordinates.size(), -1), color_map(_colors.size(), -1), normal_map(_normals.size(), -1);
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      const facet& f = _facet_data[i][j];
+      coordinate_map[f.id] = 0;
+      color_map[f.color] = 0;
+      normal_map[f.normal] = 0;
+    }
+  }
+
+  // number the survivors in their current order, moving them down over the garbage
+  int coordinates = 0;
+  for (int i=0;i<coordinate_map.size();i++) {
+    if (coordinate_map[i] < 0) continue;
+    coordinate_map[i] = coordinates;
+    _coordinates[coordinates] = _coordinates[i];
+    if (_lattice) _lattice_coordinates[coordinates] = _lattice_coordinates[i];
+    coordinates++;
+  }
+  int removed = _coordinates.size() - coordinates;
+  _coordinates.resize(coordinates);
+  if (_lattice) {
+    _lattice_coordinates.resize(coordinates);
+    _rebuild_lattice();
+  }
+
+  attribute_table* const tables[2] = { &_colors, &_normals };
+  vector<int>* const maps[2] = { &color_map, &normal_map };
+  for (int k=0;k<2;k++) {
+    vector<int>& map = *maps[k];
+    vector<vect3f> values;
+    for (int i=0;i<map.size();i++) {
+      if (map[i] < 0) continue;
+      map[i] = values.size();
+      values.push_back((*tables[k])[i]);
+    }
+    if (values.size() < map.size()) tables[k]->assign(move(values));
+  }
+
+  // renumber the facets and drop the empty faces (the last face is the one being added to, so it stays)
+  int faces = 0;
+  _vertex_count = 0;
+  for (int i=0;i<_facet_data.size();i++) {
+    if (drop_empty_faces && _facet_data[i].empty() && i+1 < _facet_data.size()) continue;
+    for (int j=0;j<_facet_data[i].size();j++) {
+      facet& f = _facet_data[i][j];
+      f = facet(coordinate_map[f.id], color_map[f.color], normal_map[f.normal]);
+    }
+    _vertex_count += _facet_data[i].size();
+    if (faces != i) _facet_data[faces] = move(_facet_data[i]);
+    faces++;
+  }
+  _facet_data.resize(faces);
+  _released = 0;
+
+  TRACE_ARG(defragment_span, "coordinates_removed", removed);
+  if (was_compact) compact();
+  return removed;
+}
+
+void model3d::optimize_order(int cache_size) {
+  if (_paged) return;
+  for (int i=0;i<_lods.size();i++) _lods[i].optimize_order(cache_size);
+  bool was_compact = _compact;
+  if (was_compact) expand();
+  TRACE_SPAN(optimize_span, "model3d::optimize_order");
+  _adjacency.clear(); // (the coordinates and faces are renumbered)
+  if (_need_normals) _calculate_normals(); // the current face's normals are renumbered with the table
+
+  // the faces, in cache order (the current face last, wherever the order put it)
+  vector<int> order;
+  cache_order(_facet_data, _coordinates.size(), order, cache_size);
+  int current = _facet_data.size()-1;
+  order.erase(find(order.begin(), order.end(), current));
+  order.push_back(current);
+  TRACE_ARG(optimize_span, "faces", order.size());
+  vector<vector<facet>> faces(_facet_data.size());
+  for (int i=0;i<order.size();i++) faces[i] = _facet_data[order[i]]; // (copied, not moved, so the faces are allocated in order too)
+  _facet_data.swap(faces);
+  vector<vector<facet>>().swap(faces);
+
+  // number the coordinates, colors and normals as the faces first use them (anything unused follows, in its current order)
+  vector<int> coordinate_map(_coordinates.size(), -1), color_map(_colors.size(), -1), normal_map(_normals.size(), -1);
+  int coordinates = 0, colors = 0, normals = 0;
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      const facet& f = _facet_data[i][j];
+      if (coordinate_map[f.id] < 0) coordinate_map[f.id] = coordinates++;
+      if (color_map[f.color] < 0) color_map[f.color] = colors++;
+      if (normal_map[f.normal] < 0) normal_map[f.normal] = normals++;
+    }
+  }
+  for (int i=0;i<coordinate_map.size();i++) if (coordinate_map[i] < 0) coordinate_map[i] = coordinates++;
+  for (int i=0;i<color_map.size();i++) if (color_map[i] < 0) color_map[i] = colors++;
+  for (int i=0;i<normal_map.size();i++) if (normal_map[i] < 0) normal_map[i] = normals++;
+
+  vector<vect3f> points(_coordinates.size());
+  for (int i=0;i<coordinate_map.size();i++) points[coordinate_map[i]] = _coordinates[i];
+  _coordinates.swap(points);
+  if (_lattice) {
+    vector<lattice_point> lattice_points(_lattice_coordinates.size());
+    for (int i=0;i<coordinate_map.size();i++) lattice_points[coordinate_map[i]] = _lattice_coordinates[i];
+    _lattice_coordinates.swap(lattice_points);
+    _rebuild_lattice();
+  }
+
+  attribute_table* const tables[2] = { &_colors, &_normals };
+  vector<int>* const maps[2] = { &color_map, &normal_map };
+  for (int k=0;k<2;k++) {
+    const vector<int>& map = *maps[k];
+    vector<vect3f> values(map.size());
+    for (int i=0;i<map.size();i++) values[map[i]] = (*tables[k])[i];
+    tables[k]->assign(move(values));
+  }
+
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      facet& f = _facet_data[i][j];
+      f = facet(coordinate_map[f.id], color_map[f.color], normal_map[f.normal]);
+    }
+  }
+
+  if (was_compact) compact();
+}
+
+int model3d::coordinate_count() const {
+  if (_paged) return _paged->facet_count(); // (every facet has its own point)
+  return (_compact ? _compact_coordinates.size()/3 : _coordinates.size());
+}
+
+vect3f model3d::_decode_coordinate(int id) const {
+  const unsigned short* const q = &_compact_coordinates[id*3];
+  return vect3f(_compact_origin.x + q[0]*_compact_step.x, _compact_origin.y + q[1]*_compact_step.y, _compact_origin.z + q[2]*_compact_step.z);
+}
+
+void model3d::_decode_facet(const compact_facet& f, vect3f& color, vect3f& normal) const {
+  color = unpack_color(f.color);
+  normal = decode_normal(f.normal);
+}
+
+void model3d::compact() {
+  if (_paged) expand();
+  if (!_compact && _released > 0) defragment();
+  if (_compact) return;
+  TRACE_SPAN(compact_span, "model3d::compact");
+  _adjacency.clear();
+  if (_need_normals) _calculate_normals();
+  _need_normals = false;
+
+  // coordinates are quantized within the bounding box, so the error is at most half of the box's extent/65535 per axis
+  vect3f low, high;
+  if (!_coordinates.empty()) low = high = _coordinates[0];
+  for (int i=1;i<_coordinates.size();i++) {
+    const vect3f& p = _coordinates[i];
+    low = vect3f(min(low.x, p.x), min(low.y, p.y), min(low.z, p.z));
+    high = vect3f(max(high.x, p.x), max(high.y, p.y), max(high.z, p.z));
+  }
+  _compact_origin = low;
+  _compact_step = (high-low)/QUANTIZE_MAX;
+
+  // a lattice model spanning at most 65535 lattice steps per axis is quantized on the lattice itself, which is lossless
+  if (_lattice && !_lattice_coordinates.empty()) {
+    lattice_point lattice_low = _lattice_coordinates[0], lattice_high = _lattice_coordinates[0];
+    for (int i=1;i<_lattice_coordinates.size();i++) {
+      const lattice_point& p = _lattice_coordinates[i];
+      lattice_low = lattice_point(min(lattice_low.x, p.x), min(lattice_low.y, p.y), min(lattice_low.z, p.z));
+      lattice_high = lattice_point(max(lattice_high.x, p.x), max(lattice_high.y, p.y), max(lattice_high.z, p.z));
+    }
+    if ((long long int)lattice_high.x-lattice_low.x <= 65535 && (long long int)lattice_high.y-lattice_low.y <= 65535 && (long long int)lattice_high.z-lattice_low.z <= 65535) {
+      _compact_origin = _lattice_position(lattice_low);
+      _compact_step = vect3f(_lattice_scale, _lattice_scale, _lattice_scale);
+    }
+  }
+
+  _compact_coordinates.resize(_coordinates.size()*3);
+  for (int i=0;i<_coordinates.size();i++) {
+    _compact_coordinates[i*3+0] = quantize(_coordinates[i].x, _compact_origin.x, _compact_step.x);
+    _compact_coordinates[i*3+1] = quantize(_coordinates[i].y, _compact_origin.y, _compact_step.y);
+    _compact_coordinates[i*3+2] = quantize(_coordinates[i].z, _compact_origin.z, _compact_step.z);
+  }
+
+  size_t facet_count = 0;
+  _compact_face_sizes.resize(_facet_data.size());
+  for (int i=0;i<_facet_data.size();i++) {
+    _compact_face_sizes[i] = _facet_data[i].size();
+    facet_count += _facet_data[i].size();
+  }
+
+  _compact_facets.resize(facet_count);
+  size_t k = 0;
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++,k++) {
+      const facet& f = _facet_data[i][j];
+      _compact_facets[k].id = f.id;
+      encode_normal(_normals[f.normal], _compact_facets[k].normal);
+      _compact_facets[k].color = pack_color(_colors[f.color]);
+    }
+  }
+
+  // swap rather than clear() so the memory is actually released
+  vector<vect3f>().swap(_coordinates);
+  vector<vector<facet>>(1).swap(_facet_data);
+  _colors.clear();
+  _normals.clear();
+  vector<lattice_point>().swap(_lattice_coordinates); // re-snapped by expand()
+  _lattice_index = unordered_map<lattice_point, int, lattice_point_hash>();
+  _compact = true;
+  TRACE_ARG(compact_span, "facets", facet_count);
+}
+
+void model3d::expand() {
+  if (_compact || _paged) _adjacency.clear(); // (of the empty face kept while compact or paged)
+  if (_paged) { // points are welded back together as they're read (as the text format's loader welds them)
+    TRACE_SPAN(expand_span, "model3d::expand");
+    shared_ptr<paged_store> store;
+    store.swap(_paged);
+
+    attribute_table points;
+    _facet_data.clear();
+    _facet_data.reserve(store->face_count());
+    _vertex_count = 0;
+    store->visit([&](int, const page_chunk& data) {
+      size_t k = 0;
+      for (int i=0;i<data.face_sizes.size();i++) {
+        _facet_data.push_back(vector<facet>(data.face_sizes[i]));
+        for (int j=0;j<data.face_sizes[i];j++,k++) {
+          _facet_data.back()[j] = facet(points.insert(chunk_value(data.points, k)), _colors.insert(chunk_value(data.colors, k)),
+                                        _normals.insert(chunk_value(data.normals, k)));
+        }
+      }
+      _vertex_count += k;
+    });
+    _coordinates = points.values();
+    if (_facet_data.empty()) _facet_data.push_back(vector<facet>());
+
+    if (_lattice) {
+      _lattice_coordinates.resize(_coordinates.size());
+      for (int i=0;i<_coordinates.size();i++) _lattice_coordinates[i] = _snap(_coordinates[i]);
+      _rebuild_lattice();
+    }
+    TRACE_ARG(expand_span, "facets", _vertex_count);
+    return;
+  }
+  if (!_compact) return;
+  TRACE_SPAN(expand_span, "model3d::expand");
+
+  int coordinates = coordinate_count();
+  _coordinates.resize(coordinates);
+  for (int i=0;i<coordinates;i++) _coordinates[i] = _decode_coordinate(i);
+
+  _facet_data.assign(_compact_face_sizes.size(), vector<facet>());
+  size_t k = 0;
+  vect3f color, normal;
+  for (int i=0;i<_compact_face_sizes.size();i++) {
+    _facet_data[i].resize(_compact_face_sizes[i]);
+    for (int j=0;j<_compact_face_sizes[i];j++,k++) {
+      _decode_facet(_compact_facets[k], color, normal);
+      _facet_data[i][j] = facet(_compact_facets[k].id, _colors.insert(color), _normals.insert(normal));
+    }
+  }
+  if (_facet_data.empty()) _facet_data.push_back(vector<facet>());
+
+  if (_lattice) {
+    _lattice_coordinates.resize(coordinates);
+    for (int i=0;i<coordinates;i++) _lattice_coordinates[i] = _snap(_coordinates[i]);
+    _rebuild_lattice();
+  }
+
+  vector<unsigned short>().swap(_compact_coordinates);
+  vector<unsigned int>().swap(_compact_face_sizes);
+  vector<compact_facet>().swap(_compact_facets);
+  _compact = false;
+  TRACE_ARG(expand_span, "facets", k);
+}
+
+bool model3d::is_compact() const { return _compact; }
+
+bool model3d::page_out(page_cache& cache) {
+  if (_paged) return true;
+  if (_compact) expand();
+  TRACE_SPAN(page_span, "model3d::page_out");
+  _adjacency.clear();
+  if (_need_normals) _calculate_normals();
+
+  shared_ptr<paged_store> store(new paged_store(cache));
+  vector<float> points, colors, normals;
+  for (int i=0;i<_facet_data.size();i++) {
+    points.clear();
+    colors.clear();
+    normals.clear();
+    for (int j=0;j<_facet_data[i].size();j++) {
+      const facet& f = _facet_data[i][j];
+      append_value(points, _coordinates[f.id]);
+      append_value(colors, _colors[f.color]);
+      append_value(normals, _normals[f.normal]);
+    }
+    store->add_face(points.data(), colors.data(), normals.data(), _facet_data[i].size());
+  }
+  if (!store->finish()) return false; // (the model is left as it was)
+
+  // released as compact() releases them; the page file holds no garbage
+  vector<vect3f>().swap(_coordinates);
+  vector<vector<facet>>(1).swap(_facet_data);
+  _colors.clear();
+  _normals.clear();
+  vector<lattice_point>().swap(_lattice_coordinates);
+  _lattice_index = unordered_map<lattice_point, int, lattice_point_hash>();
+  _need_normals = false;
+  _released = 0;
+  _paged = store;
+  TRACE_ARG(page_span, "chunks", store->chunk_count());
+  TRACE_ARG(page_span, "bytes", store->file_bytes());
+  return true;
+}
+
+bool model3d::load_paged(const string& filename, page_cache& cache) {
+  TRACE_SPAN(load_span, "model3d::load_paged");
+  TRACE_ARG(load_span, "file", filename);
+
+  fileio file;
+  file.open(filename, "r");
+  if (!file.is_open()) return false;
+  long long int file_size = file.size();
+  auto read_u32 = [&](unsigned int& value) {
+    string bytes = file.read(sizeof(unsigned int));
+    if (bytes.length() != sizeof(unsigned int)) return false;
+    memcpy(&value, bytes.data(), sizeof(unsigned int));
+    return true;
+  };
+
+  string header = file.read(BINARY_FILE_HEADER().length());
+  unsigned int version = 0;
+  if (_lattice || header != BINARY_FILE_HEADER() || !read_u32(version) || version != BINARY_FILE_VERSION) {
+    file.close(); // (version 1 files have no tables to stream the facets against)
+    return (load(filename) && page_out(cache));
+  }
+
+  // the tables are read whole (they're deduplicated, so small against the facets); the facets are streamed into chunks
+  vector<float> tables[3];
+  long long int facets_pos = BINARY_FILE_HEADER().length() + sizeof(unsigned int); // where the facets start (for the levels of detail)
+  for (int k=0;k<3;k++) {
+    unsigned int count = 0;
+    if (!read_u32(count) || count > file_size/12) return false;
+    string values = file.read((long long int)count*3*sizeof(float));
+    if (values.length() != (size_t)count*3*sizeof(float)) return false;
+    tables[k].resize(count*3);
+    if (count > 0) memcpy(&tables[k][0], values.data(), values.length());
+    facets_pos += sizeof(unsigned int) + values.length();
+  }
+  unsigned int face_count = 0;
+  if (!read_u32(face_count) || face_count > file_size/4) return false;
+  string sizes = file.read((long long int)face_count*sizeof(unsigned int));
+  if (sizes.length() != (size_t)face_count*sizeof(unsigned int)) return false;
+  facets_pos += sizeof(unsigned int) + sizes.length();
+
+  const int BLOCK_FACETS = 65536; // facets read at a time
+  shared_ptr<paged_store> store(new paged_store(cache));
+  string block;
+  size_t block_pos = 0;
+  long long int facets = 0;
+  vector<float> face[3];
+  for (unsigned int i=0;i<face_count;i++) {
+    unsigned int size;
+    memcpy(&size, sizes.data()+i*sizeof(unsigned int), sizeof(unsigned int));
+    for (int k=0;k<3;k++) face[k].clear();
+    for (unsigned int j=0;j<size;j++) {
+      if (block_pos+3*sizeof(int) > block.length()) {
+        block = file.read(3*sizeof(int)*BLOCK_FACETS);
+        block_pos = 0;
+        if (block.length() < 3*sizeof(int)) return false;
+      }
+      int indices[3];
+      memcpy(indices, block.data()+block_pos, sizeof(indices));
+      block_pos += sizeof(indices);
+      for (int k=0;k<3;k++) {
+        if (indices[k] < 0 || (size_t)indices[k]*3 >= tables[k].size()) return false;
+        face[k].insert(face[k].end(), &tables[k][indices[k]*3], &tables[k][indices[k]*3]+3);
+      }
+    }
+    store->add_face(face[0].data(), face[1].data(), face[2].data(), size);
+    facets += size;
+  }
+  if (!store->finish()) return false;
+
+  // the levels of detail (small against the model, so held in memory) follow the facets, if they were written
+  vector<model3d> lods;
+  long long int lods_pos = facets_pos + facets*3*sizeof(int);
+  if (file_size - lods_pos >= (long long int)sizeof(unsigned int) && file.seek(lods_pos) == lods_pos) {
+    model3d levels;
+    string data = BINARY_FILE_HEADER();
+    put<unsigned int>(data, BINARY_FILE_VERSION);
+    for (int k=0;k<4;k++) put<unsigned int>(data, 0); // (an empty model for _load_binary() to read the levels after)
+    data += file.read(file_size - lods_pos);
+    if (!levels._load_binary(data)) return false;
+    lods.swap(levels._lods);
+  }
+
+  _coordinates.clear();
+  _facet_data.clear();
+  _initialize();
+  _vertex_count = facets;
+  _paged = store;
+  if (!lods.empty()) set_lods(std::move(lods));
+  TRACE_ARG(load_span, "vertex_count", _vertex_count);
+  return true;
+}
+
+bool model3d::is_paged() const { return (bool)_paged; }
+
+void model3d::set_lods(vector<model3d>&& levels) {
+  _lods.swap(levels);
+  vector<model3d>().swap(levels);
+
+  // the bounding sphere of the first level (which is within a rounding of the model's own)
+  _lod_center = vect3f();
+  _lod_radius = 0.0f;
+  if (_lods.empty()) return;
+  const vector<vect3f>& points = _lods[0]._coordinates;
+  if (points.empty()) return;
+  vect3f low = points[0], high = points[0];
+  for (int i=1;i<points.size();i++) {
+    low = vect3f(min(low.x, points[i].x), min(low.y, points[i].y), min(low.z, points[i].z));
+    high = vect3f(max(high.x, points[i].x), max(high.y, points[i].y), max(high.z, points[i].z));
+  }
+  _lod_center = (low+high)*0.5f;
+  for (int i=0;i<points.size();i++) {
+    vect3f offset = points[i] - _lod_center;
+    _lod_radius = max(_lod_radius, (float)sqrt(offset.x*offset.x + offset.y*offset.y + offset.z*offset.z));
+  }
+}
+
+void model3d::clear_lods() { vector<model3d>().swap(_lods); }
+
+const vector<model3d>& model3d::get_lods() const { return _lods; }
+
+int model3d::select_lod(const float* projection, const float* modelview, int viewport_height) const {
+  if (_lods.empty()) return 0;
+
+  // the bounding sphere in eye space (modelview may scale it)
+  const float* const m = modelview;
+  float z = m[2]*_lod_center.x + m[6]*_lod_center.y + m[10]*_lod_center.z + m[14];
+  float scale = 0.0f;
+  for (int c=0;c<3;c++) scale = max(scale, (float)sqrt(m[c*4+0]*m[c*4+0] + m[c*4+1]*m[c*4+1] + m[c*4+2]*m[c*4+2]));
+  float radius = _lod_radius*scale;
+
+  // projected diameter in pixels: perspective projections divide by the distance, orthographic ones don't
+  float pixels = 2.0f*radius*projection[5]*viewport_height*0.5f;
+  if (projection[15] == 0.0f) {
+    float distance = -z;
+    if (distance <= radius) return 0; // the camera is at (or inside) the model
+    pixels /= distance;
+  }
+
+  int level = 0;
+  while (level < _lods.size() && pixels < (LOD_FULL_PIXELS >> level)) level++;
+  return level;
+}
+
+const paged_store* const model3d::get_paged_ptr() const { return _paged.get(); }
+
+bool model3d::get_bounds(vect3f& low, vect3f& high) const {
+  bool found = false;
+  auto include = [&](const vect3f& p) {
+    if (!found) low = high = p;
+    low = vect3f(min(low.x, p.x), min(low.y, p.y), min(low.z, p.z));
+    high = vect3f(max(high.x, p.x), max(high.y, p.y), max(high.z, p.z));
+    found = true;
+  };
+
+  if (_paged) { // (from the chunk bounds kept in memory)
+    for (int i=0;i<_paged->chunk_count();i++) {
+      include(_paged->info(i).low);
+      include(_paged->info(i).high);
+    }
+  }
+  else if (_compact) {
+    for (int i=0;i<_compact_coordinates.size()/3;i++) include(_decode_coordinate(i));
+  }
+  else {
+    for (int i=0;i<_coordinates.size();i++) include(_coordinates[i]);
+  }
+  if (found) {
+    low += _pos;
+    high += _pos;
+  }
+
+  vect3f sub_low, sub_high;
+  for (int i=0;i<_sub_models.size();i++) {
+    if (!_sub_models[i].get_bounds(sub_low, sub_high)) continue;
+    include(sub_low + _pos);
+    include(sub_high + _pos);
+  }
+  return found;
+}
+
+size_t model3d::memory_usage() const {
+  size_t bytes = _coordinates.capacity()*sizeof(vect3f) + _facet_data.capacity()*sizeof(vector<facet>);
+  for (int i=0;i<_facet_data.size();i++) bytes += _facet_data[i].capacity()*sizeof(facet);
+  bytes += _colors.memory_usage() + _normals.memory_usage();
+  bytes += _lattice_coordinates.capacity()*sizeof(lattice_point);
+  bytes += _lattice_index.bucket_count()*sizeof(void*) + _lattice_index.size()*(sizeof(lattice_point)+sizeof(int)+2*sizeof(void*));
+  bytes += _compact_coordinates.capacity()*sizeof(unsigned short);
+  bytes += _compact_face_sizes.capacity()*sizeof(unsigned int);
+  bytes += _compact_facets.capacity()*sizeof(compact_facet);
+  if (_paged) bytes += _paged->chunk_count()*sizeof(page_info); // (resident chunks are the cache's)
+  for (int i=0;i<_lods.size();i++) bytes += _lods[i].memory_usage();
+  bytes += _adjacency.memory_usage();
+  return bytes;
+}
+
+lattice_point model3d::_snap(const vect3f& point) const {
+  return lattice_point((int)floor(point.x/_lattice_scale + 0.5f), (int)floor(point.y/_lattice_scale + 0.5f), (int)floor(point.z/_lattice_scale + 0.5f));
+}
+
+vect3f model3d::_lattice_position(const lattice_point& point) const {
+  return vect3f(point.x*_lattice_scale, point.y*_lattice_scale, point.z*_lattice_scale);
+}
+
+void model3d::_rebuild_lattice() {
+  _lattice_index.clear();
+  _lattice_index.reserve(_lattice_coordinates.size());
+  _coordinates.resize(_lattice_coordinates.size());
+  for (int i=0;i<_lattice_coordinates.size();i++) {
+    _coordinates[i] = _lattice_position(_lattice_coordinates[i]);
+    _lattice_index.insert(make_pair(_lattice_coordinates[i], i)); // the first id at a position wins, as with add_vertex()
+  }
+}
+
+float model3d::set_lattice(float scale) {
+  if (!(scale > 0.0f)) return 0.0f;
+  _begin_edit();
+  TRACE_SPAN(lattice_span, "model3d::set_lattice");
+
+  _lattice = true;
+  _lattice_scale = scale;
+  _lattice_coordinates.resize(_coordinates.size());
+  float moved = 0.0f;
+  for (int i=0;i<_coordinates.size();i++) {
+    _lattice_coordinates[i] = _snap(_coordinates[i]);
+    vect3f offset = _lattice_position(_lattice_coordinates[i]) - _coordinates[i];
+    moved = max(moved, (float)sqrt(offset.x*offset.x + offset.y*offset.y + offset.z*offset.z));
+  }
+  _rebuild_lattice();
+
+  // coordinates that snapped onto the same position are welded: facets are pointed at the first coordinate there
+  //   (the others are left unreferenced)
+  int welded = 0;
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      int& id = _facet_data[i][j].id;
+      int first = _lattice_index[_lattice_coordinates[id]];
+      if (first != id) {
+        id = first;
+        welded++;
+      }
+    }
+  }
+  if (welded > 0) {
+    recalculate_normals();
+    _adjacency.clear();
+  }
+  TRACE_ARG(lattice_span, "welded", welded);
+
+  return moved;
+}
+
+void model3d::clear_lattice() {
+  _lattice = false;
+  _lattice_scale = 0.0f;
+  vector<lattice_point>().swap(_lattice_coordinates);
+  _lattice_index = unordered_map<lattice_point, int, lattice_point_hash>();
+}
+
+bool model3d::is_lattice() const { return _lattice; }
+
+float model3d::get_lattice_scale() const { return _lattice_scale; }
+
+const vector<lattice_point>* const model3d::get_lattice_ptr() const { return &_lattice_coordinates; }
+
+void model3d::save() const {
+  string filename;
+  save(filename);
+}
+
+void model3d::save(string& filename, bool indexed) const {
+  if (_compact || _released > 0) {
+    model3d expanded(*this);
+    expanded.expand();
+    expanded.defragment(false); // empty faces are kept so the file's face indices match the model's
+    expanded.save(filename, indexed);
+    return;
+  }
+  TRACE_SPAN(save_span, "model3d::save");
   if (_need_normals) _calculate_normals();
 
   fileio save_file;
@@ -194,54 +1171,357 @@ void model3d::save(string& filename) const {
     }
   }
   save_file.open(filename, "w");
+  TRACE_ARG(save_span, "file", filename);
+  TRACE_ARG(save_span, "vertex_count", _vertex_count);
+  TRACE_ARG(save_span, "indexed", indexed);
 
   // file header
-  save_file.write(SAVE_FILE_HEADER());
+  save_file.write(indexed ? INDEXED_FILE_HEADER() : SAVE_FILE_HEADER());
+
+  if (_paged) { // the same sections, one pass over the chunks each: facet k refers to coordinate, color and normal k
+    for (int section=0;section<4;section++) {
+      if (section > 0) save_file.write("::");
+      int k = 0;
+      _paged->visit([&](int, const page_chunk& chunk) {
+        string data;
+        if (section == 1) {
+          for (int i=0;i<chunk.face_sizes.size();i++) {
+            data += "{";
+            for (int j=0;j<chunk.face_sizes[i];j++,k++) {
+              data += (indexed ? itos(k) + "/" + itos(k) + "/" + itos(k) : itos(k));
+              if (j != chunk.face_sizes[i]-1) data += ", ";
+            }
+            data += "}";
+          }
+        }
+        else if (section == 0 || indexed) {
+          const vector<float>& values = (section == 0 ? chunk.points : section == 2 ? chunk.colors : chunk.normals);
+          for (size_t i=0;i<values.size()/3;i++) data += chunk_value(values, i).to_string();
+        }
+        else { // the original format: each face's colors (or normals) in braces
+          const vector<float>& values = (section == 2 ? chunk.colors : chunk.normals);
+          size_t v = 0;
+          for (int i=0;i<chunk.face_sizes.size();i++) {
+            data += "{";
+            for (int j=0;j<chunk.face_sizes[i];j++,v++) {
+              data += chunk_value(values, v).to_string();
+              if (j != chunk.face_sizes[i]-1) data += "; ";
+            }
+            data += "}";
+          }
+        }
+        save_file.write(data);
+      });
+    }
+    save_file.close();
+    return;
+  }
 
   // coordinate data
-  for (int i=0;i<_coordinates.size();i++) {
-    string data(_coordinates[i].to_string());
-    save_file.write(data);
+  {
+    TRACE_SPAN(coordinate_span, "write coordinates");
+    TRACE_ARG(coordinate_span, "count", _coordinates.size());
+    for (int i=0;i<_coordinates.size();i++) {
+      string data(_coordinates[i].to_string());
+      save_file.write(data);
+    }
   }
 
   save_file.write("::");
 
-  string color_data, normal_data;
-
-  // facet data
-  for (int i=0;i<_facet_data.size();i++) {
-    string data("{");
-    color_data += "{";
-    normal_data += "{";
-    for (int j=0;j<_facet_data[i].size();j++) {
-      data += itos(_facet_data[i][j].id);
-      color_data += (_facet_data[i][j].color).to_string();
-      normal_data += (_facet_data[i][j].normal).to_string();
-      if (j != _facet_data[i].size()-1) {
-        data += ", ";
-        color_data += "; ";
-        normal_data += "; ";
+  // facet data (coordinate/color/normal indices; coordinate ids only in the original format)
+  {
+    TRACE_SPAN(facet_span, "write facets");
+    for (int i=0;i<_facet_data.size();i++) {
+      string data("{");
+      for (int j=0;j<_facet_data[i].size();j++) {
+        const facet& f = _facet_data[i][j];
+        data += (indexed ? itos(f.id) + "/" + itos(f.color) + "/" + itos(f.normal) : itos(f.id));
+        if (j != _facet_data[i].size()-1) data += ", ";
       }
+      data += "}";
+      save_file.write(data);
     }
-    data += "}";
-    color_data += "}";
-    normal_data += "}";
-    save_file.write(data);
+    TRACE_ARG(facet_span, "face_count", _facet_data.size());
   }
 
   save_file.write("::");
 
-  // color data
-  save_file.write(color_data);
+  if (!indexed) { // the original format repeats each facet's color, then its normal, per face
+    for (int section=0;section<2;section++) {
+      TRACE_SPAN(value_span, section == 0 ? "write colors" : "write normals");
+      if (section > 0) save_file.write("::");
+      for (int i=0;i<_facet_data.size();i++) {
+        string data("{");
+        for (int j=0;j<_facet_data[i].size();j++) {
+          const facet& f = _facet_data[i][j];
+          data += (section == 0 ? _colors[f.color] : _normals[f.normal]).to_string();
+          if (j != _facet_data[i].size()-1) data += "; ";
+        }
+        data += "}";
+        save_file.write(data);
+      }
+    }
+    TRACE_SPAN(close_span, "flush");
+    save_file.close();
+    return;
+  }
+
+  // color table
+  {
+    TRACE_SPAN(color_span, "write colors");
+    TRACE_ARG(color_span, "count", _colors.size());
+    for (int i=0;i<_colors.size();i++) save_file.write(_colors[i].to_string());
+  }
+
   save_file.write("::");
-  
-  // normal data
-  save_file.write(normal_data);
 
+  // normal table
+  {
+    TRACE_SPAN(normal_span, "write normals");
+    TRACE_ARG(normal_span, "count", _normals.size());
+    for (int i=0;i<_normals.size();i++) save_file.write(_normals[i].to_string());
+  }
+
+  TRACE_SPAN(close_span, "flush");
   save_file.close();
 }
 
-bool model3d::load(const string& filename) {
+// binary layout (version 2):
+//   BINARY_FILE_HEADER() | u32 version | u32 coordinate count | (f32 x, y, z) per coordinate
+//   | u32 color count | (f32 r, g, b) per color | u32 normal count | (f32 x, y, z) per normal
+//   | u32 face count | u32 size per face | (i32 id, i32 color, i32 normal) per facet
+//   [ | u32 level count | (u32 length | a binary format image) per level of detail ] (written when asked for; see to_binary())
+// version 1 files (no tables; i32 id, f32 color[3], f32 normal[3] per facet) are still loaded
+// save_binary() writes the faces and tables in optimize_order()'s order unless asked not to (to_binary() keeps the model's own)
+bool model3d::save_binary(const string& filename, bool include_lods, bool optimize) const {
+  if (_paged) {
+    TRACE_SPAN(save_span, "model3d::save_binary");
+    TRACE_ARG(save_span, "file", filename);
+    fileio save_file;
+    save_file.open(filename, "w");
+    if (!save_file.is_open()) return false;
+    bool written = _write_paged_binary([&](const string& data) { save_file.write(data); }, include_lods);
+    save_file.close();
+    return written;
+  }
+  if (_compact || _released > 0 || optimize) {
+    model3d finished(*this);
+    if (!include_lods) finished.clear_lods(); // (not written, so not worth reordering)
+    finished.expand();
+    if (_compact || _released > 0) finished.defragment(false);
+    if (optimize) finished.optimize_order();
+    return finished.save_binary(filename, include_lods, false);
+  }
+  TRACE_SPAN(save_span, "model3d::save_binary");
+  TRACE_ARG(save_span, "file", filename);
+
+  string data;
+  to_binary(data, include_lods);
+  TRACE_ARG(save_span, "bytes", data.length());
+
+  fileio save_file;
+  save_file.open(filename, "w");
+  if (!save_file.is_open()) return false;
+  save_file.write(data);
+  save_file.close();
+
+  return true;
+}
+
+void model3d::to_binary(string& data, bool include_lods) const {
+  if (_paged) {
+    _write_paged_binary([&](const string& bytes) { data += bytes; }, include_lods);
+    return;
+  }
+  if (_compact) {
+    model3d expanded(*this);
+    expanded.expand();
+    expanded.to_binary(data, include_lods);
+    return;
+  }
+  if (_need_normals) _calculate_normals();
+
+  data += BINARY_FILE_HEADER();
+  data.reserve(data.length() + 20 + (_coordinates.size()+_colors.size()+_normals.size())*12 + _facet_data.size()*4 + _vertex_count*12);
+  put<unsigned int>(data, BINARY_FILE_VERSION);
+
+  const vector<vect3f>* const lists[3] = { &_coordinates, &_colors.values(), &_normals.values() };
+  for (int k=0;k<3;k++) {
+    const vector<vect3f>& list = *lists[k];
+    put<unsigned int>(data, list.size());
+    for (int i=0;i<list.size();i++) {
+      put<float>(data, list[i].x);
+      put<float>(data, list[i].y);
+      put<float>(data, list[i].z);
+    }
+  }
+
+  put<unsigned int>(data, _facet_data.size());
+  for (int i=0;i<_facet_data.size();i++) put<unsigned int>(data, _facet_data[i].size());
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      const facet& f = _facet_data[i][j];
+      put<int>(data, f.id);
+      put<int>(data, f.color);
+      put<int>(data, f.normal);
+    }
+  }
+  if (include_lods) _write_lods(data);
+}
+
+void model3d::_write_lods(string& data) const {
+  put<unsigned int>(data, _lods.size());
+  for (int i=0;i<_lods.size();i++) {
+    size_t length_pos = data.length();
+    put<unsigned int>(data, 0);
+    _lods[i].to_binary(data);
+    unsigned int length = data.length() - length_pos - sizeof(unsigned int);
+    memcpy(&data[length_pos], &length, sizeof(unsigned int));
+  }
+}
+
+// the binary format written from the chunks, in order: the tables are the facets' own values (facet k refers to entry k of each)
+bool model3d::_write_paged_binary(const function<void (const string&)>& write, bool include_lods) const {
+  string data(BINARY_FILE_HEADER());
+  put<unsigned int>(data, BINARY_FILE_VERSION);
+
+  bool read = true;
+  for (int section=0;section<3;section++) {
+    put<unsigned int>(data, _paged->facet_count());
+    read = _paged->visit([&](int, const page_chunk& chunk) {
+      const vector<float>& values = (section == 0 ? chunk.points : section == 1 ? chunk.colors : chunk.normals);
+      data.append((const char*)values.data(), values.size()*sizeof(float));
+      write(data);
+      data.clear();
+    }) && read;
+  }
+
+  put<unsigned int>(data, _paged->face_count());
+  read = _paged->visit([&](int, const page_chunk& chunk) {
+    data.append((const char*)chunk.face_sizes.data(), chunk.face_sizes.size()*sizeof(unsigned int));
+    write(data);
+    data.clear();
+  }) && read;
+
+  for (int k=0;k<_paged->facet_count();k++) {
+    put<int>(data, k);
+    put<int>(data, k);
+    put<int>(data, k);
+    if (data.length() >= 1024*1024) {
+      write(data);
+      data.clear();
+    }
+  }
+  if (include_lods) _write_lods(data);
+  write(data);
+  return read;
+}
+
+bool model3d::from_binary(const string& data) {
+  float lattice_scale = (_lattice ? _lattice_scale : 0.0f);
+  _coordinates.clear();
+  _facet_data.clear();
+  _initialize();
+
+  if (data.compare(0, BINARY_FILE_HEADER().length(), BINARY_FILE_HEADER()) != 0) return false;
+  _facet_data.clear();
+  bool loaded = _load_binary(data);
+  if (!loaded) clear();
+  else if (lattice_scale > 0.0f) set_lattice(lattice_scale);
+  return loaded;
+}
+
+// data is the entire file, including the header
+bool model3d::_load_binary(const string& data) {
+  TRACE_SPAN(parse_span, "parse binary");
+  binary_reader reader(data, BINARY_FILE_HEADER().length());
+
+  unsigned int version = reader.get<unsigned int>();
+  if (version != 1 && version != BINARY_FILE_VERSION) return false;
+
+  unsigned int coordinate_count = reader.get<unsigned int>();
+  if (!reader.ok() || coordinate_count > data.length()/12) return false;
+  _coordinates.resize(coordinate_count);
+  for (int i=0;i<coordinate_count;i++) _coordinates[i] = reader.get_vect3f();
+
+  if (version > 1) {
+    for (int k=0;k<2;k++) {
+      unsigned int count = reader.get<unsigned int>();
+      if (!reader.ok() || count > data.length()/12) return false;
+      vector<vect3f> list(count);
+      for (int i=0;i<count;i++) list[i] = reader.get_vect3f();
+      if (k == 0) _colors.assign(std::move(list));
+      else _normals.assign(std::move(list));
+    }
+  }
+
+  unsigned int face_count = reader.get<unsigned int>();
+  if (!reader.ok() || face_count > data.length()/4) return false;
+  _facet_data.resize(face_count);
+  // each face's size is bounded by the facets the rest of the data could hold (12 bytes each, 28 in version 1) before it's allocated
+  const size_t facet_bytes = (version > 1 ? 12 : 28);
+  long long int facet_total = 0;
+  for (int i=0;i<face_count;i++) {
+    unsigned int size = reader.get<unsigned int>();
+    facet_total += size;
+    if (!reader.ok() || facet_total > (long long int)(reader.remaining()/facet_bytes)) return false;
+    _facet_data[i].resize(size);
+  }
+
+  for (int i=0;i<face_count;i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      facet& f = _facet_data[i][j];
+      f.id = reader.get<int>();
+      if (f.id < 0 || f.id >= coordinate_count) return false;
+      if (version > 1) {
+        f.color = reader.get<int>();
+        f.normal = reader.get<int>();
+        if (f.color < 0 || f.color >= _colors.size() || f.normal < 0 || f.normal >= _normals.size()) return false;
+      }
+      else { // version 1 stores the values per facet; they're deduplicated here
+        f.color = _colors.insert(reader.get_vect3f());
+        f.normal = _normals.insert(reader.get_vect3f());
+      }
+    }
+    _vertex_count += _facet_data[i].size();
+  }
+  if (_facet_data.empty()) _facet_data.push_back(vector<facet>());
+  if (!reader.ok()) return false;
+
+  // the levels of detail follow, if they were written
+  if (reader.remaining() >= sizeof(unsigned int)) {
+    unsigned int levels = reader.get<unsigned int>();
+    if (levels > reader.remaining()/sizeof(unsigned int)) return false;
+    vector<model3d> lods(levels);
+    for (int i=0;i<levels;i++) {
+      string image = reader.get_bytes(reader.get<unsigned int>());
+      if (!reader.ok() || !lods[i].from_binary(image)) return false;
+    }
+    set_lods(std::move(lods));
+  }
+
+  TRACE_ARG(parse_span, "vertex_count", _vertex_count);
+  return true;
+}
+
+bool model3d::load(const string& filename, mesh_report* report) {
+  TRACE_SPAN(load_span, "model3d::load");
+  TRACE_ARG(load_span, "file", filename);
+
+  // a lattice model stays one: the loaded coordinates are snapped once they're read
+  float lattice_scale = (_lattice ? _lattice_scale : 0.0f);
+  bool loaded = _load(filename);
+  if (loaded) {
+    mesh_report validated = validate(true);
+    if (report) *report = validated;
+  }
+  if (loaded && lattice_scale > 0.0f) set_lattice(lattice_scale);
+  TRACE_ARG(load_span, "vertex_count", _vertex_count);
+  return loaded;
+}
+
+bool model3d::_load(const string& filename) {
   _coordinates.clear();
   _facet_data.clear();
 
@@ -252,51 +1532,130 @@ bool model3d::load(const string& filename) {
   if (!save_file.is_open()) return false;
 
   // check for valid header
-  if (save_file.read(SAVE_FILE_HEADER().length()) != SAVE_FILE_HEADER()) return false;
+  string header = save_file.read(SAVE_FILE_HEADER().length());
+  if (header == BINARY_FILE_HEADER()) {
+    string data;
+    {
+      TRACE_SPAN(read_span, "read binary");
+      save_file.seek(0);
+      data = save_file.read(save_file.size());
+      TRACE_ARG(read_span, "bytes", data.length());
+    }
+    _facet_data.clear();
+    bool loaded = _load_binary(data);
+    if (!loaded) clear();
+    return loaded;
+  }
+  if (header != SAVE_FILE_HEADER() && header != INDEXED_FILE_HEADER()) return false;
 
+  bool loaded = _load_text(save_file, header == INDEXED_FILE_HEADER());
+  if (!loaded) clear();
+  return loaded;
+}
+
+// reads the sections following the header:
+//   coordinates :: facets :: colors :: normals
+// indexed files (INDEXED_FILE_HEADER()) write each facet as "id/color/normal" and the colors and normals as tables;
+// the original format (SAVE_FILE_HEADER()) writes ids only and repeats every facet's color and normal per face.
+bool model3d::_load_text(fileio& save_file, bool indexed) {
   // coordinate data
-  string data = save_file.read(-1, "::");
-  vector<string> point_strings(explode(data, ")", -1));
-  for (int i=0;i<point_strings.size();i++) {
-    point_strings[i].erase(point_strings[i].begin()); // remove the '('
-    vector<string> coordinate_strings(explode(point_strings[i], ",", -1));
-    _coordinates.push_back(vect3f(atof(coordinate_strings[0].c_str()), atof(coordinate_strings[1].c_str()), atof(coordinate_strings[2].c_str()))); // create and insert point
+  string data;
+  {
+    TRACE_SPAN(read_span, "read coordinates");
+    data = save_file.read(-1, "::");
+    TRACE_ARG(read_span, "bytes", data.length());
+  }
+  {
+    TRACE_SPAN(parse_span, "tokenize coordinates");
+    parse_points(data, _coordinates);
+    TRACE_ARG(parse_span, "count", _coordinates.size());
   }
 
   // facet data
-  data = save_file.read(-1, "::");
-  _facet_data.clear(); // remove the first vector element because one is added automatically during the load
-  vector<string> facet_list_list(explode(data, "}", -1)); // removes the last brace
-  for (int i=0;i<facet_list_list.size();i++) {
-    facet_list_list[i].erase(facet_list_list[i].begin()); // remove the first brace
-    vector<string> facet_str_list(explode(facet_list_list[i], ", ", -1));
-    vector<facet> facet_list;
-    for (int j=0;j<facet_str_list.size();j++) {
-      facet_list.push_back(facet(atoi(facet_str_list[j].c_str()), DEFAULT_COLOR));
-      _vertex_count++;
+  {
+    TRACE_SPAN(read_span, "read facets");
+    data = save_file.read(-1, "::");
+    TRACE_ARG(read_span, "bytes", data.length());
+  }
+  {
+    TRACE_SPAN(parse_span, "tokenize facets");
+    _facet_data.clear(); // remove the first vector element because one is added automatically during the load
+    vector<string> facet_list_list(explode(data, "}", -1)); // removes the last brace
+    for (int i=0;i<facet_list_list.size();i++) {
+      facet_list_list[i].erase(facet_list_list[i].begin()); // remove the first brace
+      vector<string> facet_str_list(explode(facet_list_list[i], ", ", -1));
+      vector<facet> facet_list;
+      for (int j=0;j<facet_str_list.size();j++) {
+        // "id/color/normal"; the original format only has the id, the color and normal are filled in below
+        const char* token = facet_str_list[j].c_str();
+        char* end;
+        facet f((int)strtol(token, &end, 10), -1, -1);
+        if (indexed && *end == '/') f.color = strtol(end+1, &end, 10);
+        if (indexed && *end == '/') f.normal = strtol(end+1, &end, 10);
+        facet_list.push_back(f);
+        _vertex_count++;
+      }
+      _facet_data.push_back(facet_list);
     }
-    _facet_data.push_back(facet_list);
+    TRACE_ARG(parse_span, "count", _facet_data.size());
   }
+  if (_facet_data.empty()) _facet_data.push_back(vector<facet>());
 
   // color data
-  data = save_file.read(-1, "::");
-  vector<string> color_list_list(explode(data, "}", -1)); // removes the last brace
-  for (int i=0;i<color_list_list.size();i++) {
-    color_list_list[i].erase(color_list_list[i].begin()); // remove the first brace
-    vector<string> face_color_list(explode(color_list_list[i], "; ", -1));
-    for (int j=0;j<face_color_list.size();j++) {
-      _facet_data[i][j].color = vect3f().from_string(face_color_list[j]);
+  {
+    TRACE_SPAN(read_span, "read colors");
+    data = save_file.read(-1, "::");
+    TRACE_ARG(read_span, "bytes", data.length());
+  }
+  if (indexed) {
+    TRACE_SPAN(parse_span, "tokenize colors");
+    vector<vect3f> colors;
+    parse_points(data, colors);
+    _colors.assign(std::move(colors));
+  }
+  else {
+    TRACE_SPAN(parse_span, "tokenize colors");
+    vector<string> color_list_list(explode(data, "}", -1)); // removes the last brace
+    for (int i=0;i<color_list_list.size() && i<_facet_data.size();i++) { // (colors beyond the faces, or their facets, are ignored)
+      color_list_list[i].erase(color_list_list[i].begin()); // remove the first brace
+      vector<string> face_color_list(explode(color_list_list[i], "; ", -1));
+      for (int j=0;j<face_color_list.size() && j<_facet_data[i].size();j++) {
+        _facet_data[i][j].color = _colors.insert(vect3f().from_string(face_color_list[j]));
+      }
     }
   }
 
   // normal data
-  data = save_file.read(-1, "::");
-  vector<string> normal_list_list(explode(data, "}", -1)); // removes the last brace
-  for (int i=0;i<normal_list_list.size();i++) {
-    normal_list_list[i].erase(normal_list_list[i].begin()); // remove the first brace
-    vector<string> face_normal_list(explode(normal_list_list[i], "; ", -1));
-    for (int j=0;j<face_normal_list.size();j++) {
-      _facet_data[i][j].normal = vect3f().from_string(face_normal_list[j]);
+  {
+    TRACE_SPAN(read_span, "read normals");
+    data = save_file.read(-1, "::");
+    TRACE_ARG(read_span, "bytes", data.length());
+  }
+  if (indexed) {
+    TRACE_SPAN(parse_span, "tokenize normals");
+    vector<vect3f> normals;
+    parse_points(data, normals);
+    _normals.assign(std::move(normals));
+  }
+  else {
+    TRACE_SPAN(parse_span, "tokenize normals");
+    vector<string> normal_list_list(explode(data, "}", -1)); // removes the last brace
+    for (int i=0;i<normal_list_list.size() && i<_facet_data.size();i++) {
+      normal_list_list[i].erase(normal_list_list[i].begin()); // remove the first brace
+      vector<string> face_normal_list(explode(normal_list_list[i], "; ", -1));
+      for (int j=0;j<face_normal_list.size() && j<_facet_data[i].size();j++) {
+        _facet_data[i][j].normal = _normals.insert(vect3f().from_string(face_normal_list[j]));
+      }
+    }
+  }
+
+  // facets the original format gave no color or normal get the defaults add_vertex() would have used; indexed facets referring
+  //   past the tables are left to validate() (which load() runs next)
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) {
+      facet& f = _facet_data[i][j];
+      if (!indexed && f.color < 0) f.color = _colors.insert(DEFAULT_COLOR);
+      if (!indexed && f.normal < 0) f.normal = _normals.insert(DEFAULT_NORMAL);
     }
   }
 
@@ -344,106 +1703,366 @@ void model3d::operator++(int) {
   if (_child_animate_flag) for (int i=0;i<_sub_models.size();i++) _sub_models[i]++; // maintain sub models
 }
 
-void model3d::draw() const {
-  if (set_material) {
-    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, diffuse);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, shine);
-  }
-
-  glPushMatrix();
+void model3d::face_resolution(int polygon_count) {
+  _begin_edit();
+  if (_facet_data.back().size() < 3 || polygon_count < 2) return;
 
-  if (_use_draw_funcs) _pre_draw(*this);
+  TRACE_SPAN(resolution_span, "model3d::face_resolution");
+  TRACE_ARG(resolution_span, "polygon_count", polygon_count);
 
-  if (!_anchored) {
-    glTranslatef(_pos.x, _pos.y, _pos.z);
-    glRotatef(_orientation, _axis.x, _axis.y, _axis.z);
-    glTranslatef(-_pos.x, -_pos.y, -_pos.z);
+  vector<vect3f> face_points, face_colors;
+  
+  for (int i=0;i<_facet_data.back().size();i++) {
+    face_points.push_back(_coordinates[_facet_data.back()[i].id]);
+    face_colors.push_back(_colors[_facet_data.back()[i].color]);
   }
-  glTranslatef(_pos.x, _pos.y, _pos.z);
 
-  for (int i=0;i<_facet_data.size();i++) { // ...for each face
-    glBegin(_draw_mode);
-    for (int j=0;j<_facet_data[i].size();j++) { // ...for each vertex
-      // _facets[i][j] is the index which corresponds with _coordinates.
-      // _coordinates[index] contains a vertex3f struct containing x,y,z coordinates
+  _facet_data.back().clear();
+  _relink_face(_facet_data.size()-1);
+  _vertex_count -= face_points.size();
+  _release(face_points.size());
+
+  vect3f* anchor_point = &face_points[0];
+  vect3f* anchor_color = &face_colors[0];
 
-      // enable color
-      // aliasing: c = the vect3f within _facet_colors
-      const vect3f* const c = &(_facet_data[i][j].color);
+  for (int i=2;i<face_points.size();i++) {
+    vect3f* wall_point = &face_points[i-1];
+    vect3f* wall_color = &face_colors[i-1];
+    vect3f step = (face_points[i]-(*wall_point))/(float)polygon_count;
+    vect3f color_step = (face_colors[i]-(*wall_color))/(float)polygon_count;
 
-      glColor3f((*c).x, (*c).y, (*c).z);
+    if (*wall_point == *anchor_point || (*wall_point)+(step*polygon_count) == *anchor_point) {
+      (*wall_point) += step*polygon_count;
+      continue;
+    }
 
-      #ifndef USE_GL_COLOR_MATERIAL
-        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, vect4f((*c).x, (*c).y, (*c).z, 1.0));
-      #endif
-      
-      glNormal3f(_facet_data[i][j].normal.x, _facet_data[i][j].normal.y, _facet_data[i][j].normal.z);
-      glVertex3f(_coordinates[_facet_data[i][j].id].x, _coordinates[_facet_data[i][j].id].y, _coordinates[_facet_data[i][j].id].z);
+    for (int j=0;j<polygon_count;j++) {
+      push_face();
+      add_vertex(*anchor_point, *anchor_color);
+      add_vertex(*wall_point, *wall_color);
+      (*wall_point) += step;
+      (*wall_color) += color_step;
+      add_vertex(*wall_point, *wall_color);
     }
-    glEnd();
   }
+}
 
-  if (_use_draw_funcs) _post_draw(*this);
+void model3d::merge(const model3d& other) {
+  if (other._paged) { // read chunk by chunk rather than expanding a copy of other
+    _begin_edit();
+    TRACE_SPAN(merge_span, "model3d::merge");
+    other._paged->visit([&](int, const page_chunk& chunk) {
+      size_t k = 0;
+      for (int i=0;i<chunk.face_sizes.size();i++) {
+        push_face();
+        for (int j=0;j<chunk.face_sizes[i];j++,k++) add_vertex(chunk_value(chunk.points, k), chunk_value(chunk.colors, k));
+      }
+    });
+    TRACE_ARG(merge_span, "vertex_count", _vertex_count);
+    return;
+  }
+  if (other._compact) {
+    model3d expanded(other);
+    expanded.expand();
+    merge(expanded);
+    return;
+  }
+  _begin_edit();
+  TRACE_SPAN(merge_span, "model3d::merge");
+  for (int i=0;i<other._facet_data.size();i++) {
+    push_face();
+    for (int j=0;j<other._facet_data[i].size();j++) {
+      add_vertex(other._coordinates[other._facet_data[i][j].id], other._colors[other._facet_data[i][j].color]);
+    }
+  }
+  TRACE_ARG(merge_span, "vertex_count", _vertex_count);
+}
 
-  glPopMatrix();
+void model3d::translate(const vect3f& offset) {
+  if (!_lods.empty()) {
+    vect3f step = (_lattice ? _lattice_position(_snap(offset)) : offset);
+    for (int i=0;i<_lods.size();i++) _lods[i].translate(step);
+    _lod_center += step;
+  }
+  if (_paged && _paged.use_count() == 1) { // (a store shared with a copy of the model is left to the copy: this one expands)
+    vect3f step = (_lattice ? _lattice_position(_snap(offset)) : offset);
+    _paged->rewrite([&](page_chunk& chunk) {
+      for (size_t i=0;i<chunk.points.size();i+=3) {
+        chunk.points[i+0] += step.x;
+        chunk.points[i+1] += step.y;
+        chunk.points[i+2] += step.z;
+      }
+    });
+    return;
+  }
+  if (_paged) expand();
+  if (_compact) { // moving the quantization origin moves every coordinate without any loss
+    _compact_origin += (_lattice ? _lattice_position(_snap(offset)) : offset);
+    return;
+  }
+  if (_lattice) {
+    lattice_point step = _snap(offset);
+    for (int i=0;i<_lattice_coordinates.size();i++) {
+      _lattice_coordinates[i].x += step.x;
+      _lattice_coordinates[i].y += step.y;
+      _lattice_coordinates[i].z += step.z;
+    }
+    _rebuild_lattice();
+    return;
+  }
+  for (int i=0;i<_coordinates.size();i++) _coordinates[i] += offset;
+}
 
-  glPushMatrix();
+void model3d::mirror(int axis) {
+  TRACE_SPAN(mirror_span, "model3d::mirror");
+  if (axis < 0 || axis > 2) return;
+  if (!_lods.empty()) {
+    for (int i=0;i<_lods.size();i++) _lods[i].mirror(axis);
+    if (axis == 0) _lod_center.x = -_lod_center.x;
+    else if (axis == 1) _lod_center.y = -_lod_center.y;
+    else _lod_center.z = -_lod_center.z;
+  }
+  if (_paged && _paged.use_count() == 1) { // rewritten in place, as translate() does
+    _paged->rewrite([&](page_chunk& chunk) {
+      for (size_t i=axis;i<chunk.points.size();i+=3) chunk.points[i] = -chunk.points[i];
+      size_t offset = 0;
+      for (int i=0;i<chunk.face_sizes.size();i++) {
+        int size = chunk.face_sizes[i];
+        for (int j=0;j<size/2;j++) {
+          for (int c=0;c<3;c++) {
+            swap(chunk.points[(offset+j)*3+c], chunk.points[(offset+size-j-1)*3+c]);
+            swap(chunk.colors[(offset+j)*3+c], chunk.colors[(offset+size-j-1)*3+c]);
+          }
+        }
+        chunk_face_normals(chunk, offset, size);
+        offset += size;
+      }
+    });
+    return;
+  }
+  if (_compact || _paged) expand();
 
-  glTranslatef(_pos.x, _pos.y, _pos.z);
-  glRotatef(_orientation, _axis.x, _axis.y, _axis.z);
-  glTranslatef(-_pos.x, -_pos.y, -_pos.z);
+  for (int i=0;i<_coordinates.size();i++) {
+    if (axis == 0) _coordinates[i].x = -_coordinates[i].x;
+    else if (axis == 1) _coordinates[i].y = -_coordinates[i].y;
+    else _coordinates[i].z = -_coordinates[i].z;
+  }
+  if (_lattice) {
+    for (int i=0;i<_lattice_coordinates.size();i++) {
+      if (axis == 0) _lattice_coordinates[i].x = -_lattice_coordinates[i].x;
+      else if (axis == 1) _lattice_coordinates[i].y = -_lattice_coordinates[i].y;
+      else _lattice_coordinates[i].z = -_lattice_coordinates[i].z;
+    }
+    _rebuild_lattice();
+  }
 
-  glTranslatef(_pos.x, _pos.y, _pos.z);
-  for (int i=0;i<_sub_models.size();i++) _sub_models[i].draw(); // draw sub_models
+  // a reflection turns every face inside out, so each winding is reversed to keep the faces pointing outwards
+  for (int i=0;i<_facet_data.size();i++) {
+    int size = _facet_data[i].size();
+    for (int j=0;j<size/2;j++) swap(_facet_data[i][j], _facet_data[i][size-j-1]);
+  }
+  recalculate_normals();
+  _adjacency.clear();
+}
 
-  glPopMatrix();
+const half_edge_mesh& model3d::adjacency() const {
+  if (!_adjacency.built()) _adjacency.build(_facet_data, _coordinates.size());
+  return _adjacency;
 }
 
-void model3d::face_resolution(int polygon_count) {
-  if (_facet_data.back().size() < 3 || polygon_count < 2) return;
+void model3d::reverse_faces(const vector<int>& faces) {
+  _begin_edit();
+  for (int i=0;i<faces.size();i++) {
+    int face = faces[i];
+    if (face < 0 || face >= _facet_data.size()) continue;
+    reverse(_facet_data[face].begin(), _facet_data[face].end());
+    _calculate_normals(face);
+    _relink_face(face);
+  }
+}
 
-  vector<facet> face_facets = _facet_data.back();
-  vector<vect3f> face_points;
-  
-  for (int i=0;i<face_facets.size();i++) face_points.push_back(_coordinates[face_facets[i].id]);
+void model3d::set_color(const selection_set& selection, const vect3f& color) {
+  _begin_edit();
+  if (!selection.fits(*this)) return;
+  TRACE_SPAN(color_span, "model3d::set_color");
+  int index = _colors.insert(color);
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) if (selection.selected(i, j)) _facet_data[i][j].color = index;
+  }
+  TRACE_ARG(color_span, "facets", selection.count());
+}
 
-  _facet_data.back().clear();
+void model3d::translate(const selection_set& selection, const vect3f& offset) {
+  _begin_edit();
+  if (!selection.fits(*this)) return;
+  TRACE_SPAN(translate_span, "model3d::translate (selection)");
+  vector<char> moved(_coordinates.size(), 0);
+  for (int i=0;i<_facet_data.size();i++) {
+    for (int j=0;j<_facet_data[i].size();j++) if (selection.selected(i, j)) moved[_facet_data[i][j].id] = 1;
+  }
 
-  vect3f* anchor_point = &face_points[0];
-  facet* anchor_facet = &face_facets[0];
+  if (_lattice) {
+    lattice_point step = _snap(offset);
+    for (int i=0;i<moved.size();i++) {
+      if (!moved[i]) continue;
+      _lattice_coordinates[i].x += step.x;
+      _lattice_coordinates[i].y += step.y;
+      _lattice_coordinates[i].z += step.z;
+    }
+    _rebuild_lattice();
+  }
+  else for (int i=0;i<moved.size();i++) if (moved[i]) _coordinates[i] += offset;
 
-  for (int i=2;i<face_points.size();i++) {
-    vect3f* wall_point = &face_points[i-1];
-    facet* wall_facet = &face_facets[i-1];
-    vect3f step = (face_points[i]-(*wall_point))/(float)polygon_count;
-    vect3f color_step = (face_facets[i].color-(*wall_facet).color)/(float)polygon_count;
+  // a face moved whole keeps its normals; only the faces stretched across the selection's edge turn
+  int faces = 0;
+  for (int i=0;i<_facet_data.size();i++) {
+    int corners = 0;
+    for (int j=0;j<_facet_data[i].size();j++) corners += moved[_facet_data[i][j].id];
+    if (corners == 0 || corners == _facet_data[i].size()) continue;
+    _calculate_normals(i);
+    faces++;
+  }
+  TRACE_ARG(translate_span, "faces_stretched", faces);
+}
 
-    if (*wall_point == *anchor_point || (*wall_point)+(step*polygon_count) == *anchor_point) {
-      (*wall_point) += step*polygon_count;
-      continue;
+int model3d::remove(const selection_set& selection) {
+  _begin_edit();
+  if (!selection.fits(*this)) return 0;
+  TRACE_SPAN(remove_span, "model3d::remove (selection)");
+  int removed = 0;
+  for (int i=0;i<_facet_data.size();i++) {
+    vector<facet>& face = _facet_data[i];
+    int kept = 0;
+    for (int j=0;j<face.size();j++) {
+      if (selection.selected(i, j)) continue;
+      if (kept != j) face[kept] = face[j];
+      kept++;
     }
+    if (kept == face.size()) continue;
+    removed += face.size() - kept;
+    face.resize(kept);
+    _calculate_normals(i);
+    _relink_face(i);
+  }
+  _vertex_count -= removed;
+  TRACE_ARG(remove_span, "facets", removed);
+  _release(removed);
+  return removed;
+}
 
-    for (int j=0;j<polygon_count;j++) {
-      push_face();
-      add_vertex(*anchor_point, (*anchor_facet).color);
-      add_vertex(*wall_point, (*wall_facet).color);
-      (*wall_point) += step;
-      (*wall_facet).color += color_step;
-      add_vertex(*wall_point, (*wall_facet).color);
+model3d model3d::extract(const selection_set& selection) const {
+  if (_compact || _paged || !selection.fits(*this)) return model3d();
+  TRACE_SPAN(extract_span, "model3d::extract");
+  if (_need_normals) _calculate_normals();
+
+  vector<int> coordinate_map(_coordinates.size(), -1);
+  vector<vect3f> coordinates;
+  vector<vector<facet>> faces;
+  for (int i=0;i<_facet_data.size();i++) {
+    vector<facet> face;
+    for (int j=0;j<_facet_data[i].size();j++) {
+      if (!selection.selected(i, j)) continue;
+      const facet& f = _facet_data[i][j];
+      if (coordinate_map[f.id] < 0) {
+        coordinate_map[f.id] = coordinates.size();
+        coordinates.push_back(_coordinates[f.id]);
+      }
+      face.push_back(facet(coordinate_map[f.id], f.color, f.normal));
     }
+    if (!face.empty()) faces.push_back(move(face));
   }
+  faces.push_back(vector<facet>()); // (a new current face)
+
+  model3d extracted(move(coordinates), vector<vect3f>(_colors.values()), vector<vect3f>(_normals.values()), move(faces));
+  extracted.defragment(); // drops the colors and normals the facets didn't take
+  if (_lattice) extracted.set_lattice(_lattice_scale); // (the points are already on the lattice, so none move)
+  extracted._draw_mode = _draw_mode;
+  TRACE_ARG(extract_span, "facets", extracted.vertex_count());
+  return extracted;
 }
 
 
 // *** BEGIN FACET CLASS DEFINITIONS ***
 
+// a default facet refers to the first entry of each table
 facet::facet() {
   id = -1;
-  color = DEFAULT_COLOR;
-  normal = vect3f(0.0, 0.0, 1.0);
+  color = 0;
+  normal = 0;
 }
 
-facet::facet(int _id, const vect3f& _color, const vect3f& _normal)
+facet::facet(int _id, int _color, int _normal)
             : id(_id), color(_color), normal(_normal) { }
 
+
+// *** BEGIN LATTICE_POINT DEFINITIONS ***
+
+size_t lattice_point_hash::operator()(const lattice_point& p) const {
+  unsigned long long int h = (unsigned int)p.x;
+  h = h*0x9E3779B97F4A7C15ull + (unsigned int)p.y;
+  h = h*0x9E3779B97F4A7C15ull + (unsigned int)p.z;
+  return (size_t)(h ^ (h >> 29));
+}
+
+
+// *** BEGIN ATTRIBUTE_TABLE CLASS DEFINITIONS ***
+
+bool attribute_table::key::operator==(const key& other) const {
+  return (bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2]);
+}
+
+size_t attribute_table::key_hash::operator()(const key& k) const {
+  unsigned long long int h = k.bits[0];
+  h = h*0x9E3779B97F4A7C15ull + k.bits[1];
+  h = h*0x9E3779B97F4A7C15ull + k.bits[2];
+  return (size_t)(h ^ (h >> 29));
+}
+
+attribute_table::key attribute_table::_key(const vect3f& value) {
+  float components[3] = { value.x, value.y, value.z };
+  key k;
+  for (int i=0;i<3;i++) {
+    if (components[i] == 0.0f) components[i] = 0.0f; // -0.0 == 0.0, so they share an entry
+    memcpy(&k.bits[i], &components[i], sizeof(float));
+  }
+  return k;
+}
+
+attribute_table::attribute_table() : _indexed(true) { }
+
+int attribute_table::insert(const vect3f& value) {
+  if (!_indexed) { // first insert after assign(): index what's there, keeping the first of any duplicates
+    _index.clear();
+    _index.reserve(_values.size());
+    for (int i=0;i<_values.size();i++) _index.insert(make_pair(_key(_values[i]), i));
+    _indexed = true;
+  }
+
+  pair<unordered_map<key, int, key_hash>::iterator, bool> found = _index.insert(make_pair(_key(value), (int)_values.size()));
+  if (found.second) _values.push_back(value);
+  return found.first->second;
+}
+
+void attribute_table::assign(vector<vect3f>&& values) {
+  _values.swap(values);
+  _index.clear();
+  _indexed = false;
+}
+
+void attribute_table::clear() {
+  vector<vect3f>().swap(_values);
+  _index = unordered_map<key, int, key_hash>();
+  _indexed = true;
+}
+
+const vect3f& attribute_table::operator[](int i) const { return _values[i]; }
+
+int attribute_table::size() const { return _values.size(); }
+
+const vector<vect3f>& attribute_table::values() const { return _values; }
+
+size_t attribute_table::memory_usage() const {
+  // each index node holds the key, the index, a next pointer and (usually) the cached hash
+  return _values.capacity()*sizeof(vect3f) + _index.bucket_count()*sizeof(void*) + _index.size()*(sizeof(key)+sizeof(int)+2*sizeof(void*));
+}
+
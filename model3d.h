@@ -5,22 +5,83 @@
 #define MODEL3D_H
 
 #include "vectXf.h"
+#include "half_edge.h"
+#include "vertex_cache.h"
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <memory>
+#include <functional>
 
 #include <GL/gl.h>
 
+class fileio;
+class paged_store;
+class page_cache;
+class raster_frame;
+class render_queue;
+struct render_state;
+class selection_set;
+struct mesh_report;
+
 const vect3f DEFAULT_COLOR(1.0f, 0.0f, 1.0f);
 
+// a deduplicated list of attribute values (a model's colors or normals); facets refer to the values by index
+class attribute_table {
+  private:
+    struct key { // the bit patterns of a value (so lookups are exact, like vect3f's operator==)
+      unsigned int bits[3];
+      bool operator==(const key& other) const;
+    };
+    struct key_hash { size_t operator()(const key& k) const; };
+
+    std::vector<vect3f> _values;
+    std::unordered_map<key, int, key_hash> _index;
+    bool _indexed; // false after assign() until the next insert() rebuilds _index
+
+    static key _key(const vect3f& value);
+
+  public:
+    attribute_table();
+
+    int insert(const vect3f& value); // returns value's index, appending value if the table doesn't hold it yet
+    void assign(std::vector<vect3f>&& values); // takes values as they are (duplicates are kept)
+    void clear();
+
+    const vect3f& operator[](int i) const;
+    int size() const;
+    const std::vector<vect3f>& values() const;
+    size_t memory_usage() const; // approximate bytes held by the values and the hash index
+};
+
 struct facet {
-  int id;
-  vect3f color;
-  mutable vect3f normal;
+  int id;             // index into the model's coordinates
+  int color;          // index into the model's color table
+  mutable int normal; // index into the model's normal table
 
   facet();
-  facet(int _id, const vect3f& _color, const vect3f& _normal=vect3f(0.0, 0.0, 1.0));
+  facet(int _id, int _color, int _normal);
+};
+
+// a facet as held by a compacted model (see model3d::compact()): 12 bytes against sizeof(facet)
+struct compact_facet {
+  unsigned int id;
+  unsigned short normal[2]; // octahedral encoded unit normal
+  unsigned int color;       // RGBA8 (alpha is always 255)
+};
+
+// a position on a model's integer lattice (see model3d::set_lattice())
+struct lattice_point {
+  int x, y, z;
+
+  lattice_point() : x(0), y(0), z(0) { }
+  lattice_point(int _x, int _y, int _z) : x(_x), y(_y), z(_z) { }
+
+  bool operator==(const lattice_point& other) const { return (x == other.x && y == other.y && z == other.z); }
 };
 
+struct lattice_point_hash { size_t operator()(const lattice_point& p) const; };
+
 struct index2d {
   int data[2];
 
@@ -40,24 +101,75 @@ struct index2d {
 class model3d {
   private:
     inline static std::string SAVE_FILE_HEADER() { return std::string("model3d="); }
+    inline static std::string INDEXED_FILE_HEADER() { return std::string("model3i="); } // same length as SAVE_FILE_HEADER()
+    inline static std::string BINARY_FILE_HEADER() { return std::string("model3b="); } // same length as SAVE_FILE_HEADER()
+    static const unsigned int BINARY_FILE_VERSION = 2;
+    static const int DEFRAGMENT_THRESHOLD = 1024;
 
     GLenum _draw_mode;
     std::vector<vect3f> _coordinates;
     std::vector<std::vector<facet>> _facet_data;
+    attribute_table _colors;
+    mutable attribute_table _normals; // written by the (const) normal calculations
     int _vertex_count;
     bool _need_normals;
+    int _released; // facets removed or re-pointed since the last defragment() (an upper bound on the garbage it would find)
 
     std::vector<model3d> _sub_models;
 
+    mutable half_edge_mesh _adjacency; // built by adjacency() (see below)
+
+    // lattice mode: _lattice_coordinates is authoritative and each of _coordinates is derived from it (point*_lattice_scale)
+    bool _lattice;
+    float _lattice_scale;
+    std::vector<lattice_point> _lattice_coordinates;
+    std::unordered_map<lattice_point, int, lattice_point_hash> _lattice_index; // position -> the first coordinate id at it
+
+    // compact storage: while _compact, _coordinates and _facet_data are released (a single empty face is kept) and the geometry lives here
+    bool _compact;
+    vect3f _compact_origin, _compact_step; // coordinate = _compact_origin + quantized*_compact_step (per axis)
+    std::vector<unsigned short> _compact_coordinates; // quantized x, y, z per coordinate
+    std::vector<unsigned int> _compact_face_sizes;
+    std::vector<compact_facet> _compact_facets; // every face's facets, end to end
+
+    // paged storage: while _paged, _coordinates and _facet_data are released (as while _compact) and the geometry lives in the
+    //   store's page file, de-indexed; copies of the model share the store
+    std::shared_ptr<paged_store> _paged;
+
+    // levels of detail (see set_lods()), coarsest last, and the bounding sphere draw() measures the model's size on screen by
+    static const int LOD_FULL_PIXELS = 512; // the projected diameter below which the first level is drawn
+    std::vector<model3d> _lods;
+    vect3f _lod_center;
+    float _lod_radius;
+
     vect3f _pos, _axis;
     float _orientation, _new_orientation, _old_orientation;
     bool _smart_rotate, _anchored, _child_animate_flag;
     int _speed;
 
     void _initialize();
+    void _begin_edit(); // expands compact or paged storage and drops the levels of detail (which no longer match)
+    void _release(int facets); // counts garbage, defragmenting once enough has built up
     int _get_facet_id(const vect3f& point) const;
+    int _add_coordinate(const vect3f& point); // returns the id of the coordinate at point, appending one if there isn't one
     template <typename T> bool _in_bounds(const int* const indices, const std::vector<std::vector<T>>& vect) const;
-    void _calculate_normals() const;
+    void _calculate_normals(int face=-1) const; // face < 0 is the current (last) face
+    void _relink_face(int face); // brings the adjacency up to date with the face's facets
+    bool _load_binary(const std::string& data);
+    bool _load(const std::string& filename);
+    bool _load_text(fileio& file, bool indexed);
+    lattice_point _snap(const vect3f& point) const; // nearest lattice position
+    vect3f _lattice_position(const lattice_point& point) const;
+    void _rebuild_lattice(); // recomputes _coordinates and _lattice_index from _lattice_coordinates
+    vect3f _decode_coordinate(int id) const; // compact storage only
+    void _decode_facet(const compact_facet& f, vect3f& color, vect3f& normal) const; // compact storage only
+    bool _write_paged_binary(const std::function<void (const std::string&)>& write, bool include_lods) const; // paged storage only
+    void _write_lods(std::string& data) const;
+    void _draw_faces(GLenum draw_mode, bool vertex_materials=true, const index2d& highlighted=index2d(),
+                     const vect3f& highlight_color=vect3f()) const; // vertex_materials: glMaterialfv() each vertex's color (lit)
+    void _draw_paged(bool vertex_materials=true) const;
+    int _level_on_screen() const; // the level of detail draw() picks under the current gl matrices and viewport (0 for the model)
+    void _rasterize_faces(raster_frame& frame, const float* modelview) const;
 
     bool _use_draw_funcs;
     void (*_pre_draw)(const model3d&);
@@ -66,9 +178,14 @@ class model3d {
   public:
     bool set_material;
     vect4f diffuse, specular, shine;
+    bool use_lods; // draw() picks a level of detail by size on screen (if the model has any); true by default
 
     model3d();
-    model3d(const std::vector<vect3f>& coordinates, const std::vector<std::vector<facet>>& facets);
+    // facets index into coordinates, colors and normals; the color and normal lists are used as given (duplicates are kept)
+    model3d(const std::vector<vect3f>& coordinates, const std::vector<vect3f>& colors, const std::vector<vect3f>& normals,
+            const std::vector<std::vector<facet>>& facets);
+    model3d(std::vector<vect3f>&& coordinates, std::vector<vect3f>&& colors, std::vector<vect3f>&& normals,
+            std::vector<std::vector<facet>>&& facets); // takes ownership (avoids copying large generated meshes)
 
     void clear();
 
@@ -79,6 +196,8 @@ class model3d {
     const std::vector<vect3f>* const get_coordinates_ptr() const;
     std::vector<std::vector<facet>> get_facet_data() const;
     const std::vector<std::vector<facet>>* const get_facet_data_ptr() const;
+    const attribute_table* const get_colors_ptr() const;
+    const attribute_table* const get_normals_ptr() const;
     GLenum get_draw_mode() const;
 
     void set_draw_mode(GLenum);
@@ -91,14 +210,105 @@ class model3d {
     void push_face();
     void pop_face();
 
-    void recalculate_normals() const;
+    void recalculate_normals() const; // recalculates the normals of every face
+
+    // adjacency (see half_edge.h): built from the faces on first use, in linear time, then kept up to date by add_vertex(),
+    //   edit_vertex(), remove_vertex(), push_face(), pop_face(), set_face() and resize_faces() (each relinking only the face it
+    //   edits); edits that renumber or rewrite every face (defragment(), mirror(), compact(), loading, ...) drop it until it's next
+    //   asked for. empty while compact or paged (as get_facet_data_ptr() is).
+    const half_edge_mesh& adjacency() const;
+    void reverse_faces(const std::vector<int>& faces); // reverses the faces' windings (and normals), e.g. the faces adjacency().orient() lists
+
+    // bulk edits of the facets a selection holds (see selection.h), each a single pass over the model; a selection that no longer
+    //   fits the model edits nothing. set_color() recolors the facets; translate() moves the coordinates they use (and so any other
+    //   facets at those coordinates), recalculating the normals of the faces it stretches (a face moved whole keeps its normals);
+    //   remove() deletes the facets (emptied faces are kept, as remove_vertex() keeps them), returning how many it removed;
+    //   extract() copies them out as a new model, with a face for each face they were in.
+    void set_color(const selection_set& selection, const vect3f& color);
+    void translate(const selection_set& selection, const vect3f& offset);
+    int remove(const selection_set& selection);
+    model3d extract(const selection_set& selection) const;
+
+    // checks the faces against the coordinate, color and normal tables, repairing them unless told not to (see validate.h)
+    mesh_report validate(bool repair=true);
 
     void face_resolution(int polygon_count);
 
-    int vertex_count() const;
+    void merge(const model3d& other); // appends each of other's faces (coordinates are shared with existing points)
+    void translate(const vect3f& offset);
+    void mirror(int axis); // inverts the coordinates along axis (0=x, 1=y, 2=z) and reverses each face's winding
 
-    void save(std::string& filename=std::string()) const; // produces filename if filename has zero length to the saved file name
-    bool load(const std::string& filename);
+    int vertex_count() const;
+    int coordinate_count() const;
+    int face_count() const;
+
+    // face level access by value (used by edit_history): get_face() appends a face's points, colors and normals to the vectors;
+    //   set_face() replaces a face's facets with the given values and resize_faces() truncates or appends empty faces. ids, if given,
+    //   are the coordinates the points are at, saving set_face() a search for each: -1 for a point at no coordinate (one is appended)
+    void get_face(int face, std::vector<vect3f>& points, std::vector<vect3f>& colors, std::vector<vect3f>& normals) const;
+    void set_face(int face, const std::vector<vect3f>& points, const std::vector<vect3f>& colors, const std::vector<vect3f>& normals,
+                  const std::vector<int>* const ids=0);
+    void resize_faces(int count);
+
+    // removes coordinates no facet refers to (renumbering facet ids), unused color and normal table entries and empty faces
+    //   (other than the current, last, face), and recounts the facets. runs in linear time. edits that remove facets trigger it
+    //   once they've removed at least DEFRAGMENT_THRESHOLD facets and a quarter of the model (keeping empty faces, so the face
+    //   indices held by the editor and its history stay valid); save() (also keeping empty faces) and compact() write
+    //   defragmented data. returns the number of coordinates removed.
+    int defragment(bool drop_empty_faces=true);
+
+    // reorders the faces for a post transform vertex cache of cache_size entries (see vertex_cache.h), then the coordinates, colors
+    //   and normals by first use, so drawing or walking the faces reads each table front to back; the levels of detail are reordered
+    //   too. the current (last) face stays last. face indices and coordinate ids change (the editor's history and journal no longer
+    //   apply), so it's for finished models: save_binary() runs it on a copy. paged models are left alone (their pages are de-indexed).
+    void optimize_order(int cache_size=DEFAULT_VERTEX_CACHE);
+
+    // compact storage, for models that are kept (loaded, hidden, swapped out) but not edited:
+    //   coordinates are quantized to 16 bits per axis within the model's bounding box, normals are octahedral encoded
+    //   to 2x16 bits and colors are clamped to [0, 1] and packed to RGBA8. compact models still draw, save and merge;
+    //   anything that edits the model expands it first. get_coordinates_ptr() and get_facet_data_ptr() are empty while compact.
+    void compact();
+    void expand();
+    bool is_compact() const;
+    size_t memory_usage() const; // approximate bytes held by the model's geometry and levels of detail (excluding sub models)
+    bool get_bounds(vect3f& low, vect3f& high) const; // of the coordinates and sub models, at the model's position (unrotated); false if empty
+
+    // paged storage, for models larger than memory: page_out() moves the geometry into fixed size chunks of a page file, which are
+    //   read back through cache (an LRU of chunks held within a memory budget) as they're needed. draw() reads only the chunks
+    //   within the view frustum, prefetching them ahead of drawing; save(), save_binary() and to_binary() stream the chunks in turn.
+    //   translate() and mirror() rewrite the chunks in place; anything else that edits the model expands it first (reading it all
+    //   back in, as with compact storage). load_paged() pages a binary format file as it's read, never holding all of it.
+    //   the cache must outlive the model (and its copies).
+    bool page_out(page_cache& cache);
+    bool load_paged(const std::string& filename, page_cache& cache); // other formats (and lattice models) are loaded, then paged
+    bool is_paged() const;
+    const paged_store* const get_paged_ptr() const; // null unless paged
+
+    // levels of detail: coarser versions of the model (see build_lods() in lod.h) drawn in its place while it's small on screen.
+    //   draw() picks level n (0 being the model itself) once the model's projected diameter falls below LOD_FULL_PIXELS/2^(n-1),
+    //   so each level of a quarter of the faces of the one before covers about as many pixels per face. the levels move with
+    //   translate() and mirror(); any other edit drops them. to_binary() and save_binary() write them when asked to (load() reads them).
+    void set_lods(std::vector<model3d>&& levels);
+    void clear_lods();
+    const std::vector<model3d>& get_lods() const;
+    int select_lod(const float* projection, const float* modelview, int viewport_height) const; // column major gl matrices
+
+    // lattice mode: coordinates are held as int32 multiples of a per-model scale and only converted to floats for drawing and saving.
+    //   points are snapped to the lattice as they're added or edited, so equal points always weld and are found by hash rather than
+    //   by search; translations (snapped to lattice multiples) and mirroring are lossless. the mode survives clear() and load().
+    float set_lattice(float scale); // converts (and welds) the current coordinates; returns the largest distance a coordinate moved
+    void clear_lattice();            // returns to float coordinates at the current positions
+    bool is_lattice() const;
+    float get_lattice_scale() const;
+    const std::vector<lattice_point>* const get_lattice_ptr() const; // empty unless in lattice mode
+
+    void save() const;
+    void save(std::string& filename, bool indexed=true) const; // produces filename if filename has zero length to the saved file name
+                                                                // (indexed text format, or the original model3d= format if !indexed)
+    bool save_binary(const std::string& filename, bool include_lods=false, bool optimize=true) const; // optimize: see optimize_order()
+    bool load(const std::string& filename, mesh_report* report=0); // accepts both the text and binary formats; validates what it reads (filling report)
+    void to_binary(std::string& data, bool include_lods=false) const; // appends the binary format to data (an exact image: not defragmented, unlike save_binary())
+    bool from_binary(const std::string& data); // replaces the model with a binary format image (as load() would)
 
     void set_pos(const vect3f& pos);
     vect3f get_pos() const;
@@ -114,6 +324,11 @@ class model3d {
     void operator++(int);
 
     void draw() const;
+    // queues draw()'s faces (see render_queue.h) with state; the highlighted facet (of the model itself, not its levels of detail or
+    //   sub models) is drawn in highlight_color rather than its own
+    void submit(render_queue& queue, const render_state& state, const index2d& highlighted=index2d(),
+                const vect3f& highlight_color=vect3f()) const;
+    void rasterize(raster_frame& frame, const float* modelview) const; // draws into a software frame (see raster.h) as draw() draws with gl
 };
 
 #endif
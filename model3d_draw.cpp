@@ -0,0 +1,217 @@
+// File: model3d_draw.cpp
+// Written by Joshua Green
+
+// model3d's rendering lives apart from model3d.cpp so that tools which only load, edit and save models
+// (modeler_cli, model_gen, modeler_bench) can link model3d without opengl.
+
+#include "model3d.h"
+#include "vectXf.h"
+#include "paged.h"
+#include "profiler.h"
+#include "render_queue.h"
+
+#include <GL/gl.h>
+#include <GL/glut.h>
+#include <GL/glu.h>
+
+#include <vector>
+#include <memory>
+using namespace std;
+
+namespace {
+  // the diffuse material the vertices of one draw have set, so a run of vertices of one color (most faces are) sets it once
+  struct vertex_material {
+    bool enabled, known; // enabled is false while unlit (the material isn't used)
+    vect3f color;
+
+    vertex_material(bool enable) : enabled(enable), known(false) { }
+  };
+
+  void draw_vertex(const vect3f& point, const vect3f& color, const vect3f& normal, vertex_material& material) {
+    glColor3f(color.x, color.y, color.z);
+
+    #ifndef USE_GL_COLOR_MATERIAL
+      if (material.enabled && (!material.known || color != material.color)) {
+        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, vect4f(color.x, color.y, color.z, 1.0));
+        PROFILE_COUNT(COUNTER_MATERIAL_CHANGES, 1);
+        material.known = true;
+        material.color = color;
+      }
+    #endif
+
+    glNormal3f(normal.x, normal.y, normal.z);
+    glVertex3f(point.x, point.y, point.z);
+  }
+
+  // facet k of a page_chunk
+  void draw_chunk_vertex(const page_chunk& chunk, size_t k, vertex_material& material) {
+    const float* const p = &chunk.points[k*3];
+    const float* const c = &chunk.colors[k*3];
+    const float* const n = &chunk.normals[k*3];
+    draw_vertex(vect3f(p[0], p[1], p[2]), vect3f(c[0], c[1], c[2]), vect3f(n[0], n[1], n[2]), material);
+  }
+}
+
+// only the chunks within the view frustum are read (in order, with those after the one being drawn prefetched)
+void model3d::_draw_paged(bool vertex_materials) const {
+  float projection[16], modelview[16];
+  for (int i=0;i<16;i++) projection[i] = modelview[i] = (i%5 == 0 ? 1.0f : 0.0f);
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  view_frustum frustum(projection, modelview);
+
+  vector<int> visible;
+  for (int i=0;i<_paged->chunk_count();i++) {
+    if (frustum.intersects(_paged->info(i).low, _paged->info(i).high)) visible.push_back(i);
+  }
+
+  vertex_material material(vertex_materials);
+  _paged->visit(visible, [&](int, const page_chunk& chunk) {
+    size_t offset = 0;
+    for (int i=0;i<chunk.face_sizes.size();i++) { // ...for each face
+      glBegin(_draw_mode);
+      PROFILE_COUNT(COUNTER_DRAW_CALLS, 1);
+      PROFILE_COUNT(COUNTER_VERTICES, chunk.face_sizes[i]);
+      for (int j=0;j<chunk.face_sizes[i];j++) draw_chunk_vertex(chunk, offset+j, material); // ...for each vertex
+      glEnd();
+      offset += chunk.face_sizes[i];
+    }
+  });
+}
+
+void model3d::_draw_faces(GLenum draw_mode, bool vertex_materials, const index2d& highlighted, const vect3f& highlight_color) const {
+  vertex_material material(vertex_materials);
+  if (_compact) { // decoded vertex by vertex; nothing is expanded
+    size_t offset = 0;
+    vect3f color, normal;
+    for (int i=0;i<_compact_face_sizes.size();i++) { // ...for each face
+      glBegin(draw_mode);
+      PROFILE_COUNT(COUNTER_DRAW_CALLS, 1);
+      PROFILE_COUNT(COUNTER_VERTICES, _compact_face_sizes[i]);
+      for (int j=0;j<_compact_face_sizes[i];j++) { // ...for each vertex
+        const compact_facet& f = _compact_facets[offset+j];
+        _decode_facet(f, color, normal);
+        if (i == highlighted[0] && j == highlighted[1]) color = highlight_color;
+        draw_vertex(_decode_coordinate(f.id), color, normal, material);
+      }
+      glEnd();
+      offset += _compact_face_sizes[i];
+    }
+  }
+  else {
+    for (int i=0;i<_facet_data.size();i++) { // ...for each face
+      glBegin(draw_mode);
+      PROFILE_COUNT(COUNTER_DRAW_CALLS, 1);
+      PROFILE_COUNT(COUNTER_VERTICES, _facet_data[i].size());
+      for (int j=0;j<_facet_data[i].size();j++) { // ...for each vertex
+        // _facets[i][j] is the index which corresponds with _coordinates.
+        // _coordinates[index] contains a vertex3f struct containing x,y,z coordinates
+        const facet& f = _facet_data[i][j];
+        const vect3f& color = (i == highlighted[0] && j == highlighted[1] ? highlight_color : _colors[f.color]);
+        draw_vertex(_coordinates[f.id], color, _normals[f.normal], material);
+      }
+      glEnd();
+    }
+  }
+}
+
+// a level of detail in place of the model while it's small on screen
+int model3d::_level_on_screen() const {
+  if (!use_lods || _lods.empty()) return 0;
+  float projection[16], modelview[16];
+  GLint viewport[4] = { 0, 0, 0, 0 };
+  for (int i=0;i<16;i++) projection[i] = modelview[i] = (i%5 == 0 ? 1.0f : 0.0f);
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  return select_lod(projection, modelview, viewport[3]);
+}
+
+void model3d::draw() const {
+  if (set_material) {
+    glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
+    glMaterialfv(GL_FRONT, GL_SHININESS, shine);
+    PROFILE_COUNT(COUNTER_MATERIAL_CHANGES, 3);
+  }
+
+  glPushMatrix();
+
+  if (_use_draw_funcs) _pre_draw(*this);
+
+  if (!_anchored) {
+    glTranslatef(_pos.x, _pos.y, _pos.z);
+    glRotatef(_orientation, _axis.x, _axis.y, _axis.z);
+    glTranslatef(-_pos.x, -_pos.y, -_pos.z);
+  }
+  glTranslatef(_pos.x, _pos.y, _pos.z);
+
+  int level = _level_on_screen();
+  if (level > 0) _lods[level-1]._draw_faces(_draw_mode);
+  else if (_paged) _draw_paged();
+  else _draw_faces(_draw_mode);
+
+  if (_use_draw_funcs) _post_draw(*this);
+
+  glPopMatrix();
+
+  glPushMatrix();
+
+  glTranslatef(_pos.x, _pos.y, _pos.z);
+  glRotatef(_orientation, _axis.x, _axis.y, _axis.z);
+  glTranslatef(-_pos.x, -_pos.y, -_pos.z);
+
+  glTranslatef(_pos.x, _pos.y, _pos.z);
+  for (int i=0;i<_sub_models.size();i++) _sub_models[i].draw(); // draw sub_models
+
+  glPopMatrix();
+}
+
+// the transforms are draw()'s, taken through gl's matrix stack and captured with each item; the items point at this model (and
+//   its levels of detail and sub models), which must be left as it is until the queue has executed
+void model3d::submit(render_queue& queue, const render_state& state, const index2d& highlighted, const vect3f& highlight_color) const {
+  float modelview[16];
+  render_state own(state);
+  own.draw_mode = _draw_mode;
+
+  if (_use_draw_funcs) { // the draw functions may set any state, so draw() is queued whole
+    own.material = 0;
+    render_queue::current_modelview(modelview);
+    queue.submit(own, modelview, [this]() { draw(); });
+    return;
+  }
+  own.material = (set_material ? queue.material(diffuse, specular, shine) : 0);
+
+  glPushMatrix();
+
+  if (!_anchored) {
+    glTranslatef(_pos.x, _pos.y, _pos.z);
+    glRotatef(_orientation, _axis.x, _axis.y, _axis.z);
+    glTranslatef(-_pos.x, -_pos.y, -_pos.z);
+  }
+  glTranslatef(_pos.x, _pos.y, _pos.z);
+  render_queue::current_modelview(modelview);
+
+  int level = _level_on_screen();
+  const model3d* model = (level > 0 ? &_lods[level-1] : this);
+  GLenum draw_mode = _draw_mode;
+  bool materials = (state.lighting && !state.shaded); // (the lighting program takes the vertex colors as its material)
+  if (model->_paged) queue.submit(own, modelview, [model, materials]() { model->_draw_paged(materials); });
+  else if (model != this) queue.submit(own, modelview, [model, draw_mode, materials]() { model->_draw_faces(draw_mode, materials); });
+  else queue.submit(own, modelview, [model, draw_mode, materials, highlighted, highlight_color]() {
+    model->_draw_faces(draw_mode, materials, highlighted, highlight_color);
+  });
+
+  glPopMatrix();
+
+  glPushMatrix();
+
+  glTranslatef(_pos.x, _pos.y, _pos.z);
+  glRotatef(_orientation, _axis.x, _axis.y, _axis.z);
+  glTranslatef(-_pos.x, -_pos.y, -_pos.z);
+
+  glTranslatef(_pos.x, _pos.y, _pos.z);
+  for (int i=0;i<_sub_models.size();i++) _sub_models[i].submit(queue, state);
+
+  glPopMatrix();
+}
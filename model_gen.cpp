@@ -0,0 +1,100 @@
+// File: model_gen.cpp
+// Written by Joshua Green
+
+// Command line front end for mesh_gen: writes synthetic models for stress tests and benchmarks.
+//
+// usage:
+//   model_gen <sphere|torus|terrain|soup> <output file> [--faces=N] [--seed=N] [--sharing=F] [--valence=N] [--threads=N] [--binary | --legacy-text]
+//
+// example:
+//   model_gen terrain models/terrain_1m --faces=1000000 --binary
+
+#include "mesh_gen.h"
+#include "model3d.h"
+#include "parallel.h"
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+using namespace std;
+
+namespace {
+  void usage() {
+    cout << "usage: model_gen <sphere|torus|terrain|soup> <output file> [options]" << endl
+         << "  --faces=N     approximate number of faces (default 1000)" << endl
+         << "  --seed=N      random seed (default 1)" << endl
+         << "  --sharing=F   soup: fraction of corners that reuse an existing coordinate, 0.0-0.999 (default 0.5)" << endl
+         << "  --valence=N   soup: corners per face (default 3)" << endl
+         << "  --threads=N   worker threads (default: all hardware threads)" << endl
+         << "  --binary      write the binary model format instead of text" << endl
+         << "  --legacy-text write the original model3d= text format instead of the indexed one" << endl;
+  }
+
+  double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+
+  string shape(argv[1]);
+  string filename(argv[2]);
+  mesh_params params;
+  bool binary = false, legacy_text = false;
+
+  for (int i=3;i<argc;i++) {
+    if (strncmp(argv[i], "--faces=", 8) == 0) params.faces = atoll(argv[i]+8);
+    else if (strncmp(argv[i], "--seed=", 7) == 0) params.seed = strtoul(argv[i]+7, 0, 10);
+    else if (strncmp(argv[i], "--sharing=", 10) == 0) params.sharing = atof(argv[i]+10);
+    else if (strncmp(argv[i], "--valence=", 10) == 0) params.valence = atoi(argv[i]+10);
+    else if (strncmp(argv[i], "--threads=", 10) == 0) params.threads = atoi(argv[i]+10);
+    else if (strcmp(argv[i], "--binary") == 0) binary = true;
+    else if (strcmp(argv[i], "--legacy-text") == 0) legacy_text = true;
+    else {
+      cout << "Unknown option: " << argv[i] << endl;
+      usage();
+      return 1;
+    }
+  }
+
+  if (shape != "sphere" && shape != "torus" && shape != "terrain" && shape != "soup") {
+    cout << "Unknown shape: " << shape << endl;
+    usage();
+    return 1;
+  }
+
+  cout << "Generating " << shape << " (" << params.faces << " faces, seed " << params.seed << ", "
+       << (params.threads > 0 ? params.threads : hardware_threads()) << " threads)...";
+  cout.flush();
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  model3d model = generate_mesh(shape, params);
+  double generate_time = seconds_since(start);
+  cout << " done. (" << generate_time << "s)" << endl;
+
+  const vector<vector<facet>>* const faces = model.get_facet_data_ptr();
+  cout << "  faces: " << faces->size()-1 << ", coordinates: " << model.get_coordinates_ptr()->size()
+       << ", facets: " << model.vertex_count() << endl;
+
+  cout << "Saving...";
+  cout.flush();
+  start = chrono::steady_clock::now();
+  bool saved = true;
+  if (binary) saved = model.save_binary(filename);
+  else model.save(filename, !legacy_text);
+  double save_time = seconds_since(start);
+
+  if (!saved) {
+    cout << " error writing file. (file: " << filename << ")" << endl;
+    return 1;
+  }
+  cout << " done. (file: " << filename << ", " << save_time << "s)" << endl;
+
+  return 0;
+}
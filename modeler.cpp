@@ -4,6 +4,15 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <functional>
+#include <memory>
 
 // needed for multithreading...
 #include <process.h>
@@ -15,42 +24,102 @@
 #include "vectXf.h"
 #include "model3d.h"
 #include "cube.h"
+#include "profiler.h"
+#include "trace.h"
+#include "preload.h"
+#include "history.h"
+#include "journal.h"
+#include "session.h"
+#include "paged.h"
+#include "lod.h"
+#include "input_trace.h"
+#include "render_queue.h"
+#include "shader.h"
+#include "selection.h"
+#include "prompt.h"
+#include "validate.h"
+#include "frame.h"
+#include "fileio/fileio.h"
 using namespace std;
 
 
 //#define USE_GL_COLOR_MATERIAL
 #define USE_SPECULAR
+#define USE_COMPACT_MODELS // models not being edited (LOADED_MODELS) are kept in model3d's compact storage
 
 // openGL function declarations
 void init_opengl();    // sets openGL settings
 void display();        // primary display func
 void mouse_callback(int btn, int state, int x, int y);
 void keyboard_callback(unsigned char key, int x, int y);
-void refresh(); // refreshes the display (a bit convoluted.. essientially calls display() but use this instead)
+void special_keys_callback(int key, int x, int y);
+void refresh(unsigned int changed=FRAME_ALL); // requests a frame drawing what changed (FRAME_ flags); requests are coalesced into one frame per FRAME_INTERVAL_MS
+void frame_timer(int); // posts the frame refresh() requested
 void window_resize(int w, int h);
 void set_camera();
 void draw_pointer(); // draws the cursor
 void draw_axis();
+void draw_selection(); // the selected facets' points (queued by display())
+void draw_scene(); // the camera, light, axis, cursor, models and grid (drawn by display() when any changed, then cached in SCENE_LAYER)
+void draw_grid(); // the outlines of the unit cubes not highlighted (compiled into GRID_LIST)
 void draw_color_palette();
 void init_lighting();
 void set_light_pos();
 void set_ambient();
 void draw_light();
-
-void quit_branch(void*); // for multithreading
-void save_branch(void*); // for multithreading
-void load_branch(void*); // for multithreading
-void define_grid_branch(void*); // for multithreading
-void merge_model_branch(void*); // for multithreading
-void face_resolution_branch(void*); // for multithreading
-void translate_model_branch(void*); // for multithreading
-void transform_model_branch(void*); // for multithreading
+void draw_prompt(); // PROMPT's question and the background operations still running (over the bottom of the scene)
+
+// dialogs: each asks its questions through PROMPT and does what was asked once they're answered (on the glut thread)
+void quit_prompt();
+void save_prompt();
+void load_prompt();
+void define_grid_prompt();
+void merge_model_prompt();
+void face_resolution_prompt();
+void translate_model_prompt();
+void transform_model_prompt();
+void select_prompt();
+void bulk_edit_prompt();
+void preload_prompt();
+
+void preload_branch(void*); // for multithreading
+void operation_branch(void*); // runs a background_operation's work (a background_operation*, handed back through OPERATIONS_FINISHED)
+void journal_timer(int); // flushes JOURNAL every JOURNAL_FLUSH_MS
+void print_stale_journal(); // after JOURNAL.recover() moved a journal that didn't apply aside
+void attach_journal(const string& model_filename); // attaches JOURNAL to the model's journal (or, while tracing, to TRACE_FILE's)
+void session_write_branch(void*); // writes a captured session (a session_snapshot*, deleted once written)
+void session_page_branch(void*); // reads the restored session's registry models (a session_state*, deleted once read)
+void lod_branch(void*); // builds a loaded model's levels of detail (an lod_job*, handed back through LOD_FINISHED)
 
 // misc utility functions
 template <typename T> bool in_bounds(const int* const, const vector<vector<T>>&); // true if int vertices[2] is a valid index within the 2d vector
 void edit_model(int); // switches a loaded model buffer with active editing buffer
 void define_cube(); // defines the grid lines using UNIT_SIZE and CUBE_COUNT
-bool prompt_save();
+void confirm_unsaved(const function<void ()>& confirmed); // calls confirmed() once the edited model's unsaved changes may be abandoned
+void quit(bool unsaved); // writes the session (unsaved: the edited model's changes weren't saved) and exits
+void start_operation(const string& label, const function<void ()>& work, const function<void ()>& finish); // see background_operation
+void finish_operations(); // calls finish() for the operations whose work is done (glut thread only)
+int operations_running(); // background operations whose work isn't done
+void start_model_edit(const string& label, const function<void (model3d&)>& edit, const function<void ()>& record,
+                      const function<void ()>& done); // edits a copy of WORKING_MODEL in the background (see working_stamp)
+void start_select(const function<void (selection_set&, const model3d&)>& select); // selects from a copy of WORKING_MODEL in the background
+void print_selection(double ms); // SELECTION's size and the time it took to select
+bool selection_editable(); // true if SELECTION holds facets of WORKING_MODEL (clearing it and saying so otherwise)
+void install_preloaded_models(); // moves models finished by preload_branch into their LOADED_MODELS slots (glut thread only)
+void compact_model(int); // pages out (with --page-budget) or compacts (if USE_COMPACT_MODELS) a loaded model, reporting its memory
+void start_lods(int); // starts building a loaded model's levels of detail in the background (once a slot receives a model)
+void install_lods(); // gives the levels finished by lod_branch to their LOADED_MODELS slots (glut thread only)
+void memory_report(); // prints the memory held by the edited and loaded models
+vector<int> current_face(); // WORKING_MODEL's current (last) face, as a face list for HISTORY
+void journal_add_vertex(const index2d& added); // journals a vertex added to WORKING_MODEL (as it was stored)
+struct session_snapshot;
+session_snapshot* capture_session(); // copies the editor state and models for write_session() (0 while models are still loading)
+bool restore_session(session_state& state); // reads SESSION_FILE (the state and edited model), returning false if there isn't one
+int key_modifiers(); // glutGetModifiers(), or the modifiers recorded with the event being replayed
+bool replay_step(); // dispatches the next of REPLAY_EVENTS and displays a frame, returning false once the trace is finished
+void replay_idle(); // replay_step() from glut's idle loop, reporting and exiting at the end of the trace
+void print_latencies(const latency_summary& summary); // (for replay_report())
+void replay_report(); // prints the per event latencies and frame times of the replay (and writes REPLAY_CSV)
 
 // globals
 int   SCREEN_W = 800,    SCREEN_H = 600;
@@ -62,15 +131,74 @@ float UNIT_SIZE; // grid line width
 int CUBE_COUNT; // number of unit cubes centered at origin
 index2d SELECTED(-1, 0); // the currently selected vertex (used via Tab button) ((-1, -1) is the convention for no selection)
 vect3f HIGHLIGHTED_COLOR(1.0f, 1.0f, 1.0f);
+selection_set SELECTION; // facets of WORKING_MODEL selected for bulk edits ('b' selects, 'e' edits; drawn as points in SELECTION_COLOR)
+vect3f SELECTION_COLOR(1.0f, 1.0f, 0.0f);
 bool DRAW_POLYGON_MODE = false; // if false glBegin(GL_LINES) is used, true = glBegin(GL_POLYGON)
+render_queue RENDER_QUEUE; // the models and grid are queued by display() and drawn sorted by state ('R' reports the last frame's state changes)
 bool HIGHLIGHT = true; // toggles the highlight of the working unit cube
+#ifdef USE_GLSL_LIGHTING // (see shader.h)
+lighting_program LIGHTING_PROGRAM; // loaded once the gl context exists; lit models use it unless 'H' turns it off
+#endif
+bool USE_LIGHTING_PROGRAM = true;
+const double FRAME_INTERVAL_MS = 1000.0/60.0; // frames are drawn on demand, at most one per interval
+frame_scheduler FRAMES(FRAME_INTERVAL_MS); // what changed since the last frame ('R' reports the frames drawn and requests coalesced)
+layer_cache SCENE_LAYER; // the last scene drawn, recomposited by frames where only the palette or overlays changed
+display_list GRID_LIST; // the grid's outlines (recompiled when the grid is redefined or the highlighted unit cubes change)
+vector<int> GRID_HIGHLIGHTED; // RUBIX indices of the unit cubes containing the cursor (drawn translucent, outside GRID_LIST)
+display_list PALETTE_LIST; // the palette (recompiled when its alpha or gamma change)
+thread::id GLUT_THREAD = this_thread::get_id();
+
+// paged models (--page-budget=<MB>): loaded models are paged out of core rather than compacted, within a budget for all of them
+//   (declared ahead of the models, which must be gone before it)
+double PAGE_BUDGET_MB = 0.0; // zero keeps loaded models in memory
+page_cache PAGE_CACHE;
 
 model3d WORKING_MODEL; // the model currently being edited
+edit_history HISTORY; // undo ('z') and redo ('Z') of WORKING_MODEL's edits
+model_journal JOURNAL; // autosave of WORKING_MODEL's edits since it was last loaded or saved (<file>.journal, replayed at startup or load)
+const int JOURNAL_FLUSH_MS = 2000;
+string TRACE_FILE; // the input trace being recorded or replayed: its run journals to <trace>.journal, never to a model's journal
+string WORKING_FILENAME = "untitled"; // the file WORKING_MODEL was loaded from or saved to
 
 bool DISPLAY_WORKING_MODEL = true; // if false, the edited model buffer is not displayed.
 
-vector<model3d> LOADED_MODELS; // the loaded models (accessed via load/save) (display toggled via 1-9) (edited via F1-F9)
-bool DRAW_MODELS[9] = {0, 0, 0, 0, 0, 0, 0, 0, 0}; // used to toggled the display of loaded/saved models
+vector<model3d> LOADED_MODELS; // the loaded models (accessed via load/save/preload) (display toggled via 1-9, or 0 for all) (edited via F1-F9)
+vector<bool> DRAW_MODELS(9, false); // used to toggled the display of loaded/saved models (grows with LOADED_MODELS)
+
+// preloading (started with --preload=<directory or manifest> or the 'L' key)
+mutex PRELOAD_LOCK; // guards the PRELOAD_ variables below, which are shared with preload_branch
+string PRELOAD_PATH; // directory or manifest given by --preload= or preload_prompt() (read and cleared by preload_branch)
+vector<string> PRELOAD_FILES; // files being preloaded (empty when no preload is running)
+vector<int> PRELOAD_SLOTS; // LOADED_MODELS slot reserved for each of PRELOAD_FILES (assigned on the glut thread)
+vector<pair<int, preload_result*>> PRELOAD_QUEUE; // (PRELOAD_FILES index, result) finished but not yet installed
+int PRELOAD_INSTALLED = 0; // number of PRELOAD_FILES installed so far
+vector<bool> PRELOAD_SHOW; // whether each of PRELOAD_FILES is displayed once installed (empty displays them all)
+chrono::steady_clock::time_point STARTUP_TIME = chrono::steady_clock::now();
+double FIRST_FRAME_MS = -1.0; // startup until the first frame was displayed (the window is interactive from then on)
+
+// sessions (the editor state and every model, written by 'V' and on quit, restored at startup)
+string SESSION_FILE = "modeler.session"; // set with --session=<file>
+atomic<bool> SESSION_WRITING(false); // a session_write_branch is running
+float CAMERA_MATRIX[16]; // the modelview matrix as last set (read on the glut thread, so branches can capture it)
+
+struct session_snapshot {
+  session_state state;
+  model3d working;
+  vector<model3d> models;
+};
+
+// levels of detail (built in the background for loaded models of at least LOD_MIN_FACES faces; toggled with 'O')
+struct lod_job {
+  int slot, generation;
+  model3d model; // a copy of the slot's model
+  vector<model3d> levels;
+  double ms;
+};
+const int LOD_MIN_FACES = 4096;
+bool USE_LODS = true;
+mutex LOD_LOCK; // guards LOD_FINISHED, which is shared with lod_branch
+vector<lod_job*> LOD_FINISHED;
+vector<int> LOD_GENERATION; // per LOADED_MODELS slot, bumped as the slot's model changes (a job for an older model is dropped)
 
 bool DRAW_PALETTE = true; // never toggled off but still here
 const float PALETTE_HEIGHT = 3.5f;
@@ -80,9 +208,31 @@ float PALETTE_MOUSE_CTRL[2]; // the left x value and width of the area which con
                              //   (since that location is calculated dynamically depending on window size)
 
 vect3f SELECTED_COLOR(1.0f, 0.0, 0.0); // the last selected color from the palette
-vect3f* COLOR_MAP = new vect3f[WORLD_W]; // the color map used to map the palette coords to the particular color
-
-bool ALREADY_BRANCHED = false; // only one branching operation at a time (don't want to be loading and saving at the same time...)
+vect3f* COLOR_MAP = new vect3f[(int)WORLD_W]; // the color map used to map the palette coords to the particular color
+
+command_prompt PROMPT; // the dialogs' questions, drawn above the palette and answered from the keyboard (Escape cancels one)
+
+// operations a dialog starts in the background (saving, loading, merging, selecting and the face and bulk edits): work() runs on its
+//   own thread, then finish() on the glut thread (display() calls finish_operations()), so the window keeps drawing while they run
+//   and several can be in flight
+struct background_operation {
+  string label; // drawn above the prompt while the work runs
+  function<void ()> work, finish;
+};
+mutex OPERATIONS_LOCK; // guards OPERATIONS_RUNNING and OPERATIONS_FINISHED, which are shared with operation_branch
+vector<background_operation*> OPERATIONS_RUNNING, OPERATIONS_FINISHED;
+int WORKING_GENERATION = 0; // bumped as WORKING_MODEL is replaced by another model (a save finishing afterwards leaves the journal alone)
+
+// WORKING_MODEL as an operation copied it: edits, selections and merges run on the copy, and their result is only installed if the
+//   model hasn't been edited (through HISTORY), replaced or snapped on or off the lattice since (it's dropped, and said so, otherwise)
+struct working_stamp {
+  unsigned long long changes;
+  int generation;
+  bool lattice;
+
+  working_stamp() : changes(HISTORY.changes()), generation(WORKING_GENERATION), lattice(WORKING_MODEL.is_lattice()) { }
+  bool current() const { return (changes == HISTORY.changes() && generation == WORKING_GENERATION && lattice == WORKING_MODEL.is_lattice()); }
+};
 
 bool DRAW_AXIS = true;
 bool DRAW_GRID = true; // toggles drawing the grid lines (the cubes)
@@ -94,6 +244,25 @@ bool SET_LIGHT_POS = false;
 vect4f LIGHT0_POS;
 vect4f LIGHT_AMBIENT(0.2, 0.2, 0.2, 1.0);
 
+// input traces: --record=<trace> writes the keys, mouse clicks, resizes and prompt answers (not the keys typing them) as they happen;
+//   --replay=<trace> plays one back as fast as it's handled (--headless: without a window) and reports the latency of each event
+//   (both start from an empty editor: the session isn't restored, and is written to <trace>.session rather than SESSION_FILE; edits
+//   are journaled to <trace>.journal, which is never recovered)
+struct replay_sample {
+  string label;
+  double latency_ms, frame_ms; // handling the event (and the branch it answered), then displaying the frame after it (-1: it drew none)
+};
+input_recorder INPUT_RECORDER;
+vector<input_event> REPLAY_EVENTS;
+int REPLAY_NEXT = 0; // REPLAY_EVENTS index
+bool REPLAYING = false;
+bool HEADLESS = false; // no glut window or gl context (gl calls do nothing, so frames time display()'s cpu work)
+int REPLAY_MODIFIERS = 0; // key_modifiers() of the event being dispatched
+string REPLAY_CSV; // --replay-out=<csv>: a row per event
+mutex REPLAY_LOCK; // guards REPLAY_SAMPLES
+vector<replay_sample> REPLAY_SAMPLES;
+chrono::steady_clock::time_point REPLAY_START;
+
 
 void init_opengl() {
   glClearColor(0.0, 0.0, 0.0, 1.0);
@@ -148,8 +317,17 @@ void draw_light() {
   glMaterialfv(GL_FRONT, GL_EMISSION, vect4f(0.0, 0.0, 0.0, 1.0)); // turn off emmissive material
 }
 
-void refresh() {
-  glutPostRedisplay();
+// the first change since the last frame requests one, timed to be FRAME_INTERVAL_MS after it; changes before it's drawn are drawn by it
+//   (background threads post theirs straight away, since glut's timers are the glut thread's)
+void refresh(unsigned int changed) {
+  if (!FRAMES.invalidate(changed)) return;
+  if (HEADLESS || REPLAYING) return; // (replay_step() draws the requested frame itself)
+  if (this_thread::get_id() == GLUT_THREAD) glutTimerFunc(FRAMES.delay_ms(), frame_timer, 0);
+  else glutPostRedisplay();
+}
+
+void frame_timer(int) {
+  if (FRAMES.requested()) glutPostRedisplay();
 }
 
 void set_camera() {
@@ -168,19 +346,26 @@ void set_camera() {
 }
 
 void window_resize(int w, int h) {
+  if (INPUT_RECORDER.is_open()) INPUT_RECORDER.resize(w, h);
+
   SCREEN_W = w;
   SCREEN_H = h;
 
   set_camera();
+  refresh(FRAME_ALL); // (the cached scene is the old size)
 }
 
 void mouse_callback(int btn, int state, int x, int y) {
+  if (INPUT_RECORDER.is_open()) INPUT_RECORDER.mouse(btn, state, x, y, glutGetModifiers());
+
   // translate glut window coords to world coords:
   x = x * (WORLD_W / SCREEN_W);
   y = (SCREEN_H - y) * (WORLD_H / SCREEN_H);
 
+  unsigned int changed = 0;
   if (state == GLUT_DOWN) {
     if (y <= PALETTE_HEIGHT) { // clicked within the palette area
+      changed = FRAME_PALETTE;
       if (x >= PALETTE_MOUSE_CTRL[0]) { // clicked within the control area
         if (x < PALETTE_MOUSE_CTRL[0]+PALETTE_MOUSE_CTRL[1]) { // alpha control
           if (y <= PALETTE_HEIGHT/2.0) PALETTE_alpha -= 0.20; // alpha decrease
@@ -201,44 +386,50 @@ void mouse_callback(int btn, int state, int x, int y) {
         SELECTED_COLOR = COLOR_MAP[x];
         //if (in_bounds(SELECTED, MODEL_POINTS)) MODEL_COLORS[SELECTED[0]][SELECTED[1]] = SELECTED_COLOR;
         if (in_bounds(SELECTED, (*(WORKING_MODEL.get_facet_data_ptr())))) {
+          HISTORY.record_faces(WORKING_MODEL, vector<int>(1, SELECTED[0]), "color");
           WORKING_MODEL.set_vertex_color(SELECTED, SELECTED_COLOR);
+          JOURNAL.set_vertex_color(SELECTED, SELECTED_COLOR);
           UNSAVED_BUFFER = true;
+          changed |= FRAME_MODELS;
         }
       }
     }
   }
 
-  refresh();
+  refresh(changed);
 }
 
 void special_keys_callback(int key, int x, int y) {
+  if (INPUT_RECORDER.is_open()) INPUT_RECORDER.special(key, x, y, glutGetModifiers());
+
   // translate glut window coords to world coords:
   x = x * (WORLD_W / SCREEN_W);
   y = (SCREEN_H - y) * (WORLD_H / SCREEN_H);
 
   float movement_unit = 1.0f;
 
+  unsigned int changed = FRAME_CAMERA;
   switch(key) {
     case GLUT_KEY_RIGHT: {
-      if (glutGetModifiers() == GLUT_ACTIVE_CTRL) glRotatef(movement_unit, 0.0, 1.0, 0.0);
-      else if (glutGetModifiers() == GLUT_ACTIVE_ALT) glRotatef(-movement_unit, 0.0, 0.0, 1.0);
+      if (key_modifiers() == GLUT_ACTIVE_CTRL) glRotatef(movement_unit, 0.0, 1.0, 0.0);
+      else if (key_modifiers() == GLUT_ACTIVE_ALT) glRotatef(-movement_unit, 0.0, 0.0, 1.0);
       else glTranslatef(1.0, 0.0, 0.0);
     } break;
     case GLUT_KEY_LEFT: {
-      if (glutGetModifiers() == GLUT_ACTIVE_CTRL) glRotatef(-movement_unit, 0.0, 1.0, 0.0);
-      else if (glutGetModifiers() == GLUT_ACTIVE_ALT) glRotatef(movement_unit, 0.0, 0.0, 1.0);
+      if (key_modifiers() == GLUT_ACTIVE_CTRL) glRotatef(-movement_unit, 0.0, 1.0, 0.0);
+      else if (key_modifiers() == GLUT_ACTIVE_ALT) glRotatef(movement_unit, 0.0, 0.0, 1.0);
       else glTranslatef(-1.0, 0.0, 0.0);
     } break;
     case GLUT_KEY_UP: {
-      if (glutGetModifiers() == GLUT_ACTIVE_CTRL) glRotatef(-movement_unit, 1.0, 0.0, 0.0);
-      else if (glutGetModifiers() == GLUT_ACTIVE_ALT) {}
-      else if (glutGetModifiers() == GLUT_ACTIVE_SHIFT) glTranslatef(0.0, 0.0, 1.0);
+      if (key_modifiers() == GLUT_ACTIVE_CTRL) glRotatef(-movement_unit, 1.0, 0.0, 0.0);
+      else if (key_modifiers() == GLUT_ACTIVE_ALT) {}
+      else if (key_modifiers() == GLUT_ACTIVE_SHIFT) glTranslatef(0.0, 0.0, 1.0);
       else glTranslatef(0.0, -1.0, 0.0);
     } break;
     case GLUT_KEY_DOWN: {
-      if (glutGetModifiers() == GLUT_ACTIVE_CTRL) glRotatef(movement_unit, 1.0, 0.0, 0.0);
-      else if (glutGetModifiers() == GLUT_ACTIVE_ALT) {}
-      else if (glutGetModifiers() == GLUT_ACTIVE_SHIFT) glTranslatef(0.0, 0.0, -1.0);
+      if (key_modifiers() == GLUT_ACTIVE_CTRL) glRotatef(movement_unit, 1.0, 0.0, 0.0);
+      else if (key_modifiers() == GLUT_ACTIVE_ALT) {}
+      else if (key_modifiers() == GLUT_ACTIVE_SHIFT) glTranslatef(0.0, 0.0, -1.0);
       else glTranslatef(0.0, 1.0, 0.0);
     } break;
 
@@ -252,103 +443,150 @@ void special_keys_callback(int key, int x, int y) {
     case GLUT_KEY_F8: { edit_model(7); } break;
     case GLUT_KEY_F9: { edit_model(8); } break;
 
-    default: {} break;
+    default: { changed = 0; } break;
   }
+  glGetFloatv(GL_MODELVIEW_MATRIX, CAMERA_MATRIX);
 
-  refresh();
+  refresh(changed);
 }
 void keyboard_callback(unsigned char key, int x, int y) {
+  // while a dialog is asking, the keys type its answer: a trace records the answer as it's entered (and an escape cancelling it)
+  if (PROMPT.active()) {
+    if (INPUT_RECORDER.is_open()) {
+      if (key == 13) INPUT_RECORDER.line(PROMPT.typed());
+      else if (key == 27) INPUT_RECORDER.key(key, x, y, glutGetModifiers());
+    }
+    PROMPT.key(key);
+    refresh(key == 13 ? FRAME_ALL : FRAME_OVERLAY); // (an answer may have changed anything)
+    return;
+  }
+
+  if (INPUT_RECORDER.is_open()) INPUT_RECORDER.key(key, x, y, glutGetModifiers());
+
+  unsigned int changed = 0;
   if (key == 'q') {
-    if (!ALREADY_BRANCHED) _beginthread(&quit_branch, 0, (void*)0);
+    changed = FRAME_OVERLAY;
+    quit_prompt();
   }
 
   switch(key) {
     case 'w': {
+      changed = FRAME_CURSOR;
       if (SET_LIGHT_POS) LIGHT0_POS.y += UNIT_SIZE/10.0f;
       else POINTER.y += UNIT_SIZE/10.0f;
     } break;
     case 'a': {
+      changed = FRAME_CURSOR;
       if (SET_LIGHT_POS) LIGHT0_POS.x -= UNIT_SIZE/10.0f;
       else POINTER.x -= UNIT_SIZE/10.0f;
     } break;
     case 's': {
+      changed = FRAME_CURSOR;
       if (SET_LIGHT_POS) LIGHT0_POS.y -= UNIT_SIZE/10.0f;
       else POINTER.y -= UNIT_SIZE/10.0f;
     } break;
     case 'd': {
+      changed = FRAME_CURSOR;
       if (SET_LIGHT_POS) LIGHT0_POS.x += UNIT_SIZE/10.0f;
       else POINTER.x += UNIT_SIZE/10.0f;
     } break;
     case 'W': {
+      changed = FRAME_CURSOR;
       if (SET_LIGHT_POS) LIGHT0_POS.z -= UNIT_SIZE/10.0f;
       else POINTER.z -= UNIT_SIZE/10.0f;
     } break;
     case 'S': {
+      changed = FRAME_CURSOR;
       if (SET_LIGHT_POS) LIGHT0_POS.z += UNIT_SIZE/10.0f;
       else POINTER.z += UNIT_SIZE/10.0f;
     } break;
     case 8: { // backspace
+      changed = FRAME_CAMERA | FRAME_CURSOR;
       glMatrixMode(GL_MODELVIEW);
       glLoadIdentity();
       glTranslatef(0.0, 0.0, -UNIT_SIZE*(CUBE_COUNT+2));
+      glGetFloatv(GL_MODELVIEW_MATRIX, CAMERA_MATRIX);
       POINTER.clear();
       LIGHT0_POS = vect4f(UNIT_SIZE*(1), UNIT_SIZE*(1), UNIT_SIZE*(1), 1.0);
     } break;
 
     case 'c': {
+      changed = FRAME_MODELS;
       if (in_bounds(SELECTED, (*(WORKING_MODEL.get_facet_data_ptr())))) {
+        HISTORY.record_faces(WORKING_MODEL, vector<int>(1, SELECTED[0]), "remove vertex");
         WORKING_MODEL.remove_vertex(SELECTED);
+        JOURNAL.remove_vertex(SELECTED);
         UNSAVED_BUFFER = true;
       }
       SELECTED.clear();
     } break;
     case 'C': {
-      WORKING_MODEL.clear();
+      changed = FRAME_MODELS;
+      HISTORY.record_replace(WORKING_MODEL, "clear"); // keeps the model (rather than a copy) for undo, leaving WORKING_MODEL cleared
+      JOURNAL.clear();
       SELECTED.clear();
+      SELECTION.clear();
       UNSAVED_BUFFER = false;
     } break;
     case 'f': {
+      changed = FRAME_MODELS;
       const vector<vect3f>* const model_coordinates = WORKING_MODEL.get_coordinates_ptr();
       const vector<vector<facet>>* const model_facets = WORKING_MODEL.get_facet_data_ptr();
       if (in_bounds(SELECTED, *model_facets)) {
-        WORKING_MODEL.add_vertex((*model_coordinates)[((*model_facets)[SELECTED[0]][SELECTED[1]]).id], SELECTED_COLOR);
+        HISTORY.record_faces(WORKING_MODEL, current_face(), "add vertex", true);
+        journal_add_vertex(WORKING_MODEL.add_vertex((*model_coordinates)[((*model_facets)[SELECTED[0]][SELECTED[1]]).id], SELECTED_COLOR));
         UNSAVED_BUFFER = true;
       }
     } break;
 
     case 'p': {
+      changed = FRAME_MODELS;
+      HISTORY.record_faces(WORKING_MODEL, current_face(), "push face");
       WORKING_MODEL.push_face();
+      JOURNAL.push_face();
       SELECTED.clear();
       UNSAVED_BUFFER = true;
     } break;
     case 'P': {
+      changed = FRAME_MODELS;
+      HISTORY.record_faces(WORKING_MODEL, current_face(), "pop face");
       WORKING_MODEL.pop_face();
+      JOURNAL.pop_face();
       UNSAVED_BUFFER = true;
     } break;
     case 'o': {
+      changed = FRAME_MODELS;
       DISPLAY_WORKING_MODEL = !DISPLAY_WORKING_MODEL; // hides the model
     } break;
     case 'g': {
+      changed = FRAME_GRID;
       DRAW_GRID = !DRAW_GRID;
     } break;
     case 'G': {
-      if (!ALREADY_BRANCHED) _beginthread(&define_grid_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      define_grid_prompt();
     } break;
     case 'm': {
+      changed = FRAME_MODELS;
       DRAW_POLYGON_MODE = !DRAW_POLYGON_MODE;
     } break;
     case 'h': {
+      changed = FRAME_GRID;
       HIGHLIGHT = !HIGHLIGHT;
     } break;
     case 'r' : {
-      if (!ALREADY_BRANCHED) _beginthread(&face_resolution_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      face_resolution_prompt();
     }
 
     case 32: { // space key
-      WORKING_MODEL.add_vertex(POINTER, SELECTED_COLOR);
+      changed |= FRAME_MODELS;
+      HISTORY.record_faces(WORKING_MODEL, current_face(), "add vertex", true); // a run of inserts is undone as one step
+      journal_add_vertex(WORKING_MODEL.add_vertex(POINTER, SELECTED_COLOR));
       UNSAVED_BUFFER = true;
     } break;
     case 9: { // tab key
+      changed = FRAME_MODELS;
       const vector<vector<facet>>* const facet_data = WORKING_MODEL.get_facet_data_ptr();
 
       if (!in_bounds(SELECTED, *facet_data)) {
@@ -359,7 +597,7 @@ void keyboard_callback(unsigned char key, int x, int y) {
         else SELECTED.clear();
       }
       else {
-        if (glutGetModifiers() == GLUT_ACTIVE_SHIFT) {
+        if (key_modifiers() == GLUT_ACTIVE_SHIFT) {
           if (SELECTED[1] > 0) SELECTED[1]--; // set the selected vertex to the previous vertex
           else if (SELECTED[0] > 0) {
             // set the selected vertex to the last vertex in the previous face
@@ -389,59 +627,167 @@ void keyboard_callback(unsigned char key, int x, int y) {
     } break;
 
     case 13: { // enter
-      if (!ALREADY_BRANCHED) _beginthread(save_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      save_prompt();
     } break;
 
     case '1': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 0) DRAW_MODELS[0] = !DRAW_MODELS[0];
       else DRAW_MODELS[0] = false;
     } break;
     case '2': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 1) DRAW_MODELS[1] = !DRAW_MODELS[1];
       else DRAW_MODELS[1] = false;
     } break;
     case '3': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 2) DRAW_MODELS[2] = !DRAW_MODELS[2];
       else DRAW_MODELS[2] = false;
     } break;
     case '4': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 3) DRAW_MODELS[3] = !DRAW_MODELS[3];
       else DRAW_MODELS[3] = false;
     } break;
     case '5': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 4) DRAW_MODELS[4] = !DRAW_MODELS[4];
       else DRAW_MODELS[4] = false;
     } break;
     case '6': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 5) DRAW_MODELS[5] = !DRAW_MODELS[5];
       else DRAW_MODELS[5] = false;
     } break;
     case '7': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 6) DRAW_MODELS[6] = !DRAW_MODELS[6];
       else DRAW_MODELS[6] = false;
     } break;
     case '8': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 7) DRAW_MODELS[7] = !DRAW_MODELS[7];
       else DRAW_MODELS[7] = false;
     } break;
     case '9': {
+      changed = FRAME_MODELS;
       if (LOADED_MODELS.size() > 8) DRAW_MODELS[8] = !DRAW_MODELS[8];
       else DRAW_MODELS[8] = false;
     } break;
+    case '0': { // hides every loaded model if any are displayed, otherwise displays every non-empty one
+      changed = FRAME_MODELS;
+      bool any_drawn = false;
+      for (int i=0;i<DRAW_MODELS.size();i++) any_drawn = (any_drawn || DRAW_MODELS[i]);
+      for (int i=0;i<LOADED_MODELS.size();i++) DRAW_MODELS[i] = (!any_drawn && LOADED_MODELS[i].coordinate_count() > 0);
+    } break;
 
     case 'l': {
-      if (!ALREADY_BRANCHED) _beginthread(&load_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      load_prompt();
+    } break;
+    case 'L': {
+      changed = FRAME_OVERLAY;
+      preload_prompt();
+    } break;
+    case 'K': {
+      memory_report();
+    } break;
+    case 'R': {
+      render_queue_stats stats = RENDER_QUEUE.stats();
+      cout << "Render queue (last frame): " << stats.items << " items (" << stats.translucent << " translucent), " << stats.state_calls
+           << " state changes sorted (" << stats.unsorted_state_calls << " in the order queued), " << stats.matrix_loads << " matrix loads." << endl;
+      frame_stats frames = FRAMES.stats();
+      cout << "Frames: " << frames.frames << " drawn (" << frames.scene_frames << " drawing the scene, " << frames.composited_frames
+           << " recompositing it), " << frames.coalesced << " of " << frames.requests << " requests coalesced." << endl;
+    } break;
+    case 'H': {
+      changed = FRAME_MODELS;
+      #ifdef USE_GLSL_LIGHTING
+        USE_LIGHTING_PROGRAM = !USE_LIGHTING_PROGRAM;
+        if (!LIGHTING_PROGRAM.loaded()) cout << "The lighting program isn't loaded; lit models use fixed function materials." << endl;
+        else cout << "Lit models use " << (USE_LIGHTING_PROGRAM ? "the glsl lighting program." : "fixed function materials.") << endl;
+      #else
+        cout << "The glsl lighting program isn't compiled in (USE_GLSL_LIGHTING)." << endl;
+      #endif
+    } break;
+    case 'O': {
+      changed = FRAME_MODELS;
+      USE_LODS = !USE_LODS;
+      cout << "Levels of detail " << (USE_LODS ? "on." : "off (loaded models are drawn in full).") << endl;
+    } break;
+    case 'V': {
+      if (SESSION_WRITING.exchange(true)) cout << "[SESSION] The session is already being written." << endl;
+      else {
+        session_snapshot* snapshot = capture_session();
+        if (snapshot) _beginthread(&session_write_branch, 0, (void*)snapshot); // the copies are written in the background
+        else {
+          SESSION_WRITING = false;
+          cout << "[SESSION] Models are still loading; try again once they've finished." << endl;
+        }
+      }
+    } break;
+
+    case 'D': {
+      changed = FRAME_MODELS;
+      int removed = WORKING_MODEL.defragment();
+      SELECTED.clear(); // empty faces are dropped, so face indices may have moved
+      HISTORY.clear();  // (as have the faces the history refers to)
+      JOURNAL.invalidate();
+      cout << "Defragmented the edited model (" << removed << " unused coordinates removed, undo history cleared)." << endl;
+    } break;
+
+    case 'z': {
+      changed = FRAME_MODELS;
+      string label = HISTORY.undo_label();
+      if (HISTORY.undo(WORKING_MODEL)) {
+        JOURNAL.invalidate();
+        cout << "Undid " << label << " (" << HISTORY.undo_count() << " more)." << endl;
+        SELECTED.clear();
+        UNSAVED_BUFFER = true;
+      }
+      else cout << "Nothing to undo." << endl;
+    } break;
+    case 'Z': {
+      changed = FRAME_MODELS;
+      string label = HISTORY.redo_label();
+      if (HISTORY.redo(WORKING_MODEL)) {
+        JOURNAL.invalidate();
+        cout << "Redid " << label << " (" << HISTORY.redo_count() << " more)." << endl;
+        SELECTED.clear();
+        UNSAVED_BUFFER = true;
+      }
+      else cout << "Nothing to redo." << endl;
+    } break;
+
+    case 'n': { // snaps the edited model to the cursor's grid (one tenth of a unit), or releases it
+      changed = FRAME_MODELS;
+      if (WORKING_MODEL.is_lattice()) {
+        WORKING_MODEL.clear_lattice();
+        JOURNAL.invalidate(); // (vertices journaled from here on aren't snapped)
+        cout << "Lattice mode off." << endl;
+      }
+      else {
+        HISTORY.record_model(WORKING_MODEL, "lattice snap"); // snapping moves every coordinate, so the step is a copy
+        float moved = WORKING_MODEL.set_lattice(UNIT_SIZE/10.0f);
+        JOURNAL.invalidate();
+        cout << "Lattice mode on (scale " << UNIT_SIZE/10.0f << ", largest snap " << moved << ")." << endl;
+      }
     } break;
 
     case 'x': {
+      changed = FRAME_GRID;
       DRAW_AXIS = !DRAW_AXIS;
     } break;
 
     case 'M': {
-      if (!ALREADY_BRANCHED) _beginthread(&merge_model_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      merge_model_prompt();
     } break;
 
     case 't': {
+      changed = FRAME_SCENE;
       LIGHTS_ON = !LIGHTS_ON;
       if (LIGHTS_ON) {
         glEnable(GL_LIGHTING);
@@ -456,85 +802,244 @@ void keyboard_callback(unsigned char key, int x, int y) {
       SET_LIGHT_POS = !SET_LIGHT_POS;
     } break;
     case '>': {
-      if (!ALREADY_BRANCHED) _beginthread(&translate_model_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      translate_model_prompt();
     } break;
     case '<': {
-      if (!ALREADY_BRANCHED) _beginthread(&transform_model_branch, 0, (void*)0);
+      changed = FRAME_OVERLAY;
+      transform_model_prompt();
+    } break;
+    case 'b': {
+      changed = FRAME_OVERLAY;
+      select_prompt();
+    } break;
+    case 'e': {
+      changed = FRAME_OVERLAY;
+      bulk_edit_prompt();
     } break;
 
     case 27: { // escape key
+      changed = FRAME_MODELS;
       SELECTED.clear();
+      SELECTION.clear();
     } break;
+
+    #ifdef USE_PROFILER
+      case 'i': {
+        changed = FRAME_OVERLAY;
+        PROFILER.show_overlay = !PROFILER.show_overlay;
+      } break;
+      case 'I': {
+        if (PROFILER.dump("profile.csv") && PROFILER.dump("profile.json")) cout << "Wrote frame profile. (files: profile.csv, profile.json)" << endl;
+        else cout << "Error writing frame profile." << endl;
+      } break;
+    #endif
+
+    #ifdef USE_TRACE
+      case 'J': {
+        if (TRACE_WRITE("trace.json")) {
+          cout << "Wrote operation trace. (file: trace.json)" << endl;
+          if (trace_dropped_count() > 0) cout << trace_dropped_count() << " trace events were dropped (their rings were full)." << endl;
+        }
+        else cout << "Error writing operation trace." << endl;
+      } break;
+    #endif
+
     default: {} break;
   }
 
-  refresh();
+  refresh(changed);
 }
 
 void display() {
+  PROFILE_FRAME_BEGIN();
+
+  install_preloaded_models();
+  install_lods();
+  finish_operations();
+
+  // the scene is only drawn again when something in it changed: otherwise the last one drawn is recomposited under the
+  //   palette and overlays (which are cheap to draw every frame)
+  unsigned int changed = FRAMES.begin_frame();
+  bool scene_drawn = ((changed & FRAME_SCENE) || !SCENE_LAYER.valid(SCREEN_W, SCREEN_H));
+  if (scene_drawn) {
+    draw_scene();
+    SCENE_LAYER.capture(SCREEN_W, SCREEN_H);
+  }
+  else {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    SCENE_LAYER.draw();
+  }
+  glLineWidth(1.0);
+  glDisable(GL_LIGHTING);
+  
+  // draw palette (compiled once per change of its colors)
+  {
+    PROFILE_SCOPE(PHASE_PALETTE);
+    if (changed & FRAME_PALETTE) PALETTE_LIST.invalidate();
+    PALETTE_LIST.draw(draw_color_palette);
+  }
+  if (LIGHTS_ON) glEnable(GL_LIGHTING);
+
+  #ifdef USE_PROFILER
+    PROFILER.draw_overlay(SCREEN_W, SCREEN_H);
+  #endif
+  if (!HEADLESS) draw_prompt();
+
+  PROFILE_FRAME_END();
+  FRAMES.end_frame(scene_drawn);
+
+  if (!HEADLESS) glutSwapBuffers();
+
+  if (FIRST_FRAME_MS < 0.0) {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    FIRST_FRAME_MS = chrono::duration<double, milli>(chrono::steady_clock::now() - STARTUP_TIME).count();
+  }
+}
+
+void draw_scene() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
   if (LIGHTS_ON) {
     set_ambient();
     set_light_pos();
   }
-  set_camera();
-  if (LIGHTS_ON) draw_light();
+  {
+    PROFILE_SCOPE(PHASE_CAMERA);
+    set_camera();
+  }
+  if (LIGHTS_ON) {
+    PROFILE_SCOPE(PHASE_LIGHT);
+    draw_light();
+  }
 
   glDisable(GL_LIGHTING);
-  if (DRAW_AXIS) draw_axis();
-  draw_pointer();
-  if (LIGHTS_ON) glEnable(GL_LIGHTING);
-
-  glLineWidth(2.0);
-
+  if (DRAW_AXIS) {
+    PROFILE_SCOPE(PHASE_AXIS);
+    draw_axis();
+  }
+  {
+    PROFILE_SCOPE(PHASE_POINTER);
+    draw_pointer();
+  }
   #ifdef USE_SPECULAR
     glMaterialfv(GL_FRONT, GL_SPECULAR, vect4f(1.0, 1.0, 1.0, 1.0));
     glMaterialfv(GL_FRONT, GL_SHININESS, vect4f(50.0, 1.0, 1.0, 1.0));
   #endif
 
-  // draw edit model buffer
+  // the models and grid are queued (in the order they were drawn before), then drawn sorted by state
+  RENDER_QUEUE.clear();
+  render_state model_state;
+  model_state.lighting = LIGHTS_ON;
+  model_state.line_width = 2.0f;
+  #ifdef USE_GLSL_LIGHTING
+    model_state.shaded = (USE_LIGHTING_PROGRAM && LIGHTING_PROGRAM.loaded());
+    #ifdef USE_SPECULAR
+      RENDER_QUEUE.set_program(&LIGHTING_PROGRAM, vect4f(1.0, 1.0, 1.0, 1.0), 50.0f);
+    #else
+      RENDER_QUEUE.set_program(&LIGHTING_PROGRAM, vect4f(0.0, 0.0, 0.0, 1.0), 0.0f); // (gl's default material)
+    #endif
+  #endif
+
+  // queue edit model buffer
   if (DISPLAY_WORKING_MODEL) {
+    PROFILE_SCOPE(PHASE_WORKING_MODEL);
     GLenum restore_gl_draw_mode = WORKING_MODEL.get_draw_mode();
     if (DRAW_POLYGON_MODE) WORKING_MODEL.set_draw_mode(GL_LINE_LOOP); // if drawing wireframe mode, change draw mode appropriately
 
-    if (in_bounds(SELECTED, *(WORKING_MODEL.get_facet_data_ptr()))) {
-      // if SELECTED is valid, change the color of the selected vertex to the highlighted color and then draw, restoring original color afterwards
-      vect3f restore_color = WORKING_MODEL.get_vertex_color(SELECTED);
-      WORKING_MODEL.set_vertex_color(SELECTED, HIGHLIGHTED_COLOR);
-      WORKING_MODEL.draw();
-      WORKING_MODEL.set_vertex_color(SELECTED, restore_color);
-    }
-    else WORKING_MODEL.draw();
+    // if SELECTED is valid, the selected vertex is drawn in the highlighted color (the model itself is left as it is)
+    index2d highlighted;
+    if (in_bounds(SELECTED, *(WORKING_MODEL.get_facet_data_ptr()))) highlighted = SELECTED;
+    WORKING_MODEL.submit(RENDER_QUEUE, model_state, highlighted, HIGHLIGHTED_COLOR);
     if (DRAW_POLYGON_MODE) WORKING_MODEL.set_draw_mode(restore_gl_draw_mode); // restore old draw mode if it was modified...
-  }
 
-  // draw loaded models
-  for (int i=0;i<LOADED_MODELS.size();i++) {
-    if (DRAW_MODELS[i]) {
-      GLenum old_draw_mode = LOADED_MODELS[i].get_draw_mode();
-      if (DRAW_POLYGON_MODE) LOADED_MODELS[i].set_draw_mode(GL_LINE_LOOP);
-      LOADED_MODELS[i].draw();
-      LOADED_MODELS[i].set_draw_mode(old_draw_mode);
+    if (!SELECTION.empty() && SELECTION.fits(WORKING_MODEL)) {
+      render_state selection_state;
+      selection_state.draw_mode = GL_POINTS;
+      float modelview[16];
+      render_queue::current_modelview(modelview);
+      RENDER_QUEUE.submit(selection_state, modelview, draw_selection);
+    }
+  }
+  else PROFILE_COUNT(COUNTER_MODELS_CULLED, 1);
+
+  // queue loaded models
+  {
+    PROFILE_SCOPE(PHASE_LOADED_MODELS);
+    for (int i=0;i<LOADED_MODELS.size();i++) {
+      if (DRAW_MODELS[i]) {
+        GLenum old_draw_mode = LOADED_MODELS[i].get_draw_mode();
+        if (DRAW_POLYGON_MODE) LOADED_MODELS[i].set_draw_mode(GL_LINE_LOOP);
+        LOADED_MODELS[i].use_lods = USE_LODS;
+        LOADED_MODELS[i].submit(RENDER_QUEUE, model_state);
+        LOADED_MODELS[i].set_draw_mode(old_draw_mode);
+      }
+      else PROFILE_COUNT(COUNTER_MODELS_CULLED, 1);
     }
   }
-  glLineWidth(1.0);
 
-  glDisable(GL_LIGHTING);
-  // draw grid lines
+  // queue grid lines (unlit): the outlines are one item drawn from GRID_LIST, and the highlighted unit cubes' translucent sides are
+  //   drawn last
   if (DRAW_GRID) {
-    glColor3f(0.0f, 0.3f, 0.0f);
-    for (int i=0;i<RUBIX.size();i++) {
-      if (HIGHLIGHT) RUBIX[i].draw(&POINTER);
-      else RUBIX[i].draw();
+    PROFILE_SCOPE(PHASE_GRID);
+    vector<int> cells;
+    if (HIGHLIGHT) {
+      for (int i=0;i<RUBIX.size();i++) if (RUBIX[i].contains_point(POINTER)) cells.push_back(i);
     }
+    if (cells != GRID_HIGHLIGHTED) {
+      GRID_HIGHLIGHTED = cells;
+      GRID_LIST.invalidate();
+    }
+
+    render_state grid_state, outline_state;
+    outline_state.draw_mode = GL_LINE_LOOP;
+    float modelview[16];
+    render_queue::current_modelview(modelview);
+    RENDER_QUEUE.submit(outline_state, modelview, []() { GRID_LIST.draw(draw_grid); });
+    for (int i=0;i<cells.size();i++) RUBIX[cells[i]].submit(RENDER_QUEUE, grid_state, &POINTER);
   }
-  
-  // draw palette
-  draw_color_palette();
-  if (LIGHTS_ON) glEnable(GL_LIGHTING);
 
-  glutSwapBuffers();
+  {
+    PROFILE_SCOPE(PHASE_RENDER_QUEUE);
+    RENDER_QUEUE.execute();
+  }
+}
+
+void draw_grid() {
+  int next = 0; // GRID_HIGHLIGHTED index
+  for (int i=0;i<RUBIX.size();i++) {
+    if (next < GRID_HIGHLIGHTED.size() && GRID_HIGHLIGHTED[next] == i) next++;
+    else RUBIX[i].draw_outline();
+  }
+}
+
+void draw_prompt() {
+  vector<string> status;
+  {
+    lock_guard<mutex> lock(OPERATIONS_LOCK);
+    for (int i=0;i<OPERATIONS_RUNNING.size();i++) status.push_back(OPERATIONS_RUNNING[i]->label + "...");
+  }
+  PROMPT.draw(SCREEN_W, SCREEN_H, (int)(SCREEN_H*PALETTE_HEIGHT/WORLD_H), status);
+}
+
+// drawn over the model (without depth testing), so a selection on the far side of it shows through
+void draw_selection() {
+  const vector<vector<facet>>& faces = *(WORKING_MODEL.get_facet_data_ptr());
+  const vector<vect3f>& coordinates = *(WORKING_MODEL.get_coordinates_ptr());
+  glDisable(GL_DEPTH_TEST);
+  glPointSize(4.0f);
+  glColor3f(SELECTION_COLOR.x, SELECTION_COLOR.y, SELECTION_COLOR.z);
+  glBegin(GL_POINTS);
+  for (int i=0;i<faces.size();i++) {
+    for (int j=0;j<faces[i].size();j++) {
+      if (!SELECTION.selected(i, j)) continue;
+      const vect3f& p = coordinates[faces[i][j].id];
+      glVertex3f(p.x, p.y, p.z);
+    }
+  }
+  glEnd();
+  glPointSize(1.0f);
+  glEnable(GL_DEPTH_TEST);
 }
 
 void draw_axis() {
@@ -644,13 +1149,24 @@ int main(int argc, char** argv) {
        << "  'G' opens a dialog to redefine the grid size." << endl
        << "  'p' pushes the current face onto the model." << endl
        << "  'P' pops the current face from the model." << endl
+       << "  Dialogs ask along the bottom of the window: type the answer and press Enter (Escape cancels the dialog)." << endl
+       << "      - the window keeps drawing (and the arrow keys moving the scene) while a dialog asks; saves and loads run in the background." << endl
+       << "  The window is only redrawn when something in it changes ('R' reports the frames drawn)." << endl
        << "  Enter saves the model to a file." << endl
-       << "      - opens a dialog to enter a filename in the command window." << endl
+       << "      - opens a dialog to enter a filename." << endl
        << "  'l' loads a saved model." << endl
-       << "      - opens a dialog to enter the filename in the command window." << endl
+       << "      - opens a dialog to enter the filename." << endl
+       << "  'L' preloads every model in a directory (or listed in a manifest file) into the saved model slots." << endl
+       << "      - opens a dialog to enter the directory or manifest." << endl
+       << "      - the models are loaded in the background and displayed as each one finishes." << endl
+       << "      - also available at startup: modeler --preload=<directory or manifest>" << endl
        << "  1-9 toggles the display of the saved model's respective number." << endl 
+       << "  0 toggles the display of every saved or loaded model." << endl
        << "  F1-F9 edits the saved or loaded model associated with that number." << endl
        << "      - the current model buffer is swapped to the respective slot." << endl
+       << "      - models in the slots are kept in a compact (slightly quantized) format until edited again." << endl
+       << "      - modeler --page-budget=<MB> pages them out to disk instead, drawing them through a cache of at most MB." << endl
+       << "  'O' toggles levels of detail: models in the slots are simplified in the background and drawn coarser as they shrink on screen." << endl
        << "      - the swapped model buffer is not saved to a file." << endl
        << "  Select a color from the palette to change the Tab-selected facet's color." << endl
        << "      - additional vertices are drawn in the most recently selected color." << endl
@@ -659,6 +1175,30 @@ int main(int argc, char** argv) {
        << "  't' toggles lighting." << endl
        << "  'T' toggles control of the cursor position or the light source position." << endl
        << "  'r' sets the current working model's face resolution to a number of polygons." << endl
+       << "  'i' toggles the frame profiler overlay." << endl
+       << "  'I' writes the frame profile to profile.csv and profile.json." << endl
+       << "  'J' writes a trace of load/save/edit operations to trace.json (chrome://tracing)." << endl
+       << "  'K' prints the memory held by the edited model and each loaded model." << endl
+       << "  'R' prints the last frame's render queue state changes (the models and grid are drawn sorted by state)." << endl
+       << "  'H' toggles lighting models through the glsl lighting program or fixed function materials." << endl
+       << "  'b' selects facets of the edited model (drawn as yellow points) for bulk edits; Escape clears the selection." << endl
+       << "      - by a box from the cursor to a corner, a sphere around the cursor, the Tab-selected facet's color (or the palette's)," << endl
+       << "        the faces connected to the Tab-selected one, everything, or the inverse; +/- before the choice adds to or removes from it." << endl
+       << "  'e' edits every selected facet at once: recolor with the palette color, move, delete, or extract to a model slot." << endl
+       << "  Edits are journaled to <file>.journal every few seconds and replayed if the modeler exits without saving them." << endl
+       << "  'z' undoes the last edit to the current model; 'Z' redoes it." << endl
+       << "      - consecutive vertex inserts are undone together; swapping models (F1-F9) clears the history." << endl
+       << "  'D' removes the edited model's unused coordinates, colors, normals and empty faces." << endl
+       << "      - also done when the model is saved, and as faces and vertices are removed." << endl
+       << "  'V' writes the session (every model, the slots shown, camera, light, grid and palette) to modeler.session in the background." << endl
+       << "      - also written on quitting (unsaved edits included); restored at startup (modeler --session=<file> names another file)." << endl
+       << "      - the edited model is restored at once and the slots' models are read in the background, displayed ones first." << endl
+       << "  'n' toggles lattice mode: the edited model's coordinates are kept as integer multiples of the cursor step." << endl
+       << "      - coincident points weld, and moving or mirroring the model is lossless." << endl
+       << "  modeler --record=<trace> writes the keys, mouse clicks, resizes and prompt answers of the session to a trace file." << endl
+       << "      - modeler --replay=<trace> plays one back as fast as it's handled and reports each event's latency and the frame times." << endl
+       << "      - --headless replays without a window; --replay-out=<csv> also writes a row per event." << endl
+       << "      - both start from an empty editor (the session is written to <trace>.session)." << endl
        << endl;
 
   UNIT_SIZE = 1.0f;
@@ -670,19 +1210,145 @@ int main(int argc, char** argv) {
 
   for (int i=0;i<9;i++) LOADED_MODELS.push_back(model3d());
 
-  glutInit(&argc, argv);
-  glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH); // double buffer, rgb color, depth buffer
-  glutInitWindowSize(SCREEN_W, SCREEN_H);
-  glutCreateWindow("3D Modeler");
+  for (int i=1;i<argc;i++) HEADLESS = (HEADLESS || strcmp(argv[i], "--headless") == 0); // (glut isn't initialized at all)
+  if (!HEADLESS) glutInit(&argc, argv); // removes the arguments glut recognizes
+
+  string record_path, replay_path;
+  for (int i=1;i<argc;i++) {
+    string arg(argv[i]);
+    if (arg.compare(0, 10, "--preload=") == 0) PRELOAD_PATH = arg.substr(10);
+    else if (arg.compare(0, 9, "--record=") == 0) record_path = arg.substr(9);
+    else if (arg.compare(0, 9, "--replay=") == 0) replay_path = arg.substr(9);
+    else if (arg.compare(0, 13, "--replay-out=") == 0) REPLAY_CSV = arg.substr(13);
+    else if (arg == "--headless") {}
+    else if (arg.compare(0, 10, "--session=") == 0) SESSION_FILE = arg.substr(10);
+    else if (arg.compare(0, 14, "--page-budget=") == 0) {
+      PAGE_BUDGET_MB = atof(arg.c_str()+14);
+      if (PAGE_BUDGET_MB > 0.0) PAGE_CACHE.set_budget((size_t)(PAGE_BUDGET_MB*1024.0*1024.0));
+      else cout << "Invalid page budget: " << arg << endl;
+    }
+    else cout << "Unknown argument: " << arg << endl;
+  }
 
-  glutDisplayFunc(display);
-  glutMouseFunc(mouse_callback);
-  glutKeyboardFunc(keyboard_callback);
-  glutSpecialFunc(special_keys_callback);
-  glutReshapeFunc(window_resize);
+  if (record_path.length() > 0 && replay_path.length() > 0) {
+    cout << "--record and --replay can't be used together." << endl;
+    return 1;
+  }
+  if (HEADLESS && replay_path.length() == 0) {
+    cout << "--headless is only used with --replay=<trace>." << endl;
+    return 1;
+  }
+  if (record_path.length() > 0) {
+    if (!INPUT_RECORDER.open(record_path)) {
+      cout << "Error opening the input trace. (file: " << record_path << ")" << endl;
+      return 1;
+    }
+    SESSION_FILE = record_path + ".session";
+    TRACE_FILE = record_path;
+    cout << "Recording input to " << record_path << "." << endl;
+  }
+  if (replay_path.length() > 0) {
+    if (!read_input_trace(replay_path, REPLAY_EVENTS)) {
+      cout << "Error reading the input trace. (file: " << replay_path << ")" << endl;
+      return 1;
+    }
+    REPLAYING = true;
+    SESSION_FILE = replay_path + ".session";
+    TRACE_FILE = replay_path;
+    cout << "Replaying " << REPLAY_EVENTS.size() << " events from " << replay_path << (HEADLESS ? " (headless)." : ".") << endl;
+  }
+  bool tracing = (INPUT_RECORDER.is_open() || REPLAYING);
+
+  // the state and edited model are restored now; the registry's models are read once the window is up
+  session_state session;
+  bool session_restored = (!tracing && restore_session(session));
+  if (!HEADLESS) {
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH); // double buffer, rgb color, depth buffer
+    glutInitWindowSize(SCREEN_W, SCREEN_H);
+    glutCreateWindow("3D Modeler");
+
+    glutDisplayFunc(display);
+    if (!REPLAYING) { // (input that isn't in the trace isn't taken while it plays)
+      glutMouseFunc(mouse_callback);
+      glutKeyboardFunc(keyboard_callback);
+      glutSpecialFunc(special_keys_callback);
+    }
+    glutReshapeFunc(window_resize);
+  }
   init_opengl();
+  #ifdef USE_GLSL_LIGHTING
+    if (!HEADLESS) {
+      if (LIGHTING_PROGRAM.load()) cout << "Lit models are drawn with the glsl lighting program ('H' toggles it)." << endl;
+      else cout << "Lit models are drawn with fixed function materials." << endl;
+    }
+  #endif
+
+  if (session_restored) glLoadMatrixf(session.modelview);
+  else glTranslatef(0.0, 0.0, -UNIT_SIZE*(CUBE_COUNT+2));
+  glGetFloatv(GL_MODELVIEW_MATRIX, CAMERA_MATRIX);
+
+  // edits that weren't saved before the last exit (or crash): a journal holds edits made to the model's file,
+  //   so the file and journal replace the session's copy of the model
+  attach_journal(WORKING_FILENAME);
+  if (tracing) {
+    JOURNAL.discard(); // (left by a traced run that didn't quit)
+    JOURNAL.invalidate();
+  }
+  else if (JOURNAL.exists()) {
+    // (the session's copy is kept if the journal doesn't apply to the file)
+    model3d recovered;
+    if (WORKING_MODEL.is_lattice()) recovered.set_lattice(WORKING_MODEL.get_lattice_scale());
+    bool loaded = (WORKING_FILENAME == "untitled" || recovered.load(WORKING_FILENAME));
+    mesh_report validation;
+    if (JOURNAL.recover(recovered, &validation, loaded)) {
+      WORKING_MODEL = std::move(recovered);
+      cout << "Recovered unsaved edits from " << JOURNAL.filename() << "." << endl;
+      if (!validation.clean()) cout << "Repaired the recovered model: " << validation.summary() << "." << endl;
+      UNSAVED_BUFFER = true;
+    }
+    else {
+      if (JOURNAL.stale()) print_stale_journal();
+      if (UNSAVED_BUFFER) JOURNAL.invalidate(); // the session's unsaved edits aren't journaled yet
+    }
+  }
+  else if (UNSAVED_BUFFER) JOURNAL.invalidate(); // the session's unsaved edits aren't journaled yet
+  if (!HEADLESS) glutTimerFunc(JOURNAL_FLUSH_MS, journal_timer, 0);
+
+  if (session_restored) {
+    // the slots' models page in on their own thread (through the preload's install path), displayed slots first
+    {
+      lock_guard<mutex> lock(PRELOAD_LOCK);
+      for (int i=0;i<session.slots.size();i++) {
+        if (session.slots[i].length == 0) continue;
+        PRELOAD_FILES.push_back(SESSION_FILE + "#" + to_string(i+1));
+        PRELOAD_SLOTS.push_back(i);
+        PRELOAD_SHOW.push_back(session.slots[i].visible);
+      }
+    }
+    if (!PRELOAD_FILES.empty()) _beginthread(&session_page_branch, 0, (void*)(new session_state(session)));
+  }
 
-  glTranslatef(0.0, 0.0, -UNIT_SIZE*(CUBE_COUNT+2));
+  // the preload runs alongside the main loop so the window is usable while models are still loading
+  if (PRELOAD_PATH.length() > 0) _beginthread(&preload_branch, 0, (void*)0);
+
+  if (HEADLESS) { // the trace is the main loop: its events are dispatched here, with a frame displayed after each
+    REPLAY_START = chrono::steady_clock::now();
+    chrono::steady_clock::time_point flushed = REPLAY_START;
+    display();
+    while (replay_step()) {
+      if (chrono::steady_clock::now() - flushed >= chrono::milliseconds(JOURNAL_FLUSH_MS)) {
+        JOURNAL.flush(WORKING_MODEL);
+        flushed = chrono::steady_clock::now();
+      }
+    }
+    replay_report();
+    JOURNAL.discard();
+    return 0;
+  }
+  if (REPLAYING) {
+    REPLAY_START = chrono::steady_clock::now();
+    glutIdleFunc(replay_idle);
+  }
 
   refresh();
   glutMainLoop();
@@ -782,284 +1448,921 @@ void draw_color_palette() {
 
 void edit_model(int id) {
   if (id < LOADED_MODELS.size()) {
-    bool confirmed = true;
-    if (UNSAVED_BUFFER) confirmed = prompt_save();
-    if (confirmed) {
-      model3d temp_model(LOADED_MODELS[id]);
-      LOADED_MODELS[id] = WORKING_MODEL;
-      WORKING_MODEL = temp_model;
+    confirm_unsaved([id]() {
+      model3d temp_model(std::move(LOADED_MODELS[id]));
+      LOADED_MODELS[id] = std::move(WORKING_MODEL);
+      WORKING_MODEL = std::move(temp_model);
+      WORKING_MODEL.expand();
+      WORKING_GENERATION++;
+      compact_model(id);
+      HISTORY.clear(); // the history belonged to the model just swapped out
+      JOURNAL.invalidate();
 
       DRAW_MODELS[id] = false;
-    }
+      refresh(FRAME_MODELS);
+    });
   }
 }
 
-bool prompt_save() {
-  cout << "There are unsaved changes to the current model. " << endl << " Continue without saving? (yes/no) ";
-  string input;
-  getline(cin, input);
-  if (input[0] == 'y' || input[0] == 'Y') {
-    UNSAVED_BUFFER = false;
-    return true;
+void install_preloaded_models() {
+  vector<pair<int, preload_result*>> finished; // (slot, result)
+  vector<bool> show;
+  {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    if (PRELOAD_FILES.empty()) return;
+
+    // slots are reserved in file order (not completion order) so a directory always fills the same slots;
+    //   empty, hidden slots are reused before new ones are added
+    if (PRELOAD_SLOTS.empty()) {
+      int slot = 0;
+      for (int i=0;i<PRELOAD_FILES.size();i++) {
+        while (slot < LOADED_MODELS.size() && (DRAW_MODELS[slot] || LOADED_MODELS[slot].coordinate_count() > 0)) slot++;
+        if (slot == LOADED_MODELS.size()) {
+          LOADED_MODELS.push_back(model3d());
+          DRAW_MODELS.push_back(false);
+        }
+        PRELOAD_SLOTS.push_back(slot++);
+      }
+    }
+
+    for (int i=0;i<PRELOAD_QUEUE.size();i++) {
+      finished.push_back(make_pair(PRELOAD_SLOTS[PRELOAD_QUEUE[i].first], PRELOAD_QUEUE[i].second));
+      show.push_back(PRELOAD_SHOW.empty() || PRELOAD_SHOW[PRELOAD_QUEUE[i].first]);
+    }
+    PRELOAD_QUEUE.clear();
+
+    PRELOAD_INSTALLED += finished.size();
+    if (PRELOAD_INSTALLED == PRELOAD_FILES.size()) {
+      PRELOAD_FILES.clear();
+      PRELOAD_SLOTS.clear();
+      PRELOAD_SHOW.clear();
+      PRELOAD_INSTALLED = 0;
+    }
+  }
+
+  for (int i=0;i<finished.size();i++) {
+    int slot = finished[i].first;
+    preload_result* result = finished[i].second;
+    if (result->ok) {
+      LOADED_MODELS[slot] = std::move(result->model);
+      DRAW_MODELS[slot] = show[i];
+      cout << "[PRELOAD] Loaded model " << slot+1 << ". (file: " << result->filename << ", " << result->load_ms << "ms)" << endl;
+      if (!result->validation.clean()) cout << "[PRELOAD] Repaired model " << slot+1 << ": " << result->validation.summary() << "." << endl;
+      compact_model(slot);
+    }
+    else cout << "[PRELOAD] Error loading model. (file: " << result->filename << ")" << endl;
+    delete result;
   }
-  return false;
 }
 
-void define_cube() {
-  RUBIX.clear();
+void compact_model(int id) {
+  start_lods(id);
+  if (id < 0 || id >= LOADED_MODELS.size() || LOADED_MODELS[id].is_compact() || LOADED_MODELS[id].is_paged() || LOADED_MODELS[id].coordinate_count() == 0) return;
+  if (PAGE_BUDGET_MB > 0.0) {
+    size_t before = LOADED_MODELS[id].memory_usage();
+    if (!LOADED_MODELS[id].page_out(PAGE_CACHE)) {
+      cout << "Error paging out model " << id+1 << "." << endl;
+      return;
+    }
+    size_t after = LOADED_MODELS[id].memory_usage();
+    cout << "Paged out model " << id+1 << ": " << before/1024.0 << " KB -> " << after/1024.0 << " KB ("
+         << LOADED_MODELS[id].get_paged_ptr()->file_bytes()/1048576.0 << " MB page file)." << endl;
+    return;
+  }
+  #ifdef USE_COMPACT_MODELS
+    size_t before = LOADED_MODELS[id].memory_usage();
+    LOADED_MODELS[id].compact();
+    size_t after = LOADED_MODELS[id].memory_usage();
+    cout << "Compacted model " << id+1 << ": " << before/1024.0 << " KB -> " << after/1024.0 << " KB." << endl;
+  #endif
+}
 
-  vect3f cube_pos(-UNIT_SIZE*CUBE_COUNT/2.0, -UNIT_SIZE*CUBE_COUNT/2.0, -UNIT_SIZE*CUBE_COUNT/2.0);
+void start_lods(int id) {
+  if (id < 0 || id >= LOADED_MODELS.size()) return;
+  if (LOD_GENERATION.size() < LOADED_MODELS.size()) LOD_GENERATION.resize(LOADED_MODELS.size(), 0);
+  LOD_GENERATION[id]++;
+  if (!LOADED_MODELS[id].get_lods().empty() || LOADED_MODELS[id].face_count() < LOD_MIN_FACES) return; // (a session restores them)
+
+  lod_job* job = new lod_job();
+  job->slot = id;
+  job->generation = LOD_GENERATION[id];
+  job->model = LOADED_MODELS[id];
+  _beginthread(&lod_branch, 0, (void*)job);
+}
 
-  for (int i=0;i<CUBE_COUNT;i++) {
-    for (int j=0;j<CUBE_COUNT;j++) {
-      for (int k=0;k<CUBE_COUNT;k++) {
-        RUBIX.push_back(cube());
-        RUBIX.back().initialize(cube_pos+vect3f(UNIT_SIZE*i, UNIT_SIZE*j, UNIT_SIZE*k), UNIT_SIZE);
-        RUBIX.back().set_solid(false);
-        RUBIX.back().set_color(vect3f(0.0, 0.2, 0.0));
-        RUBIX.back().set_highlight(vect3f(0.6, 0.6, 0.6));
-      }
+void install_lods() {
+  vector<lod_job*> finished;
+  {
+    lock_guard<mutex> lock(LOD_LOCK);
+    finished.swap(LOD_FINISHED);
+  }
+  for (int i=0;i<finished.size();i++) {
+    lod_job* job = finished[i];
+    int slot = job->slot;
+    if (slot < LOADED_MODELS.size() && job->generation == LOD_GENERATION[slot] && !job->levels.empty()) {
+      int levels = job->levels.size(), coarsest = job->levels.back().face_count();
+      LOADED_MODELS[slot].set_lods(std::move(job->levels));
+      cout << "[LOD] Built " << levels << " levels of detail for model " << slot+1 << " (" << LOADED_MODELS[slot].face_count()
+           << " faces down to " << coarsest << ", " << job->ms << "ms)." << endl;
+      FRAMES.invalidate(FRAME_MODELS); // (drawn by the frame installing them)
     }
+    delete job;
+  }
+}
+
+void memory_report() {
+  size_t total = WORKING_MODEL.memory_usage();
+  cout << "Model memory:" << endl
+       << "  edited model: " << total/1024.0 << " KB (" << WORKING_MODEL.vertex_count() << " facets)" << endl;
+  for (int i=0;i<LOADED_MODELS.size();i++) {
+    if (LOADED_MODELS[i].coordinate_count() == 0) continue;
+    size_t bytes = LOADED_MODELS[i].memory_usage();
+    total += bytes;
+    cout << "  model " << i+1 << ": " << bytes/1024.0 << " KB (" << LOADED_MODELS[i].vertex_count() << " facets"
+         << (LOADED_MODELS[i].is_compact() ? ", compact" : "") << (LOADED_MODELS[i].is_paged() ? ", paged" : "")
+         << (LOADED_MODELS[i].get_lods().empty() ? "" : ", " + to_string(LOADED_MODELS[i].get_lods().size()) + " levels of detail")
+         << (DRAW_MODELS[i] ? ", displayed" : "") << ")" << endl;
   }
+  if (PAGE_BUDGET_MB > 0.0) {
+    page_cache_stats pages = PAGE_CACHE.stats();
+    total += pages.resident_bytes;
+    cout << "  page cache: " << pages.resident_bytes/1024.0 << " KB (peak " << pages.peak_bytes/1024.0 << " KB, budget "
+         << PAGE_BUDGET_MB*1024.0 << " KB; " << pages.misses+pages.prefetched << " chunk reads)" << endl;
+  }
+  size_t history = HISTORY.memory_usage();
+  total += history;
+  cout << "  undo history: " << history/1024.0 << " KB (" << HISTORY.undo_count() << " undo, " << HISTORY.redo_count() << " redo steps)" << endl;
+  cout << "  total: " << total/1024.0 << " KB" << endl;
 }
 
-void save_branch(void*) {
-  ALREADY_BRANCHED = true;
+vector<int> current_face() { return vector<int>(1, WORKING_MODEL.face_count()-1); }
 
-  glutIconifyWindow();
+void journal_add_vertex(const index2d& added) {
+  const facet& f = (*WORKING_MODEL.get_facet_data_ptr())[added[0]][added[1]];
+  JOURNAL.add_vertex((*WORKING_MODEL.get_coordinates_ptr())[f.id], (*WORKING_MODEL.get_colors_ptr())[f.color]);
+}
 
-  string filename;
-  cout << "[SAVE] Enter filename: ";
-  getline(cin, filename);
+void print_stale_journal() {
+  cout << "The journal " << JOURNAL.filename() << " holds edits to another version of " << WORKING_FILENAME
+       << " (or one that couldn't be loaded); it wasn't recovered, and was kept as " << JOURNAL.filename() << ".stale." << endl;
+}
 
-  cout << "Saving...";
+void attach_journal(const string& model_filename) { JOURNAL.attach(TRACE_FILE.length() > 0 ? TRACE_FILE : model_filename); }
 
-  WORKING_MODEL.save(filename);
-  cout << " done. (file: " << filename << ")" << endl;
+void journal_timer(int) {
+  if (!JOURNAL.flush(WORKING_MODEL)) cout << "Error writing the autosave journal. (file: " << JOURNAL.filename() << ")" << endl;
+  glutTimerFunc(JOURNAL_FLUSH_MS, journal_timer, 0);
+}
 
-  refresh();
+int key_modifiers() {
+  if (REPLAYING) return REPLAY_MODIFIERS;
+  return glutGetModifiers();
+}
 
-  glutShowWindow();
+void start_operation(const string& label, const function<void ()>& work, const function<void ()>& finish) {
+  background_operation* operation = new background_operation();
+  operation->label = label;
+  operation->work = work;
+  operation->finish = finish;
+  {
+    lock_guard<mutex> lock(OPERATIONS_LOCK);
+    OPERATIONS_RUNNING.push_back(operation);
+  }
+  _beginthread(&operation_branch, 0, (void*)operation);
+  refresh(FRAME_OVERLAY); // (its label is drawn while it runs)
+}
+
+void finish_operations() {
+  vector<background_operation*> finished;
+  {
+    lock_guard<mutex> lock(OPERATIONS_LOCK);
+    finished.swap(OPERATIONS_FINISHED);
+  }
+  for (int i=0;i<finished.size();i++) {
+    finished[i]->finish();
+    delete finished[i];
+  }
+}
 
-  UNSAVED_BUFFER = false;
+int operations_running() {
+  lock_guard<mutex> lock(OPERATIONS_LOCK);
+  return OPERATIONS_RUNNING.size();
+}
 
-  ALREADY_BRANCHED = false;
+// record() keeps the undo step (WORKING_MODEL is still the model the copy was made from), then the copy replaces it
+void start_model_edit(const string& label, const function<void (model3d&)>& edit, const function<void ()>& record,
+                      const function<void ()>& done) {
+  shared_ptr<model3d> edited = make_shared<model3d>(WORKING_MODEL);
+  working_stamp stamp;
+  start_operation(label, [edited, edit]() { edit(*edited); }, [edited, stamp, label, record, done]() {
+    if (!stamp.current()) {
+      cout << label << " was dropped: the model was edited while it ran." << endl;
+      return;
+    }
+    record();
+    WORKING_MODEL = std::move(*edited);
+    JOURNAL.invalidate();
+    UNSAVED_BUFFER = true;
+    done();
+  });
 }
 
-void load_branch(void*) {
-  ALREADY_BRANCHED = true;
+// the selector starts from a copy of SELECTION (for SELECT_ADD and SELECT_REMOVE), which replaces SELECTION once it's done
+void start_select(const function<void (selection_set&, const model3d&)>& select) {
+  shared_ptr<const model3d> model = make_shared<const model3d>(WORKING_MODEL);
+  shared_ptr<selection_set> selection = make_shared<selection_set>(SELECTION);
+  shared_ptr<double> ms = make_shared<double>(0.0);
+  working_stamp stamp;
+  start_operation("Selecting", [model, selection, ms, select]() {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    select(*selection, *model);
+    *ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  }, [selection, ms, stamp]() {
+    if (!stamp.current()) {
+      cout << "The selection was dropped: the model was edited while it was made." << endl;
+      return;
+    }
+    SELECTION = std::move(*selection);
+    print_selection(*ms);
+  });
+}
 
-  glutIconifyWindow();
+bool replay_step() {
+  if (REPLAY_NEXT >= REPLAY_EVENTS.size()) return false;
+  const input_event& event = REPLAY_EVENTS[REPLAY_NEXT++];
 
-  bool confirmed = true;
-  if (UNSAVED_BUFFER) confirmed = prompt_save();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  switch (event.type) {
+    case INPUT_KEY: {
+      REPLAY_MODIFIERS = event.values[3];
+      keyboard_callback((unsigned char)event.values[0], event.values[1], event.values[2]);
+    } break;
+    case INPUT_SPECIAL: {
+      REPLAY_MODIFIERS = event.values[3];
+      special_keys_callback(event.values[0], event.values[1], event.values[2]);
+    } break;
+    case INPUT_MOUSE: {
+      REPLAY_MODIFIERS = event.values[4];
+      mouse_callback(event.values[0], event.values[1], event.values[2], event.values[3]);
+    } break;
+    case INPUT_RESIZE: {
+      window_resize(event.values[0], event.values[1]);
+    } break;
+    case INPUT_LINE: {
+      // the answer is entered into the question being asked; once the last answer of a run is in, the operations it started are
+      //   waited on (and finished), so the event's latency covers them
+      if (!PROMPT.answer(event.text)) cout << "[REPLAY] No prompt took the trace's answer \"" << event.text << "\"." << endl;
+      else if (REPLAY_NEXT >= REPLAY_EVENTS.size() || REPLAY_EVENTS[REPLAY_NEXT].type != INPUT_LINE) {
+        while (operations_running() > 0) this_thread::sleep_for(chrono::microseconds(100));
+        finish_operations();
+      }
+      refresh(FRAME_ALL);
+    } break;
+  }
+  REPLAY_MODIFIERS = 0;
+  chrono::steady_clock::time_point handled = chrono::steady_clock::now();
+  bool drawn = FRAMES.requested(); // (an event changing nothing draws no frame)
+  if (drawn) display();
+  chrono::steady_clock::time_point displayed = chrono::steady_clock::now();
+
+  replay_sample sample;
+  sample.label = event.label();
+  sample.latency_ms = chrono::duration<double, milli>(handled - start).count();
+  sample.frame_ms = (drawn ? chrono::duration<double, milli>(displayed - handled).count() : -1.0);
+  lock_guard<mutex> lock(REPLAY_LOCK);
+  REPLAY_SAMPLES.push_back(sample);
+  return true;
+}
 
-  if (confirmed) {
-    string filename;
+void replay_idle() {
+  if (replay_step()) return;
+  replay_report();
+  JOURNAL.discard();
+  exit(0);
+}
 
-    cout << "[LOAD] Enter filename: ";
-    getline(cin, filename);
+void print_latencies(const latency_summary& summary) {
+  cout << summary.count << " (mean " << summary.mean << "ms, p50 " << summary.p50 << "ms, p95 " << summary.p95 << "ms, p99 " << summary.p99
+       << "ms, max " << summary.max << "ms)" << endl;
+}
 
-    model3d loaded_model;
+void replay_report() {
+  lock_guard<mutex> lock(REPLAY_LOCK);
+  double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - REPLAY_START).count();
 
-    // add a check to see if current model is saved...
+  map<string, vector<double>> latencies;
+  vector<double> all, frames;
+  for (int i=0;i<REPLAY_SAMPLES.size();i++) {
+    latencies[REPLAY_SAMPLES[i].label].push_back(REPLAY_SAMPLES[i].latency_ms);
+    all.push_back(REPLAY_SAMPLES[i].latency_ms);
+    if (REPLAY_SAMPLES[i].frame_ms >= 0.0) frames.push_back(REPLAY_SAMPLES[i].frame_ms);
+  }
 
-    if (WORKING_MODEL.load(filename)) {
-      cout << "Loaded model. (file: " << filename << ")" << endl;
+  cout << "[REPLAY] " << REPLAY_SAMPLES.size() << " of " << REPLAY_EVENTS.size() << " events in " << wall_ms << "ms"
+       << (HEADLESS ? " (headless)." : ".") << endl << "  event latency:" << endl;
+  for (map<string, vector<double>>::iterator i=latencies.begin();i!=latencies.end();i++) {
+    cout << "    " << i->first << ": ";
+    print_latencies(summarize_latencies(i->second));
+  }
+  cout << "    all events: ";
+  print_latencies(summarize_latencies(all));
+  cout << "  frame time: ";
+  print_latencies(summarize_latencies(frames));
+
+  if (REPLAY_CSV.length() > 0) {
+    fileio file;
+    file.open(REPLAY_CSV, "w");
+    if (!file.is_open()) {
+      cout << "Error writing the replay report. (file: " << REPLAY_CSV << ")" << endl;
+      return;
     }
-    else cout << "Error loading model. (file: " << filename << ")" << endl;
-
-    refresh();
+    file.write("event,label,latency_ms,frame_ms\n");
+    for (int i=0;i<REPLAY_SAMPLES.size();i++) {
+      string label = REPLAY_SAMPLES[i].label;
+      for (int j=0;j<label.length();j++) if (label[j] == ',' || label[j] == '"') label[j] = ' ';
+      file.write(to_string(i) + "," + label + "," + to_string(REPLAY_SAMPLES[i].latency_ms) + "," + to_string(REPLAY_SAMPLES[i].frame_ms) + "\n");
+    }
+    file.close();
+    cout << "Wrote the replay report. (file: " << REPLAY_CSV << ")" << endl;
   }
+}
 
-  glutShowWindow();
+session_snapshot* capture_session() {
+  {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    if (!PRELOAD_FILES.empty()) return 0; // slots still being filled would be written empty
+  }
 
-  ALREADY_BRANCHED = false;
+  session_snapshot* snapshot = new session_snapshot();
+  session_state& state = snapshot->state;
+  memcpy(state.modelview, CAMERA_MATRIX, sizeof(CAMERA_MATRIX));
+  state.pointer = POINTER;
+  state.light0_pos = LIGHT0_POS;
+  state.light_ambient = LIGHT_AMBIENT;
+  state.lights_on = LIGHTS_ON;
+  state.unit_size = UNIT_SIZE;
+  state.cube_count = CUBE_COUNT;
+  state.selected_color = SELECTED_COLOR;
+  state.palette_alpha = PALETTE_alpha;
+  state.palette_gamma = PALETTE_gamma;
+  state.draw_grid = DRAW_GRID;
+  state.draw_axis = DRAW_AXIS;
+  state.highlight = HIGHLIGHT;
+  state.draw_polygon_mode = DRAW_POLYGON_MODE;
+  state.display_working_model = DISPLAY_WORKING_MODEL;
+
+  state.working_filename = WORKING_FILENAME;
+  state.working_unsaved = UNSAVED_BUFFER;
+  state.working_lattice_scale = (WORKING_MODEL.is_lattice() ? WORKING_MODEL.get_lattice_scale() : 0.0f);
+  state.slots.resize(LOADED_MODELS.size());
+  for (int i=0;i<LOADED_MODELS.size();i++) state.slots[i].visible = DRAW_MODELS[i];
+
+  // (the loaded models are compact, so copying them is cheap next to serializing them)
+  snapshot->working = WORKING_MODEL;
+  snapshot->models = LOADED_MODELS;
+  return snapshot;
 }
 
-void define_grid_branch(void*) {
-  ALREADY_BRANCHED = true;
+bool restore_session(session_state& state) {
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  mesh_report validation;
+  if (!read_session(SESSION_FILE, state, WORKING_MODEL, &validation)) return false;
+
+  POINTER = state.pointer;
+  LIGHT0_POS = state.light0_pos;
+  LIGHT_AMBIENT = state.light_ambient;
+  LIGHTS_ON = state.lights_on;
+  UNIT_SIZE = state.unit_size;
+  CUBE_COUNT = state.cube_count;
+  SELECTED_COLOR = state.selected_color;
+  PALETTE_alpha = state.palette_alpha;
+  PALETTE_gamma = state.palette_gamma;
+  DRAW_GRID = state.draw_grid;
+  DRAW_AXIS = state.draw_axis;
+  HIGHLIGHT = state.highlight;
+  DRAW_POLYGON_MODE = state.draw_polygon_mode;
+  DISPLAY_WORKING_MODEL = state.display_working_model;
+  define_cube();
 
-  glutIconifyWindow();
+  WORKING_FILENAME = state.working_filename;
+  UNSAVED_BUFFER = state.working_unsaved;
+  while (LOADED_MODELS.size() < state.slots.size()) {
+    LOADED_MODELS.push_back(model3d());
+    DRAW_MODELS.push_back(false);
+  }
+  for (int i=0;i<state.slots.size();i++) DRAW_MODELS[i] = false; // until the slot's model is installed
 
-  string input;
-  cout << "Define grid unit size: ";
-  getline(cin, input);
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  cout << "[SESSION] Restored the session (" << state.slots.size() << " slots, " << ms << "ms). (file: " << SESSION_FILE << ")" << endl;
+  if (!validation.clean()) cout << "[SESSION] Repaired the working model: " << validation.summary() << "." << endl;
+  return true;
+}
 
-  UNIT_SIZE = atof(input.c_str());
+void session_write_branch(void* data) {
+  session_snapshot* snapshot = (session_snapshot*)data;
 
-  cout << "Define grid width (in unit squares): ";
-  getline(cin, input);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  bool written = write_session(SESSION_FILE, snapshot->state, snapshot->working, snapshot->models);
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  if (written) cout << "[SESSION] Wrote the session (" << snapshot->models.size() << " slots, " << ms << "ms). (file: " << SESSION_FILE << ")" << endl;
+  else cout << "[SESSION] Error writing the session. (file: " << SESSION_FILE << ")" << endl;
 
-  CUBE_COUNT = atof(input.c_str());
+  delete snapshot;
+  SESSION_WRITING = false;
+}
 
-  define_cube();
-  refresh();
+void lod_branch(void* data) {
+  lod_job* job = (lod_job*)data;
 
-  glutShowWindow();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  job->levels = build_lods(job->model);
+  job->ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  job->model.clear();
 
-  ALREADY_BRANCHED = false;
+  lock_guard<mutex> lock(LOD_LOCK);
+  LOD_FINISHED.push_back(job);
 }
 
-void quit_branch(void*) {
-  ALREADY_BRANCHED = true;
-
-  glutIconifyWindow();
+void operation_branch(void* data) {
+  background_operation* operation = (background_operation*)data;
+  operation->work();
+  {
+    lock_guard<mutex> lock(OPERATIONS_LOCK);
+    OPERATIONS_RUNNING.erase(find(OPERATIONS_RUNNING.begin(), OPERATIONS_RUNNING.end(), operation));
+    OPERATIONS_FINISHED.push_back(operation);
+  }
+  refresh(FRAME_ALL); // display() finishes it (which may change anything)
+}
 
-  cout << "Are you sure you want to quit? (y/n) ";
-  string input;
-  getline(cin, input);
-  if (input[0] == 'y' || input[0] == 'Y') {
-    bool confirmed = true;
-    if (UNSAVED_BUFFER) confirmed = prompt_save();
+void session_page_branch(void* data) {
+  session_state* state = (session_state*)data;
 
-    if (confirmed) exit(0); // quit the program
+  vector<int> index(state->slots.size(), -1); // slot -> PRELOAD_FILES index
+  {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    for (int i=0;i<PRELOAD_SLOTS.size();i++) index[PRELOAD_SLOTS[i]] = i;
   }
 
-  glutShowWindow();
+  preload_report report = page_session_models(SESSION_FILE, *state, [&](int slot, preload_result& result) {
+    {
+      lock_guard<mutex> lock(PRELOAD_LOCK);
+      PRELOAD_QUEUE.push_back(make_pair(index[slot], new preload_result(std::move(result))));
+    }
+    refresh(FRAME_MODELS); // display() installs the model
+  });
 
-  ALREADY_BRANCHED = false;
+  cout << "[SESSION] Read " << report.files << " models (" << report.failures << " failed) in " << report.wall_ms << "ms, "
+       << report.bytes/1048576.0 << " MB on " << report.threads << " threads." << endl;
+  delete state;
 }
 
-void merge_model_branch(void*) {
-  ALREADY_BRANCHED = true;
-  glutIconifyWindow();
-
-  bool confirmed = true;
-  if (UNSAVED_BUFFER) confirmed = prompt_save();
+void confirm_unsaved(const function<void ()>& confirmed) {
+  if (!UNSAVED_BUFFER) {
+    confirmed();
+    return;
+  }
+  PROMPT.ask("There are unsaved changes to the current model. Continue without saving? (yes/no) ", [confirmed](const string& input) {
+    if (input[0] == 'y' || input[0] == 'Y') {
+      UNSAVED_BUFFER = false;
+      confirmed();
+    }
+  });
+}
 
-  if (confirmed) {
-    cout << "Merge current edited model with which model number? ";
-    string input;
-    getline(cin, input);
+void define_cube() {
+  RUBIX.clear();
 
-    int model_id = atoi(input.c_str())-1;
+  vect3f cube_pos(-UNIT_SIZE*CUBE_COUNT/2.0, -UNIT_SIZE*CUBE_COUNT/2.0, -UNIT_SIZE*CUBE_COUNT/2.0);
 
-    if (model_id < LOADED_MODELS.size() && model_id > -1) {
-      cout << "Merging...";
-      const vector<vect3f>* const coordinate_data = LOADED_MODELS[model_id].get_coordinates_ptr();
-      const vector<vector<facet>>* const facet_data = LOADED_MODELS[model_id].get_facet_data_ptr();
-      for (int i=0;i<facet_data->size();i++) {
-        WORKING_MODEL.push_face();
-        for (int j=0;j<(*facet_data)[i].size();j++) {
-          WORKING_MODEL.add_vertex((*coordinate_data)[(*facet_data)[i][j].id], (*facet_data)[i][j].color);
-        }
+  for (int i=0;i<CUBE_COUNT;i++) {
+    for (int j=0;j<CUBE_COUNT;j++) {
+      for (int k=0;k<CUBE_COUNT;k++) {
+        RUBIX.push_back(cube());
+        RUBIX.back().initialize(cube_pos+vect3f(UNIT_SIZE*i, UNIT_SIZE*j, UNIT_SIZE*k), UNIT_SIZE);
+        RUBIX.back().set_solid(false);
+        RUBIX.back().set_color(vect3f(0.0, 0.2, 0.0));
+        RUBIX.back().set_highlight(vect3f(0.6, 0.6, 0.6));
       }
-      cout << " done." << endl;
     }
-    else cout << "Invalid model number." << endl;
   }
+  GRID_LIST.invalidate();
+}
 
-  glutShowWindow();
-  ALREADY_BRANCHED = false;
+void save_prompt() {
+  PROMPT.ask("[SAVE] Enter filename: ", [](const string& answer) {
+    // the model is saved as it is now: a copy is written in the background, and edits made meanwhile are left unsaved
+    shared_ptr<model3d> saved = make_shared<model3d>(WORKING_MODEL);
+    int generation = WORKING_GENERATION;
+    UNSAVED_BUFFER = false; // (set again by the next edit)
+    start_operation("Saving " + answer, [saved, answer]() {
+      TRACE_SPAN(operation_span, "save_model");
+      string filename(answer);
+      saved->save(filename);
+    }, [answer, generation]() {
+      cout << "Saved model. (file: " << answer << ")" << endl;
+      if (generation != WORKING_GENERATION) return; // the saved model isn't being edited anymore
+
+      // the file holds every edit up to the copy; journal from it (from a checkpoint, if the model was edited while it was written)
+      JOURNAL.discard();
+      attach_journal(answer);
+      if (UNSAVED_BUFFER) JOURNAL.invalidate();
+      WORKING_FILENAME = answer;
+    });
+  });
+}
+
+void load_prompt() {
+  confirm_unsaved([]() {
+    PROMPT.ask("[LOAD] Enter filename: ", [](const string& filename) {
+      // the file is read in the background, then replaces the edited model (which stays an undo step)
+      shared_ptr<model3d> loaded = make_shared<model3d>();
+      shared_ptr<bool> read = make_shared<bool>(false);
+      shared_ptr<mesh_report> validation = make_shared<mesh_report>();
+      start_operation("Loading " + filename, [loaded, read, validation, filename]() {
+        TRACE_SPAN(operation_span, "load_model");
+        *read = loaded->load(filename, validation.get());
+      }, [loaded, read, validation, filename]() {
+        HISTORY.record_replace(WORKING_MODEL, "load");
+        JOURNAL.discard(); // the previous model's unsaved edits were abandoned by confirming
+        WORKING_GENERATION++;
+        SELECTED.clear();
+        if (*read) {
+          WORKING_MODEL = std::move(*loaded);
+          cout << "Loaded model. (file: " << filename << ")" << endl;
+          if (!validation->clean()) cout << "Repaired the model: " << validation->summary() << "." << endl;
+          WORKING_FILENAME = filename;
+          attach_journal(filename);
+          UNSAVED_BUFFER = false;
+          if (TRACE_FILE.length() > 0) JOURNAL.invalidate(); // (a trace's journal is never recovered)
+          else if (JOURNAL.recover(WORKING_MODEL, validation.get())) {
+            cout << "Recovered unsaved edits from " << JOURNAL.filename() << "." << endl;
+            if (!validation->clean()) cout << "Repaired the recovered model: " << validation->summary() << "." << endl;
+            UNSAVED_BUFFER = true;
+          }
+          else if (JOURNAL.stale()) print_stale_journal();
+        }
+        else {
+          cout << "Error loading model. (file: " << filename << ")" << endl;
+          WORKING_FILENAME = "untitled";
+          attach_journal(WORKING_FILENAME);
+          JOURNAL.invalidate();
+        }
+      });
+    });
+  });
 }
 
-void face_resolution_branch(void*) {
-  ALREADY_BRANCHED = true;
-  glutIconifyWindow();
+void define_grid_prompt() {
+  PROMPT.ask("Define grid unit size: ", [](const string& size) {
+    PROMPT.ask("Define grid width (in unit squares): ", [size](const string& width) {
+      UNIT_SIZE = atof(size.c_str());
+      CUBE_COUNT = atof(width.c_str());
+      define_cube();
+    });
+  });
+}
 
-  cout << "Set current face (size: " << (*(WORKING_MODEL.get_facet_data_ptr())).back().size() << ") to how many polygons? ";
-  string input;
-  getline(cin, input);
+void quit_prompt() {
+  PROMPT.ask("Are you sure you want to quit? (y/n) ", [](const string& input) {
+    if (input[0] != 'y' && input[0] != 'Y') return;
+    bool unsaved = UNSAVED_BUFFER; // (confirming marks abandoned edits saved)
+    confirm_unsaved([unsaved]() { quit(unsaved); });
+  });
+}
 
-  cout << "Building face...";
-  WORKING_MODEL.face_resolution(atoi(input.c_str()));
-  cout << " done." << endl;
+void quit(bool unsaved) {
+  // the session is the editor as it's left: its unsaved edits are written as unsaved
+  session_snapshot* snapshot = capture_session();
+  if (snapshot) snapshot->state.working_unsaved = unsaved;
 
-  glutShowWindow();
-  ALREADY_BRANCHED = false;
+  while (SESSION_WRITING || operations_running() > 0) this_thread::sleep_for(chrono::milliseconds(10)); // (a 'V' write, or a save)
+  if (!snapshot) cout << "[SESSION] Models are still loading; the session wasn't written." << endl;
+  else if (!write_session(SESSION_FILE, snapshot->state, snapshot->working, snapshot->models)) {
+    cout << "[SESSION] Error writing the session. (file: " << SESSION_FILE << ")" << endl;
+  }
+  delete snapshot;
+  JOURNAL.discard(); // saved, or the changes were abandoned
+  if (REPLAYING) replay_report(); // (the trace ends here)
+  exit(0); // quit the program
 }
 
-void translate_model_branch(void*) {
-  ALREADY_BRANCHED = true;
-  glutIconifyWindow();
+void merge_model_prompt() {
+  confirm_unsaved([]() {
+    PROMPT.ask("Merge current edited model with which model number? ", [](const string& input) {
+      int model_id = atoi(input.c_str())-1;
+
+      if (model_id < LOADED_MODELS.size() && model_id > -1) {
+        shared_ptr<const model3d> merged = make_shared<const model3d>(LOADED_MODELS[model_id]); // (compact or paged models copy cheaply)
+        start_model_edit("Merging model " + to_string(model_id+1), [merged, model_id](model3d& edited) {
+          TRACE_SPAN(operation_span, "merge_model");
+          TRACE_ARG(operation_span, "model", model_id+1);
+          edited.merge(*merged);
+          TRACE_ARG(operation_span, "vertex_count", edited.vertex_count());
+        }, []() {
+          HISTORY.record_faces(WORKING_MODEL, current_face(), "merge"); // merged faces are appended after the current face
+        }, [model_id]() {
+          cout << "Merged model " << model_id+1 << "." << endl;
+        });
+      }
+      else cout << "Invalid model number." << endl;
+    });
+  });
+}
 
-  cout << "Translate Direction: (x/y/z) ";
-  string input;
-  getline(cin, input);
+void face_resolution_prompt() {
+  string question = "Set current face (size: " + to_string((*(WORKING_MODEL.get_facet_data_ptr())).back().size()) + ") to how many polygons? ";
+  PROMPT.ask(question, [](const string& input) {
+    int polygons = atoi(input.c_str());
+    start_model_edit("Building face", [polygons](model3d& edited) {
+      TRACE_SPAN(operation_span, "face_resolution");
+      edited.face_resolution(polygons);
+    }, []() {
+      HISTORY.record_faces(WORKING_MODEL, current_face(), "face resolution");
+    }, []() {
+      cout << "Built face." << endl;
+    });
+  });
+}
 
-  vect3f direction;
-  if (input[0] == 'x' || input[0] == 'X')      direction.x = 1;
-  else if (input[0] == 'y' || input[0] == 'Y') direction.y = 1;
-  else if (input[0] == 'z' || input[0] == 'Z') direction.z = 1;
+void translate_model_prompt() {
+  PROMPT.ask("Translate Direction: (x/y/z) ", [](const string& input) {
+    vect3f direction;
+    if (input[0] == 'x' || input[0] == 'X')      direction.x = 1;
+    else if (input[0] == 'y' || input[0] == 'Y') direction.y = 1;
+    else if (input[0] == 'z' || input[0] == 'Z') direction.z = 1;
+
+    PROMPT.ask("Magnitude: ", [direction](const string& input) {
+      int magnitude = atoi(input.c_str());
+
+      cout << "Translating model...";
+      {
+        TRACE_SPAN(branch_span, "translate_model");
+        WORKING_MODEL.translate(direction*magnitude);
+        HISTORY.record_translate(direction*magnitude);
+        JOURNAL.translate(direction*magnitude);
+        TRACE_ARG(branch_span, "coordinate_count", WORKING_MODEL.get_coordinates_ptr()->size());
+      }
+      cout << " done." << endl;
 
-  int magnitude;
-  cout << "Magnitude: ";
-  getline(cin, input);
-  magnitude = atoi(input.c_str());
+      UNSAVED_BUFFER = true;
+    });
+  });
+}
 
-  cout << "Translating model...";
-  const vector<vect3f>* const coords = WORKING_MODEL.get_coordinates_ptr();
+void transform_model_prompt() {
+  PROMPT.ask("Transform invert axis, or orient the faces to agree with the selected face's winding: (x/y/z/o) ", [](const string& input) {
+    if (input[0] == 'o' || input[0] == 'O') {
+      // the faces connected to the seed by shared edges are turned to wind the way it does (found through the model's adjacency)
+      int seed = (in_bounds(SELECTED, *(WORKING_MODEL.get_facet_data_ptr())) ? SELECTED[0] : 0);
+      cout << "Orienting faces...";
+      TRACE_SPAN(branch_span, "transform_model");
+      vector<int> faces;
+      bool agree = WORKING_MODEL.adjacency().orient(seed, faces);
+      if (!faces.empty()) {
+        HISTORY.record_faces(WORKING_MODEL, faces, "orient faces");
+        WORKING_MODEL.reverse_faces(faces);
+        JOURNAL.invalidate();
+        UNSAVED_BUFFER = true;
+      }
+      TRACE_ARG(branch_span, "faces_reversed", faces.size());
+      cout << " done (" << faces.size() << " faces reversed)." << endl;
+      if (!agree) cout << "The faces connected to face " << seed << " can't all agree (the surface is one sided)." << endl;
+      return;
+    }
 
-  for (int i=0;i<(*coords).size();i++) {
-    WORKING_MODEL.edit_coord(i, (*coords)[i]+direction*magnitude);
-  }
-  cout << " done." << endl;
+    int axis = -1;
+    if (input[0] == 'x' || input[0] == 'X')      axis = 0;
+    else if (input[0] == 'y' || input[0] == 'Y') axis = 1;
+    else if (input[0] == 'z' || input[0] == 'Z') axis = 2;
+
+    cout << "Translating model...";
+    {
+      TRACE_SPAN(branch_span, "transform_model");
+      WORKING_MODEL.mirror(axis);
+      if (axis >= 0) {
+        HISTORY.record_mirror(axis);
+        JOURNAL.mirror(axis);
+      }
+      TRACE_ARG(branch_span, "coordinate_count", WORKING_MODEL.get_coordinates_ptr()->size());
+    }
+    cout << " done." << endl;
 
-  UNSAVED_BUFFER = true;
+    UNSAVED_BUFFER = true;
+  });
+}
 
-  glutShowWindow();
-  ALREADY_BRANCHED = false;
+void select_prompt() {
+  PROMPT.ask("Select by (b)ox, (s)phere, (c)olor, co(n)nected faces, (a)ll, (i)nvert or (x) none (+ or - first adds or removes): ", [](const string& answer) {
+    string input(answer);
+    SELECT_MODE mode = SELECT_REPLACE;
+    if (input.length() > 0 && (input[0] == '+' || input[0] == '-')) {
+      mode = (input[0] == '+' ? SELECT_ADD : SELECT_REMOVE);
+      input.erase(0, 1);
+    }
+    char selector = (input.length() > 0 ? input[0] : ' ');
+
+    if (selector == 'b' || selector == 'B') {
+      PROMPT.ask("Opposite corner of the box from the cursor (x y z): ", [mode](const string& input) {
+        vect3f corner(POINTER);
+        sscanf(input.c_str(), "%f %f %f", &corner.x, &corner.y, &corner.z);
+        vect3f low(min(POINTER.x, corner.x), min(POINTER.y, corner.y), min(POINTER.z, corner.z));
+        vect3f high(max(POINTER.x, corner.x), max(POINTER.y, corner.y), max(POINTER.z, corner.z));
+        start_select([low, high, mode](selection_set& selection, const model3d& model) { selection.select_box(model, low, high, mode); });
+      });
+      return;
+    }
+    if (selector == 's' || selector == 'S') {
+      PROMPT.ask("Radius around the cursor: ", [mode](const string& input) {
+        vect3f center(POINTER);
+        float radius = atof(input.c_str());
+        start_select([center, radius, mode](selection_set& selection, const model3d& model) { selection.select_sphere(model, center, radius, mode); });
+      });
+      return;
+    }
+
+    // the selectors that read the model run on a copy of it; inverting and clearing only flip bits
+    bool facet_selected = in_bounds(SELECTED, *(WORKING_MODEL.get_facet_data_ptr()));
+    if (selector == 'c' || selector == 'C') {
+      vect3f color = (facet_selected ? WORKING_MODEL.get_vertex_color(SELECTED) : SELECTED_COLOR);
+      start_select([color, mode](selection_set& selection, const model3d& model) { selection.select_color(model, color, mode); });
+    }
+    else if (selector == 'n' || selector == 'N') {
+      if (facet_selected) {
+        int face = SELECTED[0];
+        start_select([face, mode](selection_set& selection, const model3d& model) { selection.select_connected(model, face, mode); });
+      }
+      else cout << "Select a facet of the region with Tab first." << endl;
+    }
+    else if (selector == 'a' || selector == 'A') start_select([](selection_set& selection, const model3d& model) { selection.select_all(model); });
+    else if (selector == 'i' || selector == 'I') {
+      if (SELECTION.fits(WORKING_MODEL)) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        SELECTION.invert();
+        print_selection(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+      }
+      else start_select([](selection_set& selection, const model3d& model) { selection.select_all(model); }); // (nothing was selected)
+    }
+    else if (selector == 'x' || selector == 'X') {
+      SELECTION.clear();
+      print_selection(0.0);
+    }
+  });
 }
 
-// polygon faces don't transfer correctly >.<
-void transform_model_branch(void*) {
-  ALREADY_BRANCHED = true;
-  glutIconifyWindow();
+void print_selection(double ms) {
+  cout << SELECTION.count() << " facets selected (" << ms << "ms)." << endl;
+}
 
-  cout << "Transform invert axis: (x/y/z) ";
-  string input;
-  getline(cin, input);
+bool selection_editable() {
+  if (!SELECTION.empty() && SELECTION.fits(WORKING_MODEL)) return true;
+  cout << "Nothing is selected (select facets with 'b')." << endl;
+  SELECTION.clear();
+  return false;
+}
 
-  vect3f direction(1.0, 1.0, 1.0), normal;
-  if (input[0] == 'x' || input[0] == 'X') {
-    direction.x = -1.0;
-    normal.x = 1.0;
-  }
-  else if (input[0] == 'y' || input[0] == 'Y') {
-    direction.y = -1.0;
-    normal.y = 1.0;
-  }
-  else if (input[0] == 'z' || input[0] == 'Z') {
-    direction.z = -1.0;
-    normal.z = 1.0;
-  }
+// the selection is checked again as each answer comes in (a load finishing in the meantime replaces the model it selects from)
+void bulk_edit_prompt() {
+  if (!selection_editable()) return;
+
+  string question = "Edit the " + to_string(SELECTION.count()) + " selected facets: (c)olor with the palette color, (m)ove, (d)elete or e(x)tract to a model slot: ";
+  PROMPT.ask(question, [](const string& input) {
+    if (!selection_editable()) return;
+    char edit = (input.length() > 0 ? input[0] : ' ');
+
+    // each edit runs on copies of the model and selection (the selection is the one the edit was asked for)
+    if (edit == 'c' || edit == 'C') {
+      shared_ptr<const selection_set> selection = make_shared<const selection_set>(SELECTION);
+      vect3f color = SELECTED_COLOR;
+      start_model_edit("Recoloring the selection", [selection, color](model3d& edited) {
+        TRACE_SPAN(operation_span, "bulk_edit");
+        TRACE_ARG(operation_span, "facets", selection->count());
+        edited.set_color(*selection, color);
+      }, [selection]() {
+        vector<int> faces;
+        selection->faces(faces);
+        HISTORY.record_faces(WORKING_MODEL, faces, "color selection");
+      }, [selection]() {
+        cout << "Recolored " << selection->count() << " facets." << endl;
+      });
+    }
+    else if (edit == 'm' || edit == 'M') {
+      PROMPT.ask("Offset (x y z): ", [](const string& input) {
+        if (!selection_editable()) return;
+        vect3f offset;
+        sscanf(input.c_str(), "%f %f %f", &offset.x, &offset.y, &offset.z);
+        shared_ptr<const selection_set> selection = make_shared<const selection_set>(SELECTION);
+        start_model_edit("Moving the selection", [selection, offset](model3d& edited) {
+          TRACE_SPAN(operation_span, "bulk_edit");
+          TRACE_ARG(operation_span, "facets", selection->count());
+          edited.translate(*selection, offset);
+        }, [selection]() {
+          HISTORY.record_move(WORKING_MODEL, *selection); // (the selected facets' points and the faces stretched, rather than a copy)
+        }, []() {
+          cout << "Moved the selected facets." << endl;
+        });
+      });
+    }
+    else if (edit == 'd' || edit == 'D') {
+      shared_ptr<const selection_set> selection = make_shared<const selection_set>(SELECTION);
+      shared_ptr<int> removed = make_shared<int>(0);
+      start_model_edit("Deleting the selection", [selection, removed](model3d& edited) {
+        TRACE_SPAN(operation_span, "bulk_edit");
+        TRACE_ARG(operation_span, "facets", selection->count());
+        *removed = edited.remove(*selection);
+      }, [selection]() {
+        vector<int> faces;
+        selection->faces(faces);
+        HISTORY.record_faces(WORKING_MODEL, faces, "delete selection"); // (the faces losing facets; their count doesn't change)
+      }, [removed]() {
+        SELECTION.clear();
+        SELECTED.clear();
+        cout << "Deleted " << *removed << " facets." << endl;
+      });
+    }
+    else if (edit == 'x' || edit == 'X') {
+      PROMPT.ask("Extract into which model number (replacing the model there)? ", [](const string& input) {
+        if (!selection_editable()) return;
+        int model_id = atoi(input.c_str())-1;
+        if (model_id < LOADED_MODELS.size() && model_id > -1) {
+          // the facets are copied out of the model as it is now (later edits don't change what's extracted)
+          shared_ptr<const model3d> source = make_shared<const model3d>(WORKING_MODEL);
+          shared_ptr<const selection_set> selection = make_shared<const selection_set>(SELECTION);
+          shared_ptr<model3d> extracted = make_shared<model3d>();
+          start_operation("Extracting the selection", [source, selection, extracted]() {
+            TRACE_SPAN(operation_span, "bulk_edit");
+            TRACE_ARG(operation_span, "facets", selection->count());
+            *extracted = source->extract(*selection);
+          }, [extracted, model_id]() {
+            LOADED_MODELS[model_id] = std::move(*extracted);
+            DRAW_MODELS[model_id] = true;
+            cout << "Extracted " << LOADED_MODELS[model_id].vertex_count() << " facets into model " << model_id+1 << "." << endl;
+            compact_model(model_id);
+          });
+        }
+        else cout << "Invalid model number." << endl;
+      });
+    }
+  });
+}
 
-  cout << "Translating model...";
-  const vector<vect3f>* const coords = WORKING_MODEL.get_coordinates_ptr();
-  const vector<vector<facet>>* const facets = WORKING_MODEL.get_facet_data_ptr();
+void preload_prompt() {
+  PROMPT.ask("[PRELOAD] Enter directory or manifest: ", [](const string& path) {
+    {
+      lock_guard<mutex> lock(PRELOAD_LOCK);
+      PRELOAD_PATH = path;
+    }
+    _beginthread(&preload_branch, 0, (void*)0);
+  });
+}
 
-  for (int i=0;i<(*coords).size();i++) {
-    vect3f new_point = (*coords)[i];
-    new_point.x *= direction.x;
-    new_point.y *= direction.y;
-    new_point.z *= direction.z;
-    WORKING_MODEL.edit_coord(i, new_point);
+void preload_branch(void*) {
+  string path; // (given by --preload= or preload_prompt())
+  {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    path = PRELOAD_PATH;
+    PRELOAD_PATH.clear();
+    if (!PRELOAD_FILES.empty()) {
+      cout << "[PRELOAD] A preload is already running." << endl;
+      return;
+    }
   }
 
-  for (int i=0;i<(*facets).size();i++) {
-    int face_size = (*facets)[i].size();
-    if (face_size > 0) {
-      vect3f cross(((*facets)[i][0].normal).cross(normal));
-      if (cross.x + cross.y + cross.z == 0) { // the face is facing the switched axis
-        for (int j=0;j<face_size;j++) {
-          facet front_facet = (*facets)[i][j]; // the j'th facet from the front
-          facet back_facet = (*facets)[i][(*facets)[i].size()-j-1]; // the j'th facet from the back
+  vector<string> files;
+  if (!preload_list(path, files)) {
+    cout << "[PRELOAD] Error reading directory or manifest. (path: " << path << ")" << endl;
+    return;
+  }
+  if (files.empty()) {
+    cout << "[PRELOAD] No models found. (path: " << path << ")" << endl;
+    return;
+  }
 
-          // swap the order of the facets:
-          WORKING_MODEL.edit_vertex(index2d(i, j), back_facet);
-          WORKING_MODEL.edit_vertex(index2d(i, (*facets)[i].size()-j-1), front_facet);
+  {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    PRELOAD_FILES = files;
+  }
+  cout << "[PRELOAD] Loading " << files.size() << " models in the background. (path: " << path << ")" << endl;
 
-          face_size--; // only swap the first half
-        }
-      }
+  preload_report report = preload_models(files, [](int index, preload_result& result) {
+    {
+      lock_guard<mutex> lock(PRELOAD_LOCK);
+      PRELOAD_QUEUE.push_back(make_pair(index, new preload_result(std::move(result))));
     }
-  }
-  WORKING_MODEL.recalculate_normals();
-  cout << " done." << endl;
+    refresh(FRAME_MODELS); // display() installs the model
+  });
 
-  UNSAVED_BUFFER = true;
+  double first_frame_ms;
+  {
+    lock_guard<mutex> lock(PRELOAD_LOCK);
+    first_frame_ms = FIRST_FRAME_MS;
+  }
 
-  glutShowWindow();
-  ALREADY_BRANCHED = false;
+  double seconds = report.wall_ms/1000.0;
+  cout << "[PRELOAD] Startup report:" << endl
+       << "  models: " << report.files << " (" << report.failures << " failed), threads: " << report.threads << endl
+       << "  first model ready after " << report.first_ms << "ms, all models after " << report.wall_ms << "ms"
+       << " (" << report.load_ms << "ms of loading summed over files)" << endl
+       << "  " << report.facets << " facets, " << report.bytes/1048576.0 << " MB ("
+       << (seconds > 0.0 ? report.bytes/seconds/1048576.0 : 0.0) << " MB/s)" << endl;
+  if (first_frame_ms >= 0.0) cout << "  window interactive " << first_frame_ms << "ms after startup" << endl;
 }
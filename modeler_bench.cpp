@@ -0,0 +1,1142 @@
+// File: modeler_bench.cpp
+// Written by Joshua Green
+
+// Microbenchmarks for vectXf, model3d, cube and the model file i/o paths.
+//
+// build (linux, against linux builds of the str and fileio libraries):
+//   g++ -O2 -std=c++11 modeler_bench.cpp model3d.cpp model3d_draw.cpp vectXf.cpp cube.cpp profiler.cpp trace.cpp mesh_gen.cpp parallel.cpp preload.cpp history.cpp journal.cpp session.cpp paged.cpp lod.cpp raster.cpp render_queue.cpp shader.cpp half_edge.cpp vertex_cache.cpp selection.cpp validate.cpp
+//       -Lstr -Lfileio -lstr -lfileio -lbenchmark -lpthread -lglut -lGLU -lGL -o modeler_bench
+//
+// run:
+//   ./modeler_bench [--corpus=models/] --benchmark_format=json --benchmark_out=bench.json
+//
+// The json output can be diffed between commits with google benchmark's tools/compare.py.
+
+#include <benchmark/benchmark.h>
+
+#include "vectXf.h"
+#include "model3d.h"
+#include "cube.h"
+#include "mesh_gen.h"
+#include "preload.h"
+#include "history.h"
+#include "journal.h"
+#include "session.h"
+#include "paged.h"
+#include "lod.h"
+#include "raster.h"
+#include "render_queue.h"
+#include "half_edge.h"
+#include "vertex_cache.h"
+#include "selection.h"
+#include "validate.h"
+#include "profiler.h"
+#include "fileio/fileio.h"
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+  string CORPUS_DIR = "models/";
+  const char* const SCRATCH_FILE = "modeler_bench.tmp";
+  const char* const JOURNAL_BASE = "modeler_bench_model"; // journals to modeler_bench_model.journal
+  const char* const SESSION_BENCH_FILE = "modeler_bench.session";
+  const char* const PAGE_PREFIX = "modeler_bench_pages"; // page files (removed with their models)
+  const char* const PRELOAD_DIR = "modeler_bench_preload"; // synthetic preload corpus, written on first use and removed on exit
+
+  // deterministic pseudo-random values so runs are comparable between commits
+  float lcg(unsigned int& state) {
+    state = state*1664525u + 1013904223u;
+    return (state>>8)/16777216.0f;
+  }
+
+  vector<vect3f> random_points(int count) {
+    unsigned int state = 12345;
+    vector<vect3f> points;
+    for (int i=0;i<count;i++) points.push_back(vect3f(lcg(state), lcg(state), lcg(state)));
+    return points;
+  }
+
+  // a seeded terrain grid of roughly face_count quads with shared corners
+  model3d terrain_model(long long int face_count) {
+    mesh_params params;
+    params.faces = face_count;
+    return generate_terrain(params);
+  }
+
+  // mirrors define_cube() in modeler.cpp
+  vector<cube> grid_cubes(int cube_count, float unit_size) {
+    vector<cube> rubix;
+    vect3f cube_pos(-unit_size*cube_count/2.0, -unit_size*cube_count/2.0, -unit_size*cube_count/2.0);
+    for (int i=0;i<cube_count;i++) {
+      for (int j=0;j<cube_count;j++) {
+        for (int k=0;k<cube_count;k++) {
+          rubix.push_back(cube());
+          rubix.back().initialize(cube_pos+vect3f(unit_size*i, unit_size*j, unit_size*k), unit_size);
+        }
+      }
+    }
+    return rubix;
+  }
+
+  long long int file_size(const string& filename) {
+    fileio file;
+    file.open(filename, "r");
+    if (!file.is_open()) return 0;
+    return file.size();
+  }
+}
+
+
+
+// **** vectXf **** //
+static void BM_vect3f_add(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  for (auto _ : state) {
+    vect3f sum;
+    for (int i=0;i<points.size();i++) sum += points[i];
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_vect3f_add)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+static void BM_vect3f_arithmetic(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  for (auto _ : state) {
+    vect3f sum;
+    for (int i=1;i<points.size();i++) sum += (points[i]-points[i-1])*0.5f + points[i]/3.0f;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_vect3f_arithmetic)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+static void BM_vect3f_cross(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  for (auto _ : state) {
+    vect3f sum;
+    for (int i=1;i<points.size();i++) sum += points[i].cross(points[i-1]);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_vect3f_cross)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+static void BM_vect3f_normalize(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    vector<vect3f> work(points);
+    state.ResumeTiming();
+    for (int i=0;i<work.size();i++) work[i].normalize();
+    benchmark::DoNotOptimize(work.data());
+  }
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_vect3f_normalize)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+
+
+// **** model3d **** //
+static void BM_model3d_add_vertex(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  for (auto _ : state) {
+    model3d model;
+    for (int i=0;i<points.size();i++) {
+      model.add_vertex(points[i]);
+      if (i%4 == 3) model.push_face();
+    }
+    benchmark::DoNotOptimize(model.vertex_count());
+  }
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_model3d_add_vertex)->RangeMultiplier(4)->Range(1<<8, 1<<14);
+
+// the same points on a lattice: welding is a hash lookup rather than a scan of every coordinate
+static void BM_model3d_add_vertex_lattice(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  for (auto _ : state) {
+    model3d model;
+    model.set_lattice(0.001f);
+    for (int i=0;i<points.size();i++) {
+      model.add_vertex(points[i]);
+      if (i%4 == 3) model.push_face();
+    }
+    benchmark::DoNotOptimize(model.vertex_count());
+  }
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_model3d_add_vertex_lattice)->RangeMultiplier(4)->Range(1<<8, 1<<14);
+
+static void BM_model3d_recalculate_normals(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  for (auto _ : state) model.recalculate_normals();
+  state.SetItemsProcessed(state.iterations()*model.vertex_count());
+}
+BENCHMARK(BM_model3d_recalculate_normals)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+static void BM_model3d_face_resolution(benchmark::State& state) {
+  for (auto _ : state) {
+    model3d model;
+    model.add_vertex(vect3f(0.0f, 0.0f, 0.0f));
+    model.add_vertex(vect3f(1.0f, 0.0f, 0.0f));
+    model.add_vertex(vect3f(1.0f, 1.0f, 0.0f));
+    model.add_vertex(vect3f(0.0f, 1.0f, 0.0f));
+    model.face_resolution(state.range(0));
+    benchmark::DoNotOptimize(model.vertex_count());
+  }
+  state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_model3d_face_resolution)->RangeMultiplier(4)->Range(4, 1024);
+
+static void BM_model3d_merge(benchmark::State& state) {
+  model3d source = terrain_model(state.range(0));
+  for (auto _ : state) {
+    model3d target;
+    target.merge(source);
+    benchmark::DoNotOptimize(target.vertex_count());
+  }
+  state.SetItemsProcessed(state.iterations()*source.vertex_count());
+}
+BENCHMARK(BM_model3d_merge)->RangeMultiplier(4)->Range(64, 4096);
+
+static void BM_model3d_save_synthetic(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  for (auto _ : state) {
+    string filename(SCRATCH_FILE);
+    model.save(filename);
+  }
+  state.SetBytesProcessed(state.iterations()*file_size(SCRATCH_FILE));
+  remove(SCRATCH_FILE);
+}
+BENCHMARK(BM_model3d_save_synthetic)->RangeMultiplier(8)->Range(1<<10, 1<<16);
+
+static void BM_model3d_load_synthetic(benchmark::State& state) {
+  string filename(SCRATCH_FILE);
+  terrain_model(state.range(0)).save(filename);
+  for (auto _ : state) {
+    model3d model;
+    benchmark::DoNotOptimize(model.load(filename));
+  }
+  state.SetBytesProcessed(state.iterations()*file_size(filename));
+  remove(SCRATCH_FILE);
+}
+BENCHMARK(BM_model3d_load_synthetic)->RangeMultiplier(8)->Range(1<<10, 1<<16);
+
+static void BM_model3d_save_binary_synthetic(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  for (auto _ : state) benchmark::DoNotOptimize(model.save_binary(SCRATCH_FILE));
+  state.SetBytesProcessed(state.iterations()*file_size(SCRATCH_FILE));
+  remove(SCRATCH_FILE);
+}
+BENCHMARK(BM_model3d_save_binary_synthetic)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+static void BM_model3d_load_binary_synthetic(benchmark::State& state) {
+  terrain_model(state.range(0)).save_binary(SCRATCH_FILE);
+  for (auto _ : state) {
+    model3d model;
+    benchmark::DoNotOptimize(model.load(SCRATCH_FILE));
+  }
+  state.SetBytesProcessed(state.iterations()*file_size(SCRATCH_FILE));
+  remove(SCRATCH_FILE);
+}
+BENCHMARK(BM_model3d_load_binary_synthetic)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+// compact storage: encode, decode (expand) and the memory ratio (bytes_before/bytes_after counters)
+static void BM_model3d_compact(benchmark::State& state) {
+  model3d source = terrain_model(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    model3d model(source);
+    state.ResumeTiming();
+    model.compact();
+    benchmark::DoNotOptimize(model.memory_usage());
+  }
+  model3d compacted(source);
+  compacted.compact();
+  state.counters["bytes_before"] = source.memory_usage();
+  state.counters["bytes_after"] = compacted.memory_usage();
+  state.SetItemsProcessed(state.iterations()*source.vertex_count());
+}
+BENCHMARK(BM_model3d_compact)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+static void BM_model3d_expand(benchmark::State& state) {
+  model3d source = terrain_model(state.range(0));
+  source.compact();
+  for (auto _ : state) {
+    state.PauseTiming();
+    model3d model(source);
+    state.ResumeTiming();
+    model.expand();
+    benchmark::DoNotOptimize(model.get_facet_data_ptr()->size());
+  }
+  state.SetItemsProcessed(state.iterations()*source.vertex_count());
+}
+BENCHMARK(BM_model3d_expand)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+// a terrain with every other face removed, leaving about half of its coordinates unreferenced
+static void BM_model3d_defragment(benchmark::State& state) {
+  model3d terrain = terrain_model(state.range(0));
+  vector<vector<facet>> faces = terrain.get_facet_data();
+  for (int i=0;i<faces.size();i+=2) faces[i].clear();
+  model3d source(terrain.get_coordinates(), terrain.get_colors_ptr()->values(), terrain.get_normals_ptr()->values(), faces);
+  for (auto _ : state) {
+    state.PauseTiming();
+    model3d model(source);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(model.defragment());
+  }
+  state.SetItemsProcessed(state.iterations()*source.coordinate_count());
+}
+BENCHMARK(BM_model3d_defragment)->RangeMultiplier(8)->Range(1<<10, 1<<20);
+
+// **** edit_history **** //
+// an edit to one face of a large model: the step holds that face (bytes_per_step), where a snapshot would hold the whole model
+static void BM_history_face_step(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  edit_history history;
+  int face = model.face_count()/2;
+  int vertex[2] = { face, 0 };
+  for (auto _ : state) {
+    history.record_faces(model, vector<int>(1, face), "color");
+    model.set_vertex_color(vertex, vect3f(0.0f, 0.0f, 1.0f));
+    history.undo(model);
+    history.redo(model);
+    history.undo(model);
+  }
+  history.clear();
+  history.record_faces(model, vector<int>(1, face), "color");
+  state.counters["bytes_per_step"] = history.memory_usage();
+  state.counters["model_bytes"] = model.memory_usage();
+}
+BENCHMARK(BM_history_face_step)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// the latency of undoing a whole model edit (a translation) on a large model
+static void BM_history_undo_translate(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  edit_history history;
+  for (auto _ : state) {
+    state.PauseTiming();
+    model.translate(vect3f(1.0f, 0.0f, 0.0f));
+    history.record_translate(vect3f(1.0f, 0.0f, 0.0f));
+    state.ResumeTiming();
+    history.undo(model);
+  }
+  state.counters["bytes_per_step"] = sizeof(vect3f);
+  state.SetItemsProcessed(state.iterations()*model.coordinate_count());
+}
+BENCHMARK(BM_history_undo_translate)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// a run of spacebar inserts coalesced into one step
+static void BM_history_coalesced_inserts(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    model3d model;
+    edit_history history;
+    for (int i=0;i<points.size();i++) {
+      history.record_faces(model, vector<int>(1, model.face_count()-1), "add vertex", true);
+      model.add_vertex(points[i]);
+    }
+    bytes = history.memory_usage();
+    history.undo(model);
+    benchmark::DoNotOptimize(model.vertex_count());
+  }
+  state.counters["history_bytes"] = bytes;
+  state.SetItemsProcessed(state.iterations()*points.size());
+}
+BENCHMARK(BM_history_coalesced_inserts)->RangeMultiplier(4)->Range(1<<6, 1<<12);
+
+// for comparison: what a snapshot per edit would cost
+static void BM_history_snapshot(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  for (auto _ : state) {
+    model3d snapshot(model);
+    benchmark::DoNotOptimize(snapshot.vertex_count());
+  }
+  state.counters["bytes_per_step"] = model.memory_usage();
+}
+BENCHMARK(BM_history_snapshot)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// **** model_journal **** //
+// flushing 64 journaled vertex inserts made to models of increasing size: the cost should stay flat
+static void BM_journal_flush(benchmark::State& state) {
+  model3d model = terrain_model(state.range(0));
+  vector<vect3f> points = random_points(64);
+  model_journal journal;
+  journal.attach(JOURNAL_BASE);
+  journal.discard();
+  for (auto _ : state) {
+    for (int i=0;i<points.size();i++) journal.add_vertex(points[i], DEFAULT_COLOR);
+    journal.flush(model);
+  }
+  state.counters["journal_bytes"] = journal.journal_bytes();
+  state.SetItemsProcessed(state.iterations()*points.size());
+  journal.discard();
+}
+BENCHMARK(BM_journal_flush)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// replaying a journal of vertex inserts, face pushes and color edits (as after a crash)
+static void BM_journal_replay(benchmark::State& state) {
+  vector<vect3f> points = random_points(state.range(0));
+  model3d source;
+  model_journal journal;
+  journal.attach(JOURNAL_BASE);
+  journal.discard();
+  for (int i=0;i<points.size();i++) {
+    source.add_vertex(points[i]);
+    journal.add_vertex(points[i], DEFAULT_COLOR);
+    if (i%4 == 3) {
+      int vertex[2] = { i/4, 0 };
+      source.set_vertex_color(vertex, vect3f(0.0f, 1.0f, 0.0f));
+      journal.set_vertex_color(vertex, vect3f(0.0f, 1.0f, 0.0f));
+      source.push_face();
+      journal.push_face();
+    }
+  }
+  journal.flush(model3d()); // (an empty model, so the journal isn't compacted into a checkpoint)
+
+  fileio file;
+  file.open(journal.filename(), "r");
+  string data = file.read(file.size());
+  file.close();
+  journal.discard();
+
+  int records = 0;
+  for (auto _ : state) {
+    model3d model;
+    records = model_journal::replay(data, model);
+    benchmark::DoNotOptimize(model.vertex_count());
+  }
+  state.counters["journal_bytes"] = data.length();
+  state.SetItemsProcessed(state.iterations()*records);
+}
+BENCHMARK(BM_journal_replay)->RangeMultiplier(4)->Range(1<<8, 1<<14);
+
+// **** sessions **** //
+// a session of model_count compact 16k face models (as the modeler keeps its slots), a tenth of them displayed
+void session_models(int model_count, session_state& session, vector<model3d>& models) {
+  model3d model = terrain_model(1<<14);
+  model.compact();
+  models.assign(model_count, model);
+  session.slots.resize(model_count);
+  for (int i=0;i<model_count;i++) session.slots[i].visible = (i%10 == 0);
+}
+
+// writing a whole session (done in the background by the modeler)
+static void BM_session_write(benchmark::State& state) {
+  session_state session;
+  vector<model3d> models;
+  session_models(state.range(0), session, models);
+  model3d working = terrain_model(1<<14);
+  for (auto _ : state) write_session(SESSION_BENCH_FILE, session, working, models);
+  state.counters["session_bytes"] = file_size(SESSION_BENCH_FILE);
+  remove(SESSION_BENCH_FILE);
+}
+BENCHMARK(BM_session_write)->RangeMultiplier(10)->Range(1, 100)->Unit(benchmark::kMillisecond);
+
+// opening a session (the state, the slot table and the edited model): what startup waits for; the slots page in afterwards
+static void BM_session_open(benchmark::State& state) {
+  session_state session;
+  vector<model3d> models;
+  session_models(state.range(0), session, models);
+  write_session(SESSION_BENCH_FILE, session, terrain_model(1<<14), models);
+  for (auto _ : state) {
+    session_state opened;
+    model3d working;
+    read_session(SESSION_BENCH_FILE, opened, working);
+    benchmark::DoNotOptimize(working.vertex_count());
+  }
+  remove(SESSION_BENCH_FILE);
+}
+BENCHMARK(BM_session_open)->RangeMultiplier(10)->Range(1, 100)->Unit(benchmark::kMillisecond);
+
+// paging in every slot's model (the background part of a restore)
+static void BM_session_page(benchmark::State& state) {
+  session_state session;
+  vector<model3d> models;
+  session_models(state.range(0), session, models);
+  write_session(SESSION_BENCH_FILE, session, model3d(), models);
+  long long int bytes = 0;
+  for (auto _ : state) {
+    preload_report report = page_session_models(SESSION_BENCH_FILE, session, [](int, preload_result& result) { benchmark::DoNotOptimize(result.model.vertex_count()); });
+    bytes += report.bytes;
+  }
+  state.SetBytesProcessed(bytes);
+  remove(SESSION_BENCH_FILE);
+}
+BENCHMARK(BM_session_page)->RangeMultiplier(10)->Range(1, 100)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// a sphere of face_count faces paged into cache, which is then given a budget of a quarter of the page file
+//   (the sphere is moved up a unit, so drawn with identity matrices the view frustum culls about half of its chunks)
+bool paged_sphere(long long int face_count, page_cache& cache, model3d& model) {
+  mesh_params params;
+  params.faces = face_count;
+  model = generate_sphere(params);
+  model.translate(vect3f(0.0f, 1.0f, 0.0f));
+  if (!model.page_out(cache)) return false;
+  cache.set_budget(model.get_paged_ptr()->file_bytes()/4);
+  cache.reset_stats();
+  return true;
+}
+
+// paged storage: drawing a model several times larger than the page cache's budget (no gl context, so the gl calls are no-ops
+//   and the matrices read back are the identity). fails if the cache ever held more than its budget and the one chunk it may
+//   exceed it by
+static void BM_paged_draw(benchmark::State& state) {
+  page_cache cache(1024*1024*1024, PAGE_PREFIX);
+  model3d model;
+  if (!paged_sphere(state.range(0), cache, model)) {
+    state.SkipWithError("unable to page the model out");
+    return;
+  }
+  const paged_store& store = *model.get_paged_ptr();
+  for (auto _ : state) model.draw();
+
+  page_cache_stats stats = cache.stats();
+  long long int largest = 0;
+  for (int i=0;i<store.chunk_count();i++) largest = max(largest, store.info(i).bytes() + (long long int)sizeof(page_chunk));
+  state.counters["budget_bytes"] = cache.budget();
+  state.counters["page_bytes"] = store.file_bytes();
+  state.counters["peak_bytes"] = stats.peak_bytes;
+  state.counters["chunk_reads"] = benchmark::Counter(stats.misses+stats.prefetched, benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations()*model.vertex_count());
+  if (stats.peak_bytes > cache.budget() + largest) state.SkipWithError("the page cache exceeded its budget");
+}
+BENCHMARK(BM_paged_draw)->RangeMultiplier(8)->Range(1<<14, 1<<20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// streaming a paged model out in the binary format (chunk by chunk, through the same budget)
+static void BM_paged_save_binary(benchmark::State& state) {
+  page_cache cache(1024*1024*1024, PAGE_PREFIX);
+  model3d model;
+  if (!paged_sphere(state.range(0), cache, model)) {
+    state.SkipWithError("unable to page the model out");
+    return;
+  }
+  for (auto _ : state) model.save_binary(SCRATCH_FILE);
+  state.counters["peak_bytes"] = cache.stats().peak_bytes;
+  state.SetBytesProcessed(state.iterations()*file_size(SCRATCH_FILE));
+  remove(SCRATCH_FILE);
+}
+BENCHMARK(BM_paged_save_binary)->RangeMultiplier(8)->Range(1<<14, 1<<20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// **** levels of detail **** //
+// simplification rate (faces removed per second) of a sphere to a quarter of its faces: one thread (a single qem pass) against
+//   the clustered, parallel pass (threads=0); the models are above lod_params().cluster_faces from 1<<17 up
+static void BM_lod_simplify(benchmark::State& state, int threads) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  lod_params lod;
+  lod.threads = threads;
+  long long int target = model.face_count()/4, faces = 0;
+  for (auto _ : state) {
+    model3d simple = simplify(model, target, lod);
+    faces = simple.face_count();
+  }
+  state.counters["faces_after"] = faces;
+  state.SetItemsProcessed(state.iterations()*(model.face_count()-faces));
+}
+BENCHMARK_CAPTURE(BM_lod_simplify, serial, 1)->RangeMultiplier(8)->Range(1<<14, 1<<20)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_lod_simplify, clustered, 0)->RangeMultiplier(8)->Range(1<<14, 1<<20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// frame time of a 1<<18 face sphere seen from distance state.range(0) (a 60 degree perspective on a 1024 pixel high viewport),
+//   drawn in full or at the level select_lod() picks; the drawn_faces counter is what reached gl
+static void BM_lod_draw(benchmark::State& state, bool use_lods) {
+  static model3d model;
+  if (model.vertex_count() == 0) {
+    mesh_params params;
+    params.faces = 1<<18;
+    model = generate_sphere(params);
+    model.set_lods(build_lods(model));
+    model.use_lods = false; // the level is picked here (draw() would read the matrices from gl)
+  }
+
+  const float near_plane = 0.1f, far_plane = 1000.0f, f = 1.0f/tan(30.0f*3.14159265f/180.0f);
+  float projection[16] = {f, 0, 0, 0,  0, f, 0, 0,  0, 0, (far_plane+near_plane)/(near_plane-far_plane), -1,  0, 0, 2.0f*far_plane*near_plane/(near_plane-far_plane), 0};
+  float modelview[16] = {1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, -(float)state.range(0), 1};
+
+  int level = 0;
+  for (auto _ : state) {
+    level = use_lods ? model.select_lod(projection, modelview, 1024) : 0;
+    const model3d& drawn = level ? model.get_lods()[level-1] : model;
+    drawn.draw();
+  }
+  const model3d& drawn = level ? model.get_lods()[level-1] : model;
+  state.counters["level"] = level;
+  state.counters["drawn_faces"] = drawn.face_count();
+  state.SetItemsProcessed(state.iterations()*drawn.face_count());
+}
+BENCHMARK_CAPTURE(BM_lod_draw, full, false)->RangeMultiplier(4)->Range(2, 128)->UseRealTime();
+BENCHMARK_CAPTURE(BM_lod_draw, lod, true)->RangeMultiplier(4)->Range(2, 128)->UseRealTime();
+
+// **** half edge adjacency **** //
+// building a sphere's adjacency on one thread against a partition per hardware thread
+static void BM_half_edge_build(benchmark::State& state, int threads) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  half_edge_mesh adjacency;
+  for (auto _ : state) {
+    adjacency.build(*model.get_facet_data_ptr(), model.coordinate_count(), threads);
+    benchmark::DoNotOptimize(adjacency.face_count());
+  }
+  state.counters["bytes"] = adjacency.memory_usage();
+  state.SetItemsProcessed(state.iterations()*model.vertex_count());
+}
+BENCHMARK_CAPTURE(BM_half_edge_build, serial, 1)->RangeMultiplier(8)->Range(1<<10, 1<<20)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_half_edge_build, parallel, 0)->RangeMultiplier(8)->Range(1<<10, 1<<20)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// the neighbors of 64 coordinates: walked around the adjacency against a scan of every face for each coordinate
+static void BM_half_edge_one_ring(benchmark::State& state, bool scan) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  const half_edge_mesh& adjacency = model.adjacency();
+  vector<int> neighbors;
+  for (auto _ : state) {
+    for (int k=0;k<64;k++) {
+      int id = (int)((long long int)k*model.coordinate_count()/64);
+      neighbors.clear();
+      if (scan) {
+        for (int i=0;i<faces.size();i++) {
+          int size = faces[i].size();
+          for (int j=0;j<size;j++) {
+            if (faces[i][j].id != id) continue;
+            neighbors.push_back(faces[i][(j+1)%size].id);
+            neighbors.push_back(faces[i][(j+size-1)%size].id);
+          }
+        }
+      }
+      else adjacency.one_ring(id, neighbors);
+      benchmark::DoNotOptimize(neighbors.data());
+    }
+  }
+  state.SetItemsProcessed(state.iterations()*64);
+}
+BENCHMARK_CAPTURE(BM_half_edge_one_ring, adjacency, false)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_half_edge_one_ring, scan, true)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// adding a triangle to a large (lattice, so points weld by hash) model, with and without its adjacency built: only the edited face
+//   is relinked
+static void BM_half_edge_add_face(benchmark::State& state, bool adjacent) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  model.set_lattice(1.0f/4096);
+  if (adjacent) model.adjacency();
+  vector<vect3f> points = random_points(3);
+  for (auto _ : state) {
+    for (int i=0;i<3;i++) model.add_vertex(points[i]);
+    model.push_face();
+    state.PauseTiming();
+    model.pop_face();
+    model.pop_face();
+    model.push_face();
+    state.ResumeTiming();
+  }
+}
+BENCHMARK_CAPTURE(BM_half_edge_add_face, adjacency, true)->RangeMultiplier(8)->Range(1<<10, 1<<18)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_half_edge_add_face, none, false)->RangeMultiplier(8)->Range(1<<10, 1<<18)->Unit(benchmark::kMicrosecond);
+
+// **** vertex cache order **** //
+// a sphere with its faces and coordinate ids shuffled, as a model built by hand (or exploded on load) is ordered
+static model3d shuffled_sphere(long long int face_count) {
+  mesh_params params;
+  params.faces = face_count;
+  model3d sphere = generate_sphere(params);
+  vector<vector<facet>> faces = sphere.get_facet_data();
+  vector<vect3f> coordinates = sphere.get_coordinates(), points(coordinates.size());
+  vector<int> map(coordinates.size());
+  for (int i=0;i<map.size();i++) map[i] = i;
+  unsigned int seed = 12345;
+  for (int i=map.size()-1;i>0;i--) swap(map[i], map[(int)(lcg(seed)*(i+1))]);
+  for (int i=faces.size()-2;i>0;i--) swap(faces[i], faces[(int)(lcg(seed)*(i+1))]); // (the current face stays last)
+  for (int i=0;i<map.size();i++) points[map[i]] = coordinates[i];
+  for (int i=0;i<faces.size();i++) {
+    for (int j=0;j<faces[i].size();j++) faces[i][j].id = map[faces[i][j].id];
+  }
+  return model3d(move(points), sphere.get_colors_ptr()->values(), sphere.get_normals_ptr()->values(), move(faces));
+}
+
+static vector<int> face_order(const model3d& model) {
+  vector<int> order(model.face_count());
+  for (int i=0;i<order.size();i++) order[i] = i;
+  return order;
+}
+
+// optimize_order() on a shuffled sphere, with the acmr (16 entry fifo) before and after as counters
+static void BM_model3d_optimize_order(benchmark::State& state) {
+  model3d source = shuffled_sphere(state.range(0));
+  model3d optimized(source);
+  for (auto _ : state) {
+    state.PauseTiming();
+    optimized = source;
+    state.ResumeTiming();
+    optimized.optimize_order();
+  }
+  state.counters["acmr_before"] = cache_miss_ratio(*source.get_facet_data_ptr(), face_order(source));
+  state.counters["acmr_after"] = cache_miss_ratio(*optimized.get_facet_data_ptr(), face_order(optimized));
+  state.SetItemsProcessed(state.iterations()*source.vertex_count());
+}
+BENCHMARK(BM_model3d_optimize_order)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+// a pass over every face reading its facets' coordinates and normals (as drawing and the batch tools do), before and after
+//   optimize_order()
+static void BM_model3d_face_traversal(benchmark::State& state, bool optimized) {
+  model3d model = shuffled_sphere(state.range(0));
+  if (optimized) model.optimize_order();
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+  const attribute_table& normals = *model.get_normals_ptr();
+  for (auto _ : state) {
+    vect3f sum;
+    for (int i=0;i<faces.size();i++) {
+      for (int j=0;j<faces[i].size();j++) sum += coordinates[faces[i][j].id] + normals[faces[i][j].normal];
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.counters["acmr"] = cache_miss_ratio(faces, face_order(model));
+  state.SetItemsProcessed(state.iterations()*model.vertex_count());
+}
+BENCHMARK_CAPTURE(BM_model3d_face_traversal, shuffled, false)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_model3d_face_traversal, optimized, true)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// **** selection sets **** //
+// a box holding about half of a sphere's facets
+static void BM_selection_select_box(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  selection_set selection;
+  for (auto _ : state) {
+    selection.select_box(model, vect3f(-2.0f, -2.0f, 0.0f), vect3f(2.0f, 2.0f, 2.0f));
+    benchmark::DoNotOptimize(selection.count());
+  }
+  state.counters["selected"] = selection.count();
+  state.counters["bytes"] = selection.memory_usage();
+  state.SetItemsProcessed(state.iterations()*model.vertex_count());
+}
+BENCHMARK(BM_selection_select_box)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+// every face of a sphere, reached from one across shared edges
+static void BM_selection_select_connected(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  model.adjacency();
+  selection_set selection;
+  for (auto _ : state) {
+    selection.select_connected(model, 0);
+    benchmark::DoNotOptimize(selection.count());
+  }
+  state.SetItemsProcessed(state.iterations()*model.vertex_count());
+}
+BENCHMARK(BM_selection_select_connected)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+// recoloring half of a sphere: the selection in one pass against a set_vertex_color() call per facet (as the palette does)
+static void BM_selection_recolor(benchmark::State& state, bool bulk) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  selection_set selection;
+  selection.select_box(model, vect3f(-2.0f, -2.0f, 0.0f), vect3f(2.0f, 2.0f, 2.0f));
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  vect3f colors[2] = { vect3f(0.0f, 1.0f, 0.0f), vect3f(0.0f, 0.0f, 1.0f) };
+  int k = 0;
+  for (auto _ : state) {
+    k = 1-k;
+    if (bulk) model.set_color(selection, colors[k]);
+    else {
+      for (int i=0;i<faces.size();i++) {
+        for (int j=0;j<faces[i].size();j++) if (selection.selected(i, j)) model.set_vertex_color(index2d(i, j), colors[k]);
+      }
+    }
+  }
+  state.SetItemsProcessed(state.iterations()*selection.count());
+}
+BENCHMARK_CAPTURE(BM_selection_recolor, bulk, true)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_selection_recolor, per_facet, false)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+static void BM_selection_translate(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  selection_set selection;
+  selection.select_box(model, vect3f(-2.0f, -2.0f, 0.0f), vect3f(2.0f, 2.0f, 2.0f));
+  float step = 0.01f;
+  for (auto _ : state) {
+    step = -step;
+    model.translate(selection, vect3f(0.0f, 0.0f, step));
+  }
+  state.SetItemsProcessed(state.iterations()*selection.count());
+}
+BENCHMARK(BM_selection_translate)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+static void BM_selection_remove(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d source = generate_sphere(params);
+  selection_set selection;
+  selection.select_box(source, vect3f(-2.0f, -2.0f, 0.0f), vect3f(2.0f, 2.0f, 2.0f));
+  for (auto _ : state) {
+    state.PauseTiming();
+    model3d model(source);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(model.remove(selection));
+  }
+  state.SetItemsProcessed(state.iterations()*source.vertex_count());
+}
+BENCHMARK(BM_selection_remove)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+static void BM_selection_extract(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  selection_set selection;
+  selection.select_box(model, vect3f(-2.0f, -2.0f, 0.0f), vect3f(2.0f, 2.0f, 2.0f));
+  for (auto _ : state) benchmark::DoNotOptimize(model.extract(selection).vertex_count());
+  state.SetItemsProcessed(state.iterations()*selection.count());
+}
+BENCHMARK(BM_selection_extract)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMillisecond);
+
+// **** mesh validation **** //
+// the bytes validate() reads: the tables, then the facets (a clean model is only read, so this is the rate to compare against
+//   memory bandwidth)
+static long long int validated_bytes(const model3d& model) {
+  return (long long int)(model.coordinate_count() + model.get_colors_ptr()->size() + model.get_normals_ptr()->size())*sizeof(vect3f) +
+         (long long int)model.vertex_count()*sizeof(facet);
+}
+
+static void BM_model3d_validate_clean(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  for (auto _ : state) benchmark::DoNotOptimize(model.validate().clean());
+  state.SetBytesProcessed(state.iterations()*validated_bytes(model));
+}
+BENCHMARK(BM_model3d_validate_clean)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// a sphere with one face in eight damaged: a repeated id, an id past the coordinates, a copy of the face before it (rotated)
+//   or an empty face, in turn
+static void BM_model3d_validate_repair(benchmark::State& state) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d sphere = generate_sphere(params);
+  vector<vector<facet>> faces = sphere.get_facet_data();
+  for (int i=8;i+1<faces.size();i+=8) {
+    switch ((i/8)%4) {
+      case 0: faces[i].insert(faces[i].begin()+1, faces[i][0]); break;
+      case 1: faces[i][0].id = sphere.coordinate_count()+i; break;
+      case 2: {
+        faces[i] = faces[i-1];
+        rotate(faces[i].begin(), faces[i].begin()+1, faces[i].end());
+      } break;
+      case 3: faces[i].clear(); break;
+    }
+  }
+  model3d source(sphere.get_coordinates(), sphere.get_colors_ptr()->values(), sphere.get_normals_ptr()->values(), faces);
+  mesh_report report;
+  for (auto _ : state) {
+    state.PauseTiming();
+    model3d model(source);
+    state.ResumeTiming();
+    report = model.validate();
+  }
+  state.counters["faces_removed"] = report.faces_removed;
+  state.counters["facets_removed"] = report.facets_removed;
+  state.SetBytesProcessed(state.iterations()*validated_bytes(source));
+}
+BENCHMARK(BM_model3d_validate_repair)->RangeMultiplier(8)->Range(1<<10, 1<<20)->Unit(benchmark::kMicrosecond);
+
+// **** render queue **** //
+// display()'s scene: nine loaded models of state.range(0) faces each (six drawn as wireframes) and the 5x5x5 grid with one
+//   unit cube highlighted, drawn as display() drew it before the render queue, or queued and drawn sorted by state; the gl
+//   calls do nothing without a context, so the time is the cpu side of submission. Counters are per frame: the queue's gl
+//   state calls (sorted, and as they'd be in the order queued) and the material calls, per vertex ones included
+static void BM_render_queue(benchmark::State& state, bool queued, bool lit) {
+  static int faces = 0;
+  static vector<model3d> models;
+  static vector<cube> grid;
+  if (faces != state.range(0)) {
+    faces = state.range(0);
+    models.clear();
+    for (int i=0;i<9;i++) {
+      mesh_params params;
+      params.faces = faces;
+      params.seed = i+1;
+      models.push_back(generate_sphere(params));
+      models.back().translate(vect3f(2.0f*(i%3), 2.0f*(i/3), 0.0f));
+      models.back().set_draw_mode(i%3 == 0 ? GL_POLYGON : GL_LINE_LOOP);
+    }
+    grid.clear();
+    for (int i=0;i<125;i++) {
+      grid.push_back(cube());
+      grid.back().initialize(vect3f(i%5-2.5f, (i/5)%5-2.5f, i/25-2.5f), 1.0f);
+      grid.back().set_solid(false);
+      grid.back().set_color(vect3f(0.0, 0.2, 0.0));
+      grid.back().set_highlight(vect3f(0.6, 0.6, 0.6));
+    }
+  }
+  const vect3f pointer(0.1f, 0.1f, 0.1f);
+
+  render_queue queue;
+  auto frame = [&]() {
+    if (queued) {
+      queue.clear();
+      render_state model_state;
+      model_state.lighting = lit;
+      model_state.line_width = 2.0f;
+      for (int i=0;i<models.size();i++) models[i].submit(queue, model_state);
+      render_state grid_state;
+      for (int i=0;i<grid.size();i++) grid[i].submit(queue, grid_state, &pointer);
+      queue.execute();
+    }
+    else {
+      if (lit) glEnable(GL_LIGHTING);
+      glLineWidth(2.0);
+      for (int i=0;i<models.size();i++) models[i].draw();
+      glLineWidth(1.0);
+      glDisable(GL_LIGHTING);
+      for (int i=0;i<grid.size();i++) grid[i].draw(&pointer);
+    }
+  };
+  for (auto _ : state) frame();
+
+  // one more frame, counted alone
+  PROFILER = profiler();
+  PROFILER.begin_frame();
+  frame();
+  PROFILER.end_frame();
+  if (queued) {
+    render_queue_stats stats = queue.stats();
+    state.counters["state_calls"] = stats.state_calls;
+    state.counters["queued_order_state_calls"] = stats.unsorted_state_calls;
+    state.counters["items"] = stats.items;
+  }
+  state.counters["material_calls"] = PROFILER.counter_mean(COUNTER_MATERIAL_CHANGES);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_render_queue, immediate_unlit, false, false)->RangeMultiplier(16)->Range(256, 1<<16)->UseRealTime();
+BENCHMARK_CAPTURE(BM_render_queue, queued_unlit, true, false)->RangeMultiplier(16)->Range(256, 1<<16)->UseRealTime();
+BENCHMARK_CAPTURE(BM_render_queue, immediate_lit, false, true)->RangeMultiplier(16)->Range(256, 1<<16)->UseRealTime();
+BENCHMARK_CAPTURE(BM_render_queue, queued_lit, true, true)->RangeMultiplier(16)->Range(256, 1<<16)->UseRealTime();
+
+// **** software rasterizer **** //
+// frames per second (items_per_second) of a lit sphere of state.range(0) faces filling a 512x512 frame: one thread against
+//   every hardware thread (tiles and the geometry pass split between them)
+static void BM_raster_frame(benchmark::State& state, int threads) {
+  mesh_params params;
+  params.faces = state.range(0);
+  model3d model = generate_sphere(params);
+  raster_frame frame(512, 512, threads);
+  float projection[16], modelview[16];
+  fit_camera(model, 45.0f, 1.0f, projection, modelview);
+  frame.set_projection(projection);
+
+  for (auto _ : state) {
+    frame.clear();
+    frame.draw(model, modelview);
+  }
+  raster_stats stats = frame.stats();
+  state.counters["triangles"] = benchmark::Counter(stats.triangles, benchmark::Counter::kAvgIterations);
+  state.counters["pixels"] = benchmark::Counter(stats.pixels, benchmark::Counter::kAvgIterations);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_raster_frame, serial, 1)->RangeMultiplier(16)->Range(1<<10, 1<<18)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_raster_frame, parallel, 0)->RangeMultiplier(16)->Range(1<<10, 1<<18)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// a frame per file of the corpus (registered in main() when --corpus is given), drawn as modeler-cli --render draws it
+static void BM_raster_corpus(benchmark::State& state, string filename) {
+  model3d model;
+  if (!model.load(filename)) {
+    state.SkipWithError("unable to load model");
+    return;
+  }
+  raster_frame frame(512, 512);
+  float projection[16], modelview[16];
+  fit_camera(model, 45.0f, 1.0f, projection, modelview);
+  frame.set_projection(projection);
+  for (auto _ : state) {
+    frame.clear();
+    frame.draw(model, modelview);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// generator throughput for each shape
+static void BM_mesh_gen(benchmark::State& state, string shape) {
+  mesh_params params;
+  params.faces = state.range(0);
+  for (auto _ : state) {
+    model3d model = generate_mesh(shape, params);
+    benchmark::DoNotOptimize(model.vertex_count());
+  }
+  state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK_CAPTURE(BM_mesh_gen, sphere, string("sphere"))->RangeMultiplier(16)->Range(1<<10, 1<<22)->UseRealTime();
+BENCHMARK_CAPTURE(BM_mesh_gen, torus, string("torus"))->RangeMultiplier(16)->Range(1<<10, 1<<22)->UseRealTime();
+BENCHMARK_CAPTURE(BM_mesh_gen, terrain, string("terrain"))->RangeMultiplier(16)->Range(1<<10, 1<<22)->UseRealTime();
+BENCHMARK_CAPTURE(BM_mesh_gen, soup, string("soup"))->RangeMultiplier(16)->Range(1<<10, 1<<22)->UseRealTime();
+
+// registered per file of the corpus in main()
+static void BM_model3d_load_corpus(benchmark::State& state, string filename) {
+  for (auto _ : state) {
+    model3d model;
+    if (!model.load(filename)) {
+      state.SkipWithError("unable to load model");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations()*file_size(filename));
+}
+
+static void BM_model3d_save_corpus(benchmark::State& state, string filename) {
+  model3d model;
+  if (!model.load(filename)) {
+    state.SkipWithError("unable to load model");
+    return;
+  }
+  for (auto _ : state) {
+    string scratch(SCRATCH_FILE);
+    model.save(scratch);
+  }
+  state.SetBytesProcessed(state.iterations()*file_size(SCRATCH_FILE));
+  remove(SCRATCH_FILE);
+}
+
+static void BM_model3d_load_binary_corpus(benchmark::State& state, string filename) {
+  model3d source;
+  if (!source.load(filename) || !source.save_binary(SCRATCH_FILE)) {
+    state.SkipWithError("unable to convert model");
+    return;
+  }
+  for (auto _ : state) {
+    model3d model;
+    benchmark::DoNotOptimize(model.load(SCRATCH_FILE));
+  }
+  state.SetBytesProcessed(state.iterations()*file_size(SCRATCH_FILE));
+  remove(SCRATCH_FILE);
+}
+
+
+
+// **** preload **** //
+// 32 text models of mixed shapes and sizes (1k-32k faces): the largest files dominate, as they do in a real models/ directory
+void write_preload_corpus() {
+  static bool written = false;
+  if (written) return;
+  written = true;
+
+  const char* const shapes[] = { "sphere", "torus", "terrain", "soup" };
+  mkdir(PRELOAD_DIR, 0755);
+  for (int i=0;i<32;i++) {
+    mesh_params params;
+    params.faces = 1024<<(i%6);
+    params.seed = i+1;
+    model3d model = generate_mesh(shapes[i%4], params);
+    string filename = string(PRELOAD_DIR) + "/model_" + (i < 10 ? "0" : "") + to_string(i);
+    model.save(filename);
+  }
+}
+
+void remove_preload_corpus() {
+  vector<string> files;
+  if (!list_directory(PRELOAD_DIR, files)) return;
+  for (int i=0;i<files.size();i++) remove(files[i].c_str());
+  rmdir(PRELOAD_DIR);
+}
+
+// preload_models() over a whole directory; range(0) is the thread count (1 is the sequential baseline)
+static void BM_preload(benchmark::State& state, string path) {
+  if (path == PRELOAD_DIR) write_preload_corpus();
+
+  vector<string> files;
+  if (!preload_list(path, files) || files.empty()) {
+    state.SkipWithError("no models to preload");
+    return;
+  }
+
+  long long int bytes = 0, facets = 0;
+  for (auto _ : state) {
+    preload_report report = preload_models(files, [](int, preload_result& result) { benchmark::DoNotOptimize(result.model.vertex_count()); }, state.range(0));
+    bytes += report.bytes;
+    facets += report.facets;
+  }
+  state.SetBytesProcessed(bytes);
+  state.SetItemsProcessed(facets);
+}
+BENCHMARK_CAPTURE(BM_preload, synthetic, string(PRELOAD_DIR))->RangeMultiplier(2)->Range(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+
+
+// **** cube **** //
+// the grid highlight test performed for every cube every frame by display()
+static void BM_cube_grid_highlight(benchmark::State& state) {
+  vector<cube> rubix = grid_cubes(state.range(0), 1.0f);
+  vector<vect3f> pointers = random_points(64);
+  for (int i=0;i<pointers.size();i++) pointers[i] = (pointers[i]-vect3f(0.5f, 0.5f, 0.5f))*(float)state.range(0);
+
+  int p = 0;
+  for (auto _ : state) {
+    const vect3f& pointer = pointers[(p++)%pointers.size()];
+    int highlighted = 0;
+    for (int i=0;i<rubix.size();i++) if (rubix[i].contains_point(pointer)) highlighted++;
+    benchmark::DoNotOptimize(highlighted);
+  }
+  state.SetItemsProcessed(state.iterations()*rubix.size());
+}
+BENCHMARK(BM_cube_grid_highlight)->RangeMultiplier(2)->Range(5, 40);
+
+
+
+int main(int argc, char** argv) {
+  // strip our own arguments before handing the rest to google benchmark
+  vector<char*> args;
+  for (int i=0;i<argc;i++) {
+    if (strncmp(argv[i], "--corpus=", 9) == 0) {
+      CORPUS_DIR = argv[i]+9;
+      if (CORPUS_DIR.length() > 0 && CORPUS_DIR[CORPUS_DIR.length()-1] != '/') CORPUS_DIR += "/";
+    }
+    else args.push_back(argv[i]);
+  }
+  int arg_count = args.size();
+
+  DIR* corpus = opendir(CORPUS_DIR.c_str());
+  if (corpus != 0) {
+    vector<string> filenames;
+    for (dirent* entry=readdir(corpus);entry!=0;entry=readdir(corpus)) {
+      if (entry->d_name[0] != '.') filenames.push_back(entry->d_name);
+    }
+    closedir(corpus);
+
+    for (int i=0;i<filenames.size();i++) {
+      benchmark::RegisterBenchmark(("BM_model3d_load_corpus/" + filenames[i]).c_str(), BM_model3d_load_corpus, CORPUS_DIR + filenames[i]);
+      benchmark::RegisterBenchmark(("BM_model3d_save_corpus/" + filenames[i]).c_str(), BM_model3d_save_corpus, CORPUS_DIR + filenames[i]);
+      benchmark::RegisterBenchmark(("BM_model3d_load_binary_corpus/" + filenames[i]).c_str(), BM_model3d_load_binary_corpus, CORPUS_DIR + filenames[i]);
+      benchmark::RegisterBenchmark(("BM_raster_corpus/" + filenames[i]).c_str(), BM_raster_corpus, CORPUS_DIR + filenames[i])->UseRealTime();
+    }
+    if (!filenames.empty()) {
+      benchmark::RegisterBenchmark("BM_preload/corpus", BM_preload, CORPUS_DIR)->RangeMultiplier(2)->Range(1, 8)->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+  }
+
+  benchmark::Initialize(&arg_count, args.data());
+  if (benchmark::ReportUnrecognizedArguments(arg_count, args.data())) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  remove_preload_corpus();
+
+  return 0;
+}
@@ -0,0 +1,350 @@
+// File: modeler_cli.cpp
+// Written by Joshua Green
+
+// Headless batch front end for the modeler's model operations (builds as modeler-cli; no opengl or glut required).
+//
+// usage:
+//   modeler-cli [operations] [options] <file or directory>...
+//
+// operations (applied to every file, in the order given):
+//   --translate=<x|y|z>:<magnitude>   moves every coordinate along an axis
+//   --mirror=<x|y|z>                  inverts an axis (as the '<' key does)
+//   --resolution=<polygons>           splits the last face into a number of polygons (as the 'r' key does)
+//   --merge=<file>                    appends the faces of another model (as the 'M' key does)
+//
+// options:
+//   --output=<directory>   writes each result to <directory>/<file name>
+//   --in-place             overwrites each input file with its result
+//   --binary               writes results in the binary model format (reordered for drawing; see model3d::optimize_order())
+//   --legacy-text          writes results in the original model3d= text format (read by builds older than the indexed format)
+//   --threads=<count>      number of files processed at once (default: all hardware threads)
+//   --page-budget=<MB>     pages each model out of core (see model3d::page_out()), holding at most MB of geometry in memory
+//                          across all files; translate and mirror run chunk by chunk and results are written by streaming
+//   --render=<png|ppm>     draws each result with the software rasterizer (see raster.h), lit as the modeler lights it and
+//                          framed to fit, to <directory>/<file name>.png with --output (or beside the input file otherwise)
+//   --render-size=<w>x<h>  the rendered image size (default: 256x256)
+//
+// Without --output or --in-place the files are only loaded and processed, which is useful for timing.
+// Every file is validated as it's loaded (see validate.h): what was repaired is listed with the file, and the repaired model is
+// what's processed and written.
+//
+// example:
+//   modeler-cli --mirror=x --translate=y:2 --output=out/ models/
+//   modeler-cli --render=png --render-size=512x512 --output=thumbnails/ models/
+
+#include "model3d.h"
+#include "vectXf.h"
+#include "paged.h"
+#include "parallel.h"
+#include "preload.h"
+#include "raster.h"
+#include "validate.h"
+#include "fileio/fileio.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <mutex>
+using namespace std;
+
+namespace {
+  enum OPERATION_TYPE { OP_TRANSLATE, OP_MIRROR, OP_RESOLUTION, OP_MERGE };
+
+  struct operation {
+    OPERATION_TYPE type;
+    int axis;
+    float amount;
+    const model3d* other; // OP_MERGE
+
+    operation(OPERATION_TYPE t) : type(t), axis(-1), amount(0.0f), other(0) { }
+  };
+
+  struct file_result {
+    string filename;
+    bool ok;
+    string error;
+    double load_ms, process_ms, save_ms, render_ms;
+    long long int bytes;
+    int facets;
+    mesh_report validation;
+
+    file_result() : ok(false), load_ms(0.0), process_ms(0.0), save_ms(0.0), render_ms(0.0), bytes(0), facets(0) { }
+  };
+
+  typedef chrono::steady_clock batch_clock;
+
+  double ms_since(batch_clock::time_point start) { return chrono::duration<double, milli>(batch_clock::now() - start).count(); }
+
+  int parse_axis(char c) {
+    if (c == 'x' || c == 'X') return 0;
+    if (c == 'y' || c == 'Y') return 1;
+    if (c == 'z' || c == 'Z') return 2;
+    return -1;
+  }
+
+  string base_name(const string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return (slash == string::npos ? path : path.substr(slash+1));
+  }
+
+  // expands directories (non-recursively) into the files they contain
+  void add_input(const string& path, vector<string>& files) {
+    if (!list_directory(path, files)) files.push_back(path);
+  }
+
+  long long int file_size(const string& filename) {
+    fileio file;
+    file.open(filename, "r");
+    if (!file.is_open()) return 0;
+    return file.size();
+  }
+
+  void apply_operation(model3d& model, const operation& op) {
+    switch(op.type) {
+      case OP_TRANSLATE: {
+        vect3f direction;
+        if (op.axis == 0) direction.x = 1.0f;
+        else if (op.axis == 1) direction.y = 1.0f;
+        else direction.z = 1.0f;
+        model.translate(direction*op.amount);
+      } break;
+      case OP_MIRROR: { model.mirror(op.axis); } break;
+      case OP_RESOLUTION: {
+        if (model.is_paged()) model.expand(); // (the face data is read below)
+        // loaded models end with the empty face save() writes, so the face to split is the one before it
+        if (model.get_facet_data_ptr()->back().size() == 0) model.pop_face();
+        model.face_resolution((int)op.amount);
+        model.push_face();
+      } break;
+      case OP_MERGE: { model.merge(*op.other); } break;
+    }
+  }
+
+  // a thumbnail of model: the modeler's view angle and lighting (its light at the upper right of the camera)
+  bool render_model(const model3d& model, int width, int height, int threads, bool png, const string& filename) {
+    raster_frame frame(width, height, threads);
+    float projection[16], modelview[16], identity[16];
+    if (fit_camera(model, 45.0f, (float)width/height, projection, modelview)) {
+      frame.set_projection(projection);
+      raster_light light;
+      light.position = vect4f(1.0f, 1.0f, 1.0f, 0.0f);
+      raster_identity(identity);
+      frame.set_light(light, identity);
+      frame.draw(model, modelview);
+    }
+    return (png ? frame.save_png(filename) : frame.save_ppm(filename));
+  }
+
+  void usage() {
+    cout << "usage: modeler-cli [operations] [options] <file or directory>..." << endl
+         << "  operations (applied in order):" << endl
+         << "    --translate=<x|y|z>:<magnitude>" << endl
+         << "    --mirror=<x|y|z>" << endl
+         << "    --resolution=<polygons>" << endl
+         << "    --merge=<file>" << endl
+         << "  options:" << endl
+         << "    --output=<directory>   write results to directory" << endl
+         << "    --in-place             overwrite the input files" << endl
+         << "    --binary               write the binary model format" << endl
+         << "    --legacy-text          write the original model3d= text format" << endl
+         << "    --threads=<count>      files processed at once (default: all hardware threads)" << endl
+         << "    --page-budget=<MB>     page models out of core within a memory budget" << endl
+         << "    --render=<png|ppm>     render each result to an image (see --output)" << endl
+         << "    --render-size=<w>x<h>  rendered image size (default: 256x256)" << endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  vector<operation> pipeline;
+  vector<model3d*> merge_models;
+  vector<string> files;
+  string output_dir;
+  bool in_place = false, binary = false, legacy_text = false;
+  int thread_count = 0;
+  double page_budget = 0.0; // MB; zero keeps models in memory
+  string render_format;      // empty renders nothing
+  int render_width = 256, render_height = 256;
+
+  for (int i=1;i<argc;i++) {
+    string arg(argv[i]);
+    if (arg.compare(0, 12, "--translate=") == 0 && arg.length() >= 15 && arg[13] == ':') {
+      operation op(OP_TRANSLATE);
+      op.axis = parse_axis(arg[12]);
+      op.amount = atof(arg.c_str()+14);
+      if (op.axis < 0) {
+        cout << "Invalid axis: " << arg << endl;
+        return 1;
+      }
+      pipeline.push_back(op);
+    }
+    else if (arg.compare(0, 9, "--mirror=") == 0 && arg.length() == 10) {
+      operation op(OP_MIRROR);
+      op.axis = parse_axis(arg[9]);
+      if (op.axis < 0) {
+        cout << "Invalid axis: " << arg << endl;
+        return 1;
+      }
+      pipeline.push_back(op);
+    }
+    else if (arg.compare(0, 13, "--resolution=") == 0) {
+      operation op(OP_RESOLUTION);
+      op.amount = atoi(arg.c_str()+13);
+      pipeline.push_back(op);
+    }
+    else if (arg.compare(0, 8, "--merge=") == 0) {
+      merge_models.push_back(new model3d());
+      if (!merge_models.back()->load(arg.substr(8))) {
+        cout << "Error loading model. (file: " << arg.substr(8) << ")" << endl;
+        return 1;
+      }
+      operation op(OP_MERGE);
+      op.other = merge_models.back();
+      pipeline.push_back(op);
+    }
+    else if (arg.compare(0, 9, "--output=") == 0) {
+      output_dir = arg.substr(9);
+      if (output_dir.length() > 0 && output_dir[output_dir.length()-1] != '/') output_dir += "/";
+    }
+    else if (arg == "--in-place") in_place = true;
+    else if (arg == "--binary") binary = true;
+    else if (arg == "--legacy-text") legacy_text = true;
+    else if (arg.compare(0, 10, "--threads=") == 0) thread_count = atoi(arg.c_str()+10);
+    else if (arg.compare(0, 14, "--page-budget=") == 0) {
+      page_budget = atof(arg.c_str()+14);
+      if (!(page_budget > 0.0)) {
+        cout << "Invalid page budget: " << arg << endl;
+        return 1;
+      }
+    }
+    else if (arg.compare(0, 9, "--render=") == 0) {
+      render_format = arg.substr(9);
+      if (render_format != "png" && render_format != "ppm") {
+        cout << "Invalid render format: " << arg << endl;
+        return 1;
+      }
+    }
+    else if (arg.compare(0, 14, "--render-size=") == 0) {
+      size_t x = arg.find('x', 14);
+      render_width = atoi(arg.c_str()+14);
+      render_height = (x == string::npos ? 0 : atoi(arg.c_str()+x+1));
+      if (render_width < 1 || render_height < 1) {
+        cout << "Invalid render size: " << arg << endl;
+        return 1;
+      }
+    }
+    else if (arg.compare(0, 2, "--") == 0) {
+      cout << "Unknown option: " << arg << endl;
+      usage();
+      return 1;
+    }
+    else add_input(arg, files);
+  }
+
+  if (files.empty()) {
+    usage();
+    return 1;
+  }
+  if (thread_count < 1) thread_count = hardware_threads();
+
+  // shared by every file, so the budget holds for the whole batch (declared before the models that page into it)
+  page_cache pages((size_t)(page_budget*1024.0*1024.0));
+
+  vector<file_result> results(files.size());
+  mutex output_lock;
+  int finished = 0;
+
+  batch_clock::time_point batch_start = batch_clock::now();
+
+  // one file per work item so a large model doesn't hold up a chunk of small ones
+  parallel_for(0, files.size(), 1, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      file_result& result = results[i];
+      result.filename = files[i];
+      result.bytes = file_size(files[i]);
+
+      model3d model;
+      batch_clock::time_point start = batch_clock::now();
+      if (!(page_budget > 0.0 ? model.load_paged(files[i], pages) : model.load(files[i], &result.validation))) result.error = "unable to load";
+      result.load_ms = ms_since(start);
+
+      if (result.error.empty()) {
+        start = batch_clock::now();
+        for (int j=0;j<pipeline.size();j++) apply_operation(model, pipeline[j]);
+        result.process_ms = ms_since(start);
+        result.facets = model.vertex_count();
+
+        if (in_place || output_dir.length() > 0) {
+          string filename = (in_place ? files[i] : output_dir + base_name(files[i]));
+          start = batch_clock::now();
+          if (binary) {
+            if (!model.save_binary(filename)) result.error = "unable to save " + filename;
+          }
+          else model.save(filename, !legacy_text);
+          result.save_ms = ms_since(start);
+        }
+
+        if (render_format.length() > 0 && result.error.empty()) {
+          string filename = (output_dir.length() > 0 ? output_dir + base_name(files[i]) : files[i]) + "." + render_format;
+          start = batch_clock::now();
+          // files already run concurrently, so each image is drawn by one thread unless there's only one file at a time
+          if (!render_model(model, render_width, render_height, (thread_count == 1 ? 0 : 1), render_format == "png", filename)) {
+            result.error = "unable to render " + filename;
+          }
+          result.render_ms = ms_since(start);
+        }
+      }
+      result.ok = result.error.empty();
+
+      lock_guard<mutex> lock(output_lock);
+      finished++;
+      cout << "[" << finished << "/" << files.size() << "] " << result.filename;
+      if (result.ok) {
+        cout << "  load " << result.load_ms << "ms, process " << result.process_ms << "ms, save " << result.save_ms << "ms";
+        if (render_format.length() > 0) cout << ", render " << result.render_ms << "ms";
+        cout << " (" << result.facets << " facets)" << endl;
+        if (!result.validation.clean()) cout << "  repaired: " << result.validation.summary() << endl;
+      }
+      else cout << "  error: " << result.error << endl;
+    }
+  }, thread_count);
+
+  double batch_ms = ms_since(batch_start);
+
+  int failures = 0;
+  long long int total_bytes = 0, total_facets = 0;
+  double total_load = 0.0, total_process = 0.0, total_save = 0.0, total_render = 0.0;
+  for (int i=0;i<results.size();i++) {
+    if (!results[i].ok) {
+      failures++;
+      continue;
+    }
+    total_bytes += results[i].bytes;
+    total_facets += results[i].facets;
+    total_load += results[i].load_ms;
+    total_process += results[i].process_ms;
+    total_save += results[i].save_ms;
+    total_render += results[i].render_ms;
+  }
+
+  double seconds = batch_ms/1000.0;
+  cout << endl
+       << "files: " << results.size() << " (" << failures << " failed), threads: " << thread_count << endl
+       << "wall time: " << batch_ms << "ms (load " << total_load << "ms, process " << total_process << "ms, save " << total_save << "ms";
+  if (render_format.length() > 0) cout << ", render " << total_render << "ms";
+  cout << " summed over files)" << endl
+       << "throughput: " << (seconds > 0.0 ? results.size()/seconds : 0.0) << " files/s, "
+       << (seconds > 0.0 ? total_bytes/seconds/1048576.0 : 0.0) << " MB/s read, "
+       << (seconds > 0.0 ? total_facets/seconds : 0.0) << " facets/s" << endl;
+  if (page_budget > 0.0) {
+    page_cache_stats stats = pages.stats();
+    cout << "paging: budget " << page_budget << " MB, peak resident " << stats.peak_bytes/1048576.0 << " MB, "
+         << stats.misses+stats.prefetched << " chunk reads (" << stats.prefetched << " prefetched), " << stats.hits << " hits" << endl;
+  }
+
+  for (int i=0;i<merge_models.size();i++) delete merge_models[i];
+
+  return (failures > 0 ? 1 : 0);
+}
@@ -0,0 +1,382 @@
+// File: paged.cpp
+// Written by Joshua Green
+
+#include "paged.h"
+#include "vectXf.h"
+#include "trace.h"
+#include "fileio/fileio.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+using namespace std;
+
+namespace {
+  template <typename T> void put(string& data, T value) { data.append((const char*)&value, sizeof(T)); }
+
+  void put_floats(string& data, const vector<float>& values) {
+    if (!values.empty()) data.append((const char*)&values[0], values.size()*sizeof(float));
+  }
+
+  void get_floats(const string& data, size_t& pos, vector<float>& values, size_t count) {
+    values.resize(count);
+    if (count > 0) memcpy(&values[0], data.data()+pos, count*sizeof(float));
+    pos += count*sizeof(float);
+  }
+}
+
+
+// *** BEGIN PAGE_CHUNK DEFINITIONS ***
+
+size_t page_chunk::memory_usage() const {
+  return sizeof(page_chunk) + face_sizes.capacity()*sizeof(unsigned int) + (points.capacity() + colors.capacity() + normals.capacity())*sizeof(float);
+}
+
+long long int page_info::bytes() const { return 2*sizeof(unsigned int) + (long long int)faces*sizeof(unsigned int) + (long long int)facets*9*sizeof(float); }
+
+
+// *** BEGIN PAGE_CACHE CLASS DEFINITIONS ***
+
+page_cache::page_cache(size_t budget_bytes, const string& scratch_prefix) : _budget(budget_bytes), _next_store(0), _stop(false) {
+  // (a per-process suffix, so two programs paging in the same directory don't share files)
+  _scratch_prefix = scratch_prefix + "_" + to_string((unsigned long long int)chrono::system_clock::now().time_since_epoch().count() % 1000000007ull);
+}
+
+page_cache::~page_cache() {
+  {
+    lock_guard<mutex> lock(_lock);
+    _stop = true;
+    _queue.clear();
+  }
+  _queued.notify_all();
+  if (_prefetcher.joinable()) _prefetcher.join();
+}
+
+void page_cache::set_budget(size_t bytes) {
+  lock_guard<mutex> lock(_lock);
+  _budget = bytes;
+  _trim();
+}
+
+size_t page_cache::budget() const { return _budget; }
+
+page_cache::key page_cache::_key(const paged_store& store, int chunk) { return ((key)store.id() << 32) | (unsigned int)chunk; }
+
+void page_cache::_trim() {
+  // the most recently used chunk is always kept, however large
+  while (_stats.resident_bytes > _budget && _lru.size() > 1) {
+    _stats.resident_bytes -= _lru.back().bytes;
+    _stats.evicted++;
+    _index.erase(_lru.back().k);
+    _lru.pop_back();
+  }
+}
+
+shared_ptr<const page_chunk> page_cache::_load(const paged_store& store, int chunk, bool prefetch) {
+  key k = _key(store, chunk);
+  {
+    unique_lock<mutex> lock(_lock);
+    while (true) {
+      unordered_map<key, list<entry>::iterator>::iterator found = _index.find(k);
+      if (found != _index.end()) {
+        _lru.splice(_lru.begin(), _lru, found->second);
+        if (!prefetch) _stats.hits++;
+        return found->second->chunk;
+      }
+      if (_loading.count(k) == 0) break;
+      if (prefetch) return shared_ptr<const page_chunk>(); // already on its way
+      _loaded.wait(lock);
+    }
+    _loading.insert(k);
+  }
+
+  // read without holding the lock, so hits on other chunks aren't held up by the disk
+  shared_ptr<page_chunk> data(new page_chunk());
+  bool ok = store.read_chunk(chunk, *data);
+
+  {
+    lock_guard<mutex> lock(_lock);
+    _loading.erase(k);
+    if (ok) {
+      entry e;
+      e.k = k;
+      e.chunk = data;
+      e.bytes = data->memory_usage();
+      _lru.push_front(e);
+      _index[k] = _lru.begin();
+      _stats.resident_bytes += e.bytes;
+      _stats.peak_bytes = max(_stats.peak_bytes, _stats.resident_bytes);
+      if (prefetch) _stats.prefetched++;
+      else _stats.misses++;
+      _trim();
+    }
+  }
+  _loaded.notify_all();
+  return (ok ? data : shared_ptr<const page_chunk>());
+}
+
+shared_ptr<const page_chunk> page_cache::get(const paged_store& store, int chunk) { return _load(store, chunk, false); }
+
+void page_cache::prefetch(const shared_ptr<const paged_store>& store, const vector<int>& chunks) {
+  {
+    lock_guard<mutex> lock(_lock);
+    if (_stop) return;
+    _queue.clear(); // the newest request (the current view) wins
+    for (int i=0;i<chunks.size();i++) {
+      if (_index.count(_key(*store, chunks[i])) == 0) _queue.push_back(make_pair(weak_ptr<const paged_store>(store), chunks[i]));
+    }
+    if (_queue.empty()) return;
+    if (!_prefetcher.joinable()) _prefetcher = thread(&page_cache::_prefetch_loop, this);
+  }
+  _queued.notify_one();
+}
+
+void page_cache::_prefetch_loop() {
+  while (true) {
+    pair<weak_ptr<const paged_store>, int> next;
+    {
+      unique_lock<mutex> lock(_lock);
+      while (!_stop && _queue.empty()) _queued.wait(lock);
+      if (_stop) return;
+      next = _queue.front();
+      _queue.pop_front();
+    }
+    shared_ptr<const paged_store> store = next.first.lock();
+    if (store) _load(*store, next.second, true);
+  }
+}
+
+void page_cache::evict(const paged_store& store) {
+  lock_guard<mutex> lock(_lock);
+  for (list<entry>::iterator i=_lru.begin();i!=_lru.end();) {
+    if ((unsigned int)(i->k >> 32) != store.id()) {
+      i++;
+      continue;
+    }
+    _stats.resident_bytes -= i->bytes;
+    _index.erase(i->k);
+    i = _lru.erase(i);
+  }
+}
+
+void page_cache::evict(const paged_store& store, int chunk) {
+  lock_guard<mutex> lock(_lock);
+  unordered_map<key, list<entry>::iterator>::iterator found = _index.find(_key(store, chunk));
+  if (found == _index.end()) return;
+  _stats.resident_bytes -= found->second->bytes;
+  _lru.erase(found->second);
+  _index.erase(found);
+}
+
+page_cache_stats page_cache::stats() {
+  lock_guard<mutex> lock(_lock);
+  return _stats;
+}
+
+void page_cache::reset_stats() {
+  lock_guard<mutex> lock(_lock);
+  size_t resident = _stats.resident_bytes;
+  _stats = page_cache_stats();
+  _stats.resident_bytes = _stats.peak_bytes = resident;
+}
+
+unsigned int page_cache::next_store_id() {
+  lock_guard<mutex> lock(_lock);
+  return _next_store++;
+}
+
+string page_cache::scratch_filename(unsigned int store_id) const { return _scratch_prefix + "_" + to_string(store_id) + ".pages"; }
+
+
+// *** BEGIN PAGED_STORE CLASS DEFINITIONS ***
+
+paged_store::paged_store(page_cache& cache) : _cache(cache), _faces(0), _facets(0), _ok(true) {
+  _id = _cache.next_store_id();
+  _filename = _cache.scratch_filename(_id);
+  _file = new fileio();
+  _file->open(_filename); // (read and write; created as the name is new)
+  _ok = _file->is_open();
+}
+
+paged_store::~paged_store() {
+  _cache.evict(*this);
+  _file->close();
+  delete _file;
+  remove(_filename.c_str());
+}
+
+bool paged_store::_write_chunk(const page_chunk& chunk, page_info& info) {
+  info.faces = chunk.face_sizes.size();
+  info.facets = chunk.points.size()/3;
+  info.low = info.high = vect3f();
+  for (int i=0;i<info.facets;i++) {
+    vect3f p(chunk.points[i*3+0], chunk.points[i*3+1], chunk.points[i*3+2]);
+    if (i == 0) info.low = info.high = p;
+    info.low = vect3f(min(info.low.x, p.x), min(info.low.y, p.y), min(info.low.z, p.z));
+    info.high = vect3f(max(info.high.x, p.x), max(info.high.y, p.y), max(info.high.z, p.z));
+  }
+
+  string data;
+  data.reserve(info.bytes());
+  put<unsigned int>(data, info.faces);
+  put<unsigned int>(data, info.facets);
+  if (info.faces > 0) data.append((const char*)&chunk.face_sizes[0], info.faces*sizeof(unsigned int));
+  put_floats(data, chunk.points);
+  put_floats(data, chunk.colors);
+  put_floats(data, chunk.normals);
+
+  lock_guard<mutex> lock(_file_lock);
+  if (_file->seek(info.offset) != info.offset) return (_ok = false);
+  _file->write(data);
+  _file->flush();
+  return _ok;
+}
+
+bool paged_store::add_face(const float* points, const float* colors, const float* normals, int count) {
+  _building.face_sizes.push_back(count);
+  _building.points.insert(_building.points.end(), points, points+count*3);
+  _building.colors.insert(_building.colors.end(), colors, colors+count*3);
+  _building.normals.insert(_building.normals.end(), normals, normals+count*3);
+  _faces++;
+  _facets += count;
+  if (_building.points.size()/3 >= PAGE_FACETS) return finish();
+  return _ok;
+}
+
+bool paged_store::finish() {
+  if (_building.face_sizes.empty()) return _ok;
+
+  page_info info;
+  if (!_chunks.empty()) {
+    info.offset = _chunks.back().offset + _chunks.back().bytes();
+    info.first_face = _chunks.back().first_face + _chunks.back().faces;
+  }
+  _write_chunk(_building, info);
+  _chunks.push_back(info);
+  _building = page_chunk();
+  return _ok;
+}
+
+bool paged_store::ok() const { return _ok; }
+
+unsigned int paged_store::id() const { return _id; }
+
+page_cache& paged_store::cache() const { return _cache; }
+
+int paged_store::chunk_count() const { return _chunks.size(); }
+
+int paged_store::face_count() const { return _faces; }
+
+int paged_store::facet_count() const { return _facets; }
+
+const page_info& paged_store::info(int chunk) const { return _chunks[chunk]; }
+
+long long int paged_store::file_bytes() const { return (_chunks.empty() ? 0 : _chunks.back().offset + _chunks.back().bytes()); }
+
+bool paged_store::read_chunk(int chunk, page_chunk& data) const {
+  if (chunk < 0 || chunk >= _chunks.size()) return false;
+  const page_info& info = _chunks[chunk];
+  TRACE_SPAN(read_span, "paged_store::read_chunk");
+  TRACE_ARG(read_span, "facets", info.facets);
+
+  string bytes;
+  {
+    lock_guard<mutex> lock(_file_lock);
+    if (_file->seek(info.offset) != info.offset) return false;
+    bytes = _file->read(info.bytes());
+  }
+  if (bytes.length() != info.bytes()) return false;
+
+  size_t pos = 2*sizeof(unsigned int);
+  data.face_sizes.resize(info.faces);
+  if (info.faces > 0) memcpy(&data.face_sizes[0], bytes.data()+pos, info.faces*sizeof(unsigned int));
+  pos += info.faces*sizeof(unsigned int);
+  get_floats(bytes, pos, data.points, info.facets*3);
+  get_floats(bytes, pos, data.colors, info.facets*3);
+  get_floats(bytes, pos, data.normals, info.facets*3);
+  return true;
+}
+
+shared_ptr<const page_chunk> paged_store::chunk(int chunk) const { return _cache.get(*this, chunk); }
+
+void paged_store::prefetch(const vector<int>& chunks) const { _cache.prefetch(shared_from_this(), chunks); }
+
+bool paged_store::visit(const vector<int>& chunks, const function<void (int, const page_chunk&)>& body) const {
+  if (chunks.empty()) return true;
+
+  // the read ahead window: as many chunks as fit in half the budget, leaving the rest for what's already resident
+  long long int chunk_bytes = file_bytes()/_chunks.size() + 1;
+  int window = max(1LL, (long long int)(_cache.budget()/2)/chunk_bytes);
+
+  for (int i=0;i<chunks.size();i++) {
+    if (i+1 < chunks.size()) prefetch(vector<int>(chunks.begin()+i+1, chunks.begin()+min((int)chunks.size(), i+1+window)));
+    shared_ptr<const page_chunk> data = chunk(chunks[i]);
+    if (!data) return false;
+    body(chunks[i], *data);
+  }
+  return true;
+}
+
+bool paged_store::visit(const function<void (int, const page_chunk&)>& body) const {
+  vector<int> chunks(_chunks.size());
+  for (int i=0;i<chunks.size();i++) chunks[i] = i;
+  return visit(chunks, body);
+}
+
+bool paged_store::rewrite(const function<void (page_chunk&)>& edit) {
+  TRACE_SPAN(rewrite_span, "paged_store::rewrite");
+  TRACE_ARG(rewrite_span, "chunks", (long long int)_chunks.size());
+  for (int i=0;i<_chunks.size();i++) {
+    shared_ptr<const page_chunk> current = chunk(i);
+    if (!current) return false;
+    page_chunk edited(*current);
+    edit(edited);
+    _cache.evict(*this, i);
+    if (!_write_chunk(edited, _chunks[i])) return false;
+  }
+  return true;
+}
+
+int paged_store::find_face(int face) const {
+  if (face < 0 || face >= _faces) return -1;
+  int low = 0, high = _chunks.size()-1;
+  while (low < high) { // the last chunk starting at or before face
+    int mid = (low+high+1)/2;
+    if (_chunks[mid].first_face <= face) low = mid;
+    else high = mid-1;
+  }
+  return low;
+}
+
+
+// *** BEGIN VIEW_FRUSTUM DEFINITIONS ***
+
+view_frustum::view_frustum(const float* projection, const float* modelview) {
+  // clip = projection*modelview (column major); the planes are sums and differences of its rows
+  float clip[16];
+  for (int c=0;c<4;c++) {
+    for (int r=0;r<4;r++) {
+      clip[c*4+r] = 0.0f;
+      for (int k=0;k<4;k++) clip[c*4+r] += projection[k*4+r]*modelview[c*4+k];
+    }
+  }
+  for (int p=0;p<6;p++) {
+    int row = p/2;
+    float sign = (p%2 == 0 ? 1.0f : -1.0f);
+    for (int c=0;c<4;c++) planes[p][c] = clip[c*4+3] + sign*clip[c*4+row];
+  }
+}
+
+bool view_frustum::intersects(const vect3f& low, const vect3f& high) const {
+  // outside if the box's corner furthest along a plane's normal is behind it
+  for (int p=0;p<6;p++) {
+    float x = (planes[p][0] >= 0.0f ? high.x : low.x);
+    float y = (planes[p][1] >= 0.0f ? high.y : low.y);
+    float z = (planes[p][2] >= 0.0f ? high.z : low.z);
+    if (planes[p][0]*x + planes[p][1]*y + planes[p][2]*z + planes[p][3] < 0.0f) return false;
+  }
+  return true;
+}
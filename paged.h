@@ -0,0 +1,176 @@
+// File: paged.h
+// Written by Joshua Green
+
+#ifndef PAGED_H
+#define PAGED_H
+
+#include "vectXf.h"
+#include <vector>
+#include <string>
+#include <list>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class paged_store;
+class fileio;
+
+// ------------------------------------------------------------- PAGED STORAGE -------------------------------------------------------------- //
+//   + page_cache(budget_bytes, scratch_prefix)                                                                                               //
+//       - holds recently used chunks of every paged_store created against it, dropping the least recently used beyond budget_bytes           //
+//       - page files are written as scratch_prefix + a unique suffix (removed once the model using them is gone)                             //
+//       - must outlive its stores (declare it before the models that page into it)                                                           //
+//   + get(store, chunk)                                                                                                                      //
+//       - returns the chunk, reading it from the store's page file on a miss (and waiting for a prefetch already reading it)                 //
+//   + prefetch(store, chunks)                                                                                                                //
+//       - replaces the queue of chunks read ahead on the cache's background thread (in the order given; resident ones are skipped)           //
+//   + stats() / reset_stats()                                                                                                                //
+//   + set_budget(bytes) / budget()                                                                                                           //
+//   + paged_store(cache)                                                                                                                     //
+//       - an empty page file: add_face() appends faces (as written by model3d::page_out()), finish() writes the last chunk                   //
+//   + chunk(i) / prefetch(chunks)                                                                                                            //
+//       - through the store's cache                                                                                                          //
+//   + visit(chunks, body)                                                                                                                    //
+//       - calls body(i, chunk) for each of chunks in order, keeping up to half of the cache's budget of the chunks after it prefetched       //
+//   + rewrite(edit)                                                                                                                          //
+//       - calls edit on every chunk in turn and writes it back in place (edit mustn't change a chunk's face or facet counts)                 //
+//   + find_face(face)                                                                                                                        //
+//       - returns the chunk holding a face (-1 if there's no such face)                                                                      //
+//   + view_frustum(projection, modelview)                                                                                                    //
+//       - the clip planes of the gl matrices given (column major, as glGetFloatv() returns them); intersects() tests a bounding box          //
+//   + NOTES:                                                                                                                                 //
+//       - a chunk is a run of whole faces of about PAGE_FACETS facets, de-indexed (each facet holds its own point, color and normal)         //
+//         so that it can be drawn, edited or exported without any other chunk; one face larger than PAGE_FACETS gets a chunk of its own      //
+//       - every chunk's position, counts and bounds stay in memory; only the geometry is paged                                               //
+//       - a chunk is u32 face count | u32 facet count | u32 size per face | f32 point[3] per facet | f32 color[3] ... | f32 normal[3] ...    //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+const int PAGE_FACETS = 16384;
+
+// a chunk's geometry: three floats per facet in each of points, colors and normals, faces end to end
+struct page_chunk {
+  std::vector<unsigned int> face_sizes;
+  std::vector<float> points, colors, normals;
+
+  size_t memory_usage() const;
+};
+
+// what's kept in memory of a chunk
+struct page_info {
+  long long int offset; // within the page file
+  int first_face, faces, facets;
+  vect3f low, high;     // bounds of the chunk's points
+
+  page_info() : offset(0), first_face(0), faces(0), facets(0) { }
+  long long int bytes() const;
+};
+
+struct page_cache_stats {
+  long long int hits, misses, prefetched, evicted;
+  size_t resident_bytes, peak_bytes; // chunks held by the cache (now, and at most)
+
+  page_cache_stats() : hits(0), misses(0), prefetched(0), evicted(0), resident_bytes(0), peak_bytes(0) { }
+};
+
+class page_cache {
+  private:
+    typedef unsigned long long int key; // store id << 32 | chunk
+    struct entry {
+      key k;
+      std::shared_ptr<const page_chunk> chunk;
+      size_t bytes;
+    };
+
+    size_t _budget;
+    std::string _scratch_prefix;
+    unsigned int _next_store;
+
+    std::mutex _lock;
+    std::list<entry> _lru; // most recently used first
+    std::unordered_map<key, std::list<entry>::iterator> _index;
+    std::unordered_set<key> _loading; // chunks being read (by get() or the prefetch thread)
+    std::condition_variable _loaded;
+    page_cache_stats _stats;
+
+    std::deque<std::pair<std::weak_ptr<const paged_store>, int>> _queue; // chunks to prefetch
+    std::condition_variable _queued;
+    std::thread _prefetcher;
+    bool _stop;
+
+    static key _key(const paged_store& store, int chunk);
+    std::shared_ptr<const page_chunk> _load(const paged_store& store, int chunk, bool prefetch);
+    void _trim(); // (with _lock held)
+    void _prefetch_loop();
+
+  public:
+    page_cache(size_t budget_bytes=256*1024*1024, const std::string& scratch_prefix="model3d_pages");
+    ~page_cache();
+
+    void set_budget(size_t bytes);
+    size_t budget() const;
+
+    std::shared_ptr<const page_chunk> get(const paged_store& store, int chunk);
+    void prefetch(const std::shared_ptr<const paged_store>& store, const std::vector<int>& chunks);
+    void evict(const paged_store& store); // drops every chunk of store
+    void evict(const paged_store& store, int chunk);
+
+    page_cache_stats stats();
+    void reset_stats(); // (keeps resident_bytes; peak_bytes restarts from it)
+
+    // (for paged_store)
+    unsigned int next_store_id();
+    std::string scratch_filename(unsigned int store_id) const;
+};
+
+class paged_store : public std::enable_shared_from_this<paged_store> {
+  private:
+    page_cache& _cache;
+    unsigned int _id;
+    std::string _filename;
+    fileio* _file;
+    mutable std::mutex _file_lock;
+    std::vector<page_info> _chunks;
+    int _faces, _facets;
+    page_chunk _building; // the chunk add_face() is filling
+    bool _ok;
+
+    bool _write_chunk(const page_chunk& chunk, page_info& info); // at info.offset (filling in its counts and bounds)
+
+  public:
+    explicit paged_store(page_cache& cache);
+    ~paged_store();
+
+    bool add_face(const float* points, const float* colors, const float* normals, int count);
+    bool finish();
+    bool ok() const; // false once a write has failed
+
+    unsigned int id() const;
+    page_cache& cache() const;
+    int chunk_count() const;
+    int face_count() const;
+    int facet_count() const;
+    const page_info& info(int chunk) const;
+    long long int file_bytes() const;
+
+    bool read_chunk(int chunk, page_chunk& data) const; // straight from the page file (the cache's loader)
+    std::shared_ptr<const page_chunk> chunk(int chunk) const;
+    void prefetch(const std::vector<int>& chunks) const;
+    bool visit(const std::vector<int>& chunks, const std::function<void (int, const page_chunk&)>& body) const; // false if a read failed
+    bool visit(const std::function<void (int, const page_chunk&)>& body) const; // every chunk
+    bool rewrite(const std::function<void (page_chunk&)>& edit);
+    int find_face(int face) const;
+};
+
+struct view_frustum {
+  float planes[6][4]; // a*x + b*y + c*z + d >= 0 inside
+
+  view_frustum(const float* projection, const float* modelview);
+  bool intersects(const vect3f& low, const vect3f& high) const;
+};
+
+#endif
@@ -0,0 +1,37 @@
+// File: parallel.cpp
+// Written by Joshua Green
+
+#include "parallel.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+using namespace std;
+
+int hardware_threads() {
+  int count = thread::hardware_concurrency();
+  return (count < 1 ? 1 : count);
+}
+
+void parallel_for(long long int begin, long long int end, long long int chunk_size,
+                  const function<void (long long int, long long int)>& body, int thread_count) {
+  if (end <= begin) return;
+  if (chunk_size < 1) chunk_size = 1;
+  if (thread_count < 1) thread_count = hardware_threads();
+
+  long long int chunk_count = (end-begin+chunk_size-1)/chunk_size;
+  if (thread_count > chunk_count) thread_count = chunk_count;
+
+  atomic<long long int> next_chunk(0);
+  auto worker = [&]() {
+    for (long long int chunk=next_chunk++;chunk<chunk_count;chunk=next_chunk++) {
+      long long int chunk_begin = begin + chunk*chunk_size;
+      long long int chunk_end = (chunk_begin+chunk_size < end ? chunk_begin+chunk_size : end);
+      body(chunk_begin, chunk_end);
+    }
+  };
+
+  vector<thread> threads;
+  for (int i=1;i<thread_count;i++) threads.push_back(thread(worker));
+  worker(); // the calling thread does its share
+  for (int i=0;i<threads.size();i++) threads[i].join();
+}
@@ -0,0 +1,20 @@
+// File: parallel.h
+// Written by Joshua Green
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+// returns the number of hardware threads (at least 1)
+int hardware_threads();
+
+// parallel_for(begin, end, chunk_size, body, thread_count=0)
+//   - splits [begin, end) into chunks of chunk_size and calls body(chunk_begin, chunk_end) for each chunk
+//   - chunks are handed out dynamically, so the order chunks are processed in is unspecified
+//   - a thread_count of zero uses hardware_threads(); a thread_count of one runs on the calling thread
+//   - returns after every chunk has been processed
+void parallel_for(long long int begin, long long int end, long long int chunk_size,
+                  const std::function<void (long long int, long long int)>& body, int thread_count=0);
+
+#endif
@@ -0,0 +1,156 @@
+// File: preload.cpp
+// Written by Joshua Green
+
+#include "preload.h"
+#include "model3d.h"
+#include "parallel.h"
+#include "trace.h"
+#include "fileio/fileio.h"
+#include "str/str.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+using namespace std;
+
+namespace {
+  typedef chrono::steady_clock preload_clock;
+
+  double ms_since(preload_clock::time_point start) { return chrono::duration<double, milli>(preload_clock::now() - start).count(); }
+
+  long long int file_size(const string& filename) {
+    fileio file;
+    file.open(filename, "r");
+    if (!file.is_open()) return 0;
+    return file.size();
+  }
+
+  bool is_absolute(const string& path) {
+    if (path.length() > 0 && (path[0] == '/' || path[0] == '\\')) return true;
+    return (path.length() > 1 && path[1] == ':'); // drive letter
+  }
+}
+
+bool list_directory(const string& path, vector<string>& files) {
+  string prefix(path);
+  if (prefix.length() > 0 && prefix[prefix.length()-1] != '/' && prefix[prefix.length()-1] != '\\') prefix += "/";
+
+  vector<string> found;
+#ifdef _WIN32
+  DWORD attributes = GetFileAttributesA(path.c_str());
+  if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) return false;
+
+  WIN32_FIND_DATAA entry;
+  HANDLE search = FindFirstFileA((prefix + "*").c_str(), &entry);
+  if (search != INVALID_HANDLE_VALUE) {
+    do {
+      if (entry.cFileName[0] == '.' || (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) continue;
+      found.push_back(prefix + entry.cFileName);
+    } while (FindNextFileA(search, &entry));
+    FindClose(search);
+  }
+#else
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) return false;
+
+  DIR* directory = opendir(path.c_str());
+  if (directory == 0) return false;
+  for (dirent* entry=readdir(directory);entry!=0;entry=readdir(directory)) {
+    if (entry->d_name[0] == '.') continue;
+    string filename = prefix + entry->d_name;
+    if (stat(filename.c_str(), &info) == 0 && !S_ISDIR(info.st_mode)) found.push_back(filename);
+  }
+  closedir(directory);
+#endif
+
+  // directory order is unspecified; sorting keeps the registry slots the same from run to run
+  sort(found.begin(), found.end());
+  files.insert(files.end(), found.begin(), found.end());
+  return true;
+}
+
+bool preload_list(const string& path, vector<string>& files) {
+  if (list_directory(path, files)) return true;
+
+  fileio manifest;
+  manifest.open(path, "r");
+  if (!manifest.is_open()) return false;
+
+  string base;
+  size_t slash = path.find_last_of("/\\");
+  if (slash != string::npos) base = path.substr(0, slash+1);
+
+  vector<string> lines = explode(manifest.read(-1), "\n", -1);
+  for (int i=0;i<lines.size();i++) {
+    string line(lines[i]);
+    while (line.length() > 0 && (line[line.length()-1] == '\r' || line[line.length()-1] == ' ' || line[line.length()-1] == '\t')) line.erase(line.length()-1);
+    if (line.length() == 0 || line[0] == '#') continue;
+    files.push_back(is_absolute(line) ? line : base + line);
+  }
+  return true;
+}
+
+preload_report preload_models(const vector<string>& files, const function<void (int, preload_result&)>& publish, int thread_count) {
+  TRACE_SPAN(preload_span, "preload_models");
+  TRACE_ARG(preload_span, "files", (long long int)files.size());
+
+  preload_report report;
+  report.files = files.size();
+  report.threads = (thread_count < 1 ? hardware_threads() : thread_count);
+  if (files.empty()) return report;
+
+  // largest first: the total time is bounded below by the largest file, so it should never be the last one started
+  vector<long long int> sizes(files.size());
+  vector<int> order(files.size());
+  for (int i=0;i<files.size();i++) {
+    sizes[i] = file_size(files[i]);
+    order[i] = i;
+  }
+  stable_sort(order.begin(), order.end(), [&](int a, int b) { return sizes[a] > sizes[b]; });
+
+  mutex report_lock;
+  atomic<int> published(0);
+  preload_clock::time_point start = preload_clock::now();
+
+  // one file per work item; load times vary too much between files for larger chunks to balance
+  parallel_for(0, order.size(), 1, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      int index = order[i];
+
+      preload_result result;
+      result.filename = files[index];
+      result.bytes = sizes[index];
+
+      preload_clock::time_point load_start = preload_clock::now();
+      result.ok = result.model.load(files[index], &result.validation);
+      result.load_ms = ms_since(load_start);
+      result.finished_ms = ms_since(start);
+
+      {
+        lock_guard<mutex> lock(report_lock);
+        if (published++ == 0) report.first_ms = result.finished_ms;
+        report.load_ms += result.load_ms;
+        if (result.ok) {
+          report.bytes += result.bytes;
+          report.facets += result.model.vertex_count();
+        }
+        else report.failures++;
+      }
+
+      publish(index, result);
+    }
+  }, report.threads);
+
+  report.wall_ms = ms_since(start);
+  return report;
+}
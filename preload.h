@@ -0,0 +1,58 @@
+// File: preload.h
+// Written by Joshua Green
+
+#ifndef PRELOAD_H
+#define PRELOAD_H
+
+#include "model3d.h"
+#include "validate.h"
+#include <vector>
+#include <string>
+#include <functional>
+
+// --------------------------------------------------------------- PRELOADING --------------------------------------------------------------- //
+//   + list_directory(path, files)                                                                                                            //
+//       - appends the files within directory path (non-recursively, sorted by name) to files                                                 //
+//       - returns false (leaving files untouched) if path isn't a directory                                                                  //
+//   + preload_list(path, files)                                                                                                              //
+//       - if path is a directory, lists it as list_directory() does                                                                          //
+//       - otherwise path is read as a manifest: one model filename per line, relative to the manifest's directory unless absolute           //
+//       - blank lines and lines beginning with '#' within a manifest are ignored                                                             //
+//       - returns false if path is neither a directory nor a readable manifest                                                               //
+//   + preload_models(files, publish, thread_count=0)                                                                                         //
+//       - loads every file concurrently on up to thread_count threads (zero uses hardware_threads())                                         //
+//       - calls publish(index, result) as each file finishes, where index is the file's position within files                                //
+//       - publish is called from the worker threads (concurrently, in completion order) and may move the model out of result                //
+//       - returns once every file has been published                                                                                         //
+//   + NOTES:                                                                                                                                 //
+//       - the largest files are started first so that one large model doesn't trail behind a batch of small ones                             //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+struct preload_result {
+  std::string filename;
+  model3d model;
+  mesh_report validation; // of the model as it was loaded (see validate.h)
+  bool ok;
+  double load_ms;     // time spent loading this file
+  double finished_ms; // time from the start of the preload until this file was published
+  long long int bytes;
+
+  preload_result() : ok(false), load_ms(0.0), finished_ms(0.0), bytes(0) { }
+};
+
+struct preload_report {
+  int files, failures, threads;
+  long long int bytes, facets;
+  double wall_ms;       // start of the preload until the last file was published
+  double first_ms;      // start of the preload until the first file was published
+  double load_ms;       // load times summed over every file
+
+  preload_report() : files(0), failures(0), threads(0), bytes(0), facets(0), wall_ms(0.0), first_ms(0.0), load_ms(0.0) { }
+};
+
+bool list_directory(const std::string& path, std::vector<std::string>& files);
+bool preload_list(const std::string& path, std::vector<std::string>& files);
+preload_report preload_models(const std::vector<std::string>& files,
+                              const std::function<void (int, preload_result&)>& publish, int thread_count=0);
+
+#endif
@@ -0,0 +1,284 @@
+// File: profiler.cpp
+// Written by Joshua Green
+
+#include "profiler.h"
+#ifdef USE_PROFILER_GL_TIMERS
+  #include "gl_proc.h" // (before gl.h)
+#endif
+#include "fileio/fileio.h"
+#include "str/str.h"
+#include <string>
+#include <algorithm>
+
+#include <GL/gl.h>
+#include <GL/glut.h>
+#include <GL/glu.h>
+using namespace std;
+
+#ifdef USE_PROFILER
+  profiler PROFILER;
+#endif
+
+#ifdef USE_PROFILER_GL_TIMERS
+  #include <GL/glext.h>
+
+  // the timer query entry points aren't part of the 1.1 headers, so they're fetched at runtime:
+  static PFNGLGENQUERIESPROC gl_gen_queries = 0;
+  static PFNGLBEGINQUERYPROC gl_begin_query = 0;
+  static PFNGLENDQUERYPROC gl_end_query = 0;
+  static PFNGLGETQUERYOBJECTIVPROC gl_get_query_objectiv = 0;
+  static PFNGLGETQUERYOBJECTUI64VPROC gl_get_query_objectui64v = 0;
+#endif
+
+
+// **** begin struct profiler::ring definitions **** //
+void profiler::ring::push(float value) {
+  samples[next] = value;
+  next = (next+1)%HISTORY_SIZE;
+  if (filled < HISTORY_SIZE) filled++;
+}
+
+float profiler::ring::percentile(float p) const {
+  if (filled == 0) return 0.0f;
+
+  float sorted[HISTORY_SIZE];
+  copy(samples, samples+filled, sorted);
+
+  int k = (int)(p*(filled-1)+0.5f);
+  if (k < 0) k = 0;
+  if (k >= filled) k = filled-1;
+  nth_element(sorted, sorted+k, sorted+filled);
+  return sorted[k];
+}
+
+float profiler::ring::mean() const {
+  if (filled == 0) return 0.0f;
+
+  float sum = 0.0f;
+  for (int i=0;i<filled;i++) sum += samples[i];
+  return sum/filled;
+}
+
+
+
+
+// **** begin class profiler definitions **** //
+profiler::profiler() : _frame_count(0), _gl_timers(false), show_overlay(false) {
+  for (int i=0;i<COUNTER_COUNT;i++) _frame_counters[i] = 0;
+  for (int i=0;i<PHASE_COUNT;i++) {
+    _gl_queries[i] = 0;
+    _gl_query_pending[i] = false;
+  }
+}
+
+// the gl context doesn't exist when the global is constructed, so queries are created lazily on the first frame
+void profiler::_init_gl_timers() {
+  #ifdef USE_PROFILER_GL_TIMERS
+    gl_gen_queries = (PFNGLGENQUERIESPROC)GL_PROC_ADDRESS("glGenQueries");
+    gl_begin_query = (PFNGLBEGINQUERYPROC)GL_PROC_ADDRESS("glBeginQuery");
+    gl_end_query = (PFNGLENDQUERYPROC)GL_PROC_ADDRESS("glEndQuery");
+    gl_get_query_objectiv = (PFNGLGETQUERYOBJECTIVPROC)GL_PROC_ADDRESS("glGetQueryObjectiv");
+    gl_get_query_objectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)GL_PROC_ADDRESS("glGetQueryObjectui64v");
+
+    if (gl_gen_queries && gl_begin_query && gl_end_query && gl_get_query_objectiv && gl_get_query_objectui64v) {
+      gl_gen_queries(PHASE_COUNT, _gl_queries);
+      _gl_timers = true;
+    }
+  #endif
+}
+
+void profiler::begin_frame() {
+  #ifdef USE_PROFILER_GL_TIMERS
+    if (_frame_count == 0) _init_gl_timers();
+
+    // collect last frame's gpu timings (if the results have arrived):
+    if (_gl_timers) {
+      for (int i=0;i<PHASE_COUNT;i++) {
+        if (!_gl_query_pending[i]) continue;
+
+        GLint available = 0;
+        gl_get_query_objectiv(_gl_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+          GLuint64 elapsed_ns = 0;
+          gl_get_query_objectui64v(_gl_queries[i], GL_QUERY_RESULT, &elapsed_ns);
+          _gpu[i].push(elapsed_ns/1000000.0f);
+          _gl_query_pending[i] = false;
+        }
+      }
+    }
+  #endif
+
+  for (int i=0;i<COUNTER_COUNT;i++) _frame_counters[i] = 0;
+  begin_phase(PHASE_FRAME);
+}
+
+void profiler::end_frame() {
+  end_phase(PHASE_FRAME);
+  for (int i=0;i<COUNTER_COUNT;i++) _counters[i].push((float)_frame_counters[i]);
+  _frame_count++;
+}
+
+void profiler::begin_phase(PROFILE_PHASE phase) {
+  #ifdef USE_PROFILER_GL_TIMERS
+    // gl only allows a single elapsed-time query at once, so the enclosing frame phase is cpu-only
+    if (_gl_timers && phase != PHASE_FRAME && !_gl_query_pending[phase]) gl_begin_query(GL_TIME_ELAPSED, _gl_queries[phase]);
+  #endif
+
+  _phase_start[phase] = clock::now();
+}
+
+void profiler::end_phase(PROFILE_PHASE phase) {
+  clock::duration elapsed = clock::now() - _phase_start[phase];
+  _cpu[phase].push(chrono::duration<float, milli>(elapsed).count());
+
+  #ifdef USE_PROFILER_GL_TIMERS
+    if (_gl_timers && phase != PHASE_FRAME && !_gl_query_pending[phase]) {
+      gl_end_query(GL_TIME_ELAPSED);
+      _gl_query_pending[phase] = true;
+    }
+  #endif
+}
+
+long int profiler::frame_count() const { return _frame_count; }
+
+float profiler::percentile(PROFILE_PHASE phase, float p) const { return _cpu[phase].percentile(p); }
+
+float profiler::gpu_percentile(PROFILE_PHASE phase, float p) const { return _gpu[phase].percentile(p); }
+
+float profiler::counter_mean(PROFILE_COUNTER counter) const { return _counters[counter].mean(); }
+
+void profiler::draw_overlay(int screen_w, int screen_h) const {
+  if (!show_overlay) return;
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0, screen_w, 0, screen_h);
+
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+
+  vector<string> lines;
+  lines.push_back(string("frames: ") + itos(_frame_count) + "   (ms: p50 / p95 / p99)");
+  for (int i=0;i<PHASE_COUNT;i++) {
+    string line(phase_name((PROFILE_PHASE)i));
+    line += ": ";
+    line += ftos(_cpu[i].percentile(0.50f)) + " / " + ftos(_cpu[i].percentile(0.95f)) + " / " + ftos(_cpu[i].percentile(0.99f));
+    if (_gl_timers && i != PHASE_FRAME) line += "   gpu: " + ftos(_gpu[i].percentile(0.50f));
+    lines.push_back(line);
+  }
+  for (int i=0;i<COUNTER_COUNT;i++) {
+    lines.push_back(string(counter_name((PROFILE_COUNTER)i)) + ": " + itos((long int)_counters[i].mean()));
+  }
+
+  const int line_height = 14;
+  int y = screen_h - line_height;
+  glColor3f(1.0f, 1.0f, 0.0f);
+  for (int i=0;i<lines.size();i++) {
+    glRasterPos2i(8, y);
+    for (int j=0;j<lines[i].length();j++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, lines[i][j]);
+    y -= line_height;
+  }
+
+  glPopAttrib();
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+bool profiler::dump(const string& filename) const {
+  bool json = (filename.length() >= 5 && filename.substr(filename.length()-5) == ".json");
+
+  fileio dump_file;
+  dump_file.open(filename, "w");
+  if (!dump_file.is_open()) return false;
+
+  if (json) {
+    dump_file.write(string("{\"frames\": ") + itos(_frame_count) + ", \"phases\": {");
+    for (int i=0;i<PHASE_COUNT;i++) {
+      string data("\"");
+      data += phase_name((PROFILE_PHASE)i);
+      data += "\": {\"mean_ms\": " + ftos(_cpu[i].mean());
+      data += ", \"p50_ms\": " + ftos(_cpu[i].percentile(0.50f));
+      data += ", \"p95_ms\": " + ftos(_cpu[i].percentile(0.95f));
+      data += ", \"p99_ms\": " + ftos(_cpu[i].percentile(0.99f));
+      data += ", \"max_ms\": " + ftos(_cpu[i].percentile(1.0f));
+      data += ", \"gpu_p50_ms\": " + ftos(_gpu[i].percentile(0.50f)) + "}";
+      if (i != PHASE_COUNT-1) data += ", ";
+      dump_file.write(data);
+    }
+    dump_file.write("}, \"counters\": {");
+    for (int i=0;i<COUNTER_COUNT;i++) {
+      string data("\"");
+      data += counter_name((PROFILE_COUNTER)i);
+      data += "\": {\"mean\": " + ftos(_counters[i].mean());
+      data += ", \"p95\": " + ftos(_counters[i].percentile(0.95f)) + "}";
+      if (i != COUNTER_COUNT-1) data += ", ";
+      dump_file.write(data);
+    }
+    dump_file.write("}}\n");
+  }
+  else {
+    dump_file.write("name,mean,p50,p95,p99,max,gpu_p50\n");
+    for (int i=0;i<PHASE_COUNT;i++) {
+      string data(phase_name((PROFILE_PHASE)i));
+      data += "," + ftos(_cpu[i].mean()) + "," + ftos(_cpu[i].percentile(0.50f)) + "," + ftos(_cpu[i].percentile(0.95f));
+      data += "," + ftos(_cpu[i].percentile(0.99f)) + "," + ftos(_cpu[i].percentile(1.0f)) + "," + ftos(_gpu[i].percentile(0.50f)) + "\n";
+      dump_file.write(data);
+    }
+    for (int i=0;i<COUNTER_COUNT;i++) {
+      string data(counter_name((PROFILE_COUNTER)i));
+      data += "," + ftos(_counters[i].mean()) + "," + ftos(_counters[i].percentile(0.50f)) + "," + ftos(_counters[i].percentile(0.95f));
+      data += "," + ftos(_counters[i].percentile(0.99f)) + "," + ftos(_counters[i].percentile(1.0f)) + ",\n";
+      dump_file.write(data);
+    }
+  }
+
+  dump_file.close();
+  return true;
+}
+
+const char* profiler::phase_name(PROFILE_PHASE phase) {
+  switch(phase) {
+    case PHASE_FRAME: return "frame";
+    case PHASE_CAMERA: return "set_camera";
+    case PHASE_LIGHT: return "draw_light";
+    case PHASE_AXIS: return "draw_axis";
+    case PHASE_POINTER: return "draw_pointer";
+    case PHASE_WORKING_MODEL: return "working_model";
+    case PHASE_LOADED_MODELS: return "loaded_models";
+    case PHASE_GRID: return "grid";
+    case PHASE_RENDER_QUEUE: return "render_queue";
+    case PHASE_PALETTE: return "draw_color_palette";
+    default: return "unknown";
+  }
+}
+
+const char* profiler::counter_name(PROFILE_COUNTER counter) {
+  switch(counter) {
+    case COUNTER_DRAW_CALLS: return "draw_calls";
+    case COUNTER_VERTICES: return "vertices";
+    case COUNTER_MATERIAL_CHANGES: return "material_changes";
+    case COUNTER_MODELS_CULLED: return "models_culled";
+    default: return "unknown";
+  }
+}
+
+
+
+
+// **** begin class profile_scope definitions **** //
+#ifdef USE_PROFILER
+  profile_scope::profile_scope(PROFILE_PHASE phase) : _phase(phase) { PROFILER.begin_phase(_phase); }
+  profile_scope::~profile_scope() { PROFILER.end_phase(_phase); }
+#else
+  profile_scope::profile_scope(PROFILE_PHASE phase) : _phase(phase) { }
+  profile_scope::~profile_scope() { }
+#endif
@@ -0,0 +1,123 @@
+// File: profiler.h
+// Written by Joshua Green
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <chrono>
+
+// comment out to compile all frame profiling out of the build (the macros below become no-ops)
+#define USE_PROFILER
+
+// uncomment to also time each phase on the gpu (requires GL_ARB_timer_query; its entry points are fetched through gl_proc.h)
+//#define USE_PROFILER_GL_TIMERS
+
+// the phases of a single call to display()
+enum PROFILE_PHASE {
+  PHASE_FRAME, PHASE_CAMERA, PHASE_LIGHT, PHASE_AXIS, PHASE_POINTER,
+  PHASE_WORKING_MODEL, PHASE_LOADED_MODELS, PHASE_GRID, PHASE_RENDER_QUEUE, PHASE_PALETTE,
+  PHASE_COUNT
+};
+
+// per-frame render counters
+enum PROFILE_COUNTER {
+  COUNTER_DRAW_CALLS,       // glBegin()/glEnd() pairs
+  COUNTER_VERTICES,         // glVertex*() calls
+  COUNTER_MATERIAL_CHANGES, // glMaterialfv() calls
+  COUNTER_MODELS_CULLED,    // models skipped during the frame
+  COUNTER_COUNT
+};
+
+// -------------------------------------------------------------- CLASS PROFILER ------------------------------------------------------------ //
+//   + begin_frame() / end_frame()                                                                                                            //
+//       - brackets a single frame; counters are reset at begin_frame() and sampled at end_frame()                                            //
+//   + begin_phase(PROFILE_PHASE) / end_phase(PROFILE_PHASE)                                                                                  //
+//       - records the cpu time (and optionally gpu time) spent within a phase                                                                //
+//   + count(PROFILE_COUNTER, int n)                                                                                                          //
+//       - adds n to the current frame's counter                                                                                              //
+//   + percentile(PROFILE_PHASE, float p)                                                                                                     //
+//       - returns the p'th percentile (0.0-1.0) cpu time in milliseconds over the last HISTORY_SIZE frames                                   //
+//   + draw_overlay(int screen_w, int screen_h)                                                                                               //
+//       - draws the rolling statistics as text over the current frame                                                                        //
+//   + dump(string filename)                                                                                                                  //
+//       - writes the rolling statistics to filename; a filename ending in ".json" is written as json, otherwise csv                          //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+class profiler {
+  public:
+    static const int HISTORY_SIZE = 240; // number of frames the rolling statistics are computed over
+
+  private:
+    typedef std::chrono::high_resolution_clock clock;
+
+    struct ring {
+      float samples[HISTORY_SIZE];
+      int next, filled;
+
+      ring() : next(0), filled(0) { }
+      void push(float value);
+      float percentile(float p) const;
+      float mean() const;
+    };
+
+    ring _cpu[PHASE_COUNT];
+    ring _gpu[PHASE_COUNT];
+    ring _counters[COUNTER_COUNT];
+    clock::time_point _phase_start[PHASE_COUNT];
+    int _frame_counters[COUNTER_COUNT];
+    long int _frame_count;
+
+    bool _gl_timers;
+    unsigned int _gl_queries[PHASE_COUNT];
+    bool _gl_query_pending[PHASE_COUNT];
+    void _init_gl_timers();
+
+  public:
+    bool show_overlay;
+
+    profiler();
+
+    void begin_frame();
+    void end_frame();
+    void begin_phase(PROFILE_PHASE phase);
+    void end_phase(PROFILE_PHASE phase);
+    void count(PROFILE_COUNTER counter, int n=1) { _frame_counters[counter] += n; }
+
+    long int frame_count() const;
+    float percentile(PROFILE_PHASE phase, float p) const;
+    float gpu_percentile(PROFILE_PHASE phase, float p) const;
+    float counter_mean(PROFILE_COUNTER counter) const;
+
+    void draw_overlay(int screen_w, int screen_h) const;
+    bool dump(const std::string& filename) const;
+
+    static const char* phase_name(PROFILE_PHASE phase);
+    static const char* counter_name(PROFILE_COUNTER counter);
+};
+
+// times the enclosing scope as the given phase
+class profile_scope {
+  private:
+    PROFILE_PHASE _phase;
+  public:
+    profile_scope(PROFILE_PHASE phase);
+    ~profile_scope();
+};
+
+#ifdef USE_PROFILER
+  extern profiler PROFILER;
+
+  #define PROFILE_FRAME_BEGIN()    PROFILER.begin_frame()
+  #define PROFILE_FRAME_END()      PROFILER.end_frame()
+  #define PROFILE_SCOPE_JOIN(a, b) a##b
+  #define PROFILE_SCOPE_NAME(line) PROFILE_SCOPE_JOIN(profile_scope_, line)
+  #define PROFILE_SCOPE(phase)     profile_scope PROFILE_SCOPE_NAME(__LINE__)(phase)
+  #define PROFILE_COUNT(counter, n) PROFILER.count(counter, n)
+#else
+  #define PROFILE_FRAME_BEGIN()
+  #define PROFILE_FRAME_END()
+  #define PROFILE_SCOPE(phase)
+  #define PROFILE_COUNT(counter, n)
+#endif
+
+#endif
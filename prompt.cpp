@@ -0,0 +1,140 @@
+// File: prompt.cpp
+// Written by Joshua Green
+
+#include "prompt.h"
+
+#include <GL/gl.h>
+#include <GL/glut.h>
+#include <GL/glu.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+using namespace std;
+
+// *** BEGIN COMMAND_PROMPT DEFINITIONS ***
+command_prompt::command_prompt() : _answering(false), _follow_ups(0) { }
+
+void command_prompt::ask(const string& text, const function<void (const string&)>& answered) {
+  pending_question asked;
+  asked.text = text;
+  asked.answered = answered;
+  if (_answering) _questions.insert(_questions.begin()+(_follow_ups++), asked);
+  else _questions.push_back(asked);
+}
+
+// the question is taken off the queue before its callback runs, so the callback's own questions are asked next
+void command_prompt::_enter(const string& answer) {
+  pending_question answered = _questions.front();
+  _questions.pop_front();
+  _answer.clear();
+  cout << answered.text << answer << endl;
+
+  bool answering = _answering;
+  int follow_ups = _follow_ups;
+  _answering = true;
+  _follow_ups = 0;
+  answered.answered(answer);
+  _answering = answering;
+  _follow_ups = follow_ups;
+}
+
+bool command_prompt::key(unsigned char key) {
+  if (_questions.empty()) return false;
+  switch (key) {
+    case 13: case 10: { // enter
+      string answer(_answer);
+      _enter(answer);
+    } break;
+    case 27: { // escape
+      cancel();
+    } break;
+    case 8: case 127: { // backspace (and delete)
+      if (_answer.length() > 0) _answer.erase(_answer.length()-1);
+    } break;
+    default: {
+      if (key >= 32 && key < 127) _answer += (char)key;
+    } break;
+  }
+  return true;
+}
+
+bool command_prompt::answer(const string& text) {
+  if (_questions.empty()) return false;
+  _enter(text);
+  return true;
+}
+
+void command_prompt::cancel() {
+  if (_questions.empty()) return;
+  cout << _questions.front().text << _answer << " (cancelled)" << endl;
+  _questions.pop_front();
+  _answer.clear();
+}
+
+bool command_prompt::active() const { return !_questions.empty(); }
+string command_prompt::question() const { return (_questions.empty() ? string() : _questions.front().text); }
+string command_prompt::typed() const { return _answer; }
+int command_prompt::queued() const { return (_questions.empty() ? 0 : _questions.size()-1); }
+
+void command_prompt::draw(int screen_w, int screen_h, int bottom, const vector<string>& status) const {
+  if (_questions.empty() && status.empty()) return;
+
+  const int line_height = 16, margin = 8, char_width = 8; // (GLUT_BITMAP_8_BY_13)
+  vector<string> lines(status);
+  if (!_questions.empty()) {
+    string line = _questions.front().text + _answer + "_";
+    if (_questions.size() > 1) line += "   (" + to_string(_questions.size()-1) + " more)";
+    lines.push_back(line);
+  }
+
+  // a line too long for the window shows its end (where the answer is typed)
+  int fits = (screen_w - 2*margin)/char_width;
+  for (int i=0;i<lines.size();i++) {
+    if (fits > 3 && lines[i].length() > fits) lines[i] = ".." + lines[i].substr(lines[i].length()-(fits-2));
+  }
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0, screen_w, 0, screen_h);
+
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+
+  int top = bottom + lines.size()*line_height + margin/2;
+  glColor4f(0.0f, 0.0f, 0.0f, 0.75f);
+  glBegin(GL_QUADS);
+  glVertex2i(0, bottom);
+  glVertex2i(screen_w, bottom);
+  glVertex2i(screen_w, top);
+  glVertex2i(0, top);
+  glEnd();
+
+  // the question is the lowest line, with the running operations stacked above it
+  int y = bottom + margin/2 + (lines.size()-1)*line_height;
+  for (int i=0;i<lines.size();i++) {
+    bool asking = (!_questions.empty() && i == lines.size()-1);
+    if (asking) glColor3f(1.0f, 1.0f, 1.0f);
+    else glColor3f(0.6f, 0.6f, 0.6f);
+    glRasterPos2i(margin, y);
+    for (int j=0;j<lines[i].length();j++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, lines[i][j]);
+    y -= line_height;
+  }
+
+  glPopAttrib();
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+// *** END COMMAND_PROMPT DEFINITIONS ***
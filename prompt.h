@@ -0,0 +1,62 @@
+// File: prompt.h
+// Written by Joshua Green
+
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+
+// ------------------------------------------------------------- COMMAND PROMPT ------------------------------------------------------------- //
+//   + ask(question, answered)                                                                                                                //
+//       - queues question; once it's the active one and an answer is entered, answered(answer) is called (on the thread entering it)         //
+//       - a question asked from inside answered() goes ahead of the ones already queued, so a dialog's follow up questions are asked         //
+//         together: a dialog is a chain of asks, each answer's callback asking the next question (or doing what was asked)                   //
+//   + key(key)                                                                                                                               //
+//       - edits the active question's answer with a keyboard_callback() key: printable characters are typed, backspace erases, enter         //
+//         answers the question and escape cancels it (along with the rest of its dialog, which is never asked)                               //
+//       - returns false without using the key if no question is being asked                                                                  //
+//   + cancel()                                                                                                                               //
+//       - cancels the active question, as escape does                                                                                        //
+//   + answer(text)                                                                                                                           //
+//       - answers the active question with text, as if it had been typed and entered; returns false if no question is being asked            //
+//   + draw(screen_w, screen_h, bottom, status)                                                                                               //
+//       - draws the active question and the answer typed so far along the window, its lowest line bottom pixels up, with the lines of        //
+//         status (the operations still running) above it; gl state is restored afterwards                                                    //
+//   + NOTES:                                                                                                                                 //
+//       - questions and their answers are echoed to cout as they're answered or cancelled, so the console keeps a log of the dialogs         //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+class command_prompt {
+  private:
+    struct pending_question {
+      std::string text;
+      std::function<void (const std::string&)> answered;
+    };
+
+    std::deque<pending_question> _questions; // the front one is being asked
+    std::string _answer;             // typed so far
+    bool _answering;                 // inside an answered() callback
+    int _follow_ups;                 // questions asked by the callback so far (inserted after each other, ahead of the rest)
+
+    void _enter(const std::string& answer);
+
+  public:
+    command_prompt();
+
+    void ask(const std::string& text, const std::function<void (const std::string&)>& answered);
+    bool key(unsigned char key);
+    bool answer(const std::string& text);
+    void cancel();
+
+    bool active() const;
+    std::string question() const; // the active question's text
+    std::string typed() const;    // the answer typed so far
+    int queued() const;           // questions waiting behind the active one
+
+    void draw(int screen_w, int screen_h, int bottom, const std::vector<std::string>& status) const;
+};
+
+#endif
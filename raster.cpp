@@ -0,0 +1,639 @@
+// File: raster.cpp
+// Written by Joshua Green
+
+#include "raster.h"
+#include "model3d.h"
+#include "paged.h"
+#include "parallel.h"
+#include "trace.h"
+#include "fileio/fileio.h"
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define RASTER_SSE2
+  #include <emmintrin.h>
+#endif
+using namespace std;
+
+namespace {
+  const float PI = 3.14159265f;
+  const float GUARD_BAND = 4.0f;   // x and y are clipped at this multiple of w (few faces reach it; the edge functions stay precise)
+  const int GEOMETRY_FACES = 1024; // faces per parallel_for chunk of the geometry pass
+  const int CLIP_VERTICES = 64;    // a clipped face's vertices (clipping a convex face to six planes adds at most six)
+  const int FAN_SPAN = CLIP_VERTICES-8;
+
+  // a vertex in clip space with its lit color
+  struct clip_vertex {
+    float p[4];
+    float c[3];
+  };
+
+  float dot3(const float* a, const float* b) { return a[0]*b[0] + a[1]*b[1] + a[2]*b[2]; }
+
+  void normalize3(float* v) {
+    float length = sqrt(dot3(v, v));
+    if (length > 0.0f) for (int i=0;i<3;i++) v[i] /= length;
+  }
+
+  // the signed distance of v inside clip plane (negative outside): near, far, then the guard band's four sides
+  float plane_distance(const clip_vertex& v, int plane) {
+    switch (plane) {
+      case 0: return v.p[2] + v.p[3];
+      case 1: return v.p[3] - v.p[2];
+      case 2: return GUARD_BAND*v.p[3] - v.p[0];
+      case 3: return GUARD_BAND*v.p[3] + v.p[0];
+      case 4: return GUARD_BAND*v.p[3] - v.p[1];
+      default: return GUARD_BAND*v.p[3] + v.p[1];
+    }
+  }
+
+  // sutherland-hodgman against every plane; returns the clipped vertex count (in, of count vertices, is overwritten)
+  int clip_polygon(clip_vertex* in, int count, clip_vertex* scratch) {
+    for (int plane=0;plane<6 && count>0;plane++) {
+      int out_count = 0;
+      for (int i=0;i<count;i++) {
+        const clip_vertex& a = in[i];
+        const clip_vertex& b = in[(i+1)%count];
+        float da = plane_distance(a, plane), db = plane_distance(b, plane);
+        if (da >= 0.0f) scratch[out_count++] = a;
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+          float t = da/(da-db);
+          clip_vertex& v = scratch[out_count++];
+          for (int k=0;k<4;k++) v.p[k] = a.p[k] + (b.p[k]-a.p[k])*t;
+          for (int k=0;k<3;k++) v.c[k] = a.c[k] + (b.c[k]-a.c[k])*t;
+        }
+      }
+      for (int i=0;i<out_count;i++) in[i] = scratch[i];
+      count = out_count;
+    }
+    return count;
+  }
+
+  bool inside_all_planes(const clip_vertex* v, int count) {
+    for (int i=0;i<count;i++) {
+      for (int plane=0;plane<6;plane++) if (plane_distance(v[i], plane) < 0.0f) return false;
+    }
+    return true;
+  }
+
+  unsigned int pack_color(float r, float g, float b) {
+    unsigned int cr = (unsigned int)(min(max(r, 0.0f), 1.0f)*255.0f + 0.5f);
+    unsigned int cg = (unsigned int)(min(max(g, 0.0f), 1.0f)*255.0f + 0.5f);
+    unsigned int cb = (unsigned int)(min(max(b, 0.0f), 1.0f)*255.0f + 0.5f);
+    return cr | (cg << 8) | (cb << 16) | 0xff000000u;
+  }
+
+  void append_u32_be(string& data, unsigned int value) {
+    data += (char)((value >> 24) & 0xff);
+    data += (char)((value >> 16) & 0xff);
+    data += (char)((value >> 8) & 0xff);
+    data += (char)(value & 0xff);
+  }
+
+  unsigned int png_crc(const string& data, size_t begin) {
+    static unsigned int table[256];
+    static bool built = false;
+    if (!built) {
+      for (unsigned int n=0;n<256;n++) {
+        unsigned int c = n;
+        for (int k=0;k<8;k++) c = (c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1);
+        table[n] = c;
+      }
+      built = true;
+    }
+    unsigned int crc = 0xffffffffu;
+    for (size_t i=begin;i<data.length();i++) crc = table[(crc ^ (unsigned char)data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+  }
+
+  // u32 length | type | data | crc of type and data
+  void append_png_chunk(string& png, const char* type, const string& data) {
+    append_u32_be(png, data.length());
+    size_t begin = png.length();
+    png += type;
+    png += data;
+    append_u32_be(png, png_crc(png, begin));
+  }
+}
+
+// *** BEGIN MATRIX DEFINITIONS ***
+void raster_identity(float* m) {
+  for (int i=0;i<16;i++) m[i] = (i%5 == 0 ? 1.0f : 0.0f);
+}
+
+void raster_multiply(const float* a, const float* b, float* result) {
+  float r[16];
+  for (int c=0;c<4;c++) {
+    for (int row=0;row<4;row++) {
+      r[c*4+row] = a[row]*b[c*4] + a[4+row]*b[c*4+1] + a[8+row]*b[c*4+2] + a[12+row]*b[c*4+3];
+    }
+  }
+  memcpy(result, r, sizeof(r));
+}
+
+void raster_translate(float* m, const vect3f& offset) {
+  float t[16];
+  raster_identity(t);
+  t[12] = offset.x;
+  t[13] = offset.y;
+  t[14] = offset.z;
+  raster_multiply(m, t, m);
+}
+
+void raster_rotate(float* m, float degrees, const vect3f& axis) {
+  float a[3] = { axis.x, axis.y, axis.z };
+  if (dot3(a, a) == 0.0f) return;
+  normalize3(a);
+  float radians = degrees*PI/180.0f, c = cos(radians), s = sin(radians), t = 1.0f-c;
+  float r[16] = { t*a[0]*a[0]+c,      t*a[0]*a[1]+s*a[2], t*a[0]*a[2]-s*a[1], 0.0f,
+                  t*a[0]*a[1]-s*a[2], t*a[1]*a[1]+c,      t*a[1]*a[2]+s*a[0], 0.0f,
+                  t*a[0]*a[2]+s*a[1], t*a[1]*a[2]-s*a[0], t*a[2]*a[2]+c,      0.0f,
+                  0.0f,               0.0f,               0.0f,               1.0f };
+  raster_multiply(m, r, m);
+}
+
+void raster_perspective(float* m, float fovy, float aspect, float near_plane, float far_plane) {
+  float f = 1.0f/tan(fovy*PI/360.0f);
+  for (int i=0;i<16;i++) m[i] = 0.0f;
+  m[0] = f/aspect;
+  m[5] = f;
+  m[10] = (far_plane+near_plane)/(near_plane-far_plane);
+  m[11] = -1.0f;
+  m[14] = 2.0f*far_plane*near_plane/(near_plane-far_plane);
+}
+
+void raster_look_at(float* m, const vect3f& eye, const vect3f& center, const vect3f& up) {
+  float f[3] = { center.x-eye.x, center.y-eye.y, center.z-eye.z }, u[3] = { up.x, up.y, up.z };
+  normalize3(f);
+  float s[3] = { f[1]*u[2]-f[2]*u[1], f[2]*u[0]-f[0]*u[2], f[0]*u[1]-f[1]*u[0] };
+  normalize3(s);
+  float v[3] = { s[1]*f[2]-s[2]*f[1], s[2]*f[0]-s[0]*f[2], s[0]*f[1]-s[1]*f[0] };
+  raster_identity(m);
+  for (int i=0;i<3;i++) {
+    m[i*4+0] = s[i];
+    m[i*4+1] = v[i];
+    m[i*4+2] = -f[i];
+  }
+  raster_translate(m, vect3f(-eye.x, -eye.y, -eye.z));
+}
+
+bool fit_camera(const model3d& model, float fovy, float aspect, float* projection, float* modelview) {
+  vect3f low, high;
+  if (!model.get_bounds(low, high)) return false;
+  vect3f center = (low+high)*0.5f, half = (high-low)*0.5f;
+  float radius = max((float)sqrt(half.x*half.x + half.y*half.y + half.z*half.z), 0.001f);
+
+  // the bounding sphere fits the narrower of the two fields of view
+  float half_angle = min(fovy*PI/360.0f, (float)atan(tan(fovy*PI/360.0f)*aspect));
+  float distance = radius/sin(half_angle);
+  float direction[3] = { 0.5f, 0.4f, 1.0f };
+  normalize3(direction);
+  vect3f eye = center + vect3f(direction[0], direction[1], direction[2])*distance;
+
+  raster_perspective(projection, fovy, aspect, max(distance-radius*1.05f, distance*0.01f), distance+radius*1.05f);
+  raster_look_at(modelview, eye, center, vect3f(0.0f, 1.0f, 0.0f));
+  return true;
+}
+// *** END MATRIX DEFINITIONS ***
+
+// *** BEGIN RASTER_FRAME DEFINITIONS ***
+raster_frame::raster_frame(int width, int height, int thread_count) {
+  _width = max(width, 1);
+  _height = max(height, 1);
+  _stride = (_width+RASTER_TILE-1)/RASTER_TILE*RASTER_TILE;
+  _rows = (_height+RASTER_TILE-1)/RASTER_TILE*RASTER_TILE;
+  _threads = (thread_count < 1 ? hardware_threads() : thread_count);
+  _color.resize((size_t)_stride*_rows);
+  _depth.resize((size_t)_stride*_rows);
+  raster_perspective(_projection, 45.0f, (float)_width/_height, 1.0f, 100.0f);
+  float identity[16];
+  raster_identity(identity);
+  set_light(raster_light(), identity);
+  clear();
+}
+
+int raster_frame::width() const { return _width; }
+int raster_frame::height() const { return _height; }
+const unsigned int* raster_frame::color() const { return &_color[0]; }
+const float* raster_frame::depth() const { return &_depth[0]; }
+const float* raster_frame::projection() const { return _projection; }
+
+void raster_frame::clear(const vect3f& color) {
+  _triangles.clear();
+  fill(_color.begin(), _color.end(), pack_color(color.x, color.y, color.z));
+  fill(_depth.begin(), _depth.end(), 1.0f);
+}
+
+void raster_frame::set_projection(const float* projection) { memcpy(_projection, projection, sizeof(_projection)); }
+
+void raster_frame::set_light(const raster_light& light, const float* modelview) {
+  _light = light;
+  const vect4f& p = light.position;
+  const float* const m = modelview;
+  _light_position = vect4f(m[0]*p.x + m[4]*p.y + m[8]*p.z + m[12]*p.a,
+                           m[1]*p.x + m[5]*p.y + m[9]*p.z + m[13]*p.a,
+                           m[2]*p.x + m[6]*p.y + m[10]*p.z + m[14]*p.a,
+                           m[3]*p.x + m[7]*p.y + m[11]*p.z + m[15]*p.a);
+}
+
+raster_stats raster_frame::stats() const { return _stats; }
+void raster_frame::reset_stats() { _stats = raster_stats(); }
+
+void raster_frame::draw(const model3d& model, const float* modelview) {
+  TRACE_SPAN(draw_span, "raster_frame::draw");
+  model.rasterize(*this, modelview);
+  _flush();
+}
+
+// transforms and lights each face, clips it and fans it into screen space triangles
+void raster_frame::add_faces(const page_chunk& faces, const float* modelview) {
+  const int face_count = faces.face_sizes.size();
+  if (face_count == 0) return;
+  vector<size_t> offsets(face_count+1, 0);
+  for (int i=0;i<face_count;i++) offsets[i+1] = offsets[i] + faces.face_sizes[i];
+
+  const float* const m = modelview;
+  float mvp[16];
+  raster_multiply(_projection, modelview, mvp);
+  const float width = _width, height = _height;
+  const vect4f light = _light_position;
+
+  vector<vector<triangle>> parts((face_count+GEOMETRY_FACES-1)/GEOMETRY_FACES);
+  vector<long long int> clipped(parts.size(), 0);
+  parallel_for(0, face_count, GEOMETRY_FACES, [&](long long int begin, long long int end) {
+    vector<triangle>& out = parts[begin/GEOMETRY_FACES];
+    clip_vertex polygon[CLIP_VERTICES], scratch[CLIP_VERTICES];
+
+    for (long long int face=begin;face<end;face++) {
+      const int size = faces.face_sizes[face];
+      if (size < 3) continue;
+
+      // a face of more than FAN_SPAN+1 points is split into fans sharing its first point, leaving room for clipped vertices
+      for (int fan=1;fan+1<size;fan+=FAN_SPAN) {
+        int count = 0, last = min(fan+FAN_SPAN, size-1);
+        for (int j=fan-1;j<=last;j++) {
+          size_t k = offsets[face] + (j < fan ? 0 : j);
+          const float* const p = &faces.points[k*3];
+          const float* const c = &faces.colors[k*3];
+          const float* const n = &faces.normals[k*3];
+          clip_vertex& v = polygon[count++];
+          for (int r=0;r<4;r++) v.p[r] = mvp[r]*p[0] + mvp[4+r]*p[1] + mvp[8+r]*p[2] + mvp[12+r];
+
+          if (!_light.enabled) {
+            for (int r=0;r<3;r++) v.c[r] = c[r];
+            continue;
+          }
+          float eye[3], normal[3], to_light[3];
+          for (int r=0;r<3;r++) {
+            eye[r] = m[r]*p[0] + m[4+r]*p[1] + m[8+r]*p[2] + m[12+r];
+            normal[r] = m[r]*n[0] + m[4+r]*n[1] + m[8+r]*n[2];
+          }
+          normalize3(normal);
+          if (light.a == 0.0f) { to_light[0] = light.x; to_light[1] = light.y; to_light[2] = light.z; }
+          else { to_light[0] = light.x/light.a - eye[0]; to_light[1] = light.y/light.a - eye[1]; to_light[2] = light.z/light.a - eye[2]; }
+          normalize3(to_light);
+
+          float diffuse = dot3(normal, to_light), highlight = 0.0f;
+          if (_light.specular && diffuse > 0.0f) {
+            float half_vector[3] = { to_light[0], to_light[1], to_light[2] }, to_eye[3] = { -eye[0], -eye[1], -eye[2] };
+            normalize3(to_eye);
+            for (int r=0;r<3;r++) half_vector[r] += to_eye[r];
+            normalize3(half_vector);
+            highlight = pow(max(dot3(normal, half_vector), 0.0f), _light.shininess);
+          }
+          diffuse = max(diffuse, 0.0f);
+          const float ambient[3] = { _light.ambient.x, _light.ambient.y, _light.ambient.z };
+          for (int r=0;r<3;r++) v.c[r] = min(c[r]*(ambient[r] + diffuse) + highlight, 1.0f);
+        }
+
+        if (!inside_all_planes(polygon, count)) {
+          count = clip_polygon(polygon, count, scratch);
+          clipped[begin/GEOMETRY_FACES]++;
+        }
+
+        for (int j=1;j+1<count;j++) {
+          const clip_vertex* v[3] = { &polygon[0], &polygon[j], &polygon[j+1] };
+          triangle t;
+          for (int r=0;r<3;r++) {
+            float inv_w = 1.0f/v[r]->p[3];
+            t.x[r] = (v[r]->p[0]*inv_w*0.5f + 0.5f)*width;
+            t.y[r] = (0.5f - v[r]->p[1]*inv_w*0.5f)*height;
+            t.z[r] = v[r]->p[2]*inv_w*0.5f + 0.5f;
+            t.inv_w[r] = inv_w;
+            for (int q=0;q<3;q++) t.color[r][q] = v[r]->c[q]*inv_w;
+          }
+
+          float area = (t.x[1]-t.x[0])*(t.y[2]-t.y[0]) - (t.y[1]-t.y[0])*(t.x[2]-t.x[0]);
+          if (area == 0.0f) continue;
+          if (area < 0.0f) { // wound the other way: swap two corners so the edge functions are positive inside
+            swap(t.x[1], t.x[2]);
+            swap(t.y[1], t.y[2]);
+            swap(t.z[1], t.z[2]);
+            swap(t.inv_w[1], t.inv_w[2]);
+            for (int q=0;q<3;q++) swap(t.color[1][q], t.color[2][q]);
+          }
+
+          // the pixels whose centers lie within the triangle's bounds
+          t.low_x = max(0, (int)ceil(min(t.x[0], min(t.x[1], t.x[2])) - 0.5f));
+          t.low_y = max(0, (int)ceil(min(t.y[0], min(t.y[1], t.y[2])) - 0.5f));
+          t.high_x = min(_width-1, (int)floor(max(t.x[0], max(t.x[1], t.x[2])) - 0.5f));
+          t.high_y = min(_height-1, (int)floor(max(t.y[0], max(t.y[1], t.y[2])) - 0.5f));
+          if (t.low_x > t.high_x || t.low_y > t.high_y) continue;
+          out.push_back(t);
+        }
+      }
+    }
+  }, _threads);
+
+  // in submission order, so that equal depths resolve as they would with gl (the first drawn is kept)
+  _stats.faces += face_count;
+  for (int i=0;i<parts.size();i++) {
+    _triangles.insert(_triangles.end(), parts[i].begin(), parts[i].end());
+    _stats.clipped += clipped[i];
+  }
+  if (_triangles.size() >= RASTER_BATCH) _flush();
+}
+
+void raster_frame::_flush() {
+  if (_triangles.empty()) return;
+  TRACE_SPAN(flush_span, "raster_frame::flush");
+  TRACE_ARG(flush_span, "triangles", _triangles.size());
+
+  const int tiles_x = _stride/RASTER_TILE, tiles_y = _rows/RASTER_TILE;
+  vector<vector<int>> bins(tiles_x*tiles_y);
+  for (int i=0;i<_triangles.size();i++) {
+    const triangle& t = _triangles[i];
+    for (int y=t.low_y/RASTER_TILE;y<=t.high_y/RASTER_TILE;y++) {
+      for (int x=t.low_x/RASTER_TILE;x<=t.high_x/RASTER_TILE;x++) bins[y*tiles_x+x].push_back(i);
+    }
+  }
+
+  vector<long long int> pixels(bins.size(), 0);
+  parallel_for(0, bins.size(), 1, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      if (!bins[i].empty()) _draw_tile(i%tiles_x, i/tiles_x, bins[i], pixels[i]);
+    }
+  }, _threads);
+
+  _stats.triangles += _triangles.size();
+  for (int i=0;i<pixels.size();i++) _stats.pixels += pixels[i];
+  _triangles.clear();
+}
+
+// edge functions are evaluated relative to each pixel group in double precision (then stepped across the group in float), so
+//   the two triangles sharing an edge compute exactly opposite values and the top-left rule gives each pixel to exactly one of them
+void raster_frame::_draw_tile(int tile_x, int tile_y, const vector<int>& bin, long long int& pixels) {
+  const int tile_left = tile_x*RASTER_TILE, tile_top = tile_y*RASTER_TILE;
+
+  for (int b=0;b<bin.size();b++) {
+    const triangle& t = _triangles[bin[b]];
+    const int top = max(t.low_y, tile_top), bottom = min(t.high_y, tile_top+RASTER_TILE-1);
+    const int left = max(t.low_x, tile_left)/4*4, right = min(t.high_x, tile_left+RASTER_TILE-1);
+
+    // w_e(x, y) = a[e]*x + b[e]*y + c[e], positive inside (the weight of the corner opposite edge e)
+    double a[3], b_[3], c[3];
+    bool top_left[3];
+    for (int e=0;e<3;e++) {
+      int i = (e+1)%3, j = (e+2)%3;
+      a[e] = (double)t.y[i] - t.y[j];
+      b_[e] = (double)t.x[j] - t.x[i];
+      c[e] = (double)t.x[i]*t.y[j] - (double)t.y[i]*t.x[j];
+      top_left[e] = (a[e] > 0.0 || (a[e] == 0.0 && b_[e] > 0.0));
+    }
+    const float inv_area = (float)(1.0/(a[0]*t.x[0] + b_[0]*t.y[0] + c[0]));
+    const float z0 = t.z[0], dz1 = t.z[1]-t.z[0], dz2 = t.z[2]-t.z[0];
+    const float w0 = t.inv_w[0], dw1 = t.inv_w[1]-t.inv_w[0], dw2 = t.inv_w[2]-t.inv_w[0];
+    float c0[3], dc1[3], dc2[3];
+    for (int q=0;q<3;q++) {
+      c0[q] = t.color[0][q];
+      dc1[q] = t.color[1][q]-t.color[0][q];
+      dc2[q] = t.color[2][q]-t.color[0][q];
+    }
+
+    #ifdef RASTER_SSE2
+      const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+      __m128 step[3], tl_mask[3];
+      for (int e=0;e<3;e++) {
+        step[e] = _mm_mul_ps(_mm_set1_ps((float)a[e]), lanes);
+        tl_mask[e] = _mm_castsi128_ps(_mm_set1_epi32(top_left[e] ? -1 : 0));
+      }
+    #endif
+
+    for (int y=top;y<=bottom;y++) {
+      float* const depth_row = &_depth[(size_t)y*_stride];
+      unsigned int* const color_row = &_color[(size_t)y*_stride];
+      double row[3]; // w_e at x = 0 on this row
+      for (int e=0;e<3;e++) row[e] = b_[e]*(y + 0.5) + c[e];
+
+      #ifdef RASTER_SSE2
+        for (int x=left;x<=right;x+=4) {
+          const double px = x + 0.5;
+          __m128 w[3], mask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+          for (int e=0;e<3;e++) {
+            w[e] = _mm_add_ps(_mm_set1_ps((float)(a[e]*px + row[e])), step[e]);
+            __m128 inside = _mm_or_ps(_mm_cmpgt_ps(w[e], zero), _mm_and_ps(tl_mask[e], _mm_cmpeq_ps(w[e], zero)));
+            mask = _mm_and_ps(mask, inside);
+          }
+          if (_mm_movemask_ps(mask) == 0) continue;
+
+          const __m128 l1 = _mm_mul_ps(w[1], _mm_set1_ps(inv_area)), l2 = _mm_mul_ps(w[2], _mm_set1_ps(inv_area));
+          const __m128 z = _mm_add_ps(_mm_set1_ps(z0), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dz1), l1), _mm_mul_ps(_mm_set1_ps(dz2), l2)));
+          const __m128 old_depth = _mm_loadu_ps(depth_row+x);
+          mask = _mm_and_ps(mask, _mm_cmplt_ps(z, old_depth));
+          const int covered = _mm_movemask_ps(mask);
+          if (covered == 0) continue;
+          _mm_storeu_ps(depth_row+x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old_depth)));
+
+          const __m128 inv_w = _mm_add_ps(_mm_set1_ps(w0), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dw1), l1), _mm_mul_ps(_mm_set1_ps(dw2), l2)));
+          __m128i rgba = _mm_set1_epi32((int)0xff000000u);
+          for (int q=0;q<3;q++) {
+            __m128 value = _mm_add_ps(_mm_set1_ps(c0[q]), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dc1[q]), l1), _mm_mul_ps(_mm_set1_ps(dc2[q]), l2)));
+            value = _mm_min_ps(_mm_max_ps(_mm_div_ps(value, inv_w), zero), one);
+            __m128i channel = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), _mm_set1_ps(0.5f)));
+            if (q == 1) channel = _mm_slli_epi32(channel, 8);
+            else if (q == 2) channel = _mm_slli_epi32(channel, 16);
+            rgba = _mm_or_si128(rgba, channel);
+          }
+          const __m128i select = _mm_castps_si128(mask);
+          const __m128i old_color = _mm_loadu_si128((const __m128i*)(color_row+x));
+          _mm_storeu_si128((__m128i*)(color_row+x), _mm_or_si128(_mm_and_si128(select, rgba), _mm_andnot_si128(select, old_color)));
+          pixels += (covered & 1) + ((covered >> 1) & 1) + ((covered >> 2) & 1) + ((covered >> 3) & 1);
+        }
+      #else
+        for (int x=max(t.low_x, tile_left);x<=right;x++) {
+          const double px = x + 0.5;
+          float w[3];
+          bool inside = true;
+          for (int e=0;e<3;e++) {
+            w[e] = (float)(a[e]*px + row[e]);
+            inside = inside && (w[e] > 0.0f || (w[e] == 0.0f && top_left[e]));
+          }
+          if (!inside) continue;
+          const float l1 = w[1]*inv_area, l2 = w[2]*inv_area;
+          const float z = z0 + dz1*l1 + dz2*l2;
+          if (!(z < depth_row[x])) continue;
+          depth_row[x] = z;
+          const float inv_w = w0 + dw1*l1 + dw2*l2;
+          float value[3];
+          for (int q=0;q<3;q++) value[q] = (c0[q] + dc1[q]*l1 + dc2[q]*l2)/inv_w;
+          color_row[x] = pack_color(value[0], value[1], value[2]);
+          pixels++;
+        }
+      #endif
+    }
+  }
+}
+
+bool raster_frame::save_ppm(const string& filename) const {
+  string data = "P6\n" + to_string(_width) + " " + to_string(_height) + "\n255\n";
+  data.reserve(data.length() + (size_t)_width*_height*3);
+  for (int y=0;y<_height;y++) {
+    for (int x=0;x<_width;x++) {
+      unsigned int rgba = _color[(size_t)y*_stride+x];
+      data += (char)(rgba & 0xff);
+      data += (char)((rgba >> 8) & 0xff);
+      data += (char)((rgba >> 16) & 0xff);
+    }
+  }
+
+  fileio file;
+  file.open(filename, "w");
+  if (!file.is_open()) return false;
+  file.write(data);
+  file.close();
+  return true;
+}
+
+// the image data is zlib "stored" blocks (no compression), which every png reader accepts and needs no deflate implementation
+bool raster_frame::save_png(const string& filename) const {
+  string raw;
+  raw.reserve((size_t)(_width*4+1)*_height);
+  for (int y=0;y<_height;y++) {
+    raw += (char)0; // no filter
+    raw.append((const char*)&_color[(size_t)y*_stride], (size_t)_width*4);
+  }
+
+  string zlib;
+  zlib += (char)0x78;
+  zlib += (char)0x01;
+  unsigned int adler_a = 1, adler_b = 0;
+  for (size_t i=0;i<raw.length();i++) {
+    adler_a = (adler_a + (unsigned char)raw[i]) % 65521;
+    adler_b = (adler_b + adler_a) % 65521;
+  }
+  for (size_t pos=0;pos<raw.length() || pos==0;pos+=65535) {
+    size_t length = min((size_t)65535, raw.length()-pos);
+    zlib += (char)(pos+length >= raw.length() ? 1 : 0); // final block flag
+    zlib += (char)(length & 0xff);
+    zlib += (char)((length >> 8) & 0xff);
+    zlib += (char)(~length & 0xff);
+    zlib += (char)((~length >> 8) & 0xff);
+    zlib.append(raw, pos, length);
+    if (length == 0) break;
+  }
+  append_u32_be(zlib, (adler_b << 16) | adler_a);
+
+  string header;
+  append_u32_be(header, _width);
+  append_u32_be(header, _height);
+  header += (char)8; // bit depth
+  header += (char)6; // RGBA
+  header += string(3, (char)0); // deflate, adaptive filtering, no interlace
+
+  string png("\x89PNG\r\n\x1a\n", 8);
+  append_png_chunk(png, "IHDR", header);
+  append_png_chunk(png, "IDAT", zlib);
+  append_png_chunk(png, "IEND", string());
+
+  fileio file;
+  file.open(filename, "w");
+  if (!file.is_open()) return false;
+  file.write(png);
+  file.close();
+  return true;
+}
+// *** END RASTER_FRAME DEFINITIONS ***
+
+// *** BEGIN MODEL3D RASTERIZATION DEFINITIONS ***
+// the transforms mirror model3d::draw(): the model rotates about its position, then is moved to it; sub models share the rotation
+void model3d::rasterize(raster_frame& frame, const float* modelview) const {
+  float rotation[16], m[16];
+  raster_identity(rotation);
+  raster_translate(rotation, _pos);
+  raster_rotate(rotation, _orientation, _axis);
+  raster_translate(rotation, vect3f(-_pos.x, -_pos.y, -_pos.z));
+
+  memcpy(m, modelview, sizeof(m));
+  if (!_anchored) raster_multiply(m, rotation, m);
+  raster_translate(m, _pos);
+
+  int level = (use_lods && !_lods.empty() ? select_lod(frame.projection(), m, frame.height()) : 0);
+  if (level > 0) _lods[level-1]._rasterize_faces(frame, m);
+  else if (_paged) {
+    view_frustum frustum(frame.projection(), m);
+    vector<int> visible;
+    for (int i=0;i<_paged->chunk_count();i++) {
+      if (frustum.intersects(_paged->info(i).low, _paged->info(i).high)) visible.push_back(i);
+    }
+    _paged->visit(visible, [&](int, const page_chunk& chunk) { frame.add_faces(chunk, m); });
+  }
+  else _rasterize_faces(frame, m);
+
+  float sub[16];
+  raster_multiply(modelview, rotation, sub);
+  raster_translate(sub, _pos);
+  for (int i=0;i<_sub_models.size();i++) _sub_models[i].rasterize(frame, sub);
+}
+
+// de-indexed into page_chunk batches of about PAGE_FACETS facets (the form paged models are already in)
+void model3d::_rasterize_faces(raster_frame& frame, const float* modelview) const {
+  page_chunk batch;
+  size_t facets = 0;
+  auto append = [&](const vect3f& point, const vect3f& color, const vect3f& normal) {
+    batch.points.push_back(point.x); batch.points.push_back(point.y); batch.points.push_back(point.z);
+    batch.colors.push_back(color.x); batch.colors.push_back(color.y); batch.colors.push_back(color.z);
+    batch.normals.push_back(normal.x); batch.normals.push_back(normal.y); batch.normals.push_back(normal.z);
+  };
+  auto submit = [&]() {
+    frame.add_faces(batch, modelview);
+    batch.face_sizes.clear();
+    batch.points.clear();
+    batch.colors.clear();
+    batch.normals.clear();
+    facets = 0;
+  };
+
+  if (_compact) {
+    size_t offset = 0;
+    vect3f color, normal;
+    for (int i=0;i<_compact_face_sizes.size();i++) {
+      for (int j=0;j<_compact_face_sizes[i];j++) {
+        const compact_facet& f = _compact_facets[offset+j];
+        _decode_facet(f, color, normal);
+        append(_decode_coordinate(f.id), color, normal);
+      }
+      batch.face_sizes.push_back(_compact_face_sizes[i]);
+      offset += _compact_face_sizes[i];
+      facets += _compact_face_sizes[i];
+      if (facets >= PAGE_FACETS) submit();
+    }
+  }
+  else {
+    for (int i=0;i<_facet_data.size();i++) {
+      for (int j=0;j<_facet_data[i].size();j++) {
+        const facet& f = _facet_data[i][j];
+        append(_coordinates[f.id], _colors[f.color], _normals[f.normal]);
+      }
+      batch.face_sizes.push_back(_facet_data[i].size());
+      facets += _facet_data[i].size();
+      if (facets >= PAGE_FACETS) submit();
+    }
+  }
+  if (!batch.face_sizes.empty()) submit();
+}
+// *** END MODEL3D RASTERIZATION DEFINITIONS ***
@@ -0,0 +1,114 @@
+// File: raster.h
+// Written by Joshua Green
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "model3d.h"
+#include "vectXf.h"
+#include "paged.h"
+#include <vector>
+#include <string>
+
+// ---------------------------------------------------------- SOFTWARE RASTERIZER ----------------------------------------------------------- //
+//   + raster_frame(width, height, thread_count=0)                                                                                            //
+//       - an RGBA8 color buffer and a depth buffer, drawn to on the cpu (no gl context or window needed)                                     //
+//       - a thread_count of zero uses hardware_threads(); one draws on the calling thread                                                    //
+//   + clear(color)                                                                                                                           //
+//       - fills the color buffer with color and the depth buffer with the far plane                                                          //
+//   + set_projection(projection) / set_light(light, modelview)                                                                               //
+//       - column major matrices, as glGetFloatv() returns them; the light's position is taken through modelview, as                          //
+//         glLightfv(GL_LIGHT0, GL_POSITION) takes it through the current modelview matrix                                                    //
+//   + draw(model, modelview)                                                                                                                 //
+//       - draws model (its sub models, position, axis and orientation, levels of detail and paged chunks included, as model3d::draw()        //
+//         does) and returns once every pixel is written                                                                                      //
+//   + save_ppm(filename) / save_png(filename)                                                                                                //
+//       - writes the color buffer (the png is 8 bit RGBA, stored without compression)                                                        //
+//   + fit_camera(model, fovy, aspect, projection, modelview)                                                                                 //
+//       - a perspective projection and a modelview looking down at model's bounds from the front right, with the model filling the view      //
+//   + NOTES:                                                                                                                                 //
+//       - lighting reproduces the modeler's fixed function setup: one positional light (white diffuse, optional specular, local viewer)      //
+//         and the global ambient, with each facet's color as the ambient and diffuse material, evaluated per vertex and interpolated         //
+//         (perspective correct) across the face; faces are filled whatever the model's draw mode, and no faces are culled                    //
+//       - faces are transformed and lit in parallel, fanned into triangles and clipped (to the near plane and a guard band), then binned     //
+//         into RASTER_TILE square tiles that are drawn concurrently: a tile is only written by one thread, so no locks are taken             //
+//       - edge functions, depth and color are evaluated four pixels at a time with sse2 where it's available (plain c++ otherwise)           //
+//       - triangles are drawn (in the order they were submitted) whenever RASTER_BATCH of them are waiting, bounding the memory held         //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+const int RASTER_TILE = 64;
+const int RASTER_BATCH = 1<<18;
+
+// the modeler's LIGHT0 (see init_lighting() in modeler.cpp)
+struct raster_light {
+  bool enabled;    // false draws each facet's color as it is (the modeler with its lights off)
+  vect4f position; // w of zero is a directional light
+  vect3f ambient;  // GL_LIGHT_MODEL_AMBIENT
+  bool specular;   // USE_SPECULAR: a white highlight of shininess
+  float shininess;
+
+  raster_light() : enabled(true), position(1.0f, 1.0f, 1.0f, 1.0f), ambient(0.2f, 0.2f, 0.2f), specular(false), shininess(50.0f) { }
+};
+
+struct raster_stats {
+  long long int faces, triangles, clipped, pixels; // triangles drawn (after clipping) and pixels that passed the depth test
+
+  raster_stats() : faces(0), triangles(0), clipped(0), pixels(0) { }
+};
+
+class raster_frame {
+  private:
+    // a screen space triangle: x, y in pixels (y down), z in [0, 1], and the reciprocal of w to interpolate the colors with
+    struct triangle {
+      float x[3], y[3], z[3], inv_w[3];
+      float color[3][3]; // divided by w
+      int low_x, low_y, high_x, high_y; // inclusive pixel bounds (within the frame)
+    };
+
+    int _width, _height, _stride, _rows; // _stride and _rows are whole tiles
+    int _threads;
+    std::vector<unsigned int> _color; // RGBA8, a byte per channel in that order
+    std::vector<float> _depth;
+    float _projection[16];
+    raster_light _light;
+    vect4f _light_position; // eye space
+    std::vector<triangle> _triangles; // waiting to be drawn
+    raster_stats _stats;
+
+    void _flush();
+    void _draw_tile(int tile_x, int tile_y, const std::vector<int>& bin, long long int& pixels);
+
+  public:
+    raster_frame(int width, int height, int thread_count=0);
+
+    int width() const;
+    int height() const;
+    const unsigned int* color() const;
+    const float* depth() const;
+    const float* projection() const;
+
+    void clear(const vect3f& color=vect3f(0.0f, 0.0f, 0.0f));
+    void set_projection(const float* projection);
+    void set_light(const raster_light& light, const float* modelview);
+
+    void draw(const model3d& model, const float* modelview);
+    void add_faces(const page_chunk& faces, const float* modelview); // (for model3d::rasterize()) queues faces for drawing
+
+    raster_stats stats() const;
+    void reset_stats();
+
+    bool save_ppm(const std::string& filename) const;
+    bool save_png(const std::string& filename) const;
+};
+
+// column major 4x4 matrices, as gl keeps them
+void raster_identity(float* m);
+void raster_multiply(const float* a, const float* b, float* result); // result = a*b (result may be a or b)
+void raster_translate(float* m, const vect3f& offset);               // m = m*translation, as glTranslatef()
+void raster_rotate(float* m, float degrees, const vect3f& axis);     // m = m*rotation, as glRotatef()
+void raster_perspective(float* m, float fovy, float aspect, float near_plane, float far_plane); // as gluPerspective()
+void raster_look_at(float* m, const vect3f& eye, const vect3f& center, const vect3f& up);       // as gluLookAt()
+
+bool fit_camera(const model3d& model, float fovy, float aspect, float* projection, float* modelview); // false for an empty model
+
+#endif
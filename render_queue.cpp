@@ -0,0 +1,204 @@
+// File: render_queue.cpp
+// Written by Joshua Green
+
+#include "render_queue.h"
+#include "vectXf.h"
+#include "profiler.h"
+#include "shader.h"
+
+#include <GL/gl.h>
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+// *** BEGIN RENDER_QUEUE DEFINITIONS ***
+render_queue::render_queue() : _program(0), _vertex_shininess(0.0f) { }
+
+bool render_queue::_shading(const render_state& state) const {
+  #ifdef USE_GLSL_LIGHTING
+    return (state.lighting && state.shaded && _program && _program->loaded());
+  #else
+    return false;
+  #endif
+}
+
+unsigned long long render_queue::_key(const render_state& state, float depth) const {
+  if (state.translucent) {
+    // the depth's bits, made to order as the float does, then inverted so the farthest item sorts first
+    unsigned int bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    bits = ((bits & 0x80000000u) ? ~bits : (bits | 0x80000000u));
+    return (1ULL << 63) | (unsigned long long)(~bits);
+  }
+
+  unsigned long long key = 0;
+  key |= (unsigned long long)(state.lighting ? 0 : 1) << 62; // lit first: the translucent items and what follows the queue are unlit
+  key |= (unsigned long long)(_shading(state) ? 0 : 1) << 61;
+  key |= (unsigned long long)min(max(state.material, 0), 0xFFFF) << 45;
+  key |= (unsigned long long)(0xFF - min(max((int)(state.line_width*4.0f + 0.5f), 0), 0xFF)) << 37; // quarter pixels, widest first
+  key |= (unsigned long long)(state.draw_mode & 0xF) << 33;
+  return key;
+}
+
+// least significant digit first, a byte at a time; each pass is stable, and a pass is skipped when every key shares its digit
+void render_queue::_sort() {
+  int n = _items.size();
+  _order.resize(n);
+  _scratch.resize(n);
+  for (int i=0;i<n;i++) _order[i] = i;
+  if (n < 2) return;
+
+  for (int shift=0;shift<64;shift+=8) {
+    int counts[257] = { 0 };
+    for (int i=0;i<n;i++) counts[((_items[_order[i]].key >> shift) & 0xFF) + 1]++;
+    if (counts[((_items[_order[0]].key >> shift) & 0xFF) + 1] == n) continue;
+
+    for (int i=0;i<256;i++) counts[i+1] += counts[i];
+    for (int i=0;i<n;i++) _scratch[counts[(_items[_order[i]].key >> shift) & 0xFF]++] = _order[i];
+    _order.swap(_scratch);
+  }
+}
+
+int render_queue::_apply(const render_state& next, applied& current, bool issue) const {
+  int calls = 0;
+  if (!current.known || next.lighting != current.state.lighting) {
+    if (issue) {
+      if (next.lighting) glEnable(GL_LIGHTING);
+      else glDisable(GL_LIGHTING);
+    }
+    calls++;
+  }
+  if (!current.known || next.translucent != current.state.translucent) {
+    if (issue) glDepthMask(next.translucent ? GL_FALSE : GL_TRUE);
+    calls++;
+  }
+  if (!current.known || next.line_width != current.state.line_width) {
+    if (issue) glLineWidth(next.line_width);
+    calls++;
+  }
+  bool shade = false;
+  #ifdef USE_GLSL_LIGHTING
+    shade = _shading(next);
+    bool shading = (current.known && _shading(current.state));
+    if (!current.known || shade != shading) {
+      if (issue) {
+        if (shade) _program->bind();
+        else lighting_program::unbind();
+      }
+      calls++;
+    }
+    if (shade && (!shading || next.material != current.state.material)) {
+      if (issue) {
+        if (next.material > 0) {
+          const material_values& m = _materials[next.material-1];
+          _program->set_material(true, m.diffuse, m.specular, m.shine.x);
+        }
+        else _program->set_material(false, vect4f(), _vertex_specular, _vertex_shininess);
+      }
+      calls++;
+    }
+  #endif
+  if (!shade && next.lighting && next.material > 0) {
+    if (issue) {
+      const material_values& m = _materials[next.material-1];
+      glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, m.diffuse);
+      glMaterialfv(GL_FRONT, GL_SPECULAR, m.specular);
+      glMaterialfv(GL_FRONT, GL_SHININESS, m.shine);
+      PROFILE_COUNT(COUNTER_MATERIAL_CHANGES, 3);
+    }
+    calls += 3;
+  }
+
+  current.state = next;
+  current.known = true;
+  return calls;
+}
+
+void render_queue::submit(const render_state& state, const float* modelview, const function<void ()>& draw, float depth) {
+  _items.push_back(item());
+  item& added = _items.back();
+  added.key = _key(state, depth);
+  added.state = state;
+  memcpy(added.modelview, modelview, sizeof(added.modelview));
+  added.draw = draw;
+}
+
+int render_queue::material(const vect4f& diffuse, const vect4f& specular, const vect4f& shine) {
+  for (int i=0;i<_materials.size();i++) {
+    const material_values& m = _materials[i];
+    if (m.diffuse == diffuse && m.specular == specular && m.shine == shine) return i+1;
+  }
+  _materials.push_back(material_values());
+  _materials.back().diffuse = diffuse;
+  _materials.back().specular = specular;
+  _materials.back().shine = shine;
+  return _materials.size();
+}
+
+void render_queue::execute() {
+  _stats = render_queue_stats();
+  _stats.items = _items.size();
+  if (_items.empty()) return;
+
+  _sort();
+
+  // the cost of the submission order, for stats()
+  applied unsorted;
+  for (int i=0;i<_items.size();i++) _stats.unsorted_state_calls += _apply(_items[i].state, unsorted, false);
+  if (unsorted.state.translucent) _stats.unsorted_state_calls++; // (depth writes restored)
+  if (_shading(unsorted.state)) _stats.unsorted_state_calls++;
+
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+
+  applied current;
+  for (int i=0;i<_order.size();i++) {
+    const item& next = _items[_order[i]];
+    _stats.state_calls += _apply(next.state, current, true);
+    if (next.state.translucent) _stats.translucent++;
+
+    glLoadMatrixf(next.modelview);
+    _stats.matrix_loads++;
+    next.draw();
+  }
+
+  glPopMatrix();
+  if (current.state.translucent) {
+    glDepthMask(GL_TRUE);
+    _stats.state_calls++;
+  }
+  #ifdef USE_GLSL_LIGHTING
+    if (_shading(current.state)) { // (what follows the queue is fixed function)
+      lighting_program::unbind();
+      _stats.state_calls++;
+    }
+  #endif
+}
+
+void render_queue::set_program(lighting_program* program, const vect4f& specular, float shininess) {
+  _program = program;
+  _vertex_specular = specular;
+  _vertex_shininess = shininess;
+}
+
+void render_queue::clear() {
+  _items.clear();
+  _materials.clear();
+}
+
+int render_queue::size() const { return _items.size(); }
+
+render_queue_stats render_queue::stats() const { return _stats; }
+
+void render_queue::current_modelview(float* modelview) {
+  for (int i=0;i<16;i++) modelview[i] = (i%5 == 0 ? 1.0f : 0.0f);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+}
+// *** END RENDER_QUEUE DEFINITIONS ***
+
+float view_depth(const float* modelview, const vect3f& point) {
+  return -(modelview[2]*point.x + modelview[6]*point.y + modelview[10]*point.z + modelview[14]);
+}
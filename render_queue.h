@@ -0,0 +1,116 @@
+// File: render_queue.h
+// Written by Joshua Green
+
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include "vectXf.h"
+#include <GL/gl.h>
+#include <vector>
+#include <functional>
+
+class lighting_program;
+
+// -------------------------------------------------------------- RENDER QUEUE -------------------------------------------------------------- //
+//   + submit(state, modelview, draw, depth=0)                                                                                                //
+//       - queues draw (which issues its own glBegin()/glEnd() pairs) to be called with state set and modelview loaded                        //
+//       - depth is the item's distance from the eye, used to order translucent items (farthest first)                                        //
+//   + material(diffuse, specular, shine)                                                                                                     //
+//       - the id of a material for render_state::material (equal materials share an id until clear())                                        //
+//   + execute()                                                                                                                              //
+//       - sorts the items by state (radix sort on a packed key) and draws them, setting only the state that differs from the                 //
+//         item before; opaque items are drawn first, then the translucent ones back to front with depth writes off                           //
+//       - the modelview matrix and depth writes are restored afterwards (lighting and the line width are left as the last item set them)     //
+//   + set_program(program, specular, shininess)                                                                                              //
+//       - lit items with render_state::shaded are drawn through program (see shader.h), their materials set as its uniforms;                 //
+//         items without a material take their vertices' colors with specular and shininess (display()'s USE_SPECULAR material)               //
+//   + clear()                                                                                                                                //
+//       - drops the items and materials (once per frame)                                                                                     //
+//   + stats()                                                                                                                                //
+//       - the last execute()'s items and gl state calls, along with the state calls the same items would have cost in the order              //
+//         they were submitted                                                                                                                //
+//   + current_modelview(modelview)                                                                                                           //
+//       - reads gl's modelview matrix (identity if there's no gl context to read it from)                                                    //
+//   + NOTES:                                                                                                                                 //
+//       - the opaque key is, from the most significant bit: translucent, unlit, unshaded, material, line width (widest first) and            //
+//         draw mode; so lighting is toggled at most twice per frame, the program bound at most once, and line widths are set once per        //
+//         run of items sharing them                                                                                                          //
+//       - materials are only set for lit items (they're ignored without lighting); with fixed function, always: a lit item's                 //
+//         vertices set their own diffuse material, so the one before it can't be relied on; through the program, only when the               //
+//         item's material differs from the one before it (the vertices' colors are an attribute, and leave the uniforms alone)               //
+//       - a translucent item's key is its depth alone (its state is still set, but isn't sorted on)                                          //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+// the pipeline state an item is drawn with
+struct render_state {
+  bool lighting;
+  bool shaded;      // (lit) drawn through the queue's lighting_program rather than fixed function materials
+  bool translucent; // blended without writing depth, after every opaque item
+  GLenum draw_mode; // the primitive the item draws (only sorted on: the item issues its own glBegin())
+  float line_width;
+  int material; // material() id, or zero to leave the material to the vertices
+
+  render_state() : lighting(false), shaded(false), translucent(false), draw_mode(GL_POLYGON), line_width(1.0f), material(0) { }
+};
+
+struct render_queue_stats {
+  int items, translucent;
+  int state_calls;          // glEnable()/glDisable(), glDepthMask(), glLineWidth(), glMaterialfv(), glUseProgram() and uniform calls made
+  int unsorted_state_calls; // the calls the items would have made in the order submitted
+  int matrix_loads;
+
+  render_queue_stats() : items(0), translucent(0), state_calls(0), unsorted_state_calls(0), matrix_loads(0) { }
+};
+
+class render_queue {
+  private:
+    struct item {
+      unsigned long long key;
+      render_state state;
+      float modelview[16];
+      std::function<void ()> draw;
+    };
+
+    struct material_values {
+      vect4f diffuse, specular, shine;
+    };
+
+    std::vector<item> _items;
+    std::vector<material_values> _materials; // id-1
+    std::vector<int> _order, _scratch; // radix sort buffers, kept between frames
+    render_queue_stats _stats;
+    lighting_program* _program;
+    vect4f _vertex_specular;
+    float _vertex_shininess;
+
+    // the gl state last set by execute() (nothing is known until the first item sets it)
+    struct applied {
+      bool known;
+      render_state state;
+
+      applied() : known(false) { }
+    };
+
+    bool _shading(const render_state& state) const; // drawn through _program
+    unsigned long long _key(const render_state& state, float depth) const;
+    void _sort();
+    int _apply(const render_state& next, applied& current, bool issue) const; // the calls setting next costs (made if issue)
+
+  public:
+    render_queue();
+
+    void set_program(lighting_program* program, const vect4f& specular, float shininess); // program may be 0 (fixed function)
+    void submit(const render_state& state, const float* modelview, const std::function<void ()>& draw, float depth=0.0f);
+    int material(const vect4f& diffuse, const vect4f& specular, const vect4f& shine);
+    void execute();
+    void clear();
+    int size() const;
+    render_queue_stats stats() const;
+
+    static void current_modelview(float* modelview);
+};
+
+// the distance from the eye to point (model coordinates) through a column major modelview
+float view_depth(const float* modelview, const vect3f& point);
+
+#endif
@@ -0,0 +1,194 @@
+// File: selection.cpp
+// Written by Joshua Green
+
+#include "selection.h"
+#include "model3d.h"
+#include "half_edge.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <vector>
+using namespace std;
+
+namespace {
+  const long long int COORDINATE_CHUNK = 65536; // coordinates tested per parallel_for() chunk
+
+  int popcount(unsigned long long word) {
+    int bits = 0;
+    for (;word;bits++) word &= word-1;
+    return bits;
+  }
+}
+
+// *** BEGIN SELECTION_SET DEFINITIONS ***
+selection_set::selection_set() : _count(0) { }
+
+void selection_set::_fit(const model3d& model) {
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  _offsets.resize(faces.size()+1);
+  _offsets[0] = 0;
+  for (int i=0;i<faces.size();i++) _offsets[i+1] = _offsets[i] + faces[i].size();
+  _bits.assign((_offsets.back()+63)/64, 0);
+  _count = 0;
+}
+
+bool selection_set::fits(const model3d& model) const {
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  if (_offsets.size() != faces.size()+1) return false;
+  for (int i=0;i<faces.size();i++) if (_offsets[i+1] - _offsets[i] != faces[i].size()) return false;
+  return true;
+}
+
+void selection_set::_recount() {
+  _count = 0;
+  for (int i=0;i<_bits.size();i++) _count += popcount(_bits[i]);
+}
+
+void selection_set::_combine(const vector<unsigned long long>& bits, SELECT_MODE mode) {
+  if (mode == SELECT_REPLACE) _bits = bits;
+  else if (mode == SELECT_ADD) for (int i=0;i<_bits.size();i++) _bits[i] |= bits[i];
+  else for (int i=0;i<_bits.size();i++) _bits[i] &= ~bits[i];
+  _recount();
+}
+
+// each word is filled before it's stored, so a run of facets costs a shift and an or each
+void selection_set::_select_marked(const model3d& model, const vector<char>& marks, int facet::*field, SELECT_MODE mode) {
+  if (!fits(model)) {
+    _fit(model);
+    mode = SELECT_REPLACE;
+  }
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  vector<unsigned long long> bits(_bits.size(), 0);
+  unsigned long long word = 0;
+  long long int bit = 0;
+  for (int i=0;i<faces.size();i++) {
+    const vector<facet>& face = faces[i];
+    for (int j=0;j<face.size();j++,bit++) {
+      if (marks[face[j].*field]) word |= 1ull << (bit&63);
+      if ((bit&63) == 63) {
+        bits[bit>>6] = word;
+        word = 0;
+      }
+    }
+  }
+  if (bit&63) bits[bit>>6] = word;
+  _combine(bits, mode);
+}
+
+void selection_set::select_box(const model3d& model, const vect3f& low, const vect3f& high, SELECT_MODE mode) {
+  TRACE_SPAN(select_span, "selection_set::select_box");
+  const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+  vector<char> inside(coordinates.size(), 0);
+  parallel_for(0, coordinates.size(), COORDINATE_CHUNK, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      const vect3f& p = coordinates[i];
+      inside[i] = (p.x >= low.x && p.x <= high.x && p.y >= low.y && p.y <= high.y && p.z >= low.z && p.z <= high.z);
+    }
+  });
+  _select_marked(model, inside, &facet::id, mode);
+  TRACE_ARG(select_span, "selected", _count);
+}
+
+void selection_set::select_sphere(const model3d& model, const vect3f& center, float radius, SELECT_MODE mode) {
+  TRACE_SPAN(select_span, "selection_set::select_sphere");
+  const vector<vect3f>& coordinates = *model.get_coordinates_ptr();
+  vector<char> inside(coordinates.size(), 0);
+  float radius_squared = radius*radius;
+  parallel_for(0, coordinates.size(), COORDINATE_CHUNK, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      float dx = coordinates[i].x - center.x, dy = coordinates[i].y - center.y, dz = coordinates[i].z - center.z;
+      inside[i] = (dx*dx + dy*dy + dz*dz <= radius_squared);
+    }
+  });
+  _select_marked(model, inside, &facet::id, mode);
+  TRACE_ARG(select_span, "selected", _count);
+}
+
+void selection_set::select_color(const model3d& model, const vect3f& color, SELECT_MODE mode) {
+  TRACE_SPAN(select_span, "selection_set::select_color");
+  const attribute_table& colors = *model.get_colors_ptr();
+  vector<char> matching(colors.size(), 0);
+  for (int i=0;i<colors.size();i++) matching[i] = (colors[i] == color); // (the table may hold duplicates)
+  _select_marked(model, matching, &facet::color, mode);
+  TRACE_ARG(select_span, "selected", _count);
+}
+
+void selection_set::select_connected(const model3d& model, int face, SELECT_MODE mode) {
+  TRACE_SPAN(select_span, "selection_set::select_connected");
+  if (!fits(model)) {
+    _fit(model);
+    mode = SELECT_REPLACE;
+  }
+  const vector<vector<facet>>& faces = *model.get_facet_data_ptr();
+  vector<unsigned long long> bits(_bits.size(), 0);
+  if (face >= 0 && face < faces.size()) {
+    const half_edge_mesh& adjacency = model.adjacency();
+    vector<char> reached(faces.size(), 0);
+    vector<int> open(1, face), sharing;
+    reached[face] = 1;
+    while (!open.empty()) {
+      int current = open.back();
+      open.pop_back();
+      for (int i=_offsets[current];i<_offsets[current+1];i++) bits[i>>6] |= 1ull << (i&63);
+      if (adjacency.face_size(current) < 3) continue; // (unlinked)
+      for (int i=0;i<faces[current].size();i++) {
+        sharing.clear();
+        adjacency.edge_faces(half_edge(current, i), sharing);
+        for (int j=0;j<sharing.size();j++) {
+          if (reached[sharing[j]]) continue;
+          reached[sharing[j]] = 1;
+          open.push_back(sharing[j]);
+        }
+      }
+    }
+  }
+  _combine(bits, mode);
+  TRACE_ARG(select_span, "selected", _count);
+}
+
+void selection_set::select_all(const model3d& model) {
+  _fit(model);
+  invert();
+}
+
+void selection_set::invert() {
+  for (int i=0;i<_bits.size();i++) _bits[i] = ~_bits[i];
+  long long int facets = (_offsets.empty() ? 0 : _offsets.back());
+  if (facets&63) _bits.back() &= (1ull << (facets&63)) - 1; // (the bits past the last facet stay clear)
+  _count = facets - _count;
+}
+
+void selection_set::clear() {
+  vector<unsigned long long>().swap(_bits);
+  vector<int>().swap(_offsets);
+  _count = 0;
+}
+
+bool selection_set::empty() const { return (_count == 0); }
+
+long long int selection_set::count() const { return _count; }
+
+void selection_set::faces(vector<int>& list) const {
+  list.clear();
+  for (int i=0;i+1<_offsets.size();i++) {
+    for (int j=_offsets[i];j<_offsets[i+1];j++) {
+      if ((_bits[j>>6] >> (j&63)) & 1) {
+        list.push_back(i);
+        break;
+      }
+    }
+  }
+}
+
+void selection_set::facets(vector<index2d>& list) const {
+  list.clear();
+  list.reserve(_count);
+  for (int i=0;i+1<_offsets.size();i++) {
+    for (int j=_offsets[i];j<_offsets[i+1];j++) if ((_bits[j>>6] >> (j&63)) & 1) list.push_back(index2d(i, j-_offsets[i]));
+  }
+}
+
+size_t selection_set::memory_usage() const {
+  return _bits.capacity()*sizeof(unsigned long long) + _offsets.capacity()*sizeof(int);
+}
+// *** END SELECTION_SET DEFINITIONS ***
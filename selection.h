@@ -0,0 +1,67 @@
+// File: selection.h
+// Written by Joshua Green
+
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include "vectXf.h"
+#include <vector>
+
+class model3d;
+struct facet;
+struct index2d;
+
+enum SELECT_MODE { SELECT_REPLACE, SELECT_ADD, SELECT_REMOVE }; // how a selector combines with what's already selected
+
+// ------------------------------------------------------------- SELECTION SET -------------------------------------------------------------- //
+//   + select_box(model, low, high, mode=SELECT_REPLACE) / select_sphere(model, center, radius, mode=SELECT_REPLACE)                          //
+//       - the facets whose coordinates lie within the box (inclusive) or sphere                                                              //
+//   + select_color(model, color, mode=SELECT_REPLACE)                                                                                        //
+//       - the facets colored exactly color (matched against the color table once, then by index)                                             //
+//   + select_connected(model, face, mode=SELECT_REPLACE)                                                                                     //
+//       - every facet of the faces reachable from face across shared edges (walked through model.adjacency(), see half_edge.h)               //
+//   + select_all(model) / invert() / clear()                                                                                                 //
+//   + fits(model)                                                                                                                            //
+//       - false once model's faces no longer line up with the set's (bulk edits on model3d do nothing with a set that doesn't fit)           //
+//   + selected(face, corner) / count() / faces(list) / facets(list)                                                                          //
+//       - a facet's bit, the facets selected, the faces holding at least one of them (ascending) and the selected facets' face and corner    //
+//   + NOTES:                                                                                                                                 //
+//       - a bit per facet, the faces' facets end to end (a million facets is 128KB); a selector starts over (as SELECT_REPLACE) on a set     //
+//         that doesn't fit the model                                                                                                         //
+//       - the box and sphere tests run once per coordinate (split across hardware threads), then a pass over the facets sets their bits a    //
+//         word at a time; the edits that take a set (model3d::set_color(), translate(), remove() and extract()) are one pass too             //
+//       - selectors read the model's facets, so a compact or paged model selects nothing until it's expanded (the edited model never is)     //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+class selection_set {
+  private:
+    std::vector<unsigned long long> _bits;
+    std::vector<int> _offsets; // each face's first bit (and the facet count last)
+    long long int _count;
+
+    void _fit(const model3d& model); // sizes the set to model's faces, keeping nothing
+    void _combine(const std::vector<unsigned long long>& bits, SELECT_MODE mode); // bits sized as _bits
+    void _select_marked(const model3d& model, const std::vector<char>& marks, int facet::*field, SELECT_MODE mode); // facets whose field is marked
+    void _recount();
+
+  public:
+    selection_set();
+
+    void select_box(const model3d& model, const vect3f& low, const vect3f& high, SELECT_MODE mode=SELECT_REPLACE);
+    void select_sphere(const model3d& model, const vect3f& center, float radius, SELECT_MODE mode=SELECT_REPLACE);
+    void select_color(const model3d& model, const vect3f& color, SELECT_MODE mode=SELECT_REPLACE);
+    void select_connected(const model3d& model, int face, SELECT_MODE mode=SELECT_REPLACE);
+    void select_all(const model3d& model);
+    void invert();
+    void clear();
+
+    bool fits(const model3d& model) const;
+    bool selected(int face, int corner) const { long long int bit = (long long int)_offsets[face] + corner; return ((_bits[bit>>6] >> (bit&63)) & 1) != 0; }
+    bool empty() const;
+    long long int count() const;
+    void faces(std::vector<int>& list) const;
+    void facets(std::vector<index2d>& list) const;
+    size_t memory_usage() const; // approximate bytes held
+};
+
+#endif
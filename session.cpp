@@ -0,0 +1,323 @@
+// File: session.cpp
+// Written by Joshua Green
+
+#include "session.h"
+#include "model3d.h"
+#include "preload.h"
+#include "parallel.h"
+#include "trace.h"
+#include "fileio/fileio.h"
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstring>
+#include <cstdio>
+using namespace std;
+
+namespace {
+  const unsigned int SESSION_VERSION = 1;
+
+  typedef chrono::steady_clock session_clock;
+
+  double ms_since(session_clock::time_point start) { return chrono::duration<double, milli>(session_clock::now() - start).count(); }
+
+  template <typename T> void put(string& data, T value) { data.append((const char*)&value, sizeof(T)); }
+
+  void put_vect3f(string& data, const vect3f& v) {
+    put<float>(data, v.x);
+    put<float>(data, v.y);
+    put<float>(data, v.z);
+  }
+
+  void put_vect4f(string& data, const vect4f& v) {
+    put_vect3f(data, v);
+    put<float>(data, v.a);
+  }
+
+  void put_slot(string& data, const session_slot& slot) {
+    put<unsigned char>(data, slot.visible);
+    put<long long int>(data, slot.offset);
+    put<long long int>(data, slot.length);
+  }
+
+  class session_reader {
+    private:
+      const string& _data;
+      size_t _pos;
+      bool _ok;
+    public:
+      session_reader(const string& data, size_t pos) : _data(data), _pos(pos), _ok(true) { }
+      bool ok() const { return _ok; }
+      template <typename T> T get() {
+        T value = T();
+        if (_pos+sizeof(T) > _data.length()) _ok = false;
+        else {
+          memcpy(&value, _data.data()+_pos, sizeof(T));
+          _pos += sizeof(T);
+        }
+        return value;
+      }
+      vect3f get_vect3f() {
+        float x = get<float>(), y = get<float>(), z = get<float>();
+        return vect3f(x, y, z);
+      }
+      vect4f get_vect4f() {
+        vect3f v = get_vect3f();
+        float a = get<float>();
+        return vect4f(v.x, v.y, v.z, a);
+      }
+      session_slot get_slot() {
+        session_slot slot;
+        slot.visible = (get<unsigned char>() != 0);
+        slot.offset = get<long long int>();
+        slot.length = get<long long int>();
+        return slot;
+      }
+      string get_string() {
+        unsigned int length = get<unsigned int>();
+        if (!_ok || _pos+length > _data.length()) {
+          _ok = false;
+          return string();
+        }
+        _pos += length;
+        return _data.substr(_pos-length, length);
+      }
+  };
+
+  // a slot's image has to lie past the header and within the file (an empty slot is always valid)
+  bool slot_fits(const session_slot& slot, long long int header_length, long long int file_size) {
+    if (slot.length == 0) return true;
+    return (slot.length > 0 && slot.offset >= header_length && slot.offset <= file_size - slot.length);
+  }
+
+  // the header (everything ahead of the first model image): slot offsets are filled in as the images are written, so it's
+  //   written twice, at the same length
+  string session_header(const session_state& state) {
+    string data(SESSION_FILE_HEADER());
+    put<unsigned int>(data, SESSION_VERSION);
+    put<unsigned int>(data, 0); // header length
+
+    for (int i=0;i<16;i++) put<float>(data, state.modelview[i]);
+    put_vect3f(data, state.pointer);
+    put_vect4f(data, state.light0_pos);
+    put_vect4f(data, state.light_ambient);
+    put<unsigned char>(data, state.lights_on);
+    put<float>(data, state.unit_size);
+    put<int>(data, state.cube_count);
+    put_vect3f(data, state.selected_color);
+    put<float>(data, state.palette_alpha);
+    put<float>(data, state.palette_gamma);
+    put<unsigned char>(data, state.draw_grid);
+    put<unsigned char>(data, state.draw_axis);
+    put<unsigned char>(data, state.highlight);
+    put<unsigned char>(data, state.draw_polygon_mode);
+    put<unsigned char>(data, state.display_working_model);
+
+    put<unsigned int>(data, state.working_filename.length());
+    data += state.working_filename;
+    put<unsigned char>(data, state.working_unsaved);
+    put<float>(data, state.working_lattice_scale);
+    put_slot(data, state.working);
+
+    put<unsigned int>(data, state.slots.size());
+    for (int i=0;i<state.slots.size();i++) put_slot(data, state.slots[i]);
+
+    unsigned int length = data.length();
+    memcpy(&data[SESSION_FILE_HEADER().length()+sizeof(unsigned int)], &length, sizeof(unsigned int));
+    return data;
+  }
+
+  // writes model's image at the next aligned offset, recording where it went in slot
+  bool write_image(fileio& file, long long int& pos, const model3d& model, session_slot& slot) {
+    slot.offset = 0;
+    slot.length = 0;
+    if (model.vertex_count() == 0 && model.coordinate_count() == 0) return true;
+
+    long long int aligned = (pos + SESSION_ALIGNMENT-1)/SESSION_ALIGNMENT*SESSION_ALIGNMENT;
+    string data(aligned-pos, '\0');
+    model.to_binary(data, true); // (with its levels of detail, so a restore needn't rebuild them)
+    file.write(data);
+
+    slot.offset = aligned;
+    slot.length = data.length() - (aligned-pos);
+    pos += data.length();
+    return true;
+  }
+}
+
+session_state::session_state() : lights_on(false), unit_size(1.0f), cube_count(5), selected_color(1.0f, 0.0f, 0.0f),
+                                 palette_alpha(1.0f), palette_gamma(0.0f), draw_grid(true), draw_axis(true), highlight(true),
+                                 draw_polygon_mode(false), display_working_model(true), working_filename("untitled"),
+                                 working_unsaved(false), working_lattice_scale(0.0f) {
+  for (int i=0;i<16;i++) modelview[i] = (i%5 == 0 ? 1.0f : 0.0f);
+}
+
+bool write_session(const string& filename, session_state& state, const model3d& working, const vector<model3d>& models) {
+  TRACE_SPAN(session_span, "write_session");
+  TRACE_ARG(session_span, "models", (long long int)models.size());
+
+  state.slots.resize(models.size());
+  string header = session_header(state);
+
+  string temp_filename = filename + ".tmp";
+  {
+    fileio file;
+    file.open(temp_filename, "w");
+    if (!file.is_open()) return false;
+    file.write(header); // (a placeholder until the offsets are known)
+
+    long long int pos = header.length();
+    write_image(file, pos, working, state.working);
+    for (int i=0;i<models.size();i++) write_image(file, pos, models[i], state.slots[i]);
+
+    file.seek(0);
+    file.write(session_header(state));
+    file.flush();
+    file.close();
+    TRACE_ARG(session_span, "bytes", pos);
+  }
+  if (rename(temp_filename.c_str(), filename.c_str()) != 0) { // (windows won't rename over an existing file)
+    remove(filename.c_str());
+    if (rename(temp_filename.c_str(), filename.c_str()) != 0) return false;
+  }
+  return true;
+}
+
+bool read_session(const string& filename, session_state& state, model3d& working, mesh_report* report) {
+  TRACE_SPAN(session_span, "read_session");
+
+  fileio file;
+  file.open(filename, "r");
+  if (!file.is_open()) return false;
+
+  // the fixed part first, for the header's length
+  size_t prefix_length = SESSION_FILE_HEADER().length() + 2*sizeof(unsigned int);
+  string data = file.read(prefix_length);
+  if (data.length() != prefix_length || data.compare(0, SESSION_FILE_HEADER().length(), SESSION_FILE_HEADER()) != 0) return false;
+  session_reader prefix(data, SESSION_FILE_HEADER().length());
+  if (prefix.get<unsigned int>() != SESSION_VERSION) return false;
+  unsigned int header_length = prefix.get<unsigned int>();
+  if (header_length < prefix_length || header_length > file.size()) return false;
+  data += file.read(header_length - prefix_length);
+  if (data.length() != header_length) return false;
+
+  session_state read;
+  session_reader reader(data, prefix_length);
+  for (int i=0;i<16;i++) read.modelview[i] = reader.get<float>();
+  read.pointer = reader.get_vect3f();
+  read.light0_pos = reader.get_vect4f();
+  read.light_ambient = reader.get_vect4f();
+  read.lights_on = (reader.get<unsigned char>() != 0);
+  read.unit_size = reader.get<float>();
+  read.cube_count = reader.get<int>();
+  read.selected_color = reader.get_vect3f();
+  read.palette_alpha = reader.get<float>();
+  read.palette_gamma = reader.get<float>();
+  read.draw_grid = (reader.get<unsigned char>() != 0);
+  read.draw_axis = (reader.get<unsigned char>() != 0);
+  read.highlight = (reader.get<unsigned char>() != 0);
+  read.draw_polygon_mode = (reader.get<unsigned char>() != 0);
+  read.display_working_model = (reader.get<unsigned char>() != 0);
+
+  read.working_filename = reader.get_string();
+  read.working_unsaved = (reader.get<unsigned char>() != 0);
+  read.working_lattice_scale = reader.get<float>();
+  read.working = reader.get_slot();
+
+  unsigned int slot_count = reader.get<unsigned int>();
+  if (!reader.ok() || slot_count > header_length) return false;
+  read.slots.resize(slot_count);
+  for (int i=0;i<slot_count;i++) read.slots[i] = reader.get_slot();
+  if (!reader.ok()) return false;
+  if (!slot_fits(read.working, header_length, file.size())) return false;
+  for (int i=0;i<slot_count;i++) if (!slot_fits(read.slots[i], header_length, file.size())) return false;
+  TRACE_ARG(session_span, "models", (long long int)slot_count);
+
+  model3d read_working;
+  if (read.working_lattice_scale > 0.0f) read_working.set_lattice(read.working_lattice_scale);
+  if (read.working.length > 0) {
+    if (file.seek(read.working.offset) != read.working.offset) return false;
+    if (!read_working.from_binary(file.read(read.working.length))) return false;
+  }
+  mesh_report validated = read_working.validate(true);
+  if (report) *report = validated;
+
+  state = read;
+  working = std::move(read_working);
+  return true;
+}
+
+bool read_session_model(const string& filename, const session_slot& slot, model3d& model, mesh_report* report) {
+  if (slot.length == 0) {
+    model.clear();
+    return true;
+  }
+
+  fileio file;
+  file.open(filename, "r");
+  if (!file.is_open()) return false;
+  size_t prefix_length = SESSION_FILE_HEADER().length() + 2*sizeof(unsigned int); // (the least a header can be)
+  if (!slot_fits(slot, prefix_length, file.size()) || file.seek(slot.offset) != slot.offset) return false;
+  if (!model.from_binary(file.read(slot.length))) return false;
+  mesh_report validated = model.validate(true);
+  if (report) *report = validated;
+  return true;
+}
+
+preload_report page_session_models(const string& filename, const session_state& state,
+                                   const function<void (int, preload_result&)>& publish, int thread_count) {
+  TRACE_SPAN(page_span, "page_session_models");
+
+  preload_report report;
+  report.threads = (thread_count < 1 ? hardware_threads() : thread_count);
+
+  // visible first, then largest first (as preload_models() orders files)
+  vector<int> order;
+  for (int i=0;i<state.slots.size();i++) if (state.slots[i].length > 0) order.push_back(i);
+  stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    if (state.slots[a].visible != state.slots[b].visible) return state.slots[a].visible;
+    return state.slots[a].length > state.slots[b].length;
+  });
+  report.files = order.size();
+  TRACE_ARG(page_span, "models", (long long int)order.size());
+  if (order.empty()) return report;
+
+  mutex report_lock;
+  atomic<int> published(0);
+  session_clock::time_point start = session_clock::now();
+
+  parallel_for(0, order.size(), 1, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      int slot = order[i];
+
+      preload_result result;
+      result.filename = filename + "#" + to_string(slot+1);
+      result.bytes = state.slots[slot].length;
+
+      session_clock::time_point load_start = session_clock::now();
+      result.ok = read_session_model(filename, state.slots[slot], result.model, &result.validation);
+      result.load_ms = ms_since(load_start);
+      result.finished_ms = ms_since(start);
+
+      {
+        lock_guard<mutex> lock(report_lock);
+        if (published++ == 0) report.first_ms = result.finished_ms;
+        report.load_ms += result.load_ms;
+        if (result.ok) {
+          report.bytes += result.bytes;
+          report.facets += result.model.vertex_count();
+        }
+        else report.failures++;
+      }
+
+      publish(slot, result);
+    }
+  }, report.threads);
+
+  report.wall_ms = ms_since(start);
+  return report;
+}
@@ -0,0 +1,73 @@
+// File: session.h
+// Written by Joshua Green
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "model3d.h"
+#include "preload.h"
+#include "vectXf.h"
+#include <vector>
+#include <string>
+#include <functional>
+
+// ---------------------------------------------------------------- SESSIONS ---------------------------------------------------------------- //
+//   + write_session(filename, state, working, models)                                                                                        //
+//       - writes the editor state, the edited model and every registry slot's model to filename (fills in state's offsets and lengths)       //
+//       - the file is written to filename + ".tmp" and then moved over filename, so a failed write leaves the previous session intact        //
+//       - a slow call (every model is serialized): the modeler runs it on a background thread against copies of its models                   //
+//   + read_session(filename, state, working, report=0)                                                                                       //
+//       - reads the editor state and slot table, and the edited model into working; no registry model is read                                //
+//       - the edited model is validated and repaired as it's read (filling report; see validate.h)                                           //
+//       - returns false (leaving state and working untouched) if filename isn't a readable session, or a slot's image doesn't lie between    //
+//         the header and the end of the file                                                                                                 //
+//   + read_session_model(filename, slot, model, report=0)                                                                                    //
+//       - reads one slot's model (only its own bytes of the file), validating and repairing it as read_session() does                        //
+//       - returns false if the slot's image doesn't lie within the file                                                                      //
+//   + page_session_models(filename, state, publish, thread_count=0)                                                                          //
+//       - reads every non-empty slot's model concurrently (as preload_models() does), calling publish(slot, result) as each finishes         //
+//         (result.validation holds what validating the model found)                                                                          //
+//       - visible slots are read first, so the models on screen appear before the hidden ones                                                //
+//   + NOTES:                                                                                                                                 //
+//       - a session is SESSION_FILE_HEADER() | u32 version | u32 header length, the state and slot table, then each model's binary format    //
+//         image starting on a SESSION_ALIGNMENT boundary: a model is a contiguous, aligned byte range that can be read (or mapped) alone     //
+//       - values are stored in the machine's native (little endian) byte order, as in the binary model format                                //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+const long long int SESSION_ALIGNMENT = 4096;
+inline std::string SESSION_FILE_HEADER() { return std::string("session="); }
+
+struct session_slot {
+  bool visible;
+  long long int offset, length; // the model's image within the session file (zero length for an empty slot)
+
+  session_slot() : visible(false), offset(0), length(0) { }
+};
+
+struct session_state {
+  float modelview[16];  // the camera (glGetFloatv(GL_MODELVIEW_MATRIX))
+  vect3f pointer;
+  vect4f light0_pos, light_ambient;
+  bool lights_on;
+  float unit_size;      // grid
+  int cube_count;
+  vect3f selected_color; // palette
+  float palette_alpha, palette_gamma;
+  bool draw_grid, draw_axis, highlight, draw_polygon_mode, display_working_model;
+
+  std::string working_filename; // the file the edited model was loaded from or saved to
+  bool working_unsaved;
+  float working_lattice_scale;  // zero unless the edited model is in lattice mode
+  session_slot working;
+  std::vector<session_slot> slots; // the registry (LOADED_MODELS), in slot order
+
+  session_state();
+};
+
+bool write_session(const std::string& filename, session_state& state, const model3d& working, const std::vector<model3d>& models);
+bool read_session(const std::string& filename, session_state& state, model3d& working, mesh_report* report=0);
+bool read_session_model(const std::string& filename, const session_slot& slot, model3d& model, mesh_report* report=0);
+preload_report page_session_models(const std::string& filename, const session_state& state,
+                                   const std::function<void (int, preload_result&)>& publish, int thread_count=0);
+
+#endif
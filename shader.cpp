@@ -0,0 +1,201 @@
+// File: shader.cpp
+// Written by Joshua Green
+
+#include "gl_proc.h" // (before gl.h)
+#include "shader.h"
+#include "vectXf.h"
+
+#ifdef USE_GLSL_LIGHTING
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// the gl 2.0 entry points aren't part of the 1.1 headers, so they're fetched at runtime (by load()):
+static PFNGLCREATESHADERPROC gl_create_shader = 0;
+static PFNGLSHADERSOURCEPROC gl_shader_source = 0;
+static PFNGLCOMPILESHADERPROC gl_compile_shader = 0;
+static PFNGLGETSHADERIVPROC gl_get_shaderiv = 0;
+static PFNGLGETSHADERINFOLOGPROC gl_get_shader_info_log = 0;
+static PFNGLDELETESHADERPROC gl_delete_shader = 0;
+static PFNGLCREATEPROGRAMPROC gl_create_program = 0;
+static PFNGLATTACHSHADERPROC gl_attach_shader = 0;
+static PFNGLLINKPROGRAMPROC gl_link_program = 0;
+static PFNGLGETPROGRAMIVPROC gl_get_programiv = 0;
+static PFNGLGETPROGRAMINFOLOGPROC gl_get_program_info_log = 0;
+static PFNGLDELETEPROGRAMPROC gl_delete_program = 0;
+static PFNGLUSEPROGRAMPROC gl_use_program = 0;
+static PFNGLGETUNIFORMLOCATIONPROC gl_get_uniform_location = 0;
+static PFNGLUNIFORM1IPROC gl_uniform1i = 0;
+static PFNGLUNIFORM1FPROC gl_uniform1f = 0;
+static PFNGLUNIFORM4FVPROC gl_uniform4fv = 0;
+
+namespace {
+  // LIGHT0 and the light model ambient as the fixed function pipeline evaluates them per vertex (a local viewer; no spot light)
+  const char* const VERTEX_SHADER =
+    "#version 110\n"
+    "uniform bool use_diffuse;\n" // false: the vertex color is the ambient and diffuse material
+    "uniform vec4 diffuse;\n"
+    "uniform vec4 specular;\n"
+    "uniform float shininess;\n"
+    "void main() {\n"
+    "  vec4 eye = gl_ModelViewMatrix*gl_Vertex;\n"
+    "  vec3 normal = normalize(gl_NormalMatrix*gl_Normal);\n"
+    "  vec4 material = (use_diffuse ? diffuse : gl_Color);\n"
+    "  vec4 light = gl_LightSource[0].position;\n"
+    "  vec3 to_light = light.xyz - eye.xyz*light.w;\n"
+    "  float attenuation = 1.0;\n"
+    "  if (light.w != 0.0) {\n"
+    "    float d = length(to_light);\n"
+    "    attenuation = 1.0/(gl_LightSource[0].constantAttenuation + gl_LightSource[0].linearAttenuation*d + gl_LightSource[0].quadraticAttenuation*d*d);\n"
+    "  }\n"
+    "  to_light = normalize(to_light);\n"
+    "  float lambert = max(dot(normal, to_light), 0.0);\n"
+    "  vec4 color = gl_LightModel.ambient*material + attenuation*(gl_LightSource[0].ambient*material + lambert*gl_LightSource[0].diffuse*material);\n"
+    "  if (lambert > 0.0) {\n"
+    "    vec3 half_vector = normalize(to_light + normalize(-eye.xyz));\n"
+    "    color += attenuation*pow(max(dot(normal, half_vector), 0.0), shininess)*gl_LightSource[0].specular*specular;\n"
+    "  }\n"
+    "  gl_FrontColor = vec4(clamp(color.rgb, 0.0, 1.0), material.a);\n"
+    "  gl_Position = ftransform();\n"
+    "}\n";
+
+  const char* const FRAGMENT_SHADER =
+    "#version 110\n"
+    "void main() {\n"
+    "  gl_FragColor = gl_Color;\n"
+    "}\n";
+
+  GLuint compile_shader(GLenum type, const char* source) {
+    GLuint shader = gl_create_shader(type);
+    gl_shader_source(shader, 1, &source, 0);
+    gl_compile_shader(shader);
+
+    GLint compiled = 0;
+    gl_get_shaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+      GLint length = 0;
+      gl_get_shaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+      vector<char> log(length+1, '\0');
+      if (length > 0) gl_get_shader_info_log(shader, length, 0, &log[0]);
+      cout << "[SHADER] The " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << " shader didn't compile: " << &log[0] << endl;
+      gl_delete_shader(shader);
+      return 0;
+    }
+    return shader;
+  }
+}
+
+// *** BEGIN LIGHTING_PROGRAM DEFINITIONS ***
+lighting_program::lighting_program() : _loaded(false), _program(0), _use_diffuse_location(-1), _diffuse_location(-1),
+  _specular_location(-1), _shininess_location(-1), _set(false), _use_diffuse(false), _shininess(0.0f) { }
+
+bool lighting_program::load() {
+  if (_loaded) return true;
+
+  gl_create_shader = (PFNGLCREATESHADERPROC)GL_PROC_ADDRESS("glCreateShader");
+  gl_shader_source = (PFNGLSHADERSOURCEPROC)GL_PROC_ADDRESS("glShaderSource");
+  gl_compile_shader = (PFNGLCOMPILESHADERPROC)GL_PROC_ADDRESS("glCompileShader");
+  gl_get_shaderiv = (PFNGLGETSHADERIVPROC)GL_PROC_ADDRESS("glGetShaderiv");
+  gl_get_shader_info_log = (PFNGLGETSHADERINFOLOGPROC)GL_PROC_ADDRESS("glGetShaderInfoLog");
+  gl_delete_shader = (PFNGLDELETESHADERPROC)GL_PROC_ADDRESS("glDeleteShader");
+  gl_create_program = (PFNGLCREATEPROGRAMPROC)GL_PROC_ADDRESS("glCreateProgram");
+  gl_attach_shader = (PFNGLATTACHSHADERPROC)GL_PROC_ADDRESS("glAttachShader");
+  gl_link_program = (PFNGLLINKPROGRAMPROC)GL_PROC_ADDRESS("glLinkProgram");
+  gl_get_programiv = (PFNGLGETPROGRAMIVPROC)GL_PROC_ADDRESS("glGetProgramiv");
+  gl_get_program_info_log = (PFNGLGETPROGRAMINFOLOGPROC)GL_PROC_ADDRESS("glGetProgramInfoLog");
+  gl_delete_program = (PFNGLDELETEPROGRAMPROC)GL_PROC_ADDRESS("glDeleteProgram");
+  gl_use_program = (PFNGLUSEPROGRAMPROC)GL_PROC_ADDRESS("glUseProgram");
+  gl_get_uniform_location = (PFNGLGETUNIFORMLOCATIONPROC)GL_PROC_ADDRESS("glGetUniformLocation");
+  gl_uniform1i = (PFNGLUNIFORM1IPROC)GL_PROC_ADDRESS("glUniform1i");
+  gl_uniform1f = (PFNGLUNIFORM1FPROC)GL_PROC_ADDRESS("glUniform1f");
+  gl_uniform4fv = (PFNGLUNIFORM4FVPROC)GL_PROC_ADDRESS("glUniform4fv");
+
+  if (!gl_create_shader || !gl_shader_source || !gl_compile_shader || !gl_get_shaderiv || !gl_get_shader_info_log || !gl_delete_shader ||
+      !gl_create_program || !gl_attach_shader || !gl_link_program || !gl_get_programiv || !gl_get_program_info_log ||
+      !gl_delete_program || !gl_use_program || !gl_get_uniform_location || !gl_uniform1i || !gl_uniform1f || !gl_uniform4fv) {
+    cout << "[SHADER] The driver doesn't support glsl (opengl 2.0)." << endl;
+    return false;
+  }
+
+  GLuint vertex = compile_shader(GL_VERTEX_SHADER, VERTEX_SHADER);
+  GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+  if (!vertex || !fragment) {
+    if (vertex) gl_delete_shader(vertex);
+    if (fragment) gl_delete_shader(fragment);
+    return false;
+  }
+
+  GLuint program = gl_create_program();
+  gl_attach_shader(program, vertex);
+  gl_attach_shader(program, fragment);
+  gl_link_program(program);
+  gl_delete_shader(vertex); // (flagged; freed with the program)
+  gl_delete_shader(fragment);
+
+  GLint linked = 0;
+  gl_get_programiv(program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    GLint length = 0;
+    gl_get_programiv(program, GL_INFO_LOG_LENGTH, &length);
+    vector<char> log(length+1, '\0');
+    if (length > 0) gl_get_program_info_log(program, length, 0, &log[0]);
+    cout << "[SHADER] The lighting program didn't link: " << &log[0] << endl;
+    gl_delete_program(program);
+    return false;
+  }
+
+  _program = program;
+  _use_diffuse_location = gl_get_uniform_location(_program, "use_diffuse");
+  _diffuse_location = gl_get_uniform_location(_program, "diffuse");
+  _specular_location = gl_get_uniform_location(_program, "specular");
+  _shininess_location = gl_get_uniform_location(_program, "shininess");
+  _set = false;
+  _loaded = true;
+  return true;
+}
+
+bool lighting_program::loaded() const { return _loaded; }
+
+void lighting_program::bind() const {
+  if (_loaded) gl_use_program(_program);
+}
+
+void lighting_program::unbind() {
+  if (gl_use_program) gl_use_program(0);
+}
+
+// uniforms belong to the program, so they're kept while it's unbound (and only the ones that changed are uploaded)
+bool lighting_program::set_material(bool use_diffuse, const vect4f& diffuse, const vect4f& specular, float shininess) {
+  if (!_loaded) return false;
+  bool changed = false;
+  if (!_set || use_diffuse != _use_diffuse) {
+    gl_uniform1i(_use_diffuse_location, use_diffuse ? 1 : 0);
+    _use_diffuse = use_diffuse;
+    changed = true;
+  }
+  if (!_set || (use_diffuse && diffuse != _diffuse)) {
+    gl_uniform4fv(_diffuse_location, 1, diffuse);
+    _diffuse = diffuse;
+    changed = true;
+  }
+  if (!_set || specular != _specular) {
+    gl_uniform4fv(_specular_location, 1, specular);
+    _specular = specular;
+    changed = true;
+  }
+  if (!_set || shininess != _shininess) {
+    gl_uniform1f(_shininess_location, shininess);
+    _shininess = shininess;
+    changed = true;
+  }
+  _set = true;
+  return changed;
+}
+// *** END LIGHTING_PROGRAM DEFINITIONS ***
+
+#endif
@@ -0,0 +1,57 @@
+// File: shader.h
+// Written by Joshua Green
+
+#ifndef SHADER_H
+#define SHADER_H
+
+#include "vectXf.h"
+#include <GL/gl.h>
+
+// comment out to leave lit models to fixed function materials and compile the glsl lighting program out of the build (shader.cpp
+// is then empty, and nothing links against the gl 2.0 entry points)
+#define USE_GLSL_LIGHTING
+
+// ------------------------------------------------------------ LIGHTING PROGRAM ------------------------------------------------------------ //
+//   + load()                                                                                                                                 //
+//       - compiles and links the program (a gl context must be current); returns false, printing why, if the driver has no glsl              //
+//         (gl 2.0) or the program doesn't build, in which case lit faces are left to fixed function materials                                //
+//   + bind() / unbind()                                                                                                                      //
+//       - glUseProgram() the program / fixed function                                                                                        //
+//   + set_material(use_diffuse, diffuse, specular, shininess)                                                                                //
+//       - the material of the faces drawn next (while bound): use_diffuse false takes each vertex's color (glColor()) as its                 //
+//         ambient and diffuse material, as glMaterialfv(GL_AMBIENT_AND_DIFFUSE) per vertex did; the alpha is the diffuse alpha               //
+//       - returns false without touching gl if the uniforms already hold the material                                                        //
+//   + NOTES:                                                                                                                                 //
+//       - the lighting is the fixed function model the modeler sets up (see init_lighting() and set_ambient() in modeler.cpp),               //
+//         evaluated per vertex: LIGHT0's ambient, diffuse and specular (a local viewer, with attenuation), plus the light model's            //
+//         ambient; the light itself is read from gl's built in state (gl_LightSource[0], gl_LightModel), so glLightfv() and                  //
+//         glLightModelfv() still place and color it                                                                                          //
+//       - the shaders are glsl 1.10 (the compatibility built ins), so they run under mesa's software renderers as well as a gpu              //
+//       - the gl 2.0 entry points are fetched with GL_PROC_ADDRESS() (gl_proc.h: wglGetProcAddress() on windows, glXGetProcAddress()         //
+//         elsewhere), so any glut will do                                                                                                    //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+class lighting_program {
+  private:
+    bool _loaded;
+    GLuint _program;
+    GLint _use_diffuse_location, _diffuse_location, _specular_location, _shininess_location;
+
+    // the uniforms as last set
+    bool _set, _use_diffuse;
+    vect4f _diffuse, _specular;
+    float _shininess;
+
+  public:
+    lighting_program();
+
+    bool load();
+    bool loaded() const;
+
+    void bind() const;
+    static void unbind();
+
+    bool set_material(bool use_diffuse, const vect4f& diffuse, const vect4f& specular, float shininess);
+};
+
+#endif
@@ -0,0 +1,197 @@
+// File: trace.cpp
+// Written by Joshua Green
+
+#include "trace.h"
+#include "fileio/fileio.h"
+#include "str/str.h"
+#include <string>
+#include <vector>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+using namespace std;
+
+namespace {
+  // single-producer (the owning thread), single-consumer (trace_write) ring of events
+  struct trace_ring {
+    static const unsigned int RING_SIZE = 4096; // must be a power of two
+
+    trace_event events[RING_SIZE];
+    atomic<unsigned int> head; // next slot to be written (owned by the producer)
+    atomic<unsigned int> tail; // next slot to be read (owned by the consumer)
+    atomic<bool> in_use;       // false once the owning thread exits, allowing the ring to be recycled
+    int reserved;              // slots held for the end events of the thread's open spans (owned by the producer)
+    int thread_id;
+    mutex collect_lock;        // held while the ring is read: by trace_write, or by the producer emptying it into spilled
+    vector<trace_event> spilled; // events the producer moved out of its full ring, until trace_write collects them
+
+    trace_ring() : head(0), tail(0), in_use(true), reserved(0), thread_id(0) { }
+  };
+
+  mutex REGISTRY_LOCK; // guards RINGS and COLLECTED; never taken on the recording path
+  vector<trace_ring*> RINGS;
+  vector<pair<int, trace_event>> COLLECTED; // (thread id, event)
+  atomic<int> DROPPED(0);
+
+  const chrono::steady_clock::time_point START = chrono::steady_clock::now();
+
+  // releases the thread's ring for reuse by a later thread (branch threads are short lived)
+  struct ring_owner {
+    trace_ring* ring;
+    ring_owner() : ring(0) { }
+    ~ring_owner() { if (ring) ring->in_use.store(false, memory_order_release); }
+  };
+  thread_local ring_owner THIS_THREAD;
+
+  trace_ring* acquire_ring() {
+    lock_guard<mutex> lock(REGISTRY_LOCK);
+    for (int i=0;i<RINGS.size();i++) {
+      bool expected = false;
+      if (RINGS[i]->in_use.compare_exchange_strong(expected, true, memory_order_acquire)) return RINGS[i];
+    }
+    RINGS.push_back(new trace_ring());
+    RINGS.back()->thread_id = RINGS.size();
+    return RINGS.back();
+  }
+
+  // (with ring->collect_lock held)
+  void collect(trace_ring* ring, vector<trace_event>& events) {
+    unsigned int head = ring->head.load(memory_order_acquire);
+    unsigned int tail = ring->tail.load(memory_order_relaxed);
+    for (;tail!=head;tail++) events.push_back(ring->events[tail&(trace_ring::RING_SIZE-1)]);
+    ring->tail.store(tail, memory_order_release);
+  }
+
+  string json_escape(const char* text) {
+    string value;
+    for (;*text!='\0';text++) {
+      if (*text == '"' || *text == '\\') value += '\\';
+      if ((unsigned char)(*text) < 0x20) continue;
+      value += *text;
+    }
+    return value;
+  }
+}
+
+long long int trace_now() {
+  return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - START).count();
+}
+
+bool trace_record(const trace_event& e) {
+  if (THIS_THREAD.ring == 0) THIS_THREAD.ring = acquire_ring();
+  trace_ring* ring = THIS_THREAD.ring;
+
+  // a begin event also reserves a slot for its span's end event, which then always fits: a span is recorded whole or not at all
+  if (e.phase == 'E') ring->reserved--;
+  unsigned int needed = ring->reserved + (e.phase == 'B' ? 2 : 1);
+  unsigned int head = ring->head.load(memory_order_relaxed);
+  if (head - ring->tail.load(memory_order_acquire) + needed > trace_ring::RING_SIZE) {
+    // a full ring is emptied by its own thread, unless trace_write is collecting it at that moment
+    unique_lock<mutex> lock(ring->collect_lock, try_to_lock);
+    if (lock.owns_lock()) collect(ring, ring->spilled);
+    if (head - ring->tail.load(memory_order_acquire) + needed > trace_ring::RING_SIZE) {
+      DROPPED++;
+      return false;
+    }
+  }
+  if (e.phase == 'B') ring->reserved++;
+  ring->events[head&(trace_ring::RING_SIZE-1)] = e;
+  ring->head.store(head+1, memory_order_release);
+  return true;
+}
+
+int trace_dropped_count() { return DROPPED.load(); }
+
+bool trace_write(const string& filename) {
+  lock_guard<mutex> lock(REGISTRY_LOCK);
+  for (int i=0;i<RINGS.size();i++) {
+    lock_guard<mutex> ring_lock(RINGS[i]->collect_lock);
+    vector<trace_event>& events = RINGS[i]->spilled;
+    collect(RINGS[i], events);
+    for (int j=0;j<events.size();j++) COLLECTED.push_back(make_pair(RINGS[i]->thread_id, events[j]));
+    events.clear();
+  }
+
+  fileio trace_file;
+  trace_file.open(filename, "w");
+  if (!trace_file.is_open()) return false;
+
+  trace_file.write("{\"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped_events\": " + to_string(DROPPED.load()) + "}, \"traceEvents\": [\n");
+  for (int i=0;i<COLLECTED.size();i++) {
+    const trace_event& e = COLLECTED[i].second;
+
+    string data("{\"name\": \"");
+    data += json_escape(e.name);
+    data += "\", \"cat\": \"modeler\", \"ph\": \"";
+    data += e.phase;
+    data += "\", \"ts\": ";
+    data += to_string(e.timestamp);
+    data += ", \"pid\": 1, \"tid\": ";
+    data += itos(COLLECTED[i].first);
+
+    if (e.arg_count > 0) {
+      data += ", \"args\": {";
+      for (int j=0;j<e.arg_count;j++) {
+        data += "\"";
+        data += json_escape(e.arg_keys[j]);
+        data += "\": ";
+        if (e.arg_is_text[j]) data += string("\"") + json_escape(e.arg_text[j]) + "\"";
+        else data += to_string(e.arg_values[j]);
+        if (j != e.arg_count-1) data += ", ";
+      }
+      data += "}";
+    }
+
+    data += "}";
+    if (i != COLLECTED.size()-1) data += ",";
+    data += "\n";
+    trace_file.write(data);
+  }
+  trace_file.write("]}\n");
+
+  trace_file.close();
+  return true;
+}
+
+
+
+
+// **** begin class trace_span definitions **** //
+trace_span::trace_span(const char* name) : _name(name), _recorded(false) {
+  _end.name = _name;
+  _end.phase = 'E';
+  _end.arg_count = 0;
+
+  trace_event begin;
+  begin.name = _name;
+  begin.phase = 'B';
+  begin.arg_count = 0;
+  begin.timestamp = trace_now();
+  _recorded = trace_record(begin);
+}
+
+trace_span::~trace_span() {
+  if (!_recorded) return; // (its begin event was dropped)
+  _end.timestamp = trace_now();
+  trace_record(_end);
+}
+
+void trace_span::arg(const char* key, long long int value) {
+  if (_end.arg_count >= trace_event::MAX_ARGS) return;
+
+  _end.arg_keys[_end.arg_count] = key;
+  _end.arg_values[_end.arg_count] = value;
+  _end.arg_is_text[_end.arg_count] = false;
+  _end.arg_count++;
+}
+
+void trace_span::arg(const char* key, const string& value) {
+  if (_end.arg_count >= trace_event::MAX_ARGS) return;
+
+  _end.arg_keys[_end.arg_count] = key;
+  _end.arg_is_text[_end.arg_count] = true;
+  strncpy(_end.arg_text[_end.arg_count], value.c_str(), trace_event::MAX_ARG_TEXT-1);
+  _end.arg_text[_end.arg_count][trace_event::MAX_ARG_TEXT-1] = '\0';
+  _end.arg_count++;
+}
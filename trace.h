@@ -0,0 +1,71 @@
+// File: trace.h
+// Written by Joshua Green
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+// comment out to compile all tracing out of the build (the macros below become no-ops)
+#define USE_TRACE
+
+// ---------------------------------------------------------------- TRACING ---------------------------------------------------------------- //
+//   + TRACE_SPAN(var, name)                                                                                                                  //
+//       - records a begin event now and an end event when var leaves scope                                                                   //
+//       - name must be a string literal (only the pointer is stored)                                                                         //
+//   + TRACE_ARG(var, key, value)                                                                                                             //
+//       - attaches an argument to span var (value may be an integer or a string); key must be a string literal                               //
+//       - arguments are written with the span's end event, so values known only after the work (bytes read, etc) can be recorded           //
+//   + TRACE_WRITE(filename)                                                                                                                  //
+//       - collects the events from every thread and writes them as chrome trace_event json (viewable in chrome://tracing or perfetto)       //
+//   + NOTES:                                                                                                                                 //
+//       - each thread records into its own lock-free ring of RING_SIZE events; a full ring is emptied by its own thread, and events are      //
+//         only dropped (and counted) if trace_write() is collecting that ring at the time; the count is written with the trace (otherData)   //
+//       - a span's begin event reserves a slot for its end event, so a span is recorded whole or dropped whole                               //
+//       - collected events are kept, so repeated writes produce the complete trace so far                                                    //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+struct trace_event {
+  static const int MAX_ARGS = 2;
+  static const int MAX_ARG_TEXT = 64;
+
+  const char* name;
+  char phase; // 'B' or 'E'
+  long long int timestamp; // microseconds since the first traced event
+  int arg_count;
+  const char* arg_keys[MAX_ARGS];
+  long long int arg_values[MAX_ARGS];
+  bool arg_is_text[MAX_ARGS];
+  char arg_text[MAX_ARGS][MAX_ARG_TEXT];
+};
+
+class trace_span {
+  private:
+    const char* _name;
+    bool _recorded; // the begin event was recorded (its end event is only recorded if it was)
+    trace_event _end;
+
+  public:
+    trace_span(const char* name);
+    ~trace_span();
+
+    void arg(const char* key, long long int value);
+    void arg(const char* key, const std::string& value);
+};
+
+bool trace_record(const trace_event& e); // false if the event was dropped
+long long int trace_now();
+bool trace_write(const std::string& filename);
+int trace_dropped_count(); // events dropped so far (a dropped span counts once)
+
+#ifdef USE_TRACE
+  #define TRACE_SPAN(var, name)      trace_span var(name)
+  #define TRACE_ARG(var, key, value) var.arg(key, value)
+  #define TRACE_WRITE(filename)      trace_write(filename)
+#else
+  #define TRACE_SPAN(var, name)
+  #define TRACE_ARG(var, key, value)
+  #define TRACE_WRITE(filename)      false
+#endif
+
+#endif
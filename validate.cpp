@@ -0,0 +1,291 @@
+// File: validate.cpp
+// Written by Joshua Green
+
+#include "validate.h"
+#include "model3d.h"
+#include "vectXf.h"
+#include "parallel.h"
+#include "trace.h"
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+using namespace std;
+
+namespace {
+  const long long int FACE_CHUNK = 16384;   // faces scanned per parallel_for() chunk
+  const long long int VALUE_CHUNK = 65536;  // coordinates, colors or normals checked per parallel_for() chunk
+
+  const vect3f DEFAULT_NORMAL(0.0f, 0.0f, 1.0f); // (as model3d.cpp's)
+
+  // a face's problems, as found by the scan
+  enum FACE_PROBLEM { FACE_BAD_ID=0x01, FACE_BAD_COLOR=0x02, FACE_BAD_NORMAL=0x04, FACE_REPEATED_ID=0x08, FACE_DEGENERATE=0x10, FACE_DUPLICATE=0x20 };
+
+  bool finite_value(const vect3f& v) { return (std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z)); }
+  bool usable_normal(const vect3f& v) { return (finite_value(v) && v.x*v.x + v.y*v.y + v.z*v.z > 1.0e-12f); }
+
+  // marks the values failing test (a byte each, so chunks on different threads never share a word they write)
+  int mark_invalid(const vector<vect3f>& values, vector<char>& invalid, bool (*test)(const vect3f&)) {
+    invalid.assign(values.size(), 0);
+    mutex count_lock;
+    int count = 0;
+    parallel_for(0, values.size(), VALUE_CHUNK, [&](long long int begin, long long int end) {
+      int found = 0;
+      for (long long int i=begin;i<end;i++) {
+        if (test(values[i])) continue;
+        invalid[i] = 1;
+        found++;
+      }
+      if (found == 0) return;
+      lock_guard<mutex> lock(count_lock);
+      count += found;
+    });
+    return count;
+  }
+
+  // the facets of face kept by a repair: those with valid ids, less any repeating the facet kept before them (the last kept facet
+  //   repeating the first is dropped too). appended to kept if it's given; returns the number kept, counting what's dropped
+  int kept_facets(const vector<facet>& face, const vector<char>& invalid_coordinates, int& invalid_ids, int& repeated_ids,
+                  vector<facet>* kept=0) {
+    int count = 0, first = -1, last = -1;
+    for (int j=0;j<face.size();j++) {
+      int id = face[j].id;
+      if (id < 0 || id >= invalid_coordinates.size() || invalid_coordinates[id]) {
+        invalid_ids++;
+        continue;
+      }
+      if (count > 0 && id == last) {
+        repeated_ids++;
+        continue;
+      }
+      if (count == 0) first = id;
+      last = id;
+      count++;
+      if (kept) kept->push_back(face[j]);
+    }
+    if (count > 1 && last == first) {
+      repeated_ids++;
+      count--;
+      if (kept) kept->pop_back();
+    }
+    return count;
+  }
+
+  // independent of which facet the face starts at
+  unsigned long long face_hash(const vector<facet>& face) {
+    unsigned long long hash = face.size();
+    for (int j=0;j<face.size();j++) {
+      unsigned long long h = (unsigned long long)(unsigned int)face[j].id * 0x9E3779B97F4A7C15ull;
+      h ^= h >> 29;
+      hash += h * 0xBF58476D1CE4E5B9ull;
+    }
+    return (hash == 0 ? 1 : hash); // (zero is no hash)
+  }
+
+  // the same ids in the same winding, from any starting facet
+  bool same_face(const vector<facet>& a, const vector<facet>& b) {
+    int size = a.size();
+    if (b.size() != size) return false;
+    for (int start=0;start<size;start++) {
+      if (b[start].id != a[0].id) continue;
+      int j = 1;
+      while (j < size && a[j].id == b[(start+j)%size].id) j++;
+      if (j == size) return true;
+    }
+    return false;
+  }
+}
+
+// *** BEGIN MESH_REPORT DEFINITIONS ***
+mesh_report::mesh_report() : faces(0), facets(0), invalid_coordinates(0), invalid_ids(0), invalid_colors(0), invalid_normals(0),
+  repeated_ids(0), degenerate_faces(0), duplicate_faces(0), repaired(false), facets_removed(0), faces_removed(0), normals_recalculated(0),
+  ms(0.0) { }
+
+bool mesh_report::clean() const {
+  return (invalid_coordinates == 0 && invalid_ids == 0 && invalid_colors == 0 && invalid_normals == 0 && repeated_ids == 0 &&
+          degenerate_faces == 0 && duplicate_faces == 0);
+}
+
+string mesh_report::summary() const {
+  if (clean()) return "no problems found in " + to_string(faces) + " faces";
+  string text;
+  auto add = [&](int count, const string& what) {
+    if (count == 0) return;
+    text += (text.empty() ? "" : ", ") + to_string(count) + " " + what;
+  };
+  add(invalid_coordinates, "non-finite coordinates");
+  add(invalid_ids, "bad ids");
+  add(repeated_ids, "repeated ids");
+  add(invalid_colors, "bad colors");
+  add(invalid_normals, "bad normals");
+  add(degenerate_faces, "degenerate faces");
+  add(duplicate_faces, "duplicate faces");
+  if (repaired) {
+    text += "; dropped " + to_string(facets_removed) + " facets and " + to_string(faces_removed) + " faces";
+    if (normals_recalculated > 0) text += ", recalculated the normals of " + to_string(normals_recalculated) + " faces";
+  }
+  return text;
+}
+// *** END MESH_REPORT DEFINITIONS ***
+
+// *** BEGIN MODEL3D VALIDATION DEFINITIONS ***
+mesh_report model3d::validate(bool repair) {
+  mesh_report report;
+  if (_compact || _paged) return report;
+  TRACE_SPAN(validate_span, "model3d::validate");
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+  // the tables, one pass each
+  vector<char> invalid_coordinates, invalid_colors, invalid_normals;
+  report.invalid_coordinates = mark_invalid(_coordinates, invalid_coordinates, finite_value);
+  mark_invalid(_colors.values(), invalid_colors, finite_value);
+  mark_invalid(_normals.values(), invalid_normals, usable_normal);
+
+  // the faces: each one's problems are marked and counted (the current face is never degenerate)
+  int face_total = _facet_data.size();
+  vector<unsigned char> problems(face_total, 0);
+  mutex report_lock;
+  parallel_for(0, face_total, FACE_CHUNK, [&](long long int begin, long long int end) {
+    mesh_report found;
+    for (long long int i=begin;i<end;i++) {
+      const vector<facet>& face = _facet_data[i];
+      unsigned char marks = 0;
+      int ids = found.invalid_ids, repeats = found.repeated_ids;
+      int kept = kept_facets(face, invalid_coordinates, found.invalid_ids, found.repeated_ids);
+      if (found.invalid_ids != ids) marks |= FACE_BAD_ID;
+      if (found.repeated_ids != repeats) marks |= FACE_REPEATED_ID;
+      for (int j=0;j<face.size();j++) {
+        const facet& f = face[j];
+        if (f.color < 0 || f.color >= invalid_colors.size() || invalid_colors[f.color]) {
+          marks |= FACE_BAD_COLOR;
+          found.invalid_colors++;
+        }
+        if (f.normal < 0 || f.normal >= invalid_normals.size() || invalid_normals[f.normal]) {
+          marks |= FACE_BAD_NORMAL;
+          found.invalid_normals++;
+        }
+      }
+      if (kept < 3 && i+1 < face_total) {
+        marks |= FACE_DEGENERATE;
+        found.degenerate_faces++;
+      }
+      found.facets += face.size();
+      problems[i] = marks;
+    }
+    lock_guard<mutex> lock(report_lock);
+    report.facets += found.facets;
+    report.invalid_ids += found.invalid_ids;
+    report.repeated_ids += found.repeated_ids;
+    report.invalid_colors += found.invalid_colors;
+    report.invalid_normals += found.invalid_normals;
+    report.degenerate_faces += found.degenerate_faces;
+  });
+  report.faces = face_total;
+
+  // repair the facets: each chunk rewrites only its own faces; the defaults are added to the tables up front
+  if (repair && (report.invalid_ids > 0 || report.repeated_ids > 0 || report.invalid_colors > 0 || report.invalid_normals > 0)) {
+    int default_color = (report.invalid_colors > 0 ? _colors.insert(DEFAULT_COLOR) : -1);
+    int default_normal = (report.invalid_normals > 0 ? _normals.insert(DEFAULT_NORMAL) : -1);
+    parallel_for(0, face_total, FACE_CHUNK, [&](long long int begin, long long int end) {
+      vector<facet> kept;
+      int dropped = 0, ignored = 0;
+      for (long long int i=begin;i<end;i++) {
+        if (problems[i] == 0) continue;
+        vector<facet>& face = _facet_data[i];
+        if (problems[i] & (FACE_BAD_ID | FACE_REPEATED_ID)) {
+          kept.clear();
+          kept_facets(face, invalid_coordinates, ignored, ignored, &kept);
+          dropped += face.size() - kept.size();
+          face.swap(kept);
+        }
+        for (int j=0;j<face.size();j++) {
+          facet& f = face[j];
+          if (f.color < 0 || f.color >= invalid_colors.size() || invalid_colors[f.color]) f.color = default_color;
+          if (f.normal < 0 || f.normal >= invalid_normals.size() || invalid_normals[f.normal]) f.normal = default_normal;
+        }
+      }
+      if (dropped == 0) return;
+      lock_guard<mutex> lock(report_lock);
+      report.facets_removed += dropped;
+    });
+
+    // normals are added to the table as they're calculated, so the faces needing them are done in turn (there are few)
+    for (int i=0;i<face_total;i++) {
+      if (!(problems[i] & FACE_BAD_NORMAL) || (problems[i] & FACE_DEGENERATE) || _facet_data[i].size() < 3) continue;
+      _calculate_normals(i);
+      report.normals_recalculated++;
+      vector<facet>& face = _facet_data[i];
+      for (int j=0;j<face.size();j++) {
+        if (!usable_normal(_normals[face[j].normal])) face[j].normal = _normals.insert(DEFAULT_NORMAL); // (flat or too small)
+      }
+    }
+  }
+
+  // duplicates: the faces still standing are hashed, then each partition (a share of the hashes) keeps the first face with each
+  //   hash and compares the later ones against it; a face only matches a face before it, so the earliest copy survives
+  vector<unsigned long long> hashes(face_total, 0);
+  parallel_for(0, face_total, FACE_CHUNK, [&](long long int begin, long long int end) {
+    for (long long int i=begin;i<end;i++) {
+      if (problems[i] & FACE_DEGENERATE) continue;
+      if (!repair && (problems[i] & (FACE_BAD_ID | FACE_REPEATED_ID))) continue; // (they'd differ once repaired)
+      if (_facet_data[i].size() < 3) continue;
+      hashes[i] = face_hash(_facet_data[i]);
+    }
+  });
+  int partitions = (face_total+FACE_CHUNK-1)/FACE_CHUNK;
+  if (partitions > hardware_threads()) partitions = hardware_threads();
+  parallel_for(0, partitions, 1, [&](long long int begin, long long int end) {
+    for (long long int p=begin;p<end;p++) {
+      // an open addressed table of the first face with each hash, at most half full
+      int count = 0;
+      for (int i=0;i<face_total;i++) count += (hashes[i] != 0 && hashes[i]%partitions == p);
+      int capacity = 16;
+      while (capacity < 2*count) capacity *= 2;
+      vector<int> firsts(capacity, -1);
+      int duplicates = 0;
+      for (int i=0;i<face_total;i++) {
+        if (hashes[i] == 0 || hashes[i]%partitions != p) continue;
+        bool duplicate = false;
+        int slot = (hashes[i] >> 32) & (capacity-1); // (the low bits chose the partition)
+        for (;firsts[slot] >= 0 && !duplicate;slot=(slot+1)&(capacity-1)) {
+          int first = firsts[slot];
+          duplicate = (hashes[first] == hashes[i] && same_face(_facet_data[first], _facet_data[i]));
+        }
+        if (!duplicate) firsts[slot] = i;
+        else if (i+1 < face_total) { // (the current face is kept, duplicate or not)
+          problems[i] |= FACE_DUPLICATE;
+          duplicates++;
+        }
+      }
+      lock_guard<mutex> lock(report_lock);
+      report.duplicate_faces += duplicates;
+    }
+  });
+
+  // drop the degenerate and duplicate faces, moving the rest down over them
+  if (repair) {
+    int faces = 0;
+    _vertex_count = 0;
+    for (int i=0;i<face_total;i++) {
+      if (problems[i] & (FACE_DEGENERATE | FACE_DUPLICATE)) {
+        report.facets_removed += _facet_data[i].size();
+        continue;
+      }
+      _vertex_count += _facet_data[i].size();
+      if (faces != i) _facet_data[faces] = move(_facet_data[i]);
+      faces++;
+    }
+    _facet_data.resize(faces);
+    report.faces_removed = face_total - faces;
+    report.repaired = true;
+    if (!report.clean()) _adjacency.clear(); // (the faces were renumbered or rewritten)
+  }
+
+  report.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  TRACE_ARG(validate_span, "faces", report.faces);
+  TRACE_ARG(validate_span, "faces_removed", report.faces_removed);
+  return report;
+}
+// *** END MODEL3D VALIDATION DEFINITIONS ***
@@ -0,0 +1,52 @@
+// File: validate.h
+// Written by Joshua Green
+
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <string>
+
+// ------------------------------------------------------------ MESH VALIDATION ------------------------------------------------------------- //
+//   + model3d::validate(repair=true)                                                                                                         //
+//       - scans a model's faces for facets referring past the coordinate, color or normal tables (or to a non-finite coordinate, a non-      //
+//         finite color or a zero length or non-finite normal), ids repeating the facet before them (the last facet wrapping around to the    //
+//         first), faces left with fewer than 3 facets and faces with the same ids, in the same winding, as an earlier face                   //
+//       - with repair: facets with a bad id or repeating the one before them are dropped, bad colors are pointed at DEFAULT_COLOR, the       //
+//         faces with bad normals have them recalculated (DEFAULT_NORMAL where the face is too small or flat for one), then the degenerate    //
+//         and duplicate faces are dropped                                                                                                    //
+//       - returns a mesh_report of what was found (and what repairing it removed)                                                            //
+//   + summary()                                                                                                                              //
+//       - the report as one line for the console, e.g. "30 repeated ids, 29 degenerate faces; dropped 88 facets and 29 faces"                //
+//   + NOTES:                                                                                                                                 //
+//       - model3d::load() always validates (and repairs) what it reads, as do read_session(), read_session_model() and                       //
+//         model_journal::recover(); from_binary() itself doesn't, as a journal's checkpoint is followed by records referring to its faces    //
+//         by index (recover() validates once they're replayed) and levels of detail are built from an already validated model                //
+//       - the coordinate, color and normal tables are checked in one pass each and the faces in one more, in chunks split across hardware    //
+//         threads; a clean model (the usual case) is only read, so the cost of validating is about that of reading the model once            //
+//       - duplicates are found by hashing each face's ids (independent of where the face starts), then matching the hashes in an open        //
+//         addressed table per partition, a partition per thread                                                                              //
+//       - the current (last) face is never dropped, since the editor adds to it; coordinates left unused by dropped facets are removed by    //
+//         defragment()                                                                                                                       //
+//       - compact and paged models are skipped (their facets aren't held as facets)                                                          //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+struct mesh_report {
+  int faces, facets;             // scanned
+  int invalid_coordinates;       // non-finite coordinates (facets using them count as invalid ids)
+  int invalid_ids;               // facets referring past the coordinates, or to an invalid one
+  int invalid_colors;            // facets referring past the color table, or to a non-finite color
+  int invalid_normals;           // facets referring past the normal table, or to a zero length or non-finite normal
+  int repeated_ids;              // facets repeating the id of the facet before them
+  int degenerate_faces;          // faces with fewer than 3 facets once the bad and repeated ones are left out (the current face aside)
+  int duplicate_faces;           // faces repeating an earlier face
+  bool repaired;
+  int facets_removed, faces_removed, normals_recalculated; // (normals_recalculated counts faces)
+  double ms;
+
+  mesh_report();
+
+  bool clean() const; // nothing was found
+  std::string summary() const;
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include "str/str.h"
 #include <string>
 #include <vector>
+#include <cmath>
+#include <cstdlib>
 using namespace std;
 
 int mod(int a, int b) { return a%b < 0 ? a%b+b : a%b; }
@@ -48,7 +50,7 @@ vect2f& vect2f::from_string(string data) {
   }
 
   data.erase(data.begin()); // remove '('
-  data.erase(data.end()--); // remove ')'
+  data.erase(data.end()-1); // remove ')'
   std::vector<std::string> coordinate_strings(explode(data, ", ", -1));
 
   if (coordinate_strings.size() < 2) clear();
@@ -115,7 +117,7 @@ vect3f& vect3f::from_string(std::string data) {
   }
 
   data.erase(data.begin()); // remove '('
-  data.erase(data.end()--); // remove ')'
+  data.erase(data.end()-1); // remove ')'
   std::vector<std::string> coordinate_strings(explode(data, ", ", -1));
 
   if (coordinate_strings.size() < 3) return (*this);
@@ -187,7 +189,7 @@ vect4f& vect4f::from_string(string data) {
     return (*this);
   }
   data.erase(data.begin()); // remove '('
-  data.erase(data.end()--); // remove ')'
+  data.erase(data.end()-1); // remove ')'
   vector<string> coordinate_strings(explode(data, ", ", -1));
 
   if (coordinate_strings.size() < 4) return (*this);
@@ -0,0 +1,100 @@
+// File: vertex_cache.cpp
+// Written by Joshua Green
+
+#include "vertex_cache.h"
+#include "model3d.h"
+#include "trace.h"
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+void cache_order(const vector<vector<facet>>& faces, int coordinate_count, vector<int>& order, int cache_size) {
+  TRACE_SPAN(order_span, "cache_order");
+  TRACE_ARG(order_span, "faces", faces.size());
+  order.clear();
+  order.reserve(faces.size());
+
+  // the faces at each coordinate, end to end (offsets[id] to offsets[id+1])
+  vector<int> offsets(coordinate_count+1, 0);
+  for (int i=0;i<faces.size();i++) {
+    for (int j=0;j<faces[i].size();j++) offsets[faces[i][j].id+1]++;
+  }
+  for (int i=0;i<coordinate_count;i++) offsets[i+1] += offsets[i];
+  vector<int> coordinate_faces(offsets.back()), fill(offsets.begin(), offsets.end()-1);
+  for (int i=0;i<faces.size();i++) {
+    for (int j=0;j<faces[i].size();j++) coordinate_faces[fill[faces[i][j].id]++] = i;
+  }
+
+  vector<int> live(coordinate_count); // faces not yet drawn at each coordinate
+  for (int i=0;i<coordinate_count;i++) live[i] = offsets[i+1] - offsets[i];
+  vector<int> cached(coordinate_count, 0); // the time each coordinate entered the cache: it's cached while time - cached <= cache_size
+  vector<char> drawn(faces.size(), 0);
+  vector<int> dead_ends, candidates;
+  int time = cache_size+1, cursor = 0;
+
+  int fan = 0;
+  while (fan < coordinate_count && live[fan] == 0) fan++;
+  while (fan < coordinate_count) {
+    candidates.clear();
+    for (int k=offsets[fan];k<offsets[fan+1];k++) {
+      int face = coordinate_faces[k];
+      if (drawn[face]) continue;
+      drawn[face] = 1;
+      order.push_back(face);
+      for (int j=0;j<faces[face].size();j++) {
+        int id = faces[face][j].id;
+        dead_ends.push_back(id);
+        candidates.push_back(id);
+        live[id]--;
+        if (time - cached[id] > cache_size) cached[id] = time++;
+      }
+    }
+
+    // the next fan: the candidate cached longest that its own faces (at most two new coordinates each) won't push out
+    int next = -1, best = -1;
+    for (int i=0;i<candidates.size();i++) {
+      int id = candidates[i];
+      if (live[id] == 0) continue;
+      int priority = (time - cached[id] + 2*live[id] <= cache_size ? time - cached[id] : 0);
+      if (priority > best) {
+        best = priority;
+        next = id;
+      }
+    }
+    while (next < 0 && !dead_ends.empty()) {
+      int id = dead_ends.back();
+      dead_ends.pop_back();
+      if (live[id] > 0) next = id;
+    }
+    if (next < 0) {
+      while (cursor < coordinate_count && live[cursor] == 0) cursor++;
+      next = cursor;
+    }
+    fan = next;
+  }
+
+  for (int i=0;i<faces.size();i++) {
+    if (!drawn[i]) order.push_back(i); // (empty)
+  }
+}
+
+float cache_miss_ratio(const vector<vector<facet>>& faces, const vector<int>& order, int cache_size) {
+  int coordinate_count = 0;
+  for (int i=0;i<faces.size();i++) {
+    for (int j=0;j<faces[i].size();j++) coordinate_count = max(coordinate_count, faces[i][j].id+1);
+  }
+
+  // a fifo: a coordinate is cached while fewer than cache_size coordinates have entered after it
+  vector<long long int> entered(coordinate_count, -(long long int)cache_size-1);
+  long long int misses = 0, triangles = 0;
+  for (int i=0;i<order.size();i++) {
+    const vector<facet>& face = faces[order[i]];
+    for (int j=0;j<face.size();j++) {
+      int id = face[j].id;
+      if (misses - entered[id] > cache_size) entered[id] = misses++;
+    }
+    if (face.size() > 2) triangles += face.size()-2;
+  }
+  return (triangles > 0 ? (float)misses/triangles : 0.0f);
+}
@@ -0,0 +1,32 @@
+// File: vertex_cache.h
+// Written by Joshua Green
+
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include <vector>
+
+struct facet;
+
+const int DEFAULT_VERTEX_CACHE = 16; // entries in the post transform cache orders are tuned for
+
+// -------------------------------------------------------------- VERTEX CACHE -------------------------------------------------------------- //
+//   + cache_order(faces, coordinate_count, order, cache_size=DEFAULT_VERTEX_CACHE)                                                           //
+//       - fills order with every face index, once, in an order that reuses a post transform vertex cache of cache_size entries (tipsify,     //
+//         sander et al.): the faces are drawn as fans around one coordinate at a time, each fan moving on to the coordinate of the faces     //
+//         just drawn that's been cached longest but will still be cached once its own faces are drawn (or, at a dead end, to the most        //
+//         recently drawn coordinate with faces left, then to the next unfinished coordinate by id)                                           //
+//       - linear in the number of facets                                                                                                     //
+//   + cache_miss_ratio(faces, order, cache_size=DEFAULT_VERTEX_CACHE)                                                                        //
+//       - the average cache miss ratio (acmr) of drawing the faces in order through a fifo cache of cache_size entries: the coordinates      //
+//         transformed per triangle (a face of n facets being n-2 triangles); 3.0 is no reuse at all, and a closed triangle mesh can't go     //
+//         much below 0.5                                                                                                                     //
+//   + NOTES:                                                                                                                                 //
+//       - faces are polygons: every facet of a face is looked up in the cache as the face is drawn                                           //
+//       - empty faces are listed last by cache_order(); they (and points and lines) count no triangles                                       //
+// ------------------------------------------------------------------------------------------------------------------------------------------ //
+
+void cache_order(const std::vector<std::vector<facet>>& faces, int coordinate_count, std::vector<int>& order, int cache_size=DEFAULT_VERTEX_CACHE);
+float cache_miss_ratio(const std::vector<std::vector<facet>>& faces, const std::vector<int>& order, int cache_size=DEFAULT_VERTEX_CACHE);
+
+#endif